@@ -34,6 +34,10 @@ AlphaMap *  alpha_map_fread_bin (FILE *file);
 
 int         alpha_map_fwrite_bin (const AlphaMap *alpha_map, FILE *file);
 
+AlphaMap *  alpha_map_new_mapped (const void *mem, size_t size, size_t *o_len);
+
+int         alpha_map_fwrite_mapped (const AlphaMap *alpha_map, FILE *file);
+
 TrieChar    alpha_map_char_to_trie (const AlphaMap *alpha_map,
                                     AlphaChar       ac);
 
@@ -46,6 +50,11 @@ TrieChar *  alpha_map_char_to_trie_str (const AlphaMap  *alpha_map,
 AlphaChar * alpha_map_trie_to_char_str (const AlphaMap  *alpha_map,
                                         const TrieChar  *str);
 
+int         alpha_map_utf8_to_trie_str (const AlphaMap  *alpha_map,
+                                        const char      *utf8,
+                                        int              len,
+                                        TrieChar        *out);
+
 
 #endif /* __ALPHA_MAP_PRIVATE_H */
 
@@ -29,6 +29,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
 
 #include "alpha-map.h"
 #include "alpha-map-private.h"
@@ -64,12 +67,27 @@ typedef struct _AlphaRange {
 
 struct _AlphaMap {
     AlphaRange     *first_range;
+
+    /* lookup tables, NULL if the ranges are too large for them */
+    uint16         *char_to_trie_index; /* page of each block of 256 chars */
+    TrieChar       *char_to_trie_pages; /* 256 codes per page, 0 is empty */
+    AlphaChar       char_to_trie_limit; /* chars from here on are unmapped */
+    AlphaChar      *trie_to_char;       /* char for each trie code */
 };
 
 /*-----------------------------------*
  *    PRIVATE METHODS DECLARATIONS   *
  *-----------------------------------*/
 static int  alpha_map_get_total_ranges (const AlphaMap *alpha_map);
+static void alpha_map_free_tables (AlphaMap *alpha_map);
+static void alpha_map_build_tables (AlphaMap *alpha_map);
+static TrieChar  alpha_map_char_to_trie_walk (const AlphaMap *alpha_map,
+                                              AlphaChar       ac);
+static AlphaChar alpha_map_trie_to_char_walk (const AlphaMap *alpha_map,
+                                              TrieChar        tc);
+static Bool      alpha_map_is_ascii_run (const unsigned char *p);
+static Bool      alpha_map_is_unmapped  (const AlphaMap *alpha_map,
+                                         TrieChar        tc);
 
 /*-----------------------------*
  *    METHODS IMPLEMENTAIONS   *
@@ -77,6 +95,9 @@ static int  alpha_map_get_total_ranges (const AlphaMap *alpha_map);
 
 #define ALPHAMAP_SIGNATURE  0xD9FCD9FC
 
+/* lookup tables cover characters below this */
+#define ALPHAMAP_TABLE_LIMIT    0x110000
+
 /* AlphaMap Header:
  * - INT32: signature
  * - INT32: total ranges
@@ -107,6 +128,11 @@ alpha_map_new ()
 
     alpha_map->first_range = NULL;
 
+    alpha_map->char_to_trie_index = NULL;
+    alpha_map->char_to_trie_pages = NULL;
+    alpha_map->char_to_trie_limit = 0;
+    alpha_map->trie_to_char      = NULL;
+
     return alpha_map;
 }
 
@@ -158,9 +184,111 @@ alpha_map_free (AlphaMap *alpha_map)
         p = q;
     }
 
+    alpha_map_free_tables (alpha_map);
     free (alpha_map);
 }
 
+static void
+alpha_map_free_tables (AlphaMap *alpha_map)
+{
+    free (alpha_map->char_to_trie_index);
+    free (alpha_map->char_to_trie_pages);
+    free (alpha_map->trie_to_char);
+
+    alpha_map->char_to_trie_index = NULL;
+    alpha_map->char_to_trie_pages = NULL;
+    alpha_map->char_to_trie_limit = 0;
+    alpha_map->trie_to_char      = NULL;
+}
+
+/* Build direct tables for translating between alphabet characters and
+ * trie codes. The alphabet-to-trie table is two-level: the index gives a
+ * 256-code page for each block of 256 characters, with page 0 shared by
+ * all blocks having no characters in the map. Maps with more characters
+ * than trie codes, or with characters beyond Unicode, keep walking the
+ * ranges instead.
+ */
+static void
+alpha_map_build_tables (AlphaMap *alpha_map)
+{
+    AlphaRange *range;
+    AlphaChar   ac, max_char;
+    int         n_chars, n_blocks, n_pages, page, i;
+    TrieChar    tc;
+
+    alpha_map_free_tables (alpha_map);
+
+    n_chars = 0;
+    max_char = 0;
+    for (range = alpha_map->first_range; range; range = range->next) {
+        if (range->end - range->begin >= TRIE_CHAR_MAX)
+            return;
+        n_chars += range->end - range->begin + 1;
+        max_char = range->end;
+    }
+    if (n_chars > TRIE_CHAR_MAX || max_char >= ALPHAMAP_TABLE_LIMIT)
+        return;
+
+    n_blocks = (max_char >> 8) + 1;
+    alpha_map->char_to_trie_index = (uint16 *) calloc (n_blocks,
+                                                       sizeof (uint16));
+    if (!alpha_map->char_to_trie_index)
+        goto exit_tables_created;
+
+    /* block 0 always gets a page, to map char 0 */
+    n_pages = 1;
+    alpha_map->char_to_trie_index[0] = n_pages++;
+    for (range = alpha_map->first_range; range; range = range->next) {
+        for (ac = range->begin; ac <= range->end; ac++) {
+            if (0 == alpha_map->char_to_trie_index[ac >> 8])
+                alpha_map->char_to_trie_index[ac >> 8] = n_pages++;
+        }
+    }
+
+    alpha_map->char_to_trie_pages = (TrieChar *) malloc (n_pages * 256);
+    alpha_map->trie_to_char = (AlphaChar *) malloc ((TRIE_CHAR_MAX + 1)
+                                                    * sizeof (AlphaChar));
+    if (!alpha_map->char_to_trie_pages || !alpha_map->trie_to_char)
+        goto exit_tables_created;
+
+    memset (alpha_map->char_to_trie_pages, TRIE_CHAR_MAX, n_pages * 256);
+    for (i = 0; i <= TRIE_CHAR_MAX; i++)
+        alpha_map->trie_to_char[i] = ALPHA_CHAR_ERROR;
+
+    tc = 1;
+    for (range = alpha_map->first_range; range; range = range->next) {
+        for (ac = range->begin; ac <= range->end; ac++, tc++) {
+            page = alpha_map->char_to_trie_index[ac >> 8];
+            alpha_map->char_to_trie_pages[page * 256 + (ac & 0xff)] = tc;
+            alpha_map->trie_to_char[tc] = ac;
+        }
+    }
+    /* char 0 is the terminator, even if it is in a range */
+    page = alpha_map->char_to_trie_index[0];
+    alpha_map->char_to_trie_pages[page * 256] = 0;
+    alpha_map->trie_to_char[0] = 0;
+
+    alpha_map->char_to_trie_limit = (AlphaChar) n_blocks << 8;
+
+#ifndef NDEBUG
+    for (range = alpha_map->first_range; range; range = range->next) {
+        for (ac = range->begin; ac <= range->end; ac++) {
+            assert (alpha_map_char_to_trie (alpha_map, ac)
+                    == alpha_map_char_to_trie_walk (alpha_map, ac));
+        }
+    }
+    for (tc = 0; tc < TRIE_CHAR_MAX; tc++) {
+        assert (alpha_map_trie_to_char (alpha_map, tc)
+                == alpha_map_trie_to_char_walk (alpha_map, tc));
+    }
+#endif
+
+    return;
+
+exit_tables_created:
+    alpha_map_free_tables (alpha_map);
+}
+
 AlphaMap *
 alpha_map_fread_bin (FILE *file)
 {
@@ -234,6 +362,66 @@ alpha_map_fwrite_bin (const AlphaMap *alpha_map, FILE *file)
     return 0;
 }
 
+/**
+ * @brief Read alphabet map from mapped memory
+ *
+ * @param mem   : the memory block, in the layout by alpha_map_fwrite_mapped()
+ * @param size  : size of @a mem in bytes
+ * @param o_len : storage for the number of bytes occupied by the map data
+ *
+ * @return a newly created alphabet map, NULL on failure
+ *
+ * The ranges are copied out, so @a mem is not referenced after return.
+ */
+AlphaMap *
+alpha_map_new_mapped (const void *mem, size_t size, size_t *o_len)
+{
+    const unsigned char *p = (const unsigned char *) mem;
+    AlphaMap   *alpha_map;
+    int32       total, i;
+
+    if (size < 8 || ALPHAMAP_SIGNATURE != (uint32) mem_read_int32_le (p))
+        return NULL;
+
+    total = mem_read_int32_le (p + 4);
+    if (total < 0 || (size - 8) / 8 < (size_t) total)
+        return NULL;
+
+    if (NULL == (alpha_map = alpha_map_new ()))
+        return NULL;
+
+    for (i = 0, p += 8; i < total; i++, p += 8) {
+        alpha_map_add_range (alpha_map, mem_read_int32_le (p),
+                             mem_read_int32_le (p + 4));
+    }
+
+    *o_len = 8 + 8 * (size_t) total;
+    return alpha_map;
+}
+
+/* Mapped AlphaMap layout: as in the binary file, but little-endian */
+int
+alpha_map_fwrite_mapped (const AlphaMap *alpha_map, FILE *file)
+{
+    AlphaRange *range;
+
+    if (!file_write_int32_le (file, ALPHAMAP_SIGNATURE) ||
+        !file_write_int32_le (file, alpha_map_get_total_ranges (alpha_map)))
+    {
+        return -1;
+    }
+
+    for (range = alpha_map->first_range; range; range = range->next) {
+        if (!file_write_int32_le (file, range->begin) ||
+            !file_write_int32_le (file, range->end))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 /**
  * @brief Add a range to alphabet map
  *
@@ -331,11 +519,38 @@ alpha_map_add_range (AlphaMap *alpha_map, AlphaChar begin, AlphaChar end)
         range->next = r;
     }
 
+    alpha_map_build_tables (alpha_map);
+
     return 0;
 }
 
 TrieChar
 alpha_map_char_to_trie (const AlphaMap *alpha_map, AlphaChar ac)
+{
+    if (alpha_map->char_to_trie_index) {
+        int page;
+
+        if (ac >= alpha_map->char_to_trie_limit)
+            return TRIE_CHAR_MAX;
+        page = alpha_map->char_to_trie_index[ac >> 8];
+        return alpha_map->char_to_trie_pages[page * 256 + (ac & 0xff)];
+    }
+
+    return alpha_map_char_to_trie_walk (alpha_map, ac);
+}
+
+AlphaChar
+alpha_map_trie_to_char (const AlphaMap *alpha_map, TrieChar tc)
+{
+    if (alpha_map->trie_to_char)
+        return alpha_map->trie_to_char[tc];
+
+    return alpha_map_trie_to_char_walk (alpha_map, tc);
+}
+
+/* translations by walking the ranges, for maps without tables */
+static TrieChar
+alpha_map_char_to_trie_walk (const AlphaMap *alpha_map, AlphaChar ac)
 {
     TrieChar    alpha_begin;
     AlphaRange *range;
@@ -354,8 +569,8 @@ alpha_map_char_to_trie (const AlphaMap *alpha_map, AlphaChar ac)
     return TRIE_CHAR_MAX;
 }
 
-AlphaChar
-alpha_map_trie_to_char (const AlphaMap *alpha_map, TrieChar tc)
+static AlphaChar
+alpha_map_trie_to_char_walk (const AlphaMap *alpha_map, TrieChar tc)
 {
     TrieChar    alpha_begin;
     AlphaRange *range;
@@ -388,6 +603,128 @@ alpha_map_char_to_trie_str (const AlphaMap *alpha_map, const AlphaChar *str)
     return trie_str;
 }
 
+/* number of bytes of the runs of ASCII characters mapped at once */
+#define ALPHA_MAP_ASCII_RUN 16
+
+/* Decode the first 'len' bytes of 'utf8', up to a NUL byte, and map each
+ * character to its trie code into 'out', which must have room for 'len' + 1
+ * codes, in one pass. Returns the number of codes, not counting the
+ * terminator, or -1 if 'utf8' is not valid UTF-8 or has a character out of
+ * the alphabet.
+ */
+int
+alpha_map_utf8_to_trie_str (const AlphaMap *alpha_map,
+                            const char     *utf8,
+                            int             len,
+                            TrieChar       *out)
+{
+    const unsigned char *p = (const unsigned char *) utf8;
+    const unsigned char *end = p + len;
+    const TrieChar      *ascii;
+    TrieChar            *q = out;
+    AlphaChar            ac;
+    int                  n_cont, i;
+
+    /* trie codes of chars 0-255, when the map has tables */
+    ascii = alpha_map->char_to_trie_index
+            ? alpha_map->char_to_trie_pages
+              + alpha_map->char_to_trie_index[0] * 256
+            : NULL;
+
+    while (p < end && *p) {
+        if (ascii && end - p >= ALPHA_MAP_ASCII_RUN
+            && alpha_map_is_ascii_run (p))
+        {
+            Bool    is_unmapped = FALSE;
+
+            for (i = 0; i < ALPHA_MAP_ASCII_RUN; i++) {
+                q[i] = ascii[p[i]];
+                is_unmapped |= (TRIE_CHAR_MAX == q[i]);
+            }
+            if (is_unmapped) {
+                for (i = 0; i < ALPHA_MAP_ASCII_RUN; i++) {
+                    if (alpha_map_is_unmapped (alpha_map, q[i]))
+                        return -1;
+                }
+            }
+            p += ALPHA_MAP_ASCII_RUN;
+            q += ALPHA_MAP_ASCII_RUN;
+            continue;
+        }
+
+        if (*p < 0x80) {
+            ac = *p++;
+        } else {
+            if (*p >= 0xc2 && *p <= 0xdf) {
+                ac = *p & 0x1f;
+                n_cont = 1;
+            } else if (*p >= 0xe0 && *p <= 0xef) {
+                ac = *p & 0x0f;
+                n_cont = 2;
+            } else if (*p >= 0xf0 && *p <= 0xf4) {
+                ac = *p & 0x07;
+                n_cont = 3;
+            } else {
+                return -1;
+            }
+            if (end - p <= n_cont)
+                return -1;
+            for (i = 1; i <= n_cont; i++) {
+                if ((p[i] & 0xc0) != 0x80)
+                    return -1;
+                ac = (ac << 6) | (p[i] & 0x3f);
+            }
+            /* overlong forms, surrogates and chars beyond U+10FFFF */
+            if ((2 == n_cont && ac < 0x800)
+                || (3 == n_cont && ac < 0x10000)
+                || (ac >= 0xd800 && ac <= 0xdfff) || ac > 0x10ffff)
+            {
+                return -1;
+            }
+            p += n_cont + 1;
+        }
+
+        *q = ascii && ac < 0x80 ? ascii[ac]
+                                : alpha_map_char_to_trie (alpha_map, ac);
+        if (alpha_map_is_unmapped (alpha_map, *q))
+            return -1;
+        ++q;
+    }
+    *q = 0;
+
+    return q - out;
+}
+
+/* whether the ALPHA_MAP_ASCII_RUN bytes at p are all ASCII but NUL */
+static Bool
+alpha_map_is_ascii_run (const unsigned char *p)
+{
+#if defined(__SSE2__)
+    __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+
+    /* non-ASCII bytes have the sign bit set, and so have NUL marks */
+    v = _mm_or_si128 (v, _mm_cmpeq_epi8 (v, _mm_setzero_si128 ()));
+    return 0 == _mm_movemask_epi8 (v);
+#else
+    const uint64    lo = 0x0101010101010101ULL;
+    const uint64    hi = 0x8080808080808080ULL;
+    uint64          w[2];
+
+    /* a byte has its top bit set if non-ASCII, or borrows if NUL */
+    memcpy (w, p, sizeof w);
+    return 0 == (((w[0] | ((w[0] - lo) & ~w[0]))
+                  | (w[1] | ((w[1] - lo) & ~w[1]))) & hi);
+#endif
+}
+
+/* whether tc is the code of unmapped chars rather than of a real one */
+static Bool
+alpha_map_is_unmapped (const AlphaMap *alpha_map, TrieChar tc)
+{
+    return TRIE_CHAR_MAX == tc
+           && ALPHA_CHAR_ERROR == alpha_map_trie_to_char (alpha_map, tc);
+}
+
 AlphaChar *
 alpha_map_trie_to_char_str (const AlphaMap *alpha_map, const TrieChar *str)
 {
@@ -26,7 +26,6 @@
 
 #include <string.h>
 #include <stdlib.h>
-#include <stdint.h>
 #include <stdio.h>
 
 #include "trie-private.h"
@@ -44,10 +43,9 @@ struct _Symbols {
     TrieChar    symbols[256];
 };
 
-static Symbols *    symbols_new ();
-static void         symbols_free (Symbols *syms);
 static void         symbols_add (Symbols *syms, TrieChar c);
 
+#define symbols_init(s)         ((s)->num_symbols = 0)
 #define symbols_num(s)          ((s)->num_symbols)
 #define symbols_get(s,i)        ((s)->symbols[i])
 #define symbols_add_fast(s,c)   ((s)->symbols[(s)->num_symbols++] = c)
@@ -64,18 +62,29 @@ static Bool         da_check_free_cell (DArray         *d,
 static Bool         da_has_children    (DArray         *d,
                                         TrieIndex       s);
 
-static Symbols *    da_output_symbols  (const DArray   *d,
-                                        TrieIndex       s);
-
-static TrieChar *   da_get_state_key   (const DArray   *d,
-                                        TrieIndex       state);
+static void         da_output_symbols  (const DArray   *d,
+                                        TrieIndex       s,
+                                        Symbols        *syms);
 
 static TrieIndex    da_find_free_base  (DArray         *d,
                                         const Symbols  *symbols);
 
-static Bool         da_fit_symbols     (DArray         *d,
+static TrieIndex    da_find_free_base_from (DArray         *d,
+                                            const TrieChar *syms,
+                                            int             n_syms,
+                                            TrieIndex       from);
+
+static TrieIndex    da_find_base_in_line (DArray         *d,
+                                          TrieIndex       s,
+                                          const TrieChar *syms,
+                                          int             n_syms,
+                                          TrieChar        hot);
+
+static void         da_set_children    (DArray         *d,
+                                        TrieIndex       s,
                                         TrieIndex       base,
-                                        const Symbols  *symbols);
+                                        const TrieChar *labels,
+                                        int             n_labels);
 
 static void         da_relocate_base   (DArray         *d,
                                         TrieIndex       s,
@@ -84,43 +93,78 @@ static void         da_relocate_base   (DArray         *d,
 static Bool         da_extend_pool     (DArray         *d,
                                         TrieIndex       to_index);
 
+static Bool         da_retire          (DArray         *d,
+                                        void           *mem);
+
 static void         da_alloc_cell      (DArray         *d,
                                         TrieIndex       cell);
 
 static void         da_free_cell       (DArray         *d,
                                         TrieIndex       cell);
 
-static Bool         da_enumerate_recursive (const DArray   *d,
-                                            TrieIndex       state,
-                                            DAEnumFunc      enum_func,
-                                            void           *user_data);
+static uint64 *     da_build_free_map  (const DArray   *d);
 
-/* ==================== BEGIN IMPLEMENTATION PART ====================  */
+static void         da_build_links     (const DArray   *d,
+                                        uint8          *child,
+                                        uint8          *sibling);
 
-/*------------------------------------*
- *   INTERNAL TYPES IMPLEMENTATIONS   *
- *------------------------------------*/
+static void         da_link_child      (DArray         *d,
+                                        TrieIndex       s,
+                                        TrieChar        c);
 
-static Symbols *
-symbols_new ()
-{
-    Symbols *syms;
+static void         da_unlink_child    (DArray         *d,
+                                        TrieIndex       s,
+                                        TrieChar        c);
 
-    syms = (Symbols *) malloc (sizeof (Symbols));
+static uint64       da_free_map_get64  (const DArray   *d,
+                                        TrieIndex       pos);
 
-    if (!syms)
-        return NULL;
+static TrieIndex    da_free_map_next   (const DArray   *d,
+                                        TrieIndex       pos);
 
-    syms->num_symbols = 0;
+typedef struct _DAWideCell DAWideCell;
 
-    return syms;
-}
+static Bool         da_resize_wide_cells (DArray       *d,
+                                          TrieIndex     new_alloc);
 
-static void
-symbols_free (Symbols *syms)
-{
-    free (syms);
-}
+static const DAWideCell * da_load_wide_cells (const DArray *d);
+
+typedef struct _DAEnumData DAEnumData;
+
+typedef struct _DALayoutQueue DALayoutQueue;
+typedef struct _DALayoutEntry DALayoutEntry;
+
+static Bool         da_layout_before   (const DALayoutQueue *q,
+                                        const DALayoutEntry *a,
+                                        const DALayoutEntry *b);
+
+static Bool         da_layout_push     (DALayoutQueue  *q,
+                                        int64           weight,
+                                        TrieIndex       old_s,
+                                        TrieIndex       new_s);
+
+static Bool         da_layout_pop      (DALayoutQueue  *q,
+                                        TrieIndex      *old_s,
+                                        TrieIndex      *new_s);
+
+static TrieIndex    da_merged_state    (const DArray   *sub,
+                                        TrieIndex       s,
+                                        TrieIndex       sub_root_base,
+                                        TrieIndex       root_base,
+                                        TrieIndex       offset);
+
+static void         da_drop_failure    (DArray         *d);
+
+static Bool         da_enum_push       (DAEnumData     *enum_data,
+                                        int             depth,
+                                        TrieIndex       state,
+                                        TrieChar        c);
+
+/* ==================== BEGIN IMPLEMENTATION PART ====================  */
+
+/*------------------------------------*
+ *   INTERNAL TYPES IMPLEMENTATIONS   *
+ *------------------------------------*/
 
 static void
 symbols_add (Symbols *syms, TrieChar c)
@@ -153,13 +197,68 @@ symbols_add (Symbols *syms, TrieChar c)
  *------------------------------*/
 
 typedef struct {
+    int32       base;
+    int32       check;
+} DACell;
+
+/* cells of double-arrays grown beyond DA_NARROW_MAX */
+struct _DAWideCell {
     TrieIndex   base;
     TrieIndex   check;
-} DACell;
+};
+
+/* Aho-Corasick links of a state, see da_build_failure() */
+typedef struct {
+    int32       fail;       /* state of the longest proper suffix, 0 at root */
+    int32       output;     /* the state itself if a key ends there, else the
+                               nearest such state along fail links, or 0 */
+    int32       depth;      /* length of the path from root */
+} DAFailure;
 
 struct _DArray {
     TrieIndex   num_cells;
-    DACell     *cells;
+    TrieIndex   alloc_cells;/* allocated cells, grown geometrically */
+    DACell     *cells;      /* NULL once widened */
+    DAWideCell *wide_cells; /* NULL until widened */
+
+    uint64     *free_map;   /* bit set for each free cell, NULL if mapped */
+
+    /* child index, NULL if not available: first child label of each node,
+     * and next sibling label of each node in ascending order, 0 for last
+     */
+    uint8      *child;
+    uint8      *sibling;
+
+    Bool        is_mapped;  /* cells reference memory not owned by us */
+    Bool        is_links_mapped; /* child index likewise */
+
+    DAFailure  *failure;    /* failure links per cell, NULL if not built */
+    Bool        is_failure_mapped;
+
+    /* in concurrent mode, replaced cell arrays are kept for lock-free
+     * readers until da_free_retired() is called
+     */
+    Bool        is_concurrent;
+    void      **retired;
+    int         num_retired;
+};
+
+/* states waiting for their children to be placed by da_new_relayout(),
+ * as a binary heap of the heaviest, then the first or the last pushed
+ */
+struct _DALayoutEntry {
+    int64       weight;
+    TrieIndex   seq;
+    TrieIndex   old_s;
+    TrieIndex   new_s;
+};
+
+struct _DALayoutQueue {
+    DALayoutEntry  *entries;
+    TrieIndex       num_entries;
+    TrieIndex       size;
+    TrieIndex       seq;
+    Bool            is_lifo;
 };
 
 /*-----------------------------*
@@ -168,6 +267,23 @@ struct _DArray {
 
 #define DA_SIGNATURE 0xDAFCDAFC
 
+/* Cells are int32 pairs as long as the pool has at most DA_NARROW_MAX
+ * cells, as BASE and CHECK then only hold cell indices, their negations
+ * and tail block numbers, which cannot outnumber the cells. Beyond it,
+ * da_extend_pool() widens the cells to DAWideCell for good, and the
+ * double-array is saved with DA_WIDE_SIGNATURE, in int64 cells.
+ */
+#define DA_WIDE_SIGNATURE 0xDAFBDAFB
+#ifndef DA_NARROW_MAX
+# define DA_NARROW_MAX  0x7fffffff
+#endif
+
+#define da_is_wide(d)           (NULL == (d)->cells)
+#define da_cell_base(d,s)       ((d)->cells ? (TrieIndex) (d)->cells[s].base \
+                                            : (d)->wide_cells[s].base)
+#define da_cell_check(d,s)      ((d)->cells ? (TrieIndex) (d)->cells[s].check \
+                                            : (d)->wide_cells[s].check)
+
 /* DA Header:
  * - Cell 0: SIGNATURE, number of cells
  * - Cell 1: free circular-list pointers
@@ -176,6 +292,53 @@ struct _DArray {
  */
 #define DA_POOL_BEGIN 3
 
+/* max distance behind the last allocated cells for da_insert_children()
+ * to keep searching from in subsequent calls
+ */
+#define DA_SCAN_SPAN 8192
+
+/* Child index: a node has children iff CHECK[BASE + child] is the node.
+ * Sibling chains are in ascending label order, so label 0 (terminator)
+ * can only be a first child, and sibling 0 can mark the chain end.
+ */
+#define da_first_child(d,s)     ((d)->child[s])
+#define da_next_sibling(d,s)    ((d)->sibling[s])
+
+/* how far behind a state da_new_relayout() looks for free cells for its
+ * children, to fill holes close to it
+ */
+#define DA_RELAYOUT_BACK 64
+
+/* cells per 64-byte cache line */
+#define DA_LINE_CELLS   (64 / sizeof (DACell))
+
+#define DA_LINKS_SIGNATURE 0xDAFDDAFD
+#define DA_FAILURE_SIGNATURE 0xDAFEDAFE
+
+/* free cell bitmap operations; cells 0 to DA_POOL_BEGIN - 1 are never free */
+#define DA_MAP_WORDS(n)         (((size_t) (n) + 63) / 64)
+#define da_free_map_set(d,i)    ((d)->free_map[(i) / 64] |= \
+                                 (uint64) 1 << ((i) % 64))
+#define da_free_map_clear(d,i)  ((d)->free_map[(i) / 64] &= \
+                                 ~((uint64) 1 << ((i) % 64)))
+
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+# define DA_CTZ64(x)    __builtin_ctzll (x)
+#else
+static int
+da_ctz64 (uint64 x)
+{
+    int n = 0;
+
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+}
+# define DA_CTZ64(x)    da_ctz64 (x)
+#endif
+
 /**
  * @brief Create a new double-array object
  *
@@ -190,10 +353,27 @@ da_new ()
     if (!d)
         return NULL;
 
-    d->num_cells = DA_POOL_BEGIN;
-    d->cells     = (DACell *) malloc (d->num_cells * sizeof (DACell));
+    d->num_cells   = DA_POOL_BEGIN;
+    d->alloc_cells = DA_POOL_BEGIN;
+    d->is_mapped   = FALSE;
+    d->is_concurrent = FALSE;
+    d->retired     = NULL;
+    d->num_retired = 0;
+    d->wide_cells  = NULL;
+    d->cells       = (DACell *) malloc (d->alloc_cells * sizeof (DACell));
     if (!d->cells)
         goto exit_da_created;
+    d->free_map    = (uint64 *) calloc (DA_MAP_WORDS (d->alloc_cells),
+                                        sizeof (uint64));
+    if (!d->free_map)
+        goto exit_cells_created;
+    d->failure     = NULL;
+    d->is_failure_mapped = FALSE;
+    d->is_links_mapped = FALSE;
+    d->child       = (uint8 *) calloc (d->alloc_cells, 1);
+    d->sibling     = (uint8 *) calloc (d->alloc_cells, 1);
+    if (!d->child || !d->sibling)
+        goto exit_links_created;
     d->cells[0].base = DA_SIGNATURE;
     d->cells[0].check = d->num_cells;
     d->cells[1].base = -1;
@@ -203,6 +383,12 @@ da_new ()
 
     return d;
 
+exit_links_created:
+    free (d->child);
+    free (d->sibling);
+    free (d->free_map);
+exit_cells_created:
+    free (d->cells);
 exit_da_created:
     free (d);
     return NULL;
@@ -224,38 +410,89 @@ da_fread (FILE *file)
 {
     long        save_pos;
     DArray     *d = NULL;
-    TrieIndex   n;
+    int32       sig, n;
 
     /* check signature */
     save_pos = ftell (file);
-    if (!file_read_int32 (file, &n) || DA_SIGNATURE != (uint32) n)
+    if (!file_read_int32 (file, &sig) ||
+        (DA_SIGNATURE != (uint32) sig && DA_WIDE_SIGNATURE != (uint32) sig))
+    {
         goto exit_file_read;
+    }
 
     if (NULL == (d = (DArray *) malloc (sizeof (DArray))))
         goto exit_file_read;
 
     /* read number of cells */
-    if (!file_read_int32 (file, &d->num_cells))
-        goto exit_da_created;
-    if (d->num_cells > SIZE_MAX / sizeof (DACell))
-        goto exit_da_created;
-    d->cells = (DACell *) malloc (d->num_cells * sizeof (DACell));
-    if (!d->cells)
+    d->is_mapped = FALSE;
+    d->is_concurrent = FALSE;
+    d->retired = NULL;
+    d->num_retired = 0;
+    d->failure = NULL;
+    d->is_failure_mapped = FALSE;
+    d->cells = NULL;
+    d->wide_cells = NULL;
+    if (DA_SIGNATURE == (uint32) sig) {
+        if (!file_read_int32 (file, &n))
+            goto exit_da_created;
+        d->num_cells = n;
+    } else {
+        /* wide header: reserved INT32, then INT64 number of cells */
+        if (!file_read_int32 (file, &n) ||
+            !file_read_int64 (file, &d->num_cells))
+        {
+            goto exit_da_created;
+        }
+    }
+    if (d->num_cells < DA_POOL_BEGIN ||
+        (uint64) d->num_cells > TRIE_SIZE_MAX / sizeof (DAWideCell))
         goto exit_da_created;
-    d->cells[0].base = DA_SIGNATURE;
-    d->cells[0].check= d->num_cells;
-    for (n = 1; n < d->num_cells; n++) {
-        if (!file_read_int32 (file, &d->cells[n].base) ||
-            !file_read_int32 (file, &d->cells[n].check))
+    d->alloc_cells = d->num_cells;
+    if (DA_SIGNATURE == (uint32) sig) {
+        d->cells = (DACell *) malloc (d->num_cells * sizeof (DACell));
+        if (!d->cells)
+            goto exit_da_created;
+        d->cells[0].base = DA_SIGNATURE;
+        d->cells[0].check= d->num_cells;
+        /* DACell is a pair of int32's, so the cells can be read as an array */
+        if (!file_read_int32_array (file, (int32 *) (d->cells + 1),
+                                    (size_t) (d->num_cells - 1) * 2))
+        {
+            goto exit_da_cells_created;
+        }
+    } else {
+        d->wide_cells = (DAWideCell *) malloc (d->num_cells
+                                               * sizeof (DAWideCell));
+        if (!d->wide_cells)
+            goto exit_da_created;
+        d->wide_cells[0].base = DA_WIDE_SIGNATURE;
+        d->wide_cells[0].check = d->num_cells;
+        if (!file_read_int64_array (file, (int64 *) (d->wide_cells + 1),
+                                    (size_t) (d->num_cells - 1) * 2))
         {
             goto exit_da_cells_created;
         }
     }
+    if (NULL == (d->free_map = da_build_free_map (d)))
+        goto exit_da_cells_created;
+
+    /* child index is not stored in stream, build it */
+    d->is_links_mapped = FALSE;
+    d->child   = (uint8 *) malloc (d->alloc_cells);
+    d->sibling = (uint8 *) malloc (d->alloc_cells);
+    if (!d->child || !d->sibling)
+        goto exit_da_links_created;
+    da_build_links (d, d->child, d->sibling);
 
     return d;
 
+exit_da_links_created:
+    free (d->child);
+    free (d->sibling);
+    free (d->free_map);
 exit_da_cells_created:
     free (d->cells);
+    free (d->wide_cells);
 exit_da_created:
     free (d);
 exit_file_read:
@@ -273,7 +510,17 @@ exit_file_read:
 void
 da_free (DArray *d)
 {
-    free (d->cells);
+    da_free_retired (d);
+    if (!d->is_mapped) {
+        free (d->cells);
+        free (d->wide_cells);
+    }
+    if (!d->is_links_mapped) {
+        free (d->child);
+        free (d->sibling);
+    }
+    da_drop_failure (d);
+    free (d->free_map);
     free (d);
 }
 
@@ -291,12 +538,157 @@ da_free (DArray *d)
  */
 int
 da_fwrite (const DArray *d, FILE *file)
+{
+    if (da_is_wide (d)) {
+        if (!file_write_int32 (file, DA_WIDE_SIGNATURE) ||
+            !file_write_int32 (file, 0) ||
+            !file_write_int64 (file, d->num_cells) ||
+            !file_write_int64_array (file, (const int64 *) (d->wide_cells + 1),
+                                     (size_t) (d->num_cells - 1) * 2))
+        {
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!file_write_int32_array (file, (const int32 *) d->cells,
+                                 (size_t) d->num_cells * 2))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Map double-array data from memory
+ *
+ * @param mem   : the memory block, in the layout by da_fwrite_mapped()
+ * @param size  : size of @a mem in bytes
+ * @param o_len : storage for the number of bytes occupied by the cells
+ *
+ * @return a read-only double-array object, NULL on failure
+ *
+ * Create a double-array object over the cells stored in @a mem. On
+ * little-endian hosts, the cells are used in place, so @a mem must outlive
+ * the returned object and must not be modified through it. On other hosts,
+ * the cells are decoded into an allocated array.
+ */
+DArray *
+da_new_mapped (const void *mem, size_t size, size_t *o_len)
+{
+    const unsigned char *p = (const unsigned char *) mem;
+    DArray     *d;
+    TrieIndex   num_cells, i;
+    size_t      cell_size;
+
+    if (size < sizeof (DACell))
+        return NULL;
+    if (DA_SIGNATURE == (uint32) mem_read_int32_le (p)) {
+        cell_size = sizeof (DACell);
+        num_cells = mem_read_int32_le (p + 4);
+    } else if (DA_WIDE_SIGNATURE == (uint32) mem_read_int32_le (p)
+               && size >= sizeof (DAWideCell))
+    {
+        cell_size = sizeof (DAWideCell);
+        num_cells = mem_read_int64_le (p + 8);
+    } else {
+        return NULL;
+    }
+    if (num_cells < DA_POOL_BEGIN || (uint64) (size / cell_size) < num_cells)
+        return NULL;
+
+    if (NULL == (d = (DArray *) malloc (sizeof (DArray))))
+        return NULL;
+
+    d->num_cells   = num_cells;
+    d->alloc_cells = num_cells;
+    d->free_map    = NULL;
+    d->is_concurrent = FALSE;
+    d->retired     = NULL;
+    d->num_retired = 0;
+    d->child       = NULL;
+    d->sibling     = NULL;
+    d->is_links_mapped = TRUE;
+    d->failure     = NULL;
+    d->is_failure_mapped = FALSE;
+    d->cells       = NULL;
+    d->wide_cells  = NULL;
+    if (host_is_little_endian ()) {
+        if (sizeof (DACell) == cell_size)
+            d->cells = (DACell *) mem;
+        else
+            d->wide_cells = (DAWideCell *) mem;
+        d->is_mapped = TRUE;
+    } else if (sizeof (DACell) == cell_size) {
+        d->cells = (DACell *) malloc (num_cells * sizeof (DACell));
+        if (!d->cells) {
+            free (d);
+            return NULL;
+        }
+        for (i = 0; i < num_cells; i++, p += sizeof (DACell)) {
+            d->cells[i].base  = mem_read_int32_le (p);
+            d->cells[i].check = mem_read_int32_le (p + 4);
+        }
+        d->is_mapped = FALSE;
+    } else {
+        d->wide_cells = (DAWideCell *) malloc (num_cells * sizeof (DAWideCell));
+        if (!d->wide_cells) {
+            free (d);
+            return NULL;
+        }
+        for (i = 0; i < num_cells; i++, p += sizeof (DAWideCell)) {
+            d->wide_cells[i].base  = mem_read_int64_le (p);
+            d->wide_cells[i].check = mem_read_int64_le (p + 8);
+        }
+        d->is_mapped = FALSE;
+    }
+
+    *o_len = num_cells * cell_size;
+    return d;
+}
+
+/**
+ * @brief Write double-array data in mappable layout
+ *
+ * @param d     : the double-array data
+ * @param file  : the file to write to
+ *
+ * @return 0 on success, non-zero on failure
+ *
+ * Write the cells of @a d as an array of little-endian (BASE, CHECK) pairs,
+ * for mapping back with da_new_mapped(). As with da_fwrite(), cell 0 holds
+ * the signature and the number of cells. Wide cells are written as int64
+ * pairs, cell 0 then holding the signature in its low 32 bits.
+ */
+int
+da_fwrite_mapped (const DArray *d, FILE *file)
 {
     TrieIndex   i;
 
+    if (da_is_wide (d)) {
+        if (host_is_little_endian ()) {
+            return (fwrite (d->wide_cells, sizeof (DAWideCell), d->num_cells,
+                            file) == (size_t) d->num_cells) ? 0 : -1;
+        }
+        for (i = 0; i < d->num_cells; i++) {
+            if (!file_write_int64_le (file, d->wide_cells[i].base) ||
+                !file_write_int64_le (file, d->wide_cells[i].check))
+            {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    if (host_is_little_endian ()) {
+        return (fwrite (d->cells, sizeof (DACell), d->num_cells, file)
+                == (size_t) d->num_cells) ? 0 : -1;
+    }
+
     for (i = 0; i < d->num_cells; i++) {
-        if (!file_write_int32 (file, d->cells[i].base) ||
-            !file_write_int32 (file, d->cells[i].check))
+        if (!file_write_int32_le (file, d->cells[i].base) ||
+            !file_write_int32_le (file, d->cells[i].check))
         {
             return -1;
         }
@@ -305,116 +697,1117 @@ da_fwrite (const DArray *d, FILE *file)
     return 0;
 }
 
+/**
+ * @brief Use child index from a memory block
+ *
+ * @param d     : the double-array data, as created by da_new_mapped()
+ * @param mem   : the memory block, as written by da_fwrite_mapped_links()
+ * @param size  : the size of the memory block
+ * @param o_len : storage for the number of bytes occupied by the index
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Make @a d enumerate children through the child index in @a mem rather
+ * than by probing all possible labels. The memory block must stay valid
+ * until @a d is freed.
+ */
+Bool
+da_map_links (DArray *d, const void *mem, size_t size, size_t *o_len)
+{
+    const unsigned char *p = (const unsigned char *) mem;
+
+    if (size < 8 || DA_LINKS_SIGNATURE != (uint32) mem_read_int32_le (p)
+        || MIN_VAL (d->num_cells, 0x7fffffff) != mem_read_int32_le (p + 4)
+        || (uint64) ((size - 8) / 2) < (uint64) d->num_cells)
+    {
+        return FALSE;
+    }
+
+    d->child   = (uint8 *) (p + 8);
+    d->sibling = (uint8 *) (p + 8 + d->num_cells);
+    d->is_links_mapped = TRUE;
+
+    *o_len = 8 + 2 * (size_t) d->num_cells;
+    return TRUE;
+}
 
 /**
- * @brief Get root state
+ * @brief Write child index in mappable layout
  *
  * @param d     : the double-array data
+ * @param file  : the file to write to
  *
- * @return root state of the @a index set, or TRIE_INDEX_ERROR on failure
+ * @return 0 on success, non-zero on failure
  *
- * Get root state for stepwise walking.
+ * Write the child index of @a d for mapping back with da_map_links(),
+ * building it first if @a d has none.
  */
-TrieIndex
-da_get_root (const DArray *d)
+int
+da_fwrite_mapped_links (const DArray *d, FILE *file)
 {
-    /* can be calculated value for multi-index trie */
-    return 2;
+    uint8  *child, *sibling;
+    int     res = -1;
+
+    /* the number of cells only guards against mismatched sections, so
+     * it is saturated for wide double-arrays rather than widened
+     */
+    if (!file_write_int32_le (file, DA_LINKS_SIGNATURE) ||
+        !file_write_int32_le (file, MIN_VAL (d->num_cells, 0x7fffffff)))
+    {
+        return -1;
+    }
+
+    if (d->child) {
+        child   = d->child;
+        sibling = d->sibling;
+    } else {
+        child   = (uint8 *) malloc (d->num_cells);
+        sibling = (uint8 *) malloc (d->num_cells);
+        if (!child || !sibling)
+            goto exit_links_created;
+        da_build_links (d, child, sibling);
+    }
+
+    if (fwrite (child, 1, d->num_cells, file) == (size_t) d->num_cells
+        && fwrite (sibling, 1, d->num_cells, file) == (size_t) d->num_cells)
+    {
+        res = 0;
+    }
+
+exit_links_created:
+    if (child != d->child) {
+        free (child);
+        free (sibling);
+    }
+    return res;
 }
 
+/**
+ * @brief Use failure links from a memory block
+ *
+ * @param d     : the double-array data, as created by da_new_mapped()
+ * @param mem   : the memory block, as written by da_fwrite_mapped_failure()
+ * @param size  : the size of the memory block
+ * @param o_len : storage for the number of bytes occupied by the links
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Give @a d the failure links stored in @a mem. On little-endian hosts,
+ * they are used in place, so the memory block must stay valid until @a d
+ * is freed.
+ */
+Bool
+da_map_failure (DArray *d, const void *mem, size_t size, size_t *o_len)
+{
+    const unsigned char *p = (const unsigned char *) mem;
+    TrieIndex   i;
+
+    if (size < 8 || DA_FAILURE_SIGNATURE != (uint32) mem_read_int32_le (p)
+        || d->num_cells != mem_read_int32_le (p + 4)
+        || (size - 8) / sizeof (DAFailure) < (size_t) d->num_cells)
+    {
+        return FALSE;
+    }
+
+    da_drop_failure (d);
+    p += 8;
+    if (host_is_little_endian ()) {
+        d->failure = (DAFailure *) p;
+        d->is_failure_mapped = TRUE;
+    } else {
+        d->failure = (DAFailure *) malloc (d->num_cells * sizeof (DAFailure));
+        if (!d->failure)
+            return FALSE;
+        for (i = 0; i < d->num_cells; i++, p += sizeof (DAFailure)) {
+            d->failure[i].fail   = mem_read_int32_le (p);
+            d->failure[i].output = mem_read_int32_le (p + 4);
+            d->failure[i].depth  = mem_read_int32_le (p + 8);
+        }
+        d->is_failure_mapped = FALSE;
+    }
+
+    *o_len = 8 + d->num_cells * sizeof (DAFailure);
+    return TRUE;
+}
 
 /**
- * @brief Get BASE cell
+ * @brief Write failure links in mappable layout
+ *
+ * @param d     : the double-array data, with failure links
+ * @param file  : the file to write to
+ *
+ * @return 0 on success, non-zero on failure
+ *
+ * Write the failure links of @a d, as built by da_build_failure(), for
+ * mapping back with da_map_failure().
+ */
+int
+da_fwrite_mapped_failure (const DArray *d, FILE *file)
+{
+    TrieIndex   i;
+
+    if (!d->failure ||
+        !file_write_int32_le (file, DA_FAILURE_SIGNATURE) ||
+        !file_write_int32_le (file, d->num_cells))
+    {
+        return -1;
+    }
+
+    if (host_is_little_endian ()) {
+        return (fwrite (d->failure, sizeof (DAFailure), d->num_cells, file)
+                == (size_t) d->num_cells) ? 0 : -1;
+    }
+
+    for (i = 0; i < d->num_cells; i++) {
+        if (!file_write_int32_le (file, d->failure[i].fail) ||
+            !file_write_int32_le (file, d->failure[i].output) ||
+            !file_write_int32_le (file, d->failure[i].depth))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Get memory used by double-array data
  *
  * @param d : the double-array data
- * @param s : the double-array state to get data
  *
- * @return the BASE cell value for the given state
+ * @return the number of bytes taken by the cells and their indices
+ */
+size_t
+da_get_mem_size (const DArray *d)
+{
+    size_t  size;
+
+    size = d->num_cells * (da_is_wide (d) ? sizeof (DAWideCell)
+                                          : sizeof (DACell));
+    if (d->child)
+        size += 2 * (size_t) d->num_cells;
+    if (d->free_map)
+        size += DA_MAP_WORDS (d->num_cells) * sizeof (uint64);
+    if (d->failure)
+        size += d->num_cells * sizeof (DAFailure);
+
+    return size;
+}
+
+/**
+ * @brief Set double-array concurrent mode
  *
- * Get BASE cell value for the given state.
+ * @param d             : the double-array data
+ * @param is_concurrent : whether readers may walk @a d while it is modified
+ *
+ * In concurrent mode, cell arrays replaced on growth are not freed but
+ * retired, as lock-free readers may still be walking them. The caller
+ * frees them with da_free_retired() when no reader can hold them anymore.
  */
-TrieIndex
-da_get_base (const DArray *d, TrieIndex s)
+void
+da_set_concurrent (DArray *d, Bool is_concurrent)
+{
+    d->is_concurrent = is_concurrent;
+}
+
+/**
+ * @brief Get number of retired memory blocks
+ *
+ * @param d : the double-array data
+ *
+ * @return the number of blocks retired in concurrent mode and not yet freed
+ */
+int
+da_get_num_retired (const DArray *d)
+{
+    return d->num_retired;
+}
+
+/**
+ * @brief Free retired memory blocks
+ *
+ * @param d : the double-array data
+ *
+ * Free the memory blocks retired in concurrent mode so far.
+ */
+void
+da_free_retired (DArray *d)
+{
+    int     i;
+
+    for (i = 0; i < d->num_retired; i++)
+        free (d->retired[i]);
+    free (d->retired);
+    d->retired = NULL;
+    d->num_retired = 0;
+}
+
+static Bool
+da_retire (DArray *d, void *mem)
+{
+    void  **new_retired;
+
+    new_retired = (void **) realloc (d->retired,
+                                     (d->num_retired + 1) * sizeof (void *));
+    if (!new_retired)
+        return FALSE;
+    d->retired = new_retired;
+    d->retired[d->num_retired++] = mem;
+
+    return TRUE;
+}
+
+/**
+ * @brief Get root state
+ *
+ * @param d     : the double-array data
+ *
+ * @return root state of the @a index set, or TRIE_INDEX_ERROR on failure
+ *
+ * Get root state for stepwise walking.
+ */
+TrieIndex
+da_get_root (const DArray *d)
+{
+    /* can be calculated value for multi-index trie */
+    return 2;
+}
+
+
+/**
+ * @brief Get BASE cell
+ *
+ * @param d : the double-array data
+ * @param s : the double-array state to get data
+ *
+ * @return the BASE cell value for the given state
+ *
+ * Get BASE cell value for the given state.
+ */
+TrieIndex
+da_get_base (const DArray *d, TrieIndex s)
+{
+    const DACell   *cells;
+
+    if ((uint64) s >= (uint64) TRIE_LOAD_ACQUIRE (&d->num_cells))
+        return TRIE_INDEX_ERROR;
+    cells = TRIE_LOAD_RELAXED (&d->cells);
+    return cells ? cells[s].base : da_load_wide_cells (d)[s].base;
+}
+
+/**
+ * @brief Get CHECK cell
+ *
+ * @param d : the double-array data
+ * @param s : the double-array state to get data
+ *
+ * @return the CHECK cell value for the given state
+ *
+ * Get CHECK cell value for the given state.
+ */
+TrieIndex
+da_get_check (const DArray *d, TrieIndex s)
+{
+    const DACell   *cells;
+
+    if ((uint64) s >= (uint64) TRIE_LOAD_ACQUIRE (&d->num_cells))
+        return TRIE_INDEX_ERROR;
+    cells = TRIE_LOAD_RELAXED (&d->cells);
+    return cells ? cells[s].check : da_load_wide_cells (d)[s].check;
+}
+
+
+/**
+ * @brief Set BASE cell
+ *
+ * @param d   : the double-array data
+ * @param s   : the double-array state to get data
+ * @param val : the value to set
+ *
+ * Set BASE cell for the given state to the given value.
+ */
+void
+da_set_base (DArray *d, TrieIndex s, TrieIndex val)
+{
+    if (s < d->num_cells) {
+        if (d->cells)
+            d->cells[s].base = (int32) val;
+        else
+            d->wide_cells[s].base = val;
+    }
+}
+
+/**
+ * @brief Set CHECK cell
+ *
+ * @param d   : the double-array data
+ * @param s   : the double-array state to get data
+ * @param val : the value to set
+ *
+ * Set CHECK cell for the given state to the given value.
+ */
+void
+da_set_check (DArray *d, TrieIndex s, TrieIndex val)
+{
+    if (s < d->num_cells) {
+        if (d->cells)
+            d->cells[s].check = (int32) val;
+        else
+            d->wide_cells[s].check = val;
+    }
+}
+
+/**
+ * @brief Walk in double-array structure
+ *
+ * @param d : the double-array structure
+ * @param s : current state
+ * @param c : the input character
+ *
+ * @return boolean indicating success
+ *
+ * Walk the double-array trie from state @a *s, using input character @a c.
+ * If there exists an edge from @a *s with arc labeled @a c, this function
+ * returns TRUE and @a *s is updated to the new state. Otherwise, it returns
+ * FALSE and @a *s is left unchanged.
+ */
+Bool
+da_walk (const DArray *d, TrieIndex *s, TrieChar c)
+{
+    TrieIndex   next;
+
+    next = da_get_base (d, *s) + c;
+    if (da_get_check (d, next) == *s) {
+        *s = next;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/**
+ * @brief Prefetch a double-array cell
+ *
+ * @param d : the double-array structure
+ * @param s : the state whose cell is to be read soon
+ *
+ * Hint the CPU to bring the BASE and CHECK cells of state @a s into cache,
+ * so that walks of several keys can be interleaved to overlap cache misses.
+ * Out-of-range states are ignored.
+ */
+void
+da_prefetch (const DArray *d, TrieIndex s)
+{
+    if (0 <= s && s < d->num_cells) {
+        if (d->cells)
+            TRIE_PREFETCH (&d->cells[s]);
+        else
+            TRIE_PREFETCH (&d->wide_cells[s]);
+    }
+}
+
+/**
+ * @brief Get the first child of a state
+ *
+ * @param d : the double-array structure
+ * @param s : the parent state
+ * @param c : the storage for the label of the child
+ *
+ * @return the child state with the smallest label, or TRIE_INDEX_ERROR if
+ *         @a s has no child
+ *
+ * Together with da_get_next_child(), this lists the children of @a s in
+ * ascending label order, without allocating.
+ */
+TrieIndex
+da_get_first_child (const DArray *d, TrieIndex s, TrieChar *c)
+{
+    TrieIndex   base;
+    TrieIndex   i, max_c;
+
+    base = da_get_base (d, s);
+    if (base <= 0)
+        return TRIE_INDEX_ERROR;
+
+    if (d->child) {
+        i = da_first_child (d, s);
+        if (da_get_check (d, base + i) != s)
+            return TRIE_INDEX_ERROR;
+        *c = (TrieChar) i;
+        return base + i;
+    }
+
+    max_c = MIN_VAL (TRIE_CHAR_MAX, TRIE_INDEX_MAX - base);
+    for (i = 0; i <= max_c; i++) {
+        if (da_get_check (d, base + i) == s) {
+            *c = (TrieChar) i;
+            return base + i;
+        }
+    }
+    return TRIE_INDEX_ERROR;
+}
+
+/**
+ * @brief Get the next child of a state
+ *
+ * @param d : the double-array structure
+ * @param s : the parent state
+ * @param c : the label of the current child, updated to that of the next
+ *
+ * @return the child state with the smallest label greater than @a *c, or
+ *         TRIE_INDEX_ERROR if there is none
+ */
+TrieIndex
+da_get_next_child (const DArray *d, TrieIndex s, TrieChar *c)
+{
+    TrieIndex   base;
+    TrieIndex   i, max_c;
+
+    base = da_get_base (d, s);
+    if (base <= 0)
+        return TRIE_INDEX_ERROR;
+
+    if (d->child) {
+        i = da_next_sibling (d, base + *c);
+        if (0 == i || da_get_check (d, base + i) != s)
+            return TRIE_INDEX_ERROR;
+        *c = (TrieChar) i;
+        return base + i;
+    }
+
+    max_c = MIN_VAL (TRIE_CHAR_MAX, TRIE_INDEX_MAX - base);
+    for (i = *c + 1; i <= max_c; i++) {
+        if (da_get_check (d, base + i) == s) {
+            *c = (TrieChar) i;
+            return base + i;
+        }
+    }
+    return TRIE_INDEX_ERROR;
+}
+
+/**
+ * @brief Get number of cells
+ *
+ * @param d : the double-array structure
+ *
+ * @return the number of cells, i.e. one more than the highest state
+ */
+TrieIndex
+da_get_num_cells (const DArray *d)
+{
+    return d->num_cells;
+}
+
+/**
+ * @brief Get number of free cells
+ *
+ * @param d : the double-array structure
+ *
+ * @return the number of cells in the pool not taken by any state
+ */
+TrieIndex
+da_get_num_free (const DArray *d)
+{
+    TrieIndex   i, n;
+
+    n = 0;
+    for (i = DA_POOL_BEGIN; i < d->num_cells; i++) {
+        if (da_get_check (d, i) < 0)
+            n++;
+    }
+
+    return n;
+}
+
+/**
+ * @brief Copy double-array
+ *
+ * @param d               : the double-array structure
+ * @param o_sep_nodes     : pointer to get the separate nodes, or NULL
+ * @param o_num_sep_nodes : pointer to get the number of separate nodes
+ *
+ * @return the new double-array, or NULL on failure
+ *
+ * Build a modifiable copy of @a d with every state kept in its cell, and
+ * without failure links. If @a o_sep_nodes is not NULL, it gets a newly
+ * allocated array of the separate nodes of the copy, in cell order, and
+ * @a o_num_sep_nodes their number, as for da_new_relayout(). The array is
+ * to be freed by the caller.
+ */
+DArray *
+da_new_copy (const DArray  *d,
+             TrieIndex    **o_sep_nodes,
+             TrieIndex     *o_num_sep_nodes)
+{
+    DArray     *nd;
+    TrieIndex  *sep_nodes;
+    TrieIndex   num_sep, s;
+
+    nd = (DArray *) malloc (sizeof (DArray));
+    if (!nd)
+        return NULL;
+
+    nd->num_cells   = d->num_cells;
+    nd->alloc_cells = d->num_cells;
+    nd->is_mapped   = FALSE;
+    nd->is_concurrent = FALSE;
+    nd->retired     = NULL;
+    nd->num_retired = 0;
+    nd->failure     = NULL;
+    nd->is_failure_mapped = FALSE;
+    nd->is_links_mapped = FALSE;
+    nd->cells       = NULL;
+    nd->wide_cells  = NULL;
+    nd->free_map    = NULL;
+    nd->child       = NULL;
+    nd->sibling     = NULL;
+
+    if (d->cells) {
+        nd->cells = (DACell *) malloc (nd->num_cells * sizeof (DACell));
+        if (!nd->cells)
+            goto exit_da_created;
+        memcpy (nd->cells, d->cells, nd->num_cells * sizeof (DACell));
+    } else {
+        nd->wide_cells = (DAWideCell *) malloc (nd->num_cells
+                                                * sizeof (DAWideCell));
+        if (!nd->wide_cells)
+            goto exit_da_created;
+        memcpy (nd->wide_cells, da_load_wide_cells (d),
+                nd->num_cells * sizeof (DAWideCell));
+    }
+    if (NULL == (nd->free_map = da_build_free_map (nd)))
+        goto exit_da_created;
+    nd->child   = (uint8 *) malloc (nd->alloc_cells);
+    nd->sibling = (uint8 *) malloc (nd->alloc_cells);
+    if (!nd->child || !nd->sibling)
+        goto exit_da_created;
+    da_build_links (nd, nd->child, nd->sibling);
+
+    if (o_sep_nodes) {
+        /* separate nodes are the used cells with negative BASE */
+        num_sep = 0;
+        for (s = DA_POOL_BEGIN; s < nd->num_cells; s++) {
+            if (da_get_check (nd, s) >= 0 && da_get_base (nd, s) < 0)
+                num_sep++;
+        }
+        sep_nodes = (TrieIndex *) malloc ((num_sep + 1) * sizeof (TrieIndex));
+        if (!sep_nodes)
+            goto exit_da_created;
+        num_sep = 0;
+        for (s = DA_POOL_BEGIN; s < nd->num_cells; s++) {
+            if (da_get_check (nd, s) >= 0 && da_get_base (nd, s) < 0)
+                sep_nodes[num_sep++] = s;
+        }
+        *o_sep_nodes = sep_nodes;
+        *o_num_sep_nodes = num_sep;
+    }
+
+    return nd;
+
+exit_da_created:
+    da_free (nd);
+    return NULL;
+}
+
+/**
+ * @brief Copy double-array with states renumbered for locality
+ *
+ * @param d              : the double-array structure
+ * @param weights        : walk count of each state of @a d, or NULL
+ * @param is_depth_first : whether to visit states depth-first
+ *
+ * @return the new double-array, or NULL on failure
+ *
+ * Build a copy of @a d, placing the children of each state as it is
+ * visited, breadth-first or depth-first. Children are placed right after
+ * the cells placed last, unless a hole close before their parent can take
+ * them, so depth-first order puts the states of a path in neighbouring
+ * cache lines and pages. States with higher @a weights are visited first,
+ * so that the frequently walked ones are packed at the pool beginning.
+ *
+ * Separate nodes keep their BASE, i.e. their tail block numbers. If
+ * @a o_sep_nodes is not NULL, it gets a newly allocated array of the
+ * separate nodes of the copy, in the order they are placed, and
+ * @a o_num_sep_nodes their number. The array is to be freed by the caller.
+ */
+DArray *
+da_new_relayout (const DArray  *d,
+                 const int64   *weights,
+                 Bool           is_depth_first,
+                 TrieIndex    **o_sep_nodes,
+                 TrieIndex     *o_num_sep_nodes)
+{
+    DArray         *nd;
+    DALayoutQueue   q;
+    TrieChar        labels[TRIE_CHAR_MAX + 1];
+    TrieIndex       old_s, new_s, base, new_base, t, from, hint;
+    TrieIndex      *sep_nodes;
+    TrieIndex       num_sep, sep_size;
+    TrieChar        c;
+    int             n, i, hot;
+
+    if (NULL == (nd = da_new ()))
+        return NULL;
+
+    sep_nodes = NULL;
+    num_sep = sep_size = 0;
+
+    q.entries = NULL;
+    q.num_entries = q.size = q.seq = 0;
+    q.is_lifo = is_depth_first;
+    if (!da_layout_push (&q, weights ? weights[da_get_root (d)] : 0,
+                         da_get_root (d), da_get_root (nd)))
+    {
+        goto exit_da_created;
+    }
+
+    hint = 0;
+    while (da_layout_pop (&q, &old_s, &new_s)) {
+        base = da_get_base (d, old_s);
+        if (base < 0) {
+            da_set_base (nd, new_s, base);
+            if (o_sep_nodes) {
+                if (num_sep == sep_size) {
+                    TrieIndex  *new_nodes;
+
+                    sep_size = sep_size ? sep_size * 2 : 256;
+                    new_nodes = (TrieIndex *) realloc (sep_nodes,
+                                                       sep_size
+                                                       * sizeof (TrieIndex));
+                    if (!new_nodes)
+                        goto exit_da_created;
+                    sep_nodes = new_nodes;
+                }
+                sep_nodes[num_sep++] = new_s;
+            }
+            continue;
+        }
+
+        n = 0;
+        for (t = da_get_first_child (d, old_s, &c); TRIE_INDEX_ERROR != t;
+             t = da_get_next_child (d, old_s, &c))
+        {
+            labels[n++] = c;
+        }
+        if (0 == n) {
+            if (new_s != da_get_root (nd))
+                da_set_base (nd, new_s, 0);
+            continue;
+        }
+
+        /* the most walked child, if known, can share the line of s */
+        hot = 0;
+        for (i = 1; weights && i < n; i++) {
+            if (weights[base + labels[i]] > weights[base + labels[hot]])
+                hot = i;
+        }
+        new_base = da_find_base_in_line (nd, new_s, labels, n, labels[hot]);
+        if (TRIE_INDEX_ERROR != new_base) {
+            da_set_children (nd, new_s, new_base, labels, n);
+        } else {
+            from = MAX_VAL (hint, new_s - DA_RELAYOUT_BACK);
+            new_base = da_insert_children (nd, new_s, labels, n, &from);
+            if (TRIE_INDEX_ERROR == new_base)
+                goto exit_da_created;
+            hint = MAX_VAL (hint, from);
+        }
+
+        /* in depth-first order, the last pushed comes first */
+        for (i = 0; i < n; i++) {
+            c = labels[is_depth_first ? n - 1 - i : i];
+            t = base + c;
+            if (!da_layout_push (&q, weights ? weights[t] : 0,
+                                 t, new_base + c))
+            {
+                goto exit_da_created;
+            }
+        }
+    }
+
+    free (q.entries);
+    if (o_sep_nodes) {
+        *o_sep_nodes = sep_nodes;
+        *o_num_sep_nodes = num_sep;
+    }
+    return nd;
+
+exit_da_created:
+    free (sep_nodes);
+    free (q.entries);
+    da_free (nd);
+    return NULL;
+}
+
+static Bool
+da_layout_before (const DALayoutQueue *q,
+                  const DALayoutEntry *a,
+                  const DALayoutEntry *b)
+{
+    if (a->weight != b->weight)
+        return a->weight > b->weight;
+    return q->is_lifo ? a->seq > b->seq : a->seq < b->seq;
+}
+
+static Bool
+da_layout_push (DALayoutQueue *q, int64 weight,
+                TrieIndex old_s, TrieIndex new_s)
+{
+    DALayoutEntry   e;
+    TrieIndex       i, parent;
+
+    if (q->num_entries == q->size) {
+        TrieIndex       new_size = q->size ? q->size * 2 : 256;
+        DALayoutEntry  *new_entries;
+
+        new_entries = (DALayoutEntry *)
+                      realloc (q->entries, new_size * sizeof (DALayoutEntry));
+        if (!new_entries)
+            return FALSE;
+        q->entries = new_entries;
+        q->size = new_size;
+    }
+
+    e.weight = weight;
+    e.seq = q->seq++;
+    e.old_s = old_s;
+    e.new_s = new_s;
+    for (i = q->num_entries++; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (!da_layout_before (q, &e, &q->entries[parent]))
+            break;
+        q->entries[i] = q->entries[parent];
+    }
+    q->entries[i] = e;
+
+    return TRUE;
+}
+
+static Bool
+da_layout_pop (DALayoutQueue *q, TrieIndex *old_s, TrieIndex *new_s)
+{
+    DALayoutEntry   last;
+    TrieIndex       i, child;
+
+    if (0 == q->num_entries)
+        return FALSE;
+
+    *old_s = q->entries[0].old_s;
+    *new_s = q->entries[0].new_s;
+
+    last = q->entries[--q->num_entries];
+    for (i = 0; (child = 2 * i + 1) < q->num_entries; i = child) {
+        if (child + 1 < q->num_entries
+            && da_layout_before (q, &q->entries[child + 1],
+                                 &q->entries[child]))
+        {
+            ++child;
+        }
+        if (!da_layout_before (q, &q->entries[child], &last))
+            break;
+        q->entries[i] = q->entries[child];
+    }
+    q->entries[i] = last;
+
+    return TRUE;
+}
+
+/**
+ * @brief Merge double-arrays under one root
+ *
+ * @param parts        : the double-arrays to merge
+ * @param tail_offsets : the number to add to the tail block numbers of
+ *                       each part
+ * @param n_parts      : the number of parts
+ *
+ * @return the new double-array, or NULL on failure
+ *
+ * Build a double-array whose root has the children of the roots of all
+ * @a parts, each with the states below it. The labels of the root children
+ * of different parts must be distinct. The root children are placed
+ * together; then the other cells of each part are copied after the cells
+ * placed so far, as a block, so that only their BASE and CHECK values are
+ * shifted. Separate nodes have their tail block numbers shifted by
+ * @a tail_offsets of their part.
+ */
+DArray *
+da_new_merged (const DArray *const  parts[],
+               const TrieIndex      tail_offsets[],
+               int                  n_parts)
+{
+    DArray     *nd;
+    Bool        is_used[TRIE_CHAR_MAX + 1];
+    TrieChar    labels[TRIE_CHAR_MAX + 1];
+    TrieIndex   root, root_base, sub_root_base, offset, hint;
+    TrieIndex   s, new_s, base, check;
+    TrieChar    c;
+    int         n, i;
+
+    if (NULL == (nd = da_new ()))
+        return NULL;
+    root = da_get_root (nd);
+
+    /* place the root children of all parts together */
+    memset (is_used, 0, sizeof is_used);
+    for (i = 0; i < n_parts; i++) {
+        for (s = da_get_first_child (parts[i], root, &c);
+             TRIE_INDEX_ERROR != s;
+             s = da_get_next_child (parts[i], root, &c))
+        {
+            if (is_used[c])
+                goto exit_da_created;
+            is_used[c] = TRUE;
+        }
+    }
+    n = 0;
+    for (i = 0; i <= TRIE_CHAR_MAX; i++) {
+        if (is_used[i])
+            labels[n++] = (TrieChar) i;
+    }
+    if (0 == n)
+        return nd;
+    hint = 0;
+    root_base = da_insert_children (nd, root, labels, n, &hint);
+    if (TRIE_INDEX_ERROR == root_base)
+        goto exit_da_created;
+
+    /* copy the other cells of each part as a block */
+    for (i = 0; i < n_parts; i++) {
+        const DArray   *sub = parts[i];
+
+        if (da_get_first_child (sub, root, &c) == TRIE_INDEX_ERROR)
+            continue;
+        sub_root_base = da_get_base (sub, root);
+        offset = da_get_num_cells (nd) - DA_POOL_BEGIN;
+        if (!da_extend_pool (nd, offset + da_get_num_cells (sub) - 1))
+            goto exit_da_created;
+
+        for (s = DA_POOL_BEGIN; s < da_get_num_cells (sub); s++) {
+            check = da_get_check (sub, s);
+            if (check <= 0)
+                continue;
+
+            new_s = da_merged_state (sub, s, sub_root_base, root_base,
+                                     offset);
+            if (root != check) {
+                da_alloc_cell (nd, new_s);
+                da_set_check (nd, new_s,
+                              da_merged_state (sub, check, sub_root_base,
+                                               root_base, offset));
+            }
+
+            base = da_get_base (sub, s);
+            if (base < 0)
+                base -= tail_offsets[i];
+            else if (base > 0)
+                base += offset;
+            da_set_base (nd, new_s, base);
+        }
+    }
+
+    if (nd->child)
+        da_build_links (nd, nd->child, nd->sibling);
+
+    return nd;
+
+exit_da_created:
+    da_free (nd);
+    return NULL;
+}
+
+/* state of a merged double-array from state s of its part sub */
+static TrieIndex
+da_merged_state (const DArray  *sub,
+                 TrieIndex      s,
+                 TrieIndex      sub_root_base,
+                 TrieIndex      root_base,
+                 TrieIndex      offset)
+{
+    if (da_get_root (sub) == s)
+        return s;
+    if (da_get_check (sub, s) == da_get_root (sub))
+        return root_base + (s - sub_root_base);
+    return s + offset;
+}
+
+/**
+ * @brief Build failure links for multi-pattern matching
+ *
+ * @param d : the double-array structure
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Compute the Aho-Corasick failure and output links of every state of
+ * @a d, so that da_failure_walk() can follow a text through all the keys
+ * at once. Keys are expected to be fully in the double-array, each ending
+ * with a terminator branch; separate nodes are taken as leaves. An empty
+ * key is not taken as an output. The links are dropped by any later change
+ * of the structure.
+ */
+Bool
+da_build_failure (DArray *d)
+{
+    DAFailure  *failure;
+    TrieIndex  *queue;
+    TrieIndex   root, s, t, f, base;
+    TrieChar    c;
+    int         head, tail;
+
+    /* the links are int32, as the cells of mappable failure sections */
+    if (da_is_wide (d))
+        return FALSE;
+
+    failure = (DAFailure *) calloc (d->num_cells, sizeof (DAFailure));
+    if (!failure)
+        return FALSE;
+    queue = (TrieIndex *) malloc (d->num_cells * sizeof (TrieIndex));
+    if (!queue) {
+        free (failure);
+        return FALSE;
+    }
+
+    /* breadth-first, so that links of shorter paths are known first */
+    root = da_get_root (d);
+    failure[root].output = 0;
+    head = tail = 0;
+    queue[tail++] = root;
+    while (head < tail) {
+        s = queue[head++];
+        for (t = da_get_first_child (d, s, &c);
+             TRIE_INDEX_ERROR != t;
+             t = da_get_next_child (d, s, &c))
+        {
+            if (TRIE_CHAR_TERM == c)
+                continue;
+
+            /* longest proper suffix of the path to t which is a path */
+            f = root;
+            if (s != root) {
+                for (f = failure[s].fail; ; f = failure[f].fail) {
+                    base = da_get_base (d, f);
+                    if (base > 0 && da_get_check (d, base + c) == f) {
+                        f = base + c;
+                        break;
+                    }
+                    if (f == root)
+                        break;
+                }
+            }
+
+            failure[t].fail = f;
+            failure[t].depth = failure[s].depth + 1;
+            failure[t].output = (da_get_base (d, t) > 0
+                                 && da_is_walkable (d, t, TRIE_CHAR_TERM))
+                                ? t : failure[f].output;
+            queue[tail++] = t;
+        }
+    }
+    free (queue);
+
+    da_drop_failure (d);
+    d->failure = failure;
+    return TRUE;
+}
+
+/**
+ * @brief Check for failure links
+ *
+ * @param d : the double-array structure
+ *
+ * @return TRUE if @a d has failure links, built or mapped
+ */
+Bool
+da_has_failure (const DArray *d)
+{
+    return NULL != d->failure;
+}
+
+static void
+da_drop_failure (DArray *d)
 {
-    return (s < d->num_cells) ? d->cells[s].base : TRIE_INDEX_ERROR;
+    if (!d->failure)
+        return;
+    if (!d->is_failure_mapped)
+        free (d->failure);
+    d->failure = NULL;
+    d->is_failure_mapped = FALSE;
 }
 
 /**
- * @brief Get CHECK cell
+ * @brief Walk along a text through failure links
  *
- * @param d : the double-array data
- * @param s : the double-array state to get data
+ * @param d : the double-array structure, with failure links
+ * @param s : current state
+ * @param c : the input character
  *
- * @return the CHECK cell value for the given state
+ * @return the state of the longest path from root which is a suffix of the
+ *         text up to @a c
  *
- * Get CHECK cell value for the given state.
+ * Follow @a c from @a s, falling back to shorter paths through failure
+ * links until it can be followed, or back to root.
  */
 TrieIndex
-da_get_check (const DArray *d, TrieIndex s)
+da_failure_walk (const DArray *d, TrieIndex s, TrieChar c)
 {
-    return (s < d->num_cells) ? d->cells[s].check : TRIE_INDEX_ERROR;
-}
+    const DACell   *cells = d->cells;
+    TrieIndex       root, base, next;
 
+    if (TRIE_CHAR_TERM == c)
+        return da_get_root (d);
+
+    root = da_get_root (d);
+    for (;;) {
+        base = cells[s].base;
+        next = base + c;
+        if (base > 0 && next < d->num_cells && cells[next].check == s)
+            return next;
+        if (s == root)
+            return root;
+        s = d->failure[s].fail;
+    }
+}
 
 /**
- * @brief Set BASE cell
+ * @brief Get the first state where a key ends along failure links
  *
- * @param d   : the double-array data
- * @param s   : the double-array state to get data
- * @param val : the value to set
+ * @param d : the double-array structure, with failure links
+ * @param s : the state
  *
- * Set BASE cell for the given state to the given value.
+ * @return @a s if a key ends there, or else the deepest state along its
+ *         failure links where a key ends, or 0 if none
  */
-void
-da_set_base (DArray *d, TrieIndex s, TrieIndex val)
+TrieIndex
+da_get_output (const DArray *d, TrieIndex s)
 {
-    if (s < d->num_cells) {
-        d->cells[s].base = val;
-    }
+    return d->failure[s].output;
 }
 
 /**
- * @brief Set CHECK cell
+ * @brief Get the next state where a key ends along failure links
  *
- * @param d   : the double-array data
- * @param s   : the double-array state to get data
- * @param val : the value to set
+ * @param d : the double-array structure, with failure links
+ * @param s : a state where a key ends
  *
- * Set CHECK cell for the given state to the given value.
+ * @return the deepest state along failure links from @a s where a key
+ *         ends, or 0 if none
  */
-void
-da_set_check (DArray *d, TrieIndex s, TrieIndex val)
+TrieIndex
+da_get_next_output (const DArray *d, TrieIndex s)
 {
-    if (s < d->num_cells) {
-        d->cells[s].check = val;
-    }
+    return d->failure[d->failure[s].fail].output;
 }
 
 /**
- * @brief Walk in double-array structure
- *
- * @param d : the double-array structure
- * @param s : current state
- * @param c : the input character
+ * @brief Get the depth of a state
  *
- * @return boolean indicating success
+ * @param d : the double-array structure, with failure links
+ * @param s : the state
  *
- * Walk the double-array trie from state @a *s, using input character @a c.
- * If there exists an edge from @a *s with arc labeled @a c, this function
- * returns TRUE and @a *s is updated to the new state. Otherwise, it returns
- * FALSE and @a *s is left unchanged.
+ * @return the length of the path from root to @a s
  */
-Bool
-da_walk (const DArray *d, TrieIndex *s, TrieChar c)
+int
+da_get_depth (const DArray *d, TrieIndex s)
 {
-    TrieIndex   next;
-
-    next = da_get_base (d, *s) + c;
-    if (da_get_check (d, next) == *s) {
-        *s = next;
-        return TRUE;
-    }
-    return FALSE;
+    return d->failure[s].depth;
 }
 
 /**
@@ -435,6 +1828,7 @@ da_insert_branch (DArray *d, TrieIndex s, TrieChar c)
 {
     TrieIndex   base, next;
 
+    da_drop_failure (d);
     base = da_get_base (d, s);
 
     if (base > 0) {
@@ -448,14 +1842,13 @@ da_insert_branch (DArray *d, TrieIndex s, TrieChar c)
          * or cell [next] is not free, relocate to a free slot
          */
         if (base > TRIE_INDEX_MAX - c || !da_check_free_cell (d, next)) {
-            Symbols    *symbols;
+            Symbols     symbols;
             TrieIndex   new_base;
 
             /* relocate BASE[s] */
-            symbols = da_output_symbols (d, s);
-            symbols_add (symbols, c);
-            new_base = da_find_free_base (d, symbols);
-            symbols_free (symbols);
+            da_output_symbols (d, s, &symbols);
+            symbols_add (&symbols, c);
+            new_base = da_find_free_base (d, &symbols);
 
             if (TRIE_INDEX_ERROR == new_base)
                 return TRIE_INDEX_ERROR;
@@ -464,13 +1857,12 @@ da_insert_branch (DArray *d, TrieIndex s, TrieChar c)
             next = new_base + c;
         }
     } else {
-        Symbols    *symbols;
+        Symbols     symbols;
         TrieIndex   new_base;
 
-        symbols = symbols_new ();
-        symbols_add (symbols, c);
-        new_base = da_find_free_base (d, symbols);
-        symbols_free (symbols);
+        symbols_init (&symbols);
+        symbols_add_fast (&symbols, c);
+        new_base = da_find_free_base (d, &symbols);
 
         if (TRIE_INDEX_ERROR == new_base)
             return TRIE_INDEX_ERROR;
@@ -480,10 +1872,81 @@ da_insert_branch (DArray *d, TrieIndex s, TrieChar c)
     }
     da_alloc_cell (d, next);
     da_set_check (d, next, s);
+    if (d->child)
+        da_link_child (d, s, c);
 
     return next;
 }
 
+/**
+ * @brief Insert all children of a trie node at once
+ *
+ * @param d        : the double-array structure
+ * @param s        : the state to add children to
+ * @param labels   : the labels of the children, in ascending order
+ * @param n_labels : the number of labels
+ * @param hint     : the free cell to start searching from, updated on return
+ *
+ * @return the new BASE of @a s, or TRIE_INDEX_ERROR on failure
+ *
+ * Allocate the cells for the complete set of outgoing arcs of @a s, which
+ * must not have any children yet, and make BASE[s] point to them. As the
+ * whole set is known in advance, no relocation is ever needed.
+ *
+ * The search for a fitting base starts from cell @a *hint, which the
+ * caller initializes to 0 and passes back unchanged in subsequent calls.
+ * The hint follows the allocated cells at a distance of DA_SCAN_SPAN, so
+ * that a series of insertions, as in building a trie level by level, does
+ * not rescan the whole packed part of the pool each time. Holes left behind
+ * stay in the free list for later insertions.
+ */
+TrieIndex
+da_insert_children (DArray         *d,
+                    TrieIndex       s,
+                    const TrieChar *labels,
+                    int             n_labels,
+                    TrieIndex      *hint)
+{
+    TrieIndex   base;
+
+    da_drop_failure (d);
+    base = da_find_free_base_from (d, labels, n_labels, *hint);
+    if (TRIE_INDEX_ERROR == base)
+        return TRIE_INDEX_ERROR;
+
+    if (base + labels[0] > *hint + DA_SCAN_SPAN)
+        *hint = base + labels[0] - DA_SCAN_SPAN;
+
+    da_set_children (d, s, base, labels, n_labels);
+
+    return base;
+}
+
+/* allocate the children of s at the given base, whose cells are free */
+static void
+da_set_children    (DArray         *d,
+                    TrieIndex       s,
+                    TrieIndex       base,
+                    const TrieChar *labels,
+                    int             n_labels)
+{
+    int         i;
+
+    da_set_base (d, s, base);
+    for (i = 0; i < n_labels; i++) {
+        da_alloc_cell (d, base + labels[i]);
+        da_set_check (d, base + labels[i], s);
+    }
+    if (d->child) {
+        da_first_child (d, s) = labels[0];
+        for (i = 0; i < n_labels; i++) {
+            da_first_child (d, base + labels[i]) = 0;
+            da_next_sibling (d, base + labels[i])
+                = (i + 1 < n_labels) ? labels[i + 1] : 0;
+        }
+    }
+}
+
 static Bool
 da_check_free_cell (DArray         *d,
                     TrieIndex       s)
@@ -502,8 +1965,11 @@ da_has_children    (DArray         *d,
     if (TRIE_INDEX_ERROR == base || base < 0)
         return FALSE;
 
+    if (d->child)
+        return da_get_check (d, base + da_first_child (d, s)) == s;
+
     max_c = MIN_VAL (TRIE_CHAR_MAX, TRIE_INDEX_MAX - base);
-    for (c = 0; c < max_c; c++) {
+    for (c = 0; c <= max_c; c++) {
         if (da_get_check (d, base + c) == s)
             return TRUE;
     }
@@ -511,119 +1977,117 @@ da_has_children    (DArray         *d,
     return FALSE;
 }
 
-static Symbols *
+static void
 da_output_symbols  (const DArray   *d,
-                    TrieIndex       s)
+                    TrieIndex       s,
+                    Symbols        *syms)
 {
-    Symbols    *syms;
     TrieIndex   base;
     TrieIndex   c, max_c;
 
-    syms = symbols_new ();
+    symbols_init (syms);
 
     base = da_get_base (d, s);
-    max_c = MIN_VAL (TRIE_CHAR_MAX, TRIE_INDEX_MAX - base);
-    for (c = 0; c < max_c; c++) {
-        if (da_get_check (d, base + c) == s)
-            symbols_add_fast (syms, (TrieChar) c);
-    }
-
-    return syms;
-}
-
-static TrieChar *
-da_get_state_key   (const DArray   *d,
-                    TrieIndex       state)
-{
-    TrieChar   *key;
-    int         key_size, key_length;
-    int         i;
-
-    key_size = 20;
-    key_length = 0;
-    key = (TrieChar *) malloc (key_size);
-
-    /* trace back to root */
-    while (da_get_root (d) != state) {
-        TrieIndex   parent;
-
-        if (key_length + 1 >= key_size) {
-            key_size += 20;
-            key = (TrieChar *) realloc (key, key_size);
+    if (d->child) {
+        c = da_first_child (d, s);
+        if (da_get_check (d, base + c) == s) {
+            do {
+                symbols_add_fast (syms, (TrieChar) c);
+                c = da_next_sibling (d, base + c);
+            } while (c != 0);
         }
-        parent = da_get_check (d, state);
-        key[key_length++] = (TrieChar) (state - da_get_base (d, parent));
-        state = parent;
+        return;
     }
-    key[key_length] = '\0';
-
-    /* reverse the string */
-    for (i = 0; i < --key_length; i++) {
-        TrieChar temp;
 
-        temp = key[i];
-        key[i] = key[key_length];
-        key[key_length] = temp;
+    max_c = MIN_VAL (TRIE_CHAR_MAX, TRIE_INDEX_MAX - base);
+    for (c = 0; c <= max_c; c++) {
+        if (da_get_check (d, base + c) == s)
+            symbols_add_fast (syms, (TrieChar) c);
     }
-
-    return key;
 }
 
 static TrieIndex
 da_find_free_base  (DArray         *d,
                     const Symbols  *symbols)
 {
-    TrieChar        first_sym;
-    TrieIndex       s;
+    return da_find_free_base_from (d, symbols->symbols,
+                                   symbols_num (symbols), 0);
+}
 
-    /* find first free cell that is beyond the first symbol */
-    first_sym = symbols_get (symbols, 0);
-    s = -da_get_check (d, da_get_free_list (d));
-    while (s != da_get_free_list (d)
-           && s < (TrieIndex) first_sym + DA_POOL_BEGIN)
-    {
-        s = -da_get_check (d, s);
-    }
-    if (s == da_get_free_list (d)) {
-        for (s = first_sym + DA_POOL_BEGIN; ; ++s) {
-            if (!da_extend_pool (d, s))
-                return TRIE_INDEX_ERROR;
-            if (da_get_check (d, s) < 0)
-                break;
-        }
-    }
+/* Find the lowest base, with its first symbol at cell @a from or beyond,
+ * such that all cells for @a syms are free, and extend the pool to cover
+ * them. Bit k of the AND of the free map windows at (base + sym) for all
+ * symbols tells whether (base + k) fits, so 64 bases are tested at once.
+ */
+static TrieIndex
+da_find_free_base_from (DArray         *d,
+                        const TrieChar *syms,
+                        int             n_syms,
+                        TrieIndex       from)
+{
+    TrieIndex   first_free, base, max_base;
+    uint64      fits;
+    int         i;
 
-    /* search for next free cell that fits the symbols set */
-    while (!da_fit_symbols (d, s - first_sym, symbols)) {
-        /* extend pool before getting exhausted */
-        if (-da_get_check (d, s) == da_get_free_list (d)) {
-            if (!da_extend_pool (d, d->num_cells))
+    /* cells before the first free cell are all occupied */
+    first_free = -da_get_check (d, da_get_free_list (d));
+    if (first_free == da_get_free_list (d))
+        first_free = d->num_cells;
+    from = MAX_VAL (from, first_free);
+
+    base = MAX_VAL (from - (TrieIndex) syms[0], DA_POOL_BEGIN);
+    max_base = TRIE_INDEX_MAX - syms[n_syms - 1];
+    for ( ; base <= max_base; base += 64) {
+        fits = ~(uint64) 0;
+        for (i = 0; fits && i < n_syms; i++)
+            fits &= da_free_map_get64 (d, base + syms[i]);
+        if (fits) {
+            base += DA_CTZ64 (fits);
+            if (base > max_base
+                || !da_extend_pool (d, base + syms[n_syms - 1]))
+            {
                 return TRIE_INDEX_ERROR;
+            }
+            return base;
         }
-
-        s = -da_get_check (d, s);
+        if (max_base - base < 64)
+            break;
     }
 
-    return s - first_sym;
+    return TRIE_INDEX_ERROR;
 }
 
-static Bool
-da_fit_symbols     (DArray         *d,
-                    TrieIndex       base,
-                    const Symbols  *symbols)
+/* Find a base putting the child labelled hot in the cache line of s,
+ * in a hole left among the siblings of s, so that walking from s to it
+ * touches no new line. Cells are assumed to be line-aligned, as they are
+ * when mapped.
+ */
+static TrieIndex
+da_find_base_in_line (DArray         *d,
+                      TrieIndex       s,
+                      const TrieChar *syms,
+                      int             n_syms,
+                      TrieChar        hot)
 {
+    TrieIndex   base;
+    uint64      fits;
     int         i;
 
-    for (i = 0; i < symbols_num (symbols); i++) {
-        TrieChar    sym = symbols_get (symbols, i);
+    base = s - s % DA_LINE_CELLS - hot;
+    if (base < DA_POOL_BEGIN)
+        return TRIE_INDEX_ERROR;
 
-        /* if (base + sym) > TRIE_INDEX_MAX which means it's overflow,
-         * or cell [base + sym] is not free, the symbol is not fit.
-         */
-        if (base > TRIE_INDEX_MAX - sym || !da_check_free_cell (d, base + sym))
-            return FALSE;
-    }
-    return TRUE;
+    fits = ((uint64) 1 << DA_LINE_CELLS) - 1;
+    for (i = 0; fits && i < n_syms; i++)
+        fits &= da_free_map_get64 (d, base + syms[i]);
+    if (!fits)
+        return TRIE_INDEX_ERROR;
+
+    base += DA_CTZ64 (fits);
+    if (!da_extend_pool (d, base + syms[n_syms - 1]))
+        return TRIE_INDEX_ERROR;
+
+    return base;
 }
 
 static void
@@ -632,17 +2096,17 @@ da_relocate_base   (DArray         *d,
                     TrieIndex       new_base)
 {
     TrieIndex   old_base;
-    Symbols    *symbols;
+    Symbols     symbols;
     int         i;
 
     old_base = da_get_base (d, s);
-    symbols = da_output_symbols (d, s);
+    da_output_symbols (d, s, &symbols);
 
-    for (i = 0; i < symbols_num (symbols); i++) {
+    for (i = 0; i < symbols_num (&symbols); i++) {
         TrieIndex   old_next, new_next, old_next_base;
 
-        old_next = old_base + symbols_get (symbols, i);
-        new_next = new_base + symbols_get (symbols, i);
+        old_next = old_base + symbols_get (&symbols, i);
+        new_next = new_base + symbols_get (&symbols, i);
         old_next_base = da_get_base (d, old_next);
 
         /* allocate new next node and copy BASE value */
@@ -655,11 +2119,26 @@ da_relocate_base   (DArray         *d,
          * must be given to new_next
          */
         /* preventing the case of TAIL pointer */
-        if (old_next_base > 0) {
+        if (d->child) {
+            TrieIndex   c;
+
+            /* labels are relative, so the links move as they are */
+            c = da_first_child (d, old_next);
+            da_first_child (d, new_next) = c;
+            da_next_sibling (d, new_next) = da_next_sibling (d, old_next);
+            if (old_next_base > 0
+                && da_get_check (d, old_next_base + c) == old_next)
+            {
+                do {
+                    da_set_check (d, old_next_base + c, new_next);
+                    c = da_next_sibling (d, old_next_base + c);
+                } while (c != 0);
+            }
+        } else if (old_next_base > 0) {
             TrieIndex   c, max_c;
 
             max_c = MIN_VAL (TRIE_CHAR_MAX, TRIE_INDEX_MAX - old_next_base);
-            for  (c = 0; c < max_c; c++) {
+            for  (c = 0; c <= max_c; c++) {
                 if (da_get_check (d, old_next_base + c) == old_next)
                     da_set_check (d, old_next_base + c, new_next);
             }
@@ -669,8 +2148,6 @@ da_relocate_base   (DArray         *d,
         da_free_cell (d, old_next);
     }
 
-    symbols_free (symbols);
-
     /* finally, make BASE[s] point to new_base */
     da_set_base (d, s, new_base);
 }
@@ -689,15 +2166,79 @@ da_extend_pool     (DArray         *d,
     if (to_index < d->num_cells)
         return TRUE;
 
-    d->cells = (DACell *) realloc (d->cells, (to_index + 1) * sizeof (DACell));
+    if (to_index >= d->alloc_cells) {
+        TrieIndex   new_alloc;
+        uint64     *new_map;
+        size_t      old_words, new_words;
+
+        /* grow geometrically to amortize reallocation */
+        new_alloc = (d->alloc_cells < TRIE_INDEX_MAX / 2)
+                    ? d->alloc_cells * 2 : TRIE_INDEX_MAX;
+        if (new_alloc <= to_index)
+            new_alloc = to_index + 1;
+        if ((uint64) new_alloc > TRIE_SIZE_MAX / sizeof (DAWideCell))
+            return FALSE;
+
+        if (da_is_wide (d) || new_alloc > DA_NARROW_MAX) {
+            if (!da_resize_wide_cells (d, new_alloc))
+                return FALSE;
+        } else if (d->is_concurrent) {
+            DACell *new_cells;
+
+            /* readers may still be walking the old cells */
+            new_cells = (DACell *) malloc (new_alloc * sizeof (DACell));
+            if (!new_cells || !da_retire (d, d->cells)) {
+                free (new_cells);
+                return FALSE;
+            }
+            memcpy (new_cells, d->cells, d->num_cells * sizeof (DACell));
+            TRIE_STORE_RELAXED (&d->cells, new_cells);
+        } else {
+            DACell *new_cells;
+
+            new_cells = (DACell *) realloc (d->cells,
+                                            new_alloc * sizeof (DACell));
+            if (!new_cells)
+                return FALSE;
+            d->cells = new_cells;
+        }
+
+        old_words = DA_MAP_WORDS (d->alloc_cells);
+        new_words = DA_MAP_WORDS (new_alloc);
+        new_map = (uint64 *) realloc (d->free_map,
+                                      new_words * sizeof (uint64));
+        if (!new_map)
+            return FALSE;
+        memset (new_map + old_words, 0,
+                (new_words - old_words) * sizeof (uint64));
+        d->free_map = new_map;
+
+        if (d->child) {
+            uint8  *new_child, *new_sibling;
+
+            new_child = (uint8 *) realloc (d->child, new_alloc);
+            if (!new_child)
+                return FALSE;
+            d->child = new_child;
+            new_sibling = (uint8 *) realloc (d->sibling, new_alloc);
+            if (!new_sibling)
+                return FALSE;
+            d->sibling = new_sibling;
+        }
+
+        d->alloc_cells = new_alloc;
+    }
+
     new_begin = d->num_cells;
-    d->num_cells = to_index + 1;
+    TRIE_STORE_RELEASE (&d->num_cells, to_index + 1);
 
     /* initialize new free list */
     for (i = new_begin; i < to_index; i++) {
         da_set_check (d, i, -(i + 1));
         da_set_base (d, i + 1, -i);
+        da_free_map_set (d, i);
     }
+    da_free_map_set (d, to_index);
 
     /* merge the new circular list to the old */
     free_tail = -da_get_base (d, da_get_free_list (d));
@@ -707,11 +2248,69 @@ da_extend_pool     (DArray         *d,
     da_set_base (d, da_get_free_list (d), -to_index);
 
     /* update header cell */
-    d->cells[0].check = d->num_cells;
+    da_set_check (d, 0, d->num_cells);
+
+    return TRUE;
+}
+
+/* Move to, or grow, wide cells. Readers test d->cells first, so the wide
+ * cells are published before d->cells is cleared, see da_load_wide_cells().
+ */
+static Bool
+da_resize_wide_cells (DArray *d, TrieIndex new_alloc)
+{
+    DAWideCell *new_cells;
+    TrieIndex   i;
+
+    if (da_is_wide (d) && !d->is_concurrent) {
+        new_cells = (DAWideCell *) realloc (d->wide_cells,
+                                            new_alloc * sizeof (DAWideCell));
+        if (!new_cells)
+            return FALSE;
+        d->wide_cells = new_cells;
+        return TRUE;
+    }
+
+    new_cells = (DAWideCell *) malloc (new_alloc * sizeof (DAWideCell));
+    if (!new_cells)
+        return FALSE;
+    if (da_is_wide (d)) {
+        memcpy (new_cells, d->wide_cells, d->num_cells * sizeof (DAWideCell));
+    } else {
+        for (i = 0; i < d->num_cells; i++) {
+            new_cells[i].base  = d->cells[i].base;
+            new_cells[i].check = d->cells[i].check;
+        }
+        new_cells[0].base = DA_WIDE_SIGNATURE;
+    }
+
+    if (d->is_concurrent) {
+        /* readers may still be walking the old cells */
+        if (!da_retire (d, da_is_wide (d) ? (void *) d->wide_cells
+                                          : (void *) d->cells))
+        {
+            free (new_cells);
+            return FALSE;
+        }
+    } else {
+        free (d->cells);
+    }
+    TRIE_STORE_RELAXED (&d->wide_cells, new_cells);
+    TRIE_STORE_RELEASE (&d->cells, (DACell *) NULL);
 
     return TRUE;
 }
 
+/* Wide cells for readers having found d->cells cleared. The acquire fence
+ * pairs with the release store clearing it in da_resize_wide_cells().
+ */
+static const DAWideCell *
+da_load_wide_cells (const DArray *d)
+{
+    TRIE_FENCE_ACQUIRE ();
+    return TRIE_LOAD_RELAXED (&d->wide_cells);
+}
+
 /**
  * @brief Prune the single branch
  *
@@ -742,10 +2341,13 @@ da_prune (DArray *d, TrieIndex s)
 void
 da_prune_upto (DArray *d, TrieIndex p, TrieIndex s)
 {
+    da_drop_failure (d);
     while (p != s && !da_has_children (d, s)) {
         TrieIndex   parent;
 
         parent = da_get_check (d, s);
+        if (d->child)
+            da_unlink_child (d, parent, s - da_get_base (d, parent));
         da_free_cell (d, s);
         s = parent;
     }
@@ -763,6 +2365,7 @@ da_alloc_cell      (DArray         *d,
     /* remove the cell from free list */
     da_set_check (d, prev, -next);
     da_set_base (d, next, -prev);
+    da_free_map_clear (d, cell);
 }
 
 static void
@@ -772,9 +2375,7 @@ da_free_cell       (DArray         *d,
     TrieIndex   i, prev;
 
     /* find insertion point */
-    i = -da_get_check (d, da_get_free_list (d));
-    while (i != da_get_free_list (d) && i < cell)
-        i = -da_get_check (d, i);
+    i = da_free_map_next (d, cell + 1);
 
     prev = -da_get_base (d, i);
 
@@ -783,8 +2384,169 @@ da_free_cell       (DArray         *d,
     da_set_base (d, cell, -prev);
     da_set_check (d, prev, -cell);
     da_set_base (d, i, -cell);
+    da_free_map_set (d, cell);
+}
+
+static uint64 *
+da_build_free_map  (const DArray   *d)
+{
+    uint64     *map;
+    TrieIndex   i;
+
+    map = (uint64 *) calloc (DA_MAP_WORDS (d->alloc_cells),
+                             sizeof (uint64));
+    if (!map)
+        return NULL;
+
+    for (i = DA_POOL_BEGIN; i < d->num_cells; i++) {
+        if (da_cell_check (d, i) < 0)
+            map[i / 64] |= (uint64) 1 << (i % 64);
+    }
+
+    return map;
+}
+
+/* Build child index in one pass. Visiting cells downwards, each child is
+ * prepended to its parent chain, which thus ends up in ascending order.
+ */
+static void
+da_build_links     (const DArray   *d,
+                    uint8          *child,
+                    uint8          *sibling)
+{
+    TrieIndex   i, p, p_base, first;
+
+    memset (child, 0, d->num_cells);
+    memset (sibling, 0, d->num_cells);
+
+    for (i = d->num_cells - 1; i >= DA_POOL_BEGIN; i--) {
+        p = da_cell_check (d, i);
+        if (p <= 0 || p >= d->num_cells)
+            continue;
+        p_base = da_cell_base (d, p);
+        if (p_base <= 0 || i - p_base < 0 || i - p_base > TRIE_CHAR_MAX)
+            continue;
+
+        /* children already visited are all above i */
+        first = p_base + child[p];
+        sibling[i] = (first > i && first < d->num_cells
+                      && da_cell_check (d, first) == p) ? child[p] : 0;
+        child[p] = (uint8) (i - p_base);
+    }
+}
+
+/* link newly allocated child c into chain of s */
+static void
+da_link_child      (DArray         *d,
+                    TrieIndex       s,
+                    TrieChar        c)
+{
+    TrieIndex   base;
+    TrieChar    first, prev;
+
+    base = da_get_base (d, s);
+    first = da_first_child (d, s);
+    da_first_child (d, base + c) = 0;
+
+    if (first == c || da_get_check (d, base + first) != s) {
+        /* the only child */
+        da_first_child (d, s) = c;
+        da_next_sibling (d, base + c) = 0;
+    } else if (c < first) {
+        da_first_child (d, s) = c;
+        da_next_sibling (d, base + c) = first;
+    } else {
+        prev = first;
+        while (da_next_sibling (d, base + prev) != 0
+               && da_next_sibling (d, base + prev) < c)
+        {
+            prev = da_next_sibling (d, base + prev);
+        }
+        da_next_sibling (d, base + c) = da_next_sibling (d, base + prev);
+        da_next_sibling (d, base + prev) = c;
+    }
+}
+
+/* unlink child c, about to be freed, from chain of s */
+static void
+da_unlink_child    (DArray         *d,
+                    TrieIndex       s,
+                    TrieChar        c)
+{
+    TrieIndex   base;
+    TrieChar    prev;
+
+    base = da_get_base (d, s);
+    prev = da_first_child (d, s);
+    if (prev == c) {
+        da_first_child (d, s) = da_next_sibling (d, base + c);
+        return;
+    }
+    while (da_next_sibling (d, base + prev) != c) {
+        prev = da_next_sibling (d, base + prev);
+        if (0 == prev)
+            return;
+    }
+    da_next_sibling (d, base + prev) = da_next_sibling (d, base + c);
+}
+
+/* free state of cells pos to pos + 63 as bits 0 to 63;
+ * cells beyond the pool are free, as the pool can be extended over them
+ */
+static uint64
+da_free_map_get64  (const DArray   *d,
+                    TrieIndex       pos)
+{
+    size_t      w, n_words;
+    int         shift;
+    uint64      bits;
+
+    if (pos >= d->num_cells)
+        return ~(uint64) 0;
+
+    w = pos / 64;
+    shift = pos % 64;
+    n_words = DA_MAP_WORDS (d->num_cells);
+
+    bits = d->free_map[w] >> shift;
+    if (shift > 0 && w + 1 < n_words)
+        bits |= d->free_map[w + 1] << (64 - shift);
+    if (d->num_cells - pos < 64)
+        bits |= ~(uint64) 0 << (d->num_cells - pos);
+
+    return bits;
+}
+
+/* first free cell at pos or beyond, or free list head if none */
+static TrieIndex
+da_free_map_next   (const DArray   *d,
+                    TrieIndex       pos)
+{
+    size_t      w, n_words;
+    uint64      bits;
+
+    if (pos >= d->num_cells)
+        return da_get_free_list (d);
+
+    w = pos / 64;
+    n_words = DA_MAP_WORDS (d->num_cells);
+    bits = d->free_map[w] & (~(uint64) 0 << (pos % 64));
+    while (!bits) {
+        if (++w >= n_words)
+            return da_get_free_list (d);
+        bits = d->free_map[w];
+    }
+    pos = w * 64 + DA_CTZ64 (bits);
+
+    return (pos < d->num_cells) ? pos : da_get_free_list (d);
 }
 
+struct _DAEnumData {
+    TrieChar   *key;
+    TrieIndex  *path;
+    int         size;
+};
+
 /**
  * @brief Enumerate entries stored in double-array structure
  *
@@ -797,48 +2559,104 @@ da_free_cell       (DArray         *d,
  * Enumerate all keys stored in double-array structure. For each entry, the 
  * user-supplied @a enum_func callback function is called, with the entry key,
  * the separate node, and user-supplied data. Returning FALSE from such
- * callback will stop enumeration and return FALSE.
+ * callback will stop enumeration and return FALSE. The key passed to
+ * @a enum_func is only valid during the call.
+ *
+ * The walk keeps its path on an explicit stack rather than recursing, so
+ * keys of any length can be enumerated.
  */
 Bool
 da_enumerate (const DArray *d, DAEnumFunc enum_func, void *user_data)
 {
-    return da_enumerate_recursive (d, da_get_root (d), enum_func, user_data);
-}
-
-static Bool
-da_enumerate_recursive (const DArray   *d,
-                        TrieIndex       state,
-                        DAEnumFunc      enum_func,
-                        void           *user_data)
-{
+    DAEnumData  enum_data;
+    TrieIndex   s;
+    TrieChar    c;
+    int         depth;
     Bool        ret;
-    TrieIndex   base;
-
-    base = da_get_base (d, state);
 
-    if (base < 0) {
-        TrieChar   *key;
-
-        key = da_get_state_key (d, state);
-        ret = (*enum_func) (key, state, user_data);
-        free (key);
-    } else {
-        Symbols *symbols;
-        int      i;
+    enum_data.size = 64;
+    enum_data.key  = (TrieChar *) malloc (enum_data.size);
+    enum_data.path = (TrieIndex *) malloc (enum_data.size
+                                           * sizeof (TrieIndex));
+    if (!enum_data.key || !enum_data.path) {
+        ret = FALSE;
+        goto exit_enum_data_created;
+    }
 
-        ret = TRUE;
-        symbols = da_output_symbols (d, state);
-        for (i = 0; ret && i < symbols_num (symbols); i++) {
-            ret = da_enumerate_recursive (d, base + symbols_get (symbols, i),
-                                          enum_func, user_data);
+    ret = TRUE;
+    depth = 0;
+    enum_data.path[0] = s = da_get_root (d);
+    for (;;) {
+        /* descend along the first children down to a separate node */
+        while (da_get_base (d, s) >= 0) {
+            s = da_get_first_child (d, s, &c);
+            if (TRIE_INDEX_ERROR == s)
+                break;
+            if (!da_enum_push (&enum_data, depth, s, c)) {
+                ret = FALSE;
+                goto exit_enum_data_created;
+            }
+            ++depth;
+        }
+        if (TRIE_INDEX_ERROR != s) {
+            enum_data.key[depth] = '\0';
+            if (!(*enum_func) (enum_data.key, s, user_data)) {
+                ret = FALSE;
+                break;
+            }
         }
 
-        symbols_free (symbols);
+        /* climb up to the nearest state with a next child */
+        for (;;) {
+            if (0 == depth)
+                goto exit_enum_data_created;
+            --depth;
+            c = enum_data.key[depth];
+            s = da_get_next_child (d, enum_data.path[depth], &c);
+            if (TRIE_INDEX_ERROR != s)
+                break;
+        }
+        /* the buffers already hold the deeper path just climbed from */
+        enum_data.key[depth] = c;
+        enum_data.path[++depth] = s;
     }
 
+exit_enum_data_created:
+    free (enum_data.path);
+    free (enum_data.key);
     return ret;
 }
 
+/* Append @a state, reached by @a c, to the path of the walk after @a depth
+ * symbols, growing the key and path buffers as needed. One byte of the key
+ * is kept for its terminator.
+ */
+static Bool
+da_enum_push (DAEnumData *enum_data, int depth, TrieIndex state, TrieChar c)
+{
+    if (depth + 2 > enum_data->size) {
+        TrieChar   *new_key;
+        TrieIndex  *new_path;
+        int         new_size;
+
+        new_size = enum_data->size * 2;
+        new_key = (TrieChar *) realloc (enum_data->key, new_size);
+        if (!new_key)
+            return FALSE;
+        enum_data->key = new_key;
+        new_path = (TrieIndex *) realloc (enum_data->path,
+                                          new_size * sizeof (TrieIndex));
+        if (!new_path)
+            return FALSE;
+        enum_data->path = new_path;
+        enum_data->size = new_size;
+    }
+
+    enum_data->key[depth] = c;
+    enum_data->path[depth + 1] = state;
+    return TRUE;
+}
+
 /*
 vi:ts=4:ai:expandtab
 */
@@ -61,6 +61,26 @@ void     da_free (DArray *d);
 
 int      da_fwrite (const DArray *d, FILE *file);
 
+DArray * da_new_mapped (const void *mem, size_t size, size_t *o_len);
+
+int      da_fwrite_mapped (const DArray *d, FILE *file);
+
+Bool     da_map_links (DArray *d, const void *mem, size_t size, size_t *o_len);
+
+int      da_fwrite_mapped_links (const DArray *d, FILE *file);
+
+Bool     da_map_failure (DArray *d, const void *mem, size_t size, size_t *o_len);
+
+int      da_fwrite_mapped_failure (const DArray *d, FILE *file);
+
+size_t   da_get_mem_size (const DArray *d);
+
+void     da_set_concurrent (DArray *d, Bool is_concurrent);
+
+int      da_get_num_retired (const DArray *d);
+
+void     da_free_retired (DArray *d);
+
 
 TrieIndex  da_get_root (const DArray *d);
 
@@ -76,6 +96,42 @@ void       da_set_check (DArray *d, TrieIndex s, TrieIndex val);
 
 Bool       da_walk (const DArray *d, TrieIndex *s, TrieChar c);
 
+void       da_prefetch (const DArray *d, TrieIndex s);
+
+TrieIndex  da_get_first_child (const DArray *d, TrieIndex s, TrieChar *c);
+
+TrieIndex  da_get_next_child (const DArray *d, TrieIndex s, TrieChar *c);
+
+TrieIndex  da_get_num_cells (const DArray *d);
+
+TrieIndex  da_get_num_free (const DArray *d);
+
+DArray *   da_new_copy (const DArray  *d,
+                        TrieIndex    **o_sep_nodes,
+                        TrieIndex     *o_num_sep_nodes);
+
+DArray *   da_new_relayout (const DArray  *d,
+                            const int64   *weights,
+                            Bool           is_depth_first,
+                            TrieIndex    **o_sep_nodes,
+                            TrieIndex     *o_num_sep_nodes);
+
+DArray *   da_new_merged (const DArray *const  parts[],
+                          const TrieIndex      tail_offsets[],
+                          int                  n_parts);
+
+Bool       da_build_failure (DArray *d);
+
+Bool       da_has_failure (const DArray *d);
+
+TrieIndex  da_failure_walk (const DArray *d, TrieIndex s, TrieChar c);
+
+TrieIndex  da_get_output (const DArray *d, TrieIndex s);
+
+TrieIndex  da_get_next_output (const DArray *d, TrieIndex s);
+
+int        da_get_depth (const DArray *d, TrieIndex s);
+
 /**
  * @brief Test walkability in double-array structure
  *
@@ -95,6 +151,12 @@ Bool       da_is_walkable (DArray *d, TrieIndex s, TrieChar c);
 
 TrieIndex  da_insert_branch (DArray *d, TrieIndex s, TrieChar c);
 
+TrieIndex  da_insert_children (DArray         *d,
+                               TrieIndex       s,
+                               const TrieChar *labels,
+                               int             n_labels,
+                               TrieIndex      *hint);
+
 void       da_prune (DArray *d, TrieIndex s);
 
 void       da_prune_upto (DArray *d, TrieIndex p, TrieIndex s);
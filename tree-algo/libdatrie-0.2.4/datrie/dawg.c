@@ -0,0 +1,1080 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * libdatrie - Double-Array Trie Library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * dawg.c - Minimal acyclic automaton of trie keys
+ * Created: 2026-10-18
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dawg.h"
+#include "trie-private.h"
+#include "fileutils.h"
+#include "alpha-map-private.h"
+
+/**
+ * @brief Transition of the minimal automaton, as decoded
+ */
+typedef struct {
+    int32       target;     /* run of the target state */
+    int32       rank;       /* keys before those through the transition */
+    uint8       flags;      /* DAWG_FLAG_* */
+} DawgTrans;
+
+#define DAWG_FLAG_LAST          0x1     /* last transition of the state */
+#define DAWG_FLAG_FINAL         0x2     /* a key ends at the target */
+
+/* label and flags of a transition */
+#define DAWG_HEAD_BITS          10
+
+/* bits before the first run, so that run 0 stands for no transitions */
+#define DAWG_RESERVED_BITS      8
+
+/* zero bytes after bit-packed arrays, for reading any field in one load */
+#define DAWG_BITS_PADDING       8
+
+/**
+ * @brief Minimal automaton structure
+ *
+ * A state is the run of its transitions, sorted by label, the last one
+ * flagged, and is referred to by the bit offset of the run. Each
+ * transition is its label, flags and target run, followed by its rank for
+ * all but the first transition: the rank of the first one is 1 if a key
+ * ends at the state, else 0, which the walk already knows.
+ */
+struct _Dawg {
+    AlphaMap        *alpha_map;
+
+    int32            root;
+    Bool             is_root_final;
+    int32            num_trans;
+    int32            num_keys;
+
+    int              target_bits;
+    int              rank_bits;
+    int              data_bits;
+    int32            data_min;  /* data are stored as offsets from it */
+
+    const uint8     *trans;     /* transitions, bit-packed */
+    size_t           trans_size;
+    const uint8     *data;      /* data of each key by rank, bit-packed */
+    size_t           data_size;
+
+    Bool             is_owned;  /* whether the arrays are allocated */
+    void            *map_mem;
+    size_t           map_size;
+};
+
+#define DAWG_SIGNATURE          0xDAD6DAD6
+#define DAWG_VERSION            2
+#define DAWG_ALIGN              64
+
+#define ALIGN_UP(n,a)           (((n) + (a) - 1) / (a) * (a))
+
+/* Mapped Dawg Header (all values are little-endian):
+ * - INT32: signature
+ * - INT32: format version
+ * - INT32: root state
+ * - INT32: 1 if the empty key is accepted, else 0
+ * - INT32: number of transitions
+ * - INT32: number of keys
+ * - INT32: bits of transition targets
+ * - INT32: bits of transition ranks
+ * - INT32: bits of key data
+ * - INT32: least key data
+ * - INT32: size of transitions in bytes
+ *
+ * Sections, each starting at a DAWG_ALIGN boundary:
+ * - AlphaMap, as written by alpha_map_fwrite_mapped()
+ * - Transitions, as a stream of bits filling each byte from its least
+ *   significant bit: DAWG_RESERVED_BITS zero bits, then the runs of the
+ *   states, each transition being an 8-bit label, 2 bits of flags, the
+ *   target and, but for the first transition of a run, the rank;
+ *   followed by DAWG_BITS_PADDING zero bytes
+ * - Data, in the same bit order, the data of each key by rank, less the
+ *   least data; followed by DAWG_BITS_PADDING zero bytes
+ */
+#define DAWG_HEADER_SIZE        44
+
+/* number of bits to store v */
+static int
+dawg_bits_for (uint32 v)
+{
+    int n;
+
+    for (n = 0; v; n++)
+        v >>= 1;
+    return n;
+}
+
+static inline uint32
+dawg_read_bits (const uint8 *bits, uint64 pos, int width)
+{
+    const uint8 *p = bits + (pos >> 3);
+    uint64       w;
+
+    w = (uint64) p[0]         | ((uint64) p[1] << 8)
+        | ((uint64) p[2] << 16) | ((uint64) p[3] << 24)
+        | ((uint64) p[4] << 32) | ((uint64) p[5] << 40)
+        | ((uint64) p[6] << 48) | ((uint64) p[7] << 56);
+    return (uint32) ((w >> (pos & 7)) & ((((uint64) 1) << width) - 1));
+}
+
+static void
+dawg_write_bits (uint8 *bits, uint64 pos, int width, uint32 v)
+{
+    int n;
+
+    for (; width > 0; width -= n, pos += n, v >>= n) {
+        n = 8 - (int) (pos & 7);
+        if (n > width)
+            n = width;
+        bits[pos >> 3] |= (uint8) ((v & ((1u << n) - 1)) << (pos & 7));
+    }
+}
+
+/*----------------------*
+ *   BUILDING SUPPORT   *
+ *----------------------*/
+
+typedef struct {
+    TrieChar    label;
+    int32       target;
+} DawgBuildTrans;
+
+typedef struct {
+    DawgBuildTrans *trans;
+    int             num_trans;
+    int             alloc_trans;
+    Bool            is_final;
+    int32           count;      /* keys reachable, once registered */
+    uint32          hash;
+    int32           next;       /* next in register bucket or free list */
+} DawgBuildState;
+
+/* Daciuk's incremental construction from sorted keys: states off the path
+ * of the last key are final, and are merged with an equivalent registered
+ * state or registered themselves
+ */
+typedef struct {
+    DawgBuildState *states;
+    int32           num_states;
+    int32           alloc_states;
+    int32           free_states;
+
+    int32          *buckets;
+    int32           num_buckets;
+    int32           num_registered;
+
+    TrieData       *data;
+    int32           num_keys;
+    int32           alloc_keys;
+} DawgBuilder;
+
+static int32
+dawg_builder_new_state (DawgBuilder *b)
+{
+    DawgBuildState *st;
+    int32           s;
+
+    if (b->free_states >= 0) {
+        s = b->free_states;
+        b->free_states = b->states[s].next;
+    } else {
+        if (b->num_states == b->alloc_states) {
+            int32           new_size = b->alloc_states * 2;
+            DawgBuildState *new_states;
+
+            new_states = (DawgBuildState *) realloc (b->states,
+                                        new_size * sizeof (DawgBuildState));
+            if (!new_states)
+                return -1;
+            b->states = new_states;
+            b->alloc_states = new_size;
+        }
+        s = b->num_states++;
+        b->states[s].trans = NULL;
+        b->states[s].alloc_trans = 0;
+    }
+
+    st = &b->states[s];
+    st->num_trans = 0;
+    st->is_final = FALSE;
+    st->count = 0;
+    st->next = -1;
+    return s;
+}
+
+static Bool
+dawg_builder_add_trans (DawgBuilder *b, int32 s, TrieChar c, int32 target)
+{
+    DawgBuildState *st = &b->states[s];
+
+    if (st->num_trans == st->alloc_trans) {
+        int             new_size = st->alloc_trans ? st->alloc_trans * 2 : 2;
+        DawgBuildTrans *new_trans;
+
+        new_trans = (DawgBuildTrans *) realloc (st->trans,
+                                        new_size * sizeof (DawgBuildTrans));
+        if (!new_trans)
+            return FALSE;
+        st->trans = new_trans;
+        st->alloc_trans = new_size;
+    }
+    st->trans[st->num_trans].label = c;
+    st->trans[st->num_trans].target = target;
+    ++st->num_trans;
+
+    return TRUE;
+}
+
+static Bool
+dawg_builder_is_equal (const DawgBuildState *a, const DawgBuildState *b)
+{
+    int i;
+
+    if (a->hash != b->hash || a->is_final != b->is_final
+        || a->num_trans != b->num_trans)
+    {
+        return FALSE;
+    }
+    for (i = 0; i < a->num_trans; i++) {
+        if (a->trans[i].label != b->trans[i].label
+            || a->trans[i].target != b->trans[i].target)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static Bool
+dawg_builder_grow_register (DawgBuilder *b)
+{
+    int32  *new_buckets;
+    int32   new_size, i, s, next;
+
+    new_size = b->num_buckets * 2;
+    new_buckets = (int32 *) malloc (new_size * sizeof (int32));
+    if (!new_buckets)
+        return FALSE;
+    for (i = 0; i < new_size; i++)
+        new_buckets[i] = -1;
+
+    for (i = 0; i < b->num_buckets; i++) {
+        for (s = b->buckets[i]; s >= 0; s = next) {
+            next = b->states[s].next;
+            b->states[s].next = new_buckets[b->states[s].hash & (new_size - 1)];
+            new_buckets[b->states[s].hash & (new_size - 1)] = s;
+        }
+    }
+
+    free (b->buckets);
+    b->buckets = new_buckets;
+    b->num_buckets = new_size;
+    return TRUE;
+}
+
+/* registered state equivalent to s, s itself if newly registered, or -1 */
+static int32
+dawg_builder_register (DawgBuilder *b, int32 s)
+{
+    DawgBuildState *st = &b->states[s];
+    uint32          h;
+    int32           q;
+    int             i;
+
+    h = st->is_final ? 0x9e3779b9 : 0;
+    st->count = st->is_final ? 1 : 0;
+    for (i = 0; i < st->num_trans; i++) {
+        h = (h ^ st->trans[i].label) * 0x01000193;
+        h = (h ^ (uint32) st->trans[i].target) * 0x01000193;
+        st->count += b->states[st->trans[i].target].count;
+    }
+    st->hash = h ^ (h >> 15);
+
+    for (q = b->buckets[st->hash & (b->num_buckets - 1)];
+         q >= 0;
+         q = b->states[q].next)
+    {
+        if (dawg_builder_is_equal (&b->states[q], st))
+            return q;
+    }
+
+    if (b->num_registered >= b->num_buckets && !dawg_builder_grow_register (b))
+        return -1;
+    st->next = b->buckets[st->hash & (b->num_buckets - 1)];
+    b->buckets[st->hash & (b->num_buckets - 1)] = s;
+    ++b->num_registered;
+
+    return s;
+}
+
+/* register the states of the last key below the given depth */
+static Bool
+dawg_builder_minimize (DawgBuilder *b, int32 path[], int from, int to)
+{
+    DawgBuildState *parent;
+    int32           q;
+    int             i;
+
+    for (i = to; i > from; i--) {
+        q = dawg_builder_register (b, path[i]);
+        if (q < 0)
+            return FALSE;
+        if (q != path[i]) {
+            parent = &b->states[path[i - 1]];
+            parent->trans[parent->num_trans - 1].target = q;
+            b->states[path[i]].next = b->free_states;
+            b->free_states = path[i];
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+dawg_builder_free (DawgBuilder *b)
+{
+    int32   i;
+
+    for (i = 0; i < b->num_states; i++)
+        free (b->states[i].trans);
+    free (b->states);
+    free (b->buckets);
+    free (b->data);
+}
+
+/* lay the registered states out, breadth-first from root */
+static Dawg *
+dawg_builder_emit (DawgBuilder *b, int32 root)
+{
+    Dawg       *dawg;
+    uint8      *trans, *data;
+    int32      *runs, *queue;
+    int32       num_states, num_trans, head, rank, max_rank;
+    TrieData    data_min, data_max;
+    uint64      pos, num_bits;
+    int         target_bits, rank_bits, data_bits, bits, i;
+
+    dawg = NULL;
+    runs = (int32 *) malloc (b->num_states * sizeof (int32));
+    if (!runs)
+        return NULL;
+    queue = (int32 *) malloc (b->num_states * sizeof (int32));
+    if (!queue)
+        goto exit_runs_allocated;
+
+    /* order the states by discovery, and find the largest rank stored */
+    for (i = 0; i < b->num_states; i++)
+        runs[i] = -1;
+    num_states = 0;
+    num_trans = 0;
+    max_rank = 0;
+    runs[root] = 0;
+    queue[num_states++] = root;
+    for (head = 0; head < num_states; head++) {
+        const DawgBuildState *st = &b->states[queue[head]];
+
+        rank = st->is_final ? 1 : 0;
+        for (i = 0; i < st->num_trans; i++) {
+            int32   t = st->trans[i].target;
+
+            if (i > 0 && rank > max_rank)
+                max_rank = rank;
+            rank += b->states[t].count;
+            if (runs[t] < 0) {
+                runs[t] = 0;
+                queue[num_states++] = t;
+            }
+        }
+        num_trans += st->num_trans;
+    }
+    rank_bits = dawg_bits_for (max_rank);
+
+    /* targets are run offsets, whose width depends on the runs' size */
+    target_bits = 0;
+    do {
+        bits = target_bits;
+        num_bits = DAWG_RESERVED_BITS;
+        for (head = 0; head < num_states; head++) {
+            const DawgBuildState *st = &b->states[queue[head]];
+
+            runs[queue[head]] = st->num_trans ? (int32) num_bits : 0;
+            if (st->num_trans) {
+                num_bits += st->num_trans * (DAWG_HEAD_BITS + (uint64) bits)
+                            + (st->num_trans - 1) * (uint64) rank_bits;
+            }
+        }
+        if (num_bits > 0x7fffffff)
+            goto exit_queue_allocated;
+        target_bits = dawg_bits_for ((uint32) num_bits);
+    } while (target_bits != bits);
+
+    data_min = data_max = 0;
+    for (i = 0; i < b->num_keys; i++) {
+        if (0 == i || b->data[i] < data_min)
+            data_min = b->data[i];
+        if (0 == i || b->data[i] > data_max)
+            data_max = b->data[i];
+    }
+    data_bits = dawg_bits_for ((uint32) data_max - (uint32) data_min);
+
+    dawg = (Dawg *) malloc (sizeof (Dawg));
+    if (!dawg)
+        goto exit_queue_allocated;
+    dawg->trans_size = (num_bits + 7) / 8 + DAWG_BITS_PADDING;
+    dawg->data_size = ((uint64) b->num_keys * data_bits + 7) / 8
+                      + DAWG_BITS_PADDING;
+    trans = (uint8 *) calloc (dawg->trans_size, 1);
+    data = (uint8 *) calloc (dawg->data_size, 1);
+    if (!trans || !data) {
+        free (trans);
+        free (data);
+        free (dawg);
+        dawg = NULL;
+        goto exit_queue_allocated;
+    }
+
+    pos = DAWG_RESERVED_BITS;
+    for (head = 0; head < num_states; head++) {
+        const DawgBuildState *st = &b->states[queue[head]];
+
+        rank = st->is_final ? 1 : 0;
+        for (i = 0; i < st->num_trans; i++) {
+            const DawgBuildState *target = &b->states[st->trans[i].target];
+            uint32                flags;
+
+            flags = (i == st->num_trans - 1 ? DAWG_FLAG_LAST : 0)
+                    | (target->is_final ? DAWG_FLAG_FINAL : 0);
+            dawg_write_bits (trans, pos, DAWG_HEAD_BITS,
+                             st->trans[i].label | (flags << 8));
+            pos += DAWG_HEAD_BITS;
+            dawg_write_bits (trans, pos, target_bits,
+                             runs[st->trans[i].target]);
+            pos += target_bits;
+            if (i > 0) {
+                dawg_write_bits (trans, pos, rank_bits, rank);
+                pos += rank_bits;
+            }
+            rank += target->count;
+        }
+    }
+    for (i = 0; i < b->num_keys; i++) {
+        dawg_write_bits (data, (uint64) i * data_bits, data_bits,
+                         (uint32) b->data[i] - (uint32) data_min);
+    }
+
+    dawg->alpha_map     = NULL;
+    dawg->root          = runs[root];
+    dawg->is_root_final = b->states[root].is_final;
+    dawg->num_trans     = num_trans;
+    dawg->num_keys      = b->num_keys;
+    dawg->target_bits   = target_bits;
+    dawg->rank_bits     = rank_bits;
+    dawg->data_bits     = data_bits;
+    dawg->data_min      = data_min;
+    dawg->trans         = trans;
+    dawg->data          = data;
+    dawg->is_owned      = TRUE;
+    dawg->map_mem       = NULL;
+    dawg->map_size      = 0;
+
+exit_queue_allocated:
+    free (queue);
+exit_runs_allocated:
+    free (runs);
+    return dawg;
+}
+
+/*-----------------------*
+ *   GENERAL FUNCTIONS   *
+ *-----------------------*/
+
+/**
+ * @brief Build a minimal automaton of trie keys
+ *
+ * @param trie : the trie
+ *
+ * @return a newly created automaton, or NULL on failure
+ *
+ * Build the minimal automaton accepting the keys of @a trie, keeping their
+ * data. The automaton is independent of @a trie afterwards.
+ *
+ * The building keeps only the states along the current key besides the
+ * automaton itself, so it takes much less memory than @a trie for large
+ * dictionaries.
+ *
+ * The created object must be freed with dawg_free().
+ *
+ * Available since: 0.2.5
+ */
+Dawg *
+dawg_new_from_trie (const Trie *trie)
+{
+    const AlphaMap *alpha_map = trie_get_alpha_map (trie);
+    DawgBuilder     b;
+    TrieIterator   *iter;
+    TrieState       root;
+    Dawg           *dawg = NULL;
+    TrieChar       *key, *prev;
+    int32          *path;
+    const AlphaChar *akey;
+    int             key_size, len, prev_len, i, cp;
+
+    b.alloc_states = 256;
+    b.states = (DawgBuildState *) malloc (b.alloc_states
+                                          * sizeof (DawgBuildState));
+    b.num_states = 0;
+    b.free_states = -1;
+    b.num_buckets = 256;
+    b.buckets = (int32 *) malloc (b.num_buckets * sizeof (int32));
+    b.num_registered = 0;
+    b.alloc_keys = 256;
+    b.data = (TrieData *) malloc (b.alloc_keys * sizeof (TrieData));
+    b.num_keys = 0;
+    key_size = 64;
+    key  = (TrieChar *) malloc (key_size);
+    prev = (TrieChar *) malloc (key_size);
+    path = (int32 *) malloc ((key_size + 1) * sizeof (int32));
+    if (!b.states || !b.buckets || !b.data || !key || !prev || !path)
+        goto exit_allocated;
+    for (i = 0; i < b.num_buckets; i++)
+        b.buckets[i] = -1;
+
+    trie_state_init (&root, trie);
+    iter = trie_iterator_new (&root);
+    if (!iter)
+        goto exit_allocated;
+
+    path[0] = dawg_builder_new_state (&b);
+    if (path[0] < 0)
+        goto exit_iter_created;
+    prev_len = 0;
+    while (trie_iterator_next (iter)) {
+        akey = trie_iterator_get_key (iter);
+        len = alpha_char_strlen (akey);
+        if (len >= key_size) {
+            TrieChar   *new_key, *new_prev;
+            int32      *new_path;
+
+            while (len >= key_size)
+                key_size *= 2;
+            new_key  = (TrieChar *) realloc (key, key_size);
+            if (new_key)
+                key = new_key;
+            new_prev = (TrieChar *) realloc (prev, key_size);
+            if (new_prev)
+                prev = new_prev;
+            new_path = (int32 *) realloc (path,
+                                          (key_size + 1) * sizeof (int32));
+            if (new_path)
+                path = new_path;
+            if (!new_key || !new_prev || !new_path)
+                goto exit_iter_created;
+        }
+        for (i = 0; i < len; i++)
+            key[i] = alpha_map_char_to_trie (alpha_map, akey[i]);
+
+        /* keys come in trie order, which the ranks rely on */
+        for (cp = 0; cp < len && cp < prev_len && key[cp] == prev[cp]; cp++)
+            ;
+        if (b.num_keys > 0
+            && (cp == len || (cp < prev_len && key[cp] < prev[cp])))
+        {
+            goto exit_iter_created;
+        }
+
+        if (!dawg_builder_minimize (&b, path, cp, prev_len))
+            goto exit_iter_created;
+        for (i = cp; i < len; i++) {
+            int32 s = dawg_builder_new_state (&b);
+
+            if (s < 0 || !dawg_builder_add_trans (&b, path[i], key[i], s))
+                goto exit_iter_created;
+            path[i + 1] = s;
+        }
+        b.states[path[len]].is_final = TRUE;
+
+        if (b.num_keys == b.alloc_keys) {
+            TrieData *new_data;
+
+            new_data = (TrieData *) realloc (b.data, b.alloc_keys * 2
+                                                     * sizeof (TrieData));
+            if (!new_data)
+                goto exit_iter_created;
+            b.data = new_data;
+            b.alloc_keys *= 2;
+        }
+        b.data[b.num_keys++] = trie_iterator_get_data (iter);
+
+        memcpy (prev, key, len);
+        prev_len = len;
+    }
+
+    if (!dawg_builder_minimize (&b, path, 0, prev_len)
+        || dawg_builder_register (&b, path[0]) < 0)
+    {
+        goto exit_iter_created;
+    }
+
+    dawg = dawg_builder_emit (&b, path[0]);
+    if (dawg && !(dawg->alpha_map = alpha_map_clone (alpha_map))) {
+        dawg_free (dawg);
+        dawg = NULL;
+    }
+
+exit_iter_created:
+    trie_iterator_free (iter);
+exit_allocated:
+    free (path);
+    free (prev);
+    free (key);
+    dawg_builder_free (&b);
+    return dawg;
+}
+
+/**
+ * @brief Open an automaton file by memory mapping
+ *
+ * @param path : the path to the file, as written by dawg_save()
+ *
+ * @return the automaton, or NULL on failure
+ *
+ * Map the automaton file at @a path into memory and use it in place, as
+ * trie_new_mapped() does for trie files, so that processes opening the
+ * same file share its memory.
+ *
+ * The created object must be freed with dawg_free().
+ *
+ * Available since: 0.2.5
+ */
+Dawg *
+dawg_new_mapped (const char *path)
+{
+    Dawg           *dawg;
+    unsigned char  *mem;
+    size_t          size, pos, len, data_pos;
+    int32           trans_size, num_keys;
+
+    mem = (unsigned char *) file_map (path, &size);
+    if (!mem)
+        return NULL;
+
+    if (size < DAWG_HEADER_SIZE
+        || DAWG_SIGNATURE != (uint32) mem_read_int32_le (mem)
+        || DAWG_VERSION != mem_read_int32_le (mem + 4))
+    {
+        goto exit_file_mapped;
+    }
+
+    dawg = (Dawg *) malloc (sizeof (Dawg));
+    if (!dawg)
+        goto exit_file_mapped;
+    dawg->root          = mem_read_int32_le (mem + 8);
+    dawg->is_root_final = (0 != mem_read_int32_le (mem + 12));
+    dawg->num_trans     = mem_read_int32_le (mem + 16);
+    dawg->num_keys      = num_keys = mem_read_int32_le (mem + 20);
+    dawg->target_bits   = mem_read_int32_le (mem + 24);
+    dawg->rank_bits     = mem_read_int32_le (mem + 28);
+    dawg->data_bits     = mem_read_int32_le (mem + 32);
+    dawg->data_min      = mem_read_int32_le (mem + 36);
+    trans_size          = mem_read_int32_le (mem + 40);
+    if (num_keys < 0 || trans_size < DAWG_BITS_PADDING
+        || dawg->target_bits < 0 || dawg->target_bits > 32
+        || dawg->rank_bits < 0 || dawg->rank_bits > 32
+        || dawg->data_bits < 0 || dawg->data_bits > 32
+        || dawg->root < 0
+        || dawg->root / 8 >= trans_size - DAWG_BITS_PADDING)
+    {
+        goto exit_dawg_created;
+    }
+    dawg->trans_size = trans_size;
+    dawg->data_size = ((uint64) num_keys * dawg->data_bits + 7) / 8
+                      + DAWG_BITS_PADDING;
+
+    pos = ALIGN_UP (DAWG_HEADER_SIZE, DAWG_ALIGN);
+    if (pos > size ||
+        NULL == (dawg->alpha_map = alpha_map_new_mapped (mem + pos,
+                                                         size - pos, &len)))
+    {
+        goto exit_dawg_created;
+    }
+    pos = ALIGN_UP (pos + len, DAWG_ALIGN);
+    if (pos > size || size - pos < dawg->trans_size)
+        goto exit_alpha_map_created;
+    data_pos = ALIGN_UP (pos + dawg->trans_size, DAWG_ALIGN);
+    if (data_pos > size || size - data_pos < dawg->data_size)
+        goto exit_alpha_map_created;
+
+    /* the bit order is that of the bytes, so any host uses them in place */
+    dawg->trans     = mem + pos;
+    dawg->data      = mem + data_pos;
+    dawg->is_owned  = FALSE;
+    dawg->map_mem   = mem;
+    dawg->map_size  = size;
+    return dawg;
+
+exit_alpha_map_created:
+    alpha_map_free (dawg->alpha_map);
+exit_dawg_created:
+    free (dawg);
+exit_file_mapped:
+    file_unmap (mem, size);
+    return NULL;
+}
+
+/**
+ * @brief Free an automaton
+ *
+ * @param dawg : the automaton
+ *
+ * Available since: 0.2.5
+ */
+void
+dawg_free (Dawg *dawg)
+{
+    if (dawg->is_owned) {
+        free ((void *) dawg->trans);
+        free ((void *) dawg->data);
+    }
+    if (dawg->map_mem)
+        file_unmap (dawg->map_mem, dawg->map_size);
+    if (dawg->alpha_map)
+        alpha_map_free (dawg->alpha_map);
+    free (dawg);
+}
+
+/**
+ * @brief Save an automaton to file
+ *
+ * @param dawg : the automaton
+ * @param path : the path to the file
+ *
+ * @return 0 on success, non-zero on failure
+ *
+ * Create a new file at the given @a path and write @a dawg to it, to be
+ * opened with dawg_new_mapped(). If @a path already exists, its contents
+ * will be replaced.
+ *
+ * Available since: 0.2.5
+ */
+int
+dawg_save (const Dawg *dawg, const char *path)
+{
+    FILE   *file;
+    int     res = -1;
+
+    file = fopen (path, "w+");
+    if (!file)
+        return -1;
+
+    if (!file_write_int32_le (file, DAWG_SIGNATURE) ||
+        !file_write_int32_le (file, DAWG_VERSION)   ||
+        !file_write_int32_le (file, dawg->root) ||
+        !file_write_int32_le (file, dawg->is_root_final ? 1 : 0) ||
+        !file_write_int32_le (file, dawg->num_trans) ||
+        !file_write_int32_le (file, dawg->num_keys) ||
+        !file_write_int32_le (file, dawg->target_bits) ||
+        !file_write_int32_le (file, dawg->rank_bits) ||
+        !file_write_int32_le (file, dawg->data_bits) ||
+        !file_write_int32_le (file, dawg->data_min) ||
+        !file_write_int32_le (file, (int32) dawg->trans_size))
+    {
+        goto exit_file_openned;
+    }
+
+    if (!file_write_padding (file, DAWG_ALIGN) ||
+        alpha_map_fwrite_mapped (dawg->alpha_map, file) != 0 ||
+        !file_write_padding (file, DAWG_ALIGN))
+    {
+        goto exit_file_openned;
+    }
+
+    if (fwrite (dawg->trans, 1, dawg->trans_size, file) != dawg->trans_size
+        || !file_write_padding (file, DAWG_ALIGN)
+        || fwrite (dawg->data, 1, dawg->data_size, file) != dawg->data_size)
+    {
+        goto exit_file_openned;
+    }
+    res = 0;
+
+exit_file_openned:
+    if (fclose (file) != 0)
+        res = -1;
+    return res;
+}
+
+/**
+ * @brief Get the number of keys
+ *
+ * @param dawg : the automaton
+ *
+ * @return the number of keys accepted by @a dawg
+ *
+ * Available since: 0.2.5
+ */
+int
+dawg_get_num_keys (const Dawg *dawg)
+{
+    return dawg->num_keys;
+}
+
+/**
+ * @brief Get memory usage
+ *
+ * @param dawg : the automaton
+ *
+ * @return the size of the automaton tables, in bytes
+ *
+ * For a mapped automaton, this is the size of the tables in the file,
+ * shared with other processes mapping it.
+ *
+ * Available since: 0.2.5
+ */
+size_t
+dawg_get_mem_size (const Dawg *dawg)
+{
+    return sizeof (Dawg) + dawg->trans_size + dawg->data_size;
+}
+
+
+/*------------------------------*
+ *   GENERAL QUERY OPERATIONS   *
+ *------------------------------*/
+
+/* transition from the state at run s on c, whose rank is counted from
+ * the keys before s, is_final telling whether a key ends at s
+ */
+static Bool
+dawg_find_trans (const Dawg *dawg, int32 s, Bool is_final, TrieChar c,
+                 DawgTrans *o_trans)
+{
+    const uint8 *trans = dawg->trans;
+    uint32       head, pos, stride;
+    Bool         is_first;
+
+    if (0 == s)
+        return FALSE;
+
+    /* runs are short but for the first levels, a scan is enough */
+    pos = s;
+    is_first = TRUE;
+    head = dawg_read_bits (trans, pos, DAWG_HEAD_BITS);
+    if ((TrieChar) head < c) {
+        if (head & (DAWG_FLAG_LAST << 8))
+            return FALSE;
+        pos += DAWG_HEAD_BITS + dawg->target_bits;
+        is_first = FALSE;
+        stride = DAWG_HEAD_BITS + dawg->target_bits + dawg->rank_bits;
+        for (;;) {
+            head = dawg_read_bits (trans, pos, DAWG_HEAD_BITS);
+            if ((TrieChar) head >= c)
+                break;
+            if (head & (DAWG_FLAG_LAST << 8))
+                return FALSE;
+            pos += stride;
+        }
+    }
+    if ((TrieChar) head != c)
+        return FALSE;
+
+    pos += DAWG_HEAD_BITS;
+    o_trans->target = dawg_read_bits (dawg->trans, pos, dawg->target_bits);
+    if (is_first) {
+        o_trans->rank = is_final ? 1 : 0;
+    } else {
+        o_trans->rank = dawg_read_bits (dawg->trans, pos + dawg->target_bits,
+                                        dawg->rank_bits);
+    }
+    o_trans->flags = (uint8) (head >> 8);
+    return TRUE;
+}
+
+/* data of the key of the given rank */
+static TrieData
+dawg_get_data (const Dawg *dawg, int32 rank)
+{
+    return (TrieData) ((uint32) dawg->data_min
+                       + dawg_read_bits (dawg->data,
+                                         (uint64) rank * dawg->data_bits,
+                                         dawg->data_bits));
+}
+
+/**
+ * @brief Retrieve an entry from automaton
+ *
+ * @param dawg   : the automaton
+ * @param key    : the key for the entry to retrieve
+ * @param o_data : the storage for storing the entry data on return
+ *
+ * @return boolean value indicating the existence of the entry.
+ *
+ * Retrieve an entry for the given @a key from @a dawg, as trie_retrieve()
+ * does for a trie. On return, if @a key is found and @a o_data is not
+ * NULL, @a *o_data is set to the data associated to @a key.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+dawg_retrieve (const Dawg *dawg, const AlphaChar *key, TrieData *o_data)
+{
+    DawgTrans   t;
+    int32       s, rank;
+    Bool        is_final;
+
+    s = dawg->root;
+    is_final = dawg->is_root_final;
+    rank = 0;
+    for (; *key; key++) {
+        if (!dawg_find_trans (dawg, s, is_final,
+                              alpha_map_char_to_trie (dawg->alpha_map, *key),
+                              &t))
+        {
+            return FALSE;
+        }
+        rank += t.rank;
+        s = t.target;
+        is_final = (t.flags & DAWG_FLAG_FINAL) ? TRUE : FALSE;
+        TRIE_PREFETCH (dawg->trans + s / 8);
+    }
+
+    if (!is_final)
+        return FALSE;
+    if (o_data)
+        *o_data = dawg_get_data (dawg, rank);
+    return TRUE;
+}
+
+
+/*-------------------------------*
+ *   STEPWISE QUERY OPERATIONS   *
+ *-------------------------------*/
+
+/**
+ * @brief Set up an automaton state at root
+ *
+ * @param s    : the state to set up
+ * @param dawg : the automaton
+ *
+ * Available since: 0.2.5
+ */
+void
+dawg_state_init (DawgState *s, const Dawg *dawg)
+{
+    s->dawg  = dawg;
+    s->index = dawg->root;
+    s->rank  = 0;
+    s->is_terminal = dawg->is_root_final;
+}
+
+/**
+ * @brief Walk the automaton from the state
+ *
+ * @param s : current state
+ * @param c : key character for walking
+ *
+ * @return boolean value indicating the success of the walk
+ *
+ * Walk the automaton stepwise, using a given character @a c, as
+ * trie_state_walk() does for a trie. On return, the state @a s is updated
+ * to the new state if successfully walked.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+dawg_state_walk (DawgState *s, AlphaChar c)
+{
+    DawgTrans   t;
+
+    if (!dawg_find_trans (s->dawg, s->index, s->is_terminal,
+                          alpha_map_char_to_trie (s->dawg->alpha_map, c), &t))
+    {
+        return FALSE;
+    }
+
+    s->rank += t.rank;
+    s->index = t.target;
+    s->is_terminal = (t.flags & DAWG_FLAG_FINAL) ? TRUE : FALSE;
+    return TRUE;
+}
+
+/**
+ * @brief Test walkability of character from state
+ *
+ * @param s : the state to check
+ * @param c : the input character
+ *
+ * @return boolean indicating walkability
+ *
+ * Available since: 0.2.5
+ */
+Bool
+dawg_state_is_walkable (const DawgState *s, AlphaChar c)
+{
+    DawgTrans   t;
+
+    return dawg_find_trans (s->dawg, s->index, s->is_terminal,
+                            alpha_map_char_to_trie (s->dawg->alpha_map, c),
+                            &t);
+}
+
+/**
+ * @brief Check for terminal state
+ *
+ * @param s : the state to check
+ *
+ * @return boolean value indicating whether a key ends at @a s
+ *
+ * Unlike trie_state_is_terminal(), no terminator walk is needed to get the
+ * data with dawg_state_get_data().
+ *
+ * Available since: 0.2.5
+ */
+Bool
+dawg_state_is_terminal (const DawgState *s)
+{
+    return s->is_terminal;
+}
+
+/**
+ * @brief Get data from terminal state
+ *
+ * @param s : a terminal state
+ *
+ * @return the data associated with the key ending at @a s,
+ *         or TRIE_DATA_ERROR if @a s is not a terminal state
+ *
+ * Available since: 0.2.5
+ */
+TrieData
+dawg_state_get_data (const DawgState *s)
+{
+    if (!s->is_terminal)
+        return TRIE_DATA_ERROR;
+
+    return dawg_get_data (s->dawg, s->rank);
+}
+
+/*
+vi:ts=4:ai:expandtab
+*/
@@ -0,0 +1,121 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * libdatrie - Double-Array Trie Library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * dawg.h - Minimal acyclic automaton of trie keys
+ * Created: 2026-10-18
+ */
+
+#ifndef __DAWG_H
+#define __DAWG_H
+
+#include <datrie/triedefs.h>
+#include <datrie/alpha-map.h>
+#include <datrie/trie.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file dawg.h
+ * @brief Read-only minimal automaton of trie keys
+ *
+ * A Dawg holds the keys of a trie in a minimal deterministic acyclic
+ * automaton, in which keys ending alike share their ending states, not
+ * only keys beginning alike. It takes much less memory than the trie for
+ * large dictionaries, but cannot be modified.
+ *
+ * As shared states cannot hold per-key data, each state counts the keys
+ * reachable from it, so that a walk also computes the rank of the key in
+ * sorted order, which indexes a data array.
+ */
+
+/**
+ * @brief Minimal automaton data type
+ */
+typedef struct _Dawg   Dawg;
+
+/**
+ * @brief Automaton walking state
+ */
+typedef struct _DawgState DawgState;
+
+/**
+ * @brief DawgState structure
+ *
+ * The fields are private. The structure is only exposed so that a state
+ * can be declared on the stack and set up with dawg_state_init().
+ */
+struct _DawgState {
+    const Dawg *dawg;       /**< the corresponding automaton */
+    int32       index;      /**< automaton state */
+    int32       rank;       /**< number of keys sorted before the walked path */
+    Bool        is_terminal; /**< whether a key ends at the state */
+};
+
+/*-----------------------*
+ *   GENERAL FUNCTIONS   *
+ *-----------------------*/
+
+Dawg *  dawg_new_from_trie (const Trie *trie);
+
+Dawg *  dawg_new_mapped (const char *path);
+
+void    dawg_free (Dawg *dawg);
+
+int     dawg_save (const Dawg *dawg, const char *path);
+
+int     dawg_get_num_keys (const Dawg *dawg);
+
+size_t  dawg_get_mem_size (const Dawg *dawg);
+
+
+/*------------------------------*
+ *   GENERAL QUERY OPERATIONS   *
+ *------------------------------*/
+
+Bool    dawg_retrieve (const Dawg      *dawg,
+                       const AlphaChar *key,
+                       TrieData        *o_data);
+
+
+/*-------------------------------*
+ *   STEPWISE QUERY OPERATIONS   *
+ *-------------------------------*/
+
+void    dawg_state_init (DawgState *s, const Dawg *dawg);
+
+Bool    dawg_state_walk (DawgState *s, AlphaChar c);
+
+Bool    dawg_state_is_walkable (const DawgState *s, AlphaChar c);
+
+Bool    dawg_state_is_terminal (const DawgState *s);
+
+TrieData dawg_state_get_data (const DawgState *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __DAWG_H */
+
+/*
+vi:ts=4:ai:expandtab
+*/
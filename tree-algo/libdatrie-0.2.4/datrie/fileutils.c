@@ -26,11 +26,43 @@
 
 #include <string.h>
 #include <stdlib.h>
+#ifndef _WIN32
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
 
+#include "trie-private.h"
 #include "fileutils.h"
 
+/*-----------------------------------*
+ *    PRIVATE METHODS DECLARATIONS   *
+ *-----------------------------------*/
+
+static void     swap_int32_array (uint32 *dst, const uint32 *src, size_t n);
+static void     swap_int64_array (uint64 *dst, const uint64 *src, size_t n);
+
 /* ==================== BEGIN IMPLEMENTATION PART ====================  */
 
+/* number of values byte-swapped and written at a time */
+#define FILE_IO_CHUNK   16384
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 3))
+# define BSWAP32(v)     __builtin_bswap32 (v)
+#else
+# define BSWAP32(v)     ((((v) & 0xff) << 24) | (((v) & 0xff00) << 8) | \
+                         (((v) >> 8) & 0xff00) | (((v) >> 24) & 0xff))
+#endif
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 3))
+# define BSWAP64(v)     __builtin_bswap64 (v)
+#else
+# define BSWAP64(v)     (((uint64) BSWAP32 ((uint32) (v)) << 32) | \
+                         BSWAP32 ((uint32) ((v) >> 32)))
+#endif
+
 /*--------------------------------*
  *    FUNCTIONS IMPLEMENTATIONS   *
  *--------------------------------*/
@@ -41,7 +73,8 @@ file_read_int32 (FILE *file, int32 *o_val)
     unsigned char   buff[4];
 
     if (fread (buff, 4, 1, file) == 1) {
-        *o_val = (buff[0] << 24) | (buff[1] << 16) |  (buff[2] << 8) | buff[3];
+        *o_val = (int32) (((uint32) buff[0] << 24) | ((uint32) buff[1] << 16)
+                          | ((uint32) buff[2] << 8) | (uint32) buff[3]);
         return TRUE;
     }
 
@@ -61,6 +94,25 @@ file_write_int32 (FILE *file, int32 val)
     return (fwrite (buff, 4, 1, file) == 1);
 }
 
+Bool
+file_read_int64 (FILE *file, int64 *o_val)
+{
+    int32   hi, lo;
+
+    if (!file_read_int32 (file, &hi) || !file_read_int32 (file, &lo))
+        return FALSE;
+
+    *o_val = (int64) (((uint64) (uint32) hi << 32) | (uint32) lo);
+    return TRUE;
+}
+
+Bool
+file_write_int64 (FILE *file, int64 val)
+{
+    return file_write_int32 (file, (int32) (val >> 32))
+           && file_write_int32 (file, (int32) val);
+}
+
 Bool
 file_read_int16 (FILE *file, int16 *o_val)
 {
@@ -109,6 +161,341 @@ file_write_chars (FILE *file, const char *buff, int len)
     return (fwrite (buff, sizeof (char), len, file) == len);
 }
 
+/* Plain loop over independent elements, so that the compiler can
+ * vectorize it into byte shuffles.
+ */
+static void
+swap_int32_array (uint32 *dst, const uint32 *src, size_t n)
+{
+    size_t  i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = BSWAP32 (src[i]);
+}
+
+static void
+swap_int64_array (uint64 *dst, const uint64 *src, size_t n)
+{
+    size_t  i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = BSWAP64 (src[i]);
+}
+
+/**
+ * @brief Read an array of big-endian 32-bit integers
+ *
+ * @param file : the file to read
+ * @param vals : the array to fill
+ * @param n    : number of values to read
+ *
+ * @return boolean indicating success
+ *
+ * Read the whole array with a single read, then convert it to host byte
+ * order in place.
+ */
+Bool
+file_read_int32_array (FILE *file, int32 *vals, size_t n)
+{
+    if (0 == n)
+        return TRUE;
+
+    if (fread (vals, sizeof (int32), n, file) != n)
+        return FALSE;
+
+    if (host_is_little_endian ())
+        swap_int32_array ((uint32 *) vals, (const uint32 *) vals, n);
+
+    return TRUE;
+}
+
+/**
+ * @brief Write an array of 32-bit integers in big-endian
+ *
+ * @param file : the file to write to
+ * @param vals : the values to write
+ * @param n    : number of values
+ *
+ * @return boolean indicating success
+ *
+ * On big-endian hosts, the array is written as is. Otherwise, it is
+ * byte-swapped into a bounded buffer, which is written in large chunks.
+ */
+Bool
+file_write_int32_array (FILE *file, const int32 *vals, size_t n)
+{
+    uint32 *buff;
+    size_t  i, len;
+
+    if (0 == n)
+        return TRUE;
+
+    if (!host_is_little_endian ())
+        return (fwrite (vals, sizeof (int32), n, file) == n);
+
+    buff = (uint32 *) malloc (MIN_VAL (n, FILE_IO_CHUNK) * sizeof (uint32));
+    if (!buff)
+        return FALSE;
+
+    for (i = 0; i < n; i += len) {
+        len = MIN_VAL (n - i, FILE_IO_CHUNK);
+        swap_int32_array (buff, (const uint32 *) vals + i, len);
+        if (fwrite (buff, sizeof (uint32), len, file) != len) {
+            free (buff);
+            return FALSE;
+        }
+    }
+
+    free (buff);
+    return TRUE;
+}
+
+/**
+ * @brief Read an array of big-endian 64-bit integers
+ *
+ * @param file : the file to read
+ * @param vals : the array to fill
+ * @param n    : number of values to read
+ *
+ * @return boolean indicating success
+ *
+ * The 64-bit counterpart of file_read_int32_array().
+ */
+Bool
+file_read_int64_array (FILE *file, int64 *vals, size_t n)
+{
+    if (0 == n)
+        return TRUE;
+
+    if (fread (vals, sizeof (int64), n, file) != n)
+        return FALSE;
+
+    if (host_is_little_endian ())
+        swap_int64_array ((uint64 *) vals, (const uint64 *) vals, n);
+
+    return TRUE;
+}
+
+/**
+ * @brief Write an array of 64-bit integers in big-endian
+ *
+ * @param file : the file to write to
+ * @param vals : the values to write
+ * @param n    : number of values
+ *
+ * @return boolean indicating success
+ *
+ * The 64-bit counterpart of file_write_int32_array().
+ */
+Bool
+file_write_int64_array (FILE *file, const int64 *vals, size_t n)
+{
+    uint64 *buff;
+    size_t  i, len;
+
+    if (0 == n)
+        return TRUE;
+
+    if (!host_is_little_endian ())
+        return (fwrite (vals, sizeof (int64), n, file) == n);
+
+    buff = (uint64 *) malloc (MIN_VAL (n, FILE_IO_CHUNK) * sizeof (uint64));
+    if (!buff)
+        return FALSE;
+
+    for (i = 0; i < n; i += len) {
+        len = MIN_VAL (n - i, FILE_IO_CHUNK);
+        swap_int64_array (buff, (const uint64 *) vals + i, len);
+        if (fwrite (buff, sizeof (uint64), len, file) != len) {
+            free (buff);
+            return FALSE;
+        }
+    }
+
+    free (buff);
+    return TRUE;
+}
+
+int32
+mem_read_int32 (const void *mem)
+{
+    const unsigned char *buff = (const unsigned char *) mem;
+
+    return (int32) (((uint32) buff[0] << 24) | ((uint32) buff[1] << 16)
+                    | ((uint32) buff[2] << 8) | (uint32) buff[3]);
+}
+
+void
+mem_write_int32 (void *mem, int32 val)
+{
+    unsigned char *buff = (unsigned char *) mem;
+
+    buff[0] = (val >> 24) & 0xff;
+    buff[1] = (val >> 16) & 0xff;
+    buff[2] = (val >> 8) & 0xff;
+    buff[3] = val & 0xff;
+}
+
+int16
+mem_read_int16 (const void *mem)
+{
+    const unsigned char *buff = (const unsigned char *) mem;
+
+    return (buff[0] << 8) | buff[1];
+}
+
+void
+mem_write_int16 (void *mem, int16 val)
+{
+    unsigned char *buff = (unsigned char *) mem;
+
+    buff[0] = (val >> 8) & 0xff;
+    buff[1] = val & 0xff;
+}
+
+Bool
+file_write_int32_le (FILE *file, int32 val)
+{
+    unsigned char   buff[4];
+
+    buff[0] = val & 0xff;
+    buff[1] = (val >> 8) & 0xff;
+    buff[2] = (val >> 16) & 0xff;
+    buff[3] = (val >> 24) & 0xff;
+
+    return (fwrite (buff, 4, 1, file) == 1);
+}
+
+Bool
+file_write_int64_le (FILE *file, int64 val)
+{
+    return file_write_int32_le (file, (int32) val)
+           && file_write_int32_le (file, (int32) (val >> 32));
+}
+
+/* pad with zero bytes up to the next multiple of align */
+Bool
+file_write_padding (FILE *file, long align)
+{
+    long    pos;
+
+    pos = ftell (file);
+    if (pos < 0)
+        return FALSE;
+
+    for ( ; pos % align != 0; pos++) {
+        if (EOF == fputc (0, file))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+int32
+mem_read_int32_le (const void *mem)
+{
+    const unsigned char *buff = (const unsigned char *) mem;
+
+    return (int32) ((uint32) buff[0] | ((uint32) buff[1] << 8)
+                    | ((uint32) buff[2] << 16) | ((uint32) buff[3] << 24));
+}
+
+int64
+mem_read_int64_le (const void *mem)
+{
+    const unsigned char *buff = (const unsigned char *) mem;
+
+    return (int64) (((uint64) (uint32) mem_read_int32_le (buff + 4) << 32)
+                    | (uint32) mem_read_int32_le (buff));
+}
+
+Bool
+host_is_little_endian ()
+{
+    union {
+        uint32          val;
+        unsigned char   bytes[4];
+    } probe;
+
+    probe.val = 1;
+    return probe.bytes[0] == 1;
+}
+
+/**
+ * @brief Map a whole file read-only into memory
+ *
+ * @param path   : the path to the file
+ * @param o_size : storage for the size of the mapped block
+ *
+ * @return the mapped memory block, NULL on failure
+ *
+ * Map the file at @a path into memory for reading. Where mmap() is
+ * available, the pages are shared with every other process mapping the
+ * same file. Otherwise, the file contents are read into an allocated
+ * block. Either way, the block must be released with file_unmap().
+ */
+void *
+file_map (const char *path, size_t *o_size)
+{
+#ifdef _WIN32
+    FILE   *file;
+    long    size;
+    void   *mem;
+
+    file = fopen (path, "rb");
+    if (!file)
+        return NULL;
+    if (fseek (file, 0, SEEK_END) != 0 || (size = ftell (file)) <= 0)
+        goto exit_file_openned;
+    rewind (file);
+    if (NULL == (mem = malloc (size)))
+        goto exit_file_openned;
+    if (fread (mem, 1, size, file) != (size_t) size) {
+        free (mem);
+        goto exit_file_openned;
+    }
+    fclose (file);
+
+    *o_size = size;
+    return mem;
+
+exit_file_openned:
+    fclose (file);
+    return NULL;
+#else
+    int         fd;
+    struct stat st;
+    void       *mem;
+
+    fd = open (path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat (fd, &st) != 0 || st.st_size <= 0
+        || (unsigned long long) st.st_size > TRIE_SIZE_MAX)
+    {
+        close (fd);
+        return NULL;
+    }
+    mem = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (MAP_FAILED == mem)
+        return NULL;
+
+    *o_size = st.st_size;
+    return mem;
+#endif
+}
+
+void
+file_unmap (void *mem, size_t size)
+{
+#ifdef _WIN32
+    free (mem);
+#else
+    munmap (mem, size);
+#endif
+}
+
 /*
 vi:ts=4:ai:expandtab
 */
@@ -33,6 +33,9 @@
 Bool   file_read_int32 (FILE *file, int32 *o_val);
 Bool   file_write_int32 (FILE *file, int32 val);
 
+Bool   file_read_int64 (FILE *file, int64 *o_val);
+Bool   file_write_int64 (FILE *file, int64 val);
+
 Bool   file_read_int16 (FILE *file, int16 *o_val);
 Bool   file_write_int16 (FILE *file, int16 val);
 
@@ -42,6 +45,30 @@ Bool   file_write_int8 (FILE *file, int8 val);
 Bool   file_read_chars (FILE *file, char *buff, int len);
 Bool   file_write_chars (FILE *file, const char *buff, int len);
 
+Bool   file_read_int32_array (FILE *file, int32 *vals, size_t n);
+Bool   file_write_int32_array (FILE *file, const int32 *vals, size_t n);
+
+Bool   file_read_int64_array (FILE *file, int64 *vals, size_t n);
+Bool   file_write_int64_array (FILE *file, const int64 *vals, size_t n);
+
+int32  mem_read_int32 (const void *mem);
+void   mem_write_int32 (void *mem, int32 val);
+
+int16  mem_read_int16 (const void *mem);
+void   mem_write_int16 (void *mem, int16 val);
+
+Bool   file_write_int32_le (FILE *file, int32 val);
+Bool   file_write_int64_le (FILE *file, int64 val);
+Bool   file_write_padding (FILE *file, long align);
+
+int32  mem_read_int32_le (const void *mem);
+int64  mem_read_int64_le (const void *mem);
+
+Bool   host_is_little_endian ();
+
+void * file_map (const char *path, size_t *o_size);
+void   file_unmap (void *mem, size_t size);
+
 #endif /* __FILEUTILS_H */
 
 /*
@@ -0,0 +1,1312 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * libdatrie - Double-Array Trie Library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * louds.c - Succinct read-only trie in level-order unary degree sequence
+ * Created: 2026-10-18
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "louds.h"
+#include "trie-private.h"
+#include "fileutils.h"
+#include "alpha-map-private.h"
+
+/**
+ * @brief Succinct trie structure
+ *
+ * Nodes are numbered in breadth-first order from the root, 0. The tree bits
+ * are "10" for a virtual parent of the root, then 1^d 0 for each node with
+ * d children. So the children of node x are the run of 1 bits after the
+ * (x+1)-th 0 bit, from position p on, the first of them being node
+ * p - x - 1.
+ * Node x but the root is reached by the x-th label of label_bits. Labels
+ * and data are packed in as few bits as their largest value needs.
+ */
+struct _Louds {
+    AlphaMap       *alpha_map;
+
+    int32           num_nodes;
+    int32           num_keys;
+    int32           label_width;
+    int32           data_min;
+    int32           data_width; /* bits per data, after subtracting data_min */
+
+    const uint64   *tree_bits;
+    const uint32   *tree_ranks;     /* 1 bits before each block */
+    const uint32   *tree_selects;   /* block of every LOUDS_SELECT_STEP-th 0 */
+    const uint64   *label_bits;
+    const uint64   *term_bits;      /* whether a key ends at each node */
+    const uint32   *term_ranks;     /* 1 bits before each block */
+    const uint64   *data_bits;      /* data of each key, by terminal rank */
+
+    Bool            is_owned;   /* whether the arrays are allocated */
+    void           *map_mem;
+    size_t          map_size;
+};
+
+#define LOUDS_SIGNATURE         0xDA100D5A
+#define LOUDS_VERSION           1
+#define LOUDS_ALIGN             64
+
+#define LOUDS_BLOCK_WORDS       8
+#define LOUDS_BLOCK_BITS        (64 * LOUDS_BLOCK_WORDS)
+#define LOUDS_SELECT_STEP       512
+
+#define ALIGN_UP(n,a)           (((n) + (a) - 1) / (a) * (a))
+
+#define LOUDS_NUM_WORDS(bits)   (((bits) + 63) / 64)
+#define LOUDS_NUM_BLOCKS(bits)  (((bits) + LOUDS_BLOCK_BITS - 1) \
+                                 / LOUDS_BLOCK_BITS)
+
+#define LOUDS_TREE_BITS(l)      (2 * (uint64) (l)->num_nodes + 1)
+#define LOUDS_NUM_SELECTS(l)    (((uint64) (l)->num_nodes + 1 \
+                                  + LOUDS_SELECT_STEP - 1) / LOUDS_SELECT_STEP)
+#define LOUDS_LABEL_BITS(l)     ((uint64) (l)->num_nodes * (l)->label_width)
+#define LOUDS_DATA_BITS(l)      ((uint64) (l)->num_keys * (l)->data_width)
+
+#define LOUDS_GET_BIT(bits,i)   (((bits)[(i) >> 6] >> ((i) & 63)) & 1)
+#define LOUDS_SET_BIT(bits,i)   ((bits)[(i) >> 6] |= (uint64) 1 << ((i) & 63))
+
+/* Mapped Louds Header (all values are little-endian):
+ * - INT32: signature
+ * - INT32: format version
+ * - INT32: number of nodes, including root
+ * - INT32: number of keys
+ * - INT32: label width, in bits
+ * - INT32: data minimum
+ * - INT32: data width, in bits
+ *
+ * Sections, each starting at a LOUDS_ALIGN boundary, sized after the
+ * header values:
+ * - AlphaMap, as written by alpha_map_fwrite_mapped()
+ * - UINT64[]: tree bits, bit i of a word being its (1 << i) bit
+ * - UINT32[]: tree bit ranks, one per 512 bits, plus the total
+ * - UINT32[]: tree bit select samples
+ * - UINT64[]: label bits
+ * - UINT64[]: terminal bits
+ * - UINT32[]: terminal bit ranks, one per 512 bits, plus the total
+ * - UINT64[]: data bits
+ */
+#define LOUDS_HEADER_SIZE       28
+
+/*-------------------*
+ *   BIT OPERATIONS  *
+ *-------------------*/
+
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+# define louds_popcount(w)      __builtin_popcountll (w)
+# define louds_ctz(w)           __builtin_ctzll (w)
+#else
+static int
+louds_popcount (uint64 w)
+{
+    w = w - ((w >> 1) & 0x5555555555555555ULL);
+    w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+    w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int) ((w * 0x0101010101010101ULL) >> 56);
+}
+
+static int
+louds_ctz (uint64 w)
+{
+    int n;
+
+    for (n = 0; !(w & 1); n++)
+        w >>= 1;
+    return n;
+}
+#endif
+
+/* position of the k-th 1 bit of w, counting from 1 */
+static int
+louds_select_in_word (uint64 w, int k)
+{
+    int shift, n;
+
+    for (shift = 0; (n = louds_popcount (w & 0xff)) < k; shift += 8) {
+        k -= n;
+        w >>= 8;
+    }
+    while (--k > 0)
+        w &= w - 1;
+
+    return shift + louds_ctz (w);
+}
+
+/* width bits of bits from position pos, width being at most 32 */
+static uint32
+louds_get_bits (const uint64 *bits, uint64 pos, int width)
+{
+    uint64  v;
+    int     off;
+
+    off = pos & 63;
+    v = bits[pos >> 6] >> off;
+    if (off + width > 64)
+        v |= bits[(pos >> 6) + 1] << (64 - off);
+
+    return (uint32) (v & (((uint64) 1 << width) - 1));
+}
+
+static void
+louds_set_bits (uint64 *bits, uint64 pos, int width, uint32 val)
+{
+    int     off;
+
+    off = pos & 63;
+    bits[pos >> 6] |= (uint64) val << off;
+    if (off + width > 64)
+        bits[(pos >> 6) + 1] |= (uint64) val >> (64 - off);
+}
+
+/* number of bits needed for values up to max */
+static int32
+louds_bit_width (uint32 max)
+{
+    int32   width;
+
+    for (width = 0; width < 32 && (max >> width) != 0; width++)
+        ;
+    return width;
+}
+
+/* number of 1 bits before position i */
+static uint32
+louds_rank1 (const uint64 *bits, const uint32 *ranks, uint64 i)
+{
+    uint64  w;
+    uint32  rank;
+
+    rank = ranks[i / LOUDS_BLOCK_BITS];
+    for (w = i / LOUDS_BLOCK_BITS * LOUDS_BLOCK_WORDS; w < (i >> 6); w++)
+        rank += louds_popcount (bits[w]);
+    if (i & 63)
+        rank += louds_popcount (bits[i >> 6] << (64 - (i & 63)));
+
+    return rank;
+}
+
+/* position of the k-th 0 bit of the tree, counting from 1 */
+static uint64
+louds_select0 (const Louds *louds, uint64 k)
+{
+    uint64  b, w, zeros;
+    int     n;
+
+    /* zeros before block b are LOUDS_BLOCK_BITS * b - tree_ranks[b] */
+    b = louds->tree_selects[(k - 1) / LOUDS_SELECT_STEP];
+    while (LOUDS_BLOCK_BITS * (b + 1) - louds->tree_ranks[b + 1] < k)
+        ++b;
+    k -= LOUDS_BLOCK_BITS * b - louds->tree_ranks[b];
+
+    for (w = b * LOUDS_BLOCK_WORDS; ; w++) {
+        zeros = ~louds->tree_bits[w];
+        n = louds_popcount (zeros);
+        if ((uint64) n >= k)
+            break;
+        k -= n;
+    }
+
+    return w * 64 + louds_select_in_word (zeros, (int) k);
+}
+
+/* number of consecutive 1 bits of the tree from position i */
+static int32
+louds_run_length (const Louds *louds, uint64 i)
+{
+    uint64  w;
+    int32   len;
+    int     n;
+
+    for (len = 0; ; len += n, i += n) {
+        w = ~(louds->tree_bits[i >> 6] >> (i & 63));
+        n = w ? louds_ctz (w) : 64;
+        if ((uint64) n < 64 - (i & 63))
+            return len + n;
+    }
+}
+
+static void
+louds_build_ranks (const uint64 *bits, uint64 num_bits, uint32 *ranks)
+{
+    uint64  num_words, b, w;
+    uint32  ones;
+
+    num_words = LOUDS_NUM_WORDS (num_bits);
+    ones = 0;
+    for (b = 0; b < LOUDS_NUM_BLOCKS (num_bits); b++) {
+        ranks[b] = ones;
+        for (w = b * LOUDS_BLOCK_WORDS;
+             w < (b + 1) * LOUDS_BLOCK_WORDS && w < num_words;
+             w++)
+        {
+            ones += louds_popcount (bits[w]);
+        }
+    }
+    ranks[b] = ones;
+}
+
+static void
+louds_build_selects (const Louds *louds, uint32 *selects)
+{
+    uint64  s, b;
+
+    b = 0;
+    for (s = 0; s < LOUDS_NUM_SELECTS (louds); s++) {
+        while (LOUDS_BLOCK_BITS * (b + 1) - louds->tree_ranks[b + 1]
+               < s * LOUDS_SELECT_STEP + 1)
+        {
+            ++b;
+        }
+        selects[s] = (uint32) b;
+    }
+}
+
+/*-----------------*
+ *   NAVIGATION    *
+ *-----------------*/
+
+/* first child of node x, with their number in o_num_children */
+static int32
+louds_first_child (const Louds *louds, int32 x, int32 *o_num_children)
+{
+    uint64  pos;
+
+    pos = louds_select0 (louds, (uint64) x + 1) + 1;
+    *o_num_children = louds_run_length (louds, pos);
+    return (int32) (pos - x - 1);
+}
+
+static TrieChar
+louds_get_label (const Louds *louds, int32 x)
+{
+    return (TrieChar) louds_get_bits (louds->label_bits,
+                                      (uint64) x * louds->label_width,
+                                      louds->label_width);
+}
+
+/* child of node x by label c, or -1 */
+static int32
+louds_child (const Louds *louds, int32 x, TrieChar c)
+{
+    int32       first, n, y;
+    TrieChar    label;
+
+    first = louds_first_child (louds, x, &n);
+
+    /* labels of siblings are sorted */
+    for (y = first; y < first + n; y++) {
+        label = louds_get_label (louds, y);
+        if (label >= c)
+            return (label == c) ? y : -1;
+    }
+
+    return -1;
+}
+
+static Bool
+louds_is_terminal (const Louds *louds, int32 x)
+{
+    return LOUDS_GET_BIT (louds->term_bits, (uint64) x);
+}
+
+/* data of the key ending at terminal node x */
+static TrieData
+louds_get_data (const Louds *louds, int32 x)
+{
+    uint32  v;
+
+    if (0 == louds->data_width)
+        return louds->data_min;
+
+    v = louds_get_bits (louds->data_bits,
+                        (uint64) louds_rank1 (louds->term_bits,
+                                              louds->term_ranks, x)
+                        * louds->data_width,
+                        louds->data_width);
+    return (TrieData) ((uint32) louds->data_min + v);
+}
+
+/* trie character for ac, or FALSE if it is not in the alphabet */
+static Bool
+louds_char_to_trie (const Louds *louds, AlphaChar ac, TrieChar *o_tc)
+{
+    TrieChar    tc;
+
+    tc = alpha_map_char_to_trie (louds->alpha_map, ac);
+    if (TRIE_CHAR_MAX == tc
+        && alpha_map_trie_to_char (louds->alpha_map, tc) != ac)
+    {
+        return FALSE;
+    }
+
+    *o_tc = tc;
+    return TRUE;
+}
+
+/*----------------------*
+ *   BUILDING SUPPORT   *
+ *----------------------*/
+
+/* keys of the trie in trie order, in TrieChar, one after another */
+typedef struct {
+    TrieChar   *chars;
+    size_t      num_chars;
+    size_t      alloc_chars;
+    size_t     *starts;     /* start of each key, then the end of the last */
+    TrieData   *data;
+    int32       num_keys;
+    int32       alloc_keys;
+    int32       num_nodes;  /* distinct prefixes, including the empty one */
+} LoudsKeys;
+
+static Bool
+louds_keys_add (LoudsKeys       *keys,
+                const AlphaMap  *alpha_map,
+                const AlphaChar *key,
+                TrieData         data)
+{
+    const TrieChar *prev;
+    size_t          start, len, prev_len, cp, i;
+
+    len = alpha_char_strlen (key);
+    if (keys->num_chars + len > keys->alloc_chars) {
+        TrieChar   *new_chars;
+        size_t      new_size = keys->alloc_chars;
+
+        while (keys->num_chars + len > new_size)
+            new_size *= 2;
+        new_chars = (TrieChar *) realloc (keys->chars, new_size);
+        if (!new_chars)
+            return FALSE;
+        keys->chars = new_chars;
+        keys->alloc_chars = new_size;
+    }
+    if (keys->num_keys + 1 >= keys->alloc_keys) {
+        int32       new_size = keys->alloc_keys * 2;
+        size_t     *new_starts;
+        TrieData   *new_data;
+
+        new_starts = (size_t *) realloc (keys->starts,
+                                         new_size * sizeof (size_t));
+        if (!new_starts)
+            return FALSE;
+        keys->starts = new_starts;
+        new_data = (TrieData *) realloc (keys->data,
+                                         new_size * sizeof (TrieData));
+        if (!new_data)
+            return FALSE;
+        keys->data = new_data;
+        keys->alloc_keys = new_size;
+    }
+
+    start = keys->num_chars;
+    for (i = 0; i < len; i++)
+        keys->chars[start + i] = alpha_map_char_to_trie (alpha_map, key[i]);
+
+    /* each character past the prefix shared with the previous key is a
+     * new node */
+    cp = 0;
+    if (keys->num_keys > 0) {
+        prev = keys->chars + keys->starts[keys->num_keys - 1];
+        prev_len = start - keys->starts[keys->num_keys - 1];
+        while (cp < len && cp < prev_len && keys->chars[start + cp] == prev[cp])
+            ++cp;
+    }
+    keys->num_nodes += len - cp;
+
+    keys->data[keys->num_keys] = data;
+    keys->starts[keys->num_keys++] = start;
+    keys->starts[keys->num_keys] = start + len;
+    keys->num_chars += len;
+
+    return TRUE;
+}
+
+static void
+louds_free_arrays (Louds *louds)
+{
+    free ((void *) louds->tree_bits);
+    free ((void *) louds->tree_ranks);
+    free ((void *) louds->tree_selects);
+    free ((void *) louds->label_bits);
+    free ((void *) louds->term_bits);
+    free ((void *) louds->term_ranks);
+    free ((void *) louds->data_bits);
+}
+
+/* node ranges of keys, for the breadth-first building */
+typedef struct {
+    int32   lo;
+    int32   hi;
+} LoudsRange;
+
+/* lay the nodes out, level by level; each node of a level is the range of
+ * keys sharing its prefix, and its children split the range further
+ */
+static Bool
+louds_build_tree (Louds           *louds,
+                  const LoudsKeys *keys,
+                  uint64          *tree_bits,
+                  TrieChar        *labels,
+                  uint64          *term_bits,
+                  TrieData        *term_data)
+{
+    LoudsRange *cur, *next, *tmp;
+    int32       n_cur, n_next, i, lo, hi, j, x, child, n_term;
+    size_t      depth;
+    uint64      pos;
+    TrieChar    c;
+
+    cur  = (LoudsRange *) malloc ((keys->num_keys + 1) * sizeof (LoudsRange));
+    next = (LoudsRange *) malloc ((keys->num_keys + 1) * sizeof (LoudsRange));
+    if (!cur || !next) {
+        free (cur);
+        free (next);
+        return FALSE;
+    }
+
+    /* the virtual parent of the root */
+    LOUDS_SET_BIT (tree_bits, 0);
+    pos = 2;
+
+    cur[0].lo = 0;
+    cur[0].hi = keys->num_keys;
+    n_cur = 1;
+    x = 0;
+    child = 1;
+    n_term = 0;
+    labels[0] = 0;
+    for (depth = 0; n_cur > 0; depth++) {
+        n_next = 0;
+        for (i = 0; i < n_cur; i++, x++) {
+            lo = cur[i].lo;
+            hi = cur[i].hi;
+
+            /* a key ending here comes first in its range */
+            if (lo < hi && keys->starts[lo] + depth == keys->starts[lo + 1]) {
+                LOUDS_SET_BIT (term_bits, (uint64) x);
+                term_data[n_term++] = keys->data[lo];
+                ++lo;
+            }
+            while (lo < hi) {
+                c = keys->chars[keys->starts[lo] + depth];
+                for (j = lo + 1;
+                     j < hi && keys->chars[keys->starts[j] + depth] == c;
+                     j++)
+                {
+                    ;
+                }
+                labels[child++] = c;
+                LOUDS_SET_BIT (tree_bits, pos);
+                ++pos;
+                next[n_next].lo = lo;
+                next[n_next].hi = j;
+                ++n_next;
+                lo = j;
+            }
+            ++pos;
+        }
+        tmp = cur;
+        cur = next;
+        next = tmp;
+        n_cur = n_next;
+    }
+
+    free (cur);
+    free (next);
+    return TRUE;
+}
+
+/*-----------------------*
+ *   GENERAL FUNCTIONS   *
+ *-----------------------*/
+
+/**
+ * @brief Build a succinct trie of trie keys
+ *
+ * @param trie : the trie
+ *
+ * @return a newly created succinct trie, or NULL on failure
+ *
+ * Build the succinct trie of the keys of @a trie, keeping their data.
+ * The succinct trie is independent of @a trie afterwards.
+ *
+ * The created object must be freed with louds_free().
+ *
+ * Available since: 0.2.5
+ */
+Louds *
+louds_new_from_trie (const Trie *trie)
+{
+    const AlphaMap *alpha_map = trie_get_alpha_map (trie);
+    LoudsKeys       keys;
+    TrieIterator   *iter;
+    TrieState       root;
+    Louds          *louds = NULL;
+    uint64         *tree_bits, *term_bits, *data_bits;
+    uint32         *tree_ranks, *tree_selects, *term_ranks;
+    uint64         *label_bits;
+    TrieChar       *labels;
+    TrieData       *term_data;
+    uint32          max;
+    int32           i;
+
+    keys.alloc_chars = 1024;
+    keys.chars = (TrieChar *) malloc (keys.alloc_chars);
+    keys.num_chars = 0;
+    keys.alloc_keys = 256;
+    keys.starts = (size_t *) malloc (keys.alloc_keys * sizeof (size_t));
+    keys.data = (TrieData *) malloc (keys.alloc_keys * sizeof (TrieData));
+    keys.num_keys = 0;
+    keys.num_nodes = 1;
+    if (!keys.chars || !keys.starts || !keys.data)
+        goto exit_keys_allocated;
+    keys.starts[0] = 0;
+
+    trie_state_init (&root, trie);
+    iter = trie_iterator_new (&root);
+    if (!iter)
+        goto exit_keys_allocated;
+    while (trie_iterator_next (iter)) {
+        if (!louds_keys_add (&keys, alpha_map, trie_iterator_get_key (iter),
+                             trie_iterator_get_data (iter)))
+        {
+            trie_iterator_free (iter);
+            goto exit_keys_allocated;
+        }
+    }
+    trie_iterator_free (iter);
+
+    louds = (Louds *) calloc (1, sizeof (Louds));
+    if (!louds)
+        goto exit_keys_allocated;
+    louds->num_nodes = keys.num_nodes;
+    louds->num_keys  = keys.num_keys;
+    louds->is_owned  = TRUE;
+
+    /* labels and data in as few bits as their ranges need */
+    max = 0;
+    for (i = 0; (size_t) i < keys.num_chars; i++) {
+        if (keys.chars[i] > max)
+            max = keys.chars[i];
+    }
+    louds->label_width = louds_bit_width (max);
+    louds->data_min = keys.num_keys > 0 ? keys.data[0] : 0;
+    for (i = 1; i < keys.num_keys; i++) {
+        if (keys.data[i] < louds->data_min)
+            louds->data_min = keys.data[i];
+    }
+    max = 0;
+    for (i = 0; i < keys.num_keys; i++) {
+        if ((uint32) keys.data[i] - (uint32) louds->data_min > max)
+            max = (uint32) keys.data[i] - (uint32) louds->data_min;
+    }
+    louds->data_width = louds_bit_width (max);
+
+    louds->tree_bits = tree_bits
+        = (uint64 *) calloc (LOUDS_NUM_WORDS (LOUDS_TREE_BITS (louds)), 8);
+    louds->tree_ranks = tree_ranks
+        = (uint32 *) malloc ((LOUDS_NUM_BLOCKS (LOUDS_TREE_BITS (louds)) + 1)
+                             * sizeof (uint32));
+    louds->tree_selects = tree_selects
+        = (uint32 *) malloc (LOUDS_NUM_SELECTS (louds) * sizeof (uint32));
+    louds->label_bits = label_bits
+        = (uint64 *) calloc (LOUDS_NUM_WORDS (LOUDS_LABEL_BITS (louds)) + 1, 8);
+    louds->term_bits = term_bits
+        = (uint64 *) calloc (LOUDS_NUM_WORDS (louds->num_nodes), 8);
+    louds->term_ranks = term_ranks
+        = (uint32 *) malloc ((LOUDS_NUM_BLOCKS (louds->num_nodes) + 1)
+                             * sizeof (uint32));
+    louds->data_bits = data_bits
+        = (uint64 *) calloc (LOUDS_NUM_WORDS (LOUDS_DATA_BITS (louds)) + 1, 8);
+    labels = (TrieChar *) malloc (louds->num_nodes);
+    term_data = (TrieData *) malloc ((keys.num_keys + 1) * sizeof (TrieData));
+    if (!tree_bits || !tree_ranks || !tree_selects || !label_bits
+        || !term_bits || !term_ranks || !data_bits || !labels || !term_data)
+    {
+        goto exit_louds_created;
+    }
+
+    if (!louds_build_tree (louds, &keys, tree_bits, labels, term_bits,
+                           term_data))
+    {
+        goto exit_louds_created;
+    }
+    louds_build_ranks (tree_bits, LOUDS_TREE_BITS (louds), tree_ranks);
+    louds_build_selects (louds, tree_selects);
+    louds_build_ranks (term_bits, louds->num_nodes, term_ranks);
+    for (i = 0; i < louds->num_nodes; i++) {
+        louds_set_bits (label_bits, (uint64) i * louds->label_width,
+                        louds->label_width, labels[i]);
+    }
+    for (i = 0; i < louds->num_keys; i++) {
+        louds_set_bits (data_bits, (uint64) i * louds->data_width,
+                        louds->data_width,
+                        (uint32) term_data[i] - (uint32) louds->data_min);
+    }
+
+    louds->alpha_map = alpha_map_clone (alpha_map);
+    if (!louds->alpha_map)
+        goto exit_louds_created;
+
+    free (term_data);
+    free (labels);
+    goto exit_keys_allocated;
+
+exit_louds_created:
+    free (term_data);
+    free (labels);
+    louds_free_arrays (louds);
+    free (louds);
+    louds = NULL;
+exit_keys_allocated:
+    free (keys.data);
+    free (keys.starts);
+    free (keys.chars);
+    return louds;
+}
+
+/* get n elements of elem_size bytes at *pos in the mapped file, moving *pos
+ * to the next section; in place on little-endian hosts, or else converted
+ * into allocated memory
+ */
+static const void *
+louds_map_array (const unsigned char   *mem,
+                 size_t                 size,
+                 size_t                *pos,
+                 uint64                 n,
+                 int                    elem_size)
+{
+    const unsigned char *p;
+    unsigned char       *arr;
+    uint64               i;
+
+    *pos = ALIGN_UP (*pos, LOUDS_ALIGN);
+    if (*pos > size || (size - *pos) / elem_size < n)
+        return NULL;
+    p = mem + *pos;
+    *pos += n * elem_size;
+
+    if (host_is_little_endian ())
+        return p;
+
+    arr = (unsigned char *) malloc (n > 0 ? n * elem_size : 1);
+    if (!arr)
+        return NULL;
+    for (i = 0; i < n; i++, p += elem_size) {
+        if (4 == elem_size)
+            ((uint32 *) arr)[i] = (uint32) mem_read_int32_le (p);
+        else
+            ((uint64 *) arr)[i] = (uint64) mem_read_int64_le (p);
+    }
+    return arr;
+}
+
+/**
+ * @brief Open a succinct trie file by memory mapping
+ *
+ * @param path : the path to the file, as written by louds_save()
+ *
+ * @return the succinct trie, or NULL on failure
+ *
+ * Map the succinct trie file at @a path into memory and use it in place,
+ * as trie_new_mapped() does for trie files, so that processes opening the
+ * same file share its memory.
+ *
+ * The created object must be freed with louds_free().
+ *
+ * Available since: 0.2.5
+ */
+Louds *
+louds_new_mapped (const char *path)
+{
+    Louds          *louds;
+    unsigned char  *mem;
+    size_t          size, pos, len;
+    uint64          tree_bits;
+
+    mem = (unsigned char *) file_map (path, &size);
+    if (!mem)
+        return NULL;
+
+    if (size < LOUDS_HEADER_SIZE
+        || LOUDS_SIGNATURE != (uint32) mem_read_int32_le (mem)
+        || LOUDS_VERSION != mem_read_int32_le (mem + 4))
+    {
+        goto exit_file_mapped;
+    }
+
+    louds = (Louds *) calloc (1, sizeof (Louds));
+    if (!louds)
+        goto exit_file_mapped;
+    louds->num_nodes   = mem_read_int32_le (mem + 8);
+    louds->num_keys    = mem_read_int32_le (mem + 12);
+    louds->label_width = mem_read_int32_le (mem + 16);
+    louds->data_min    = mem_read_int32_le (mem + 20);
+    louds->data_width  = mem_read_int32_le (mem + 24);
+    if (louds->num_nodes <= 0 || louds->num_keys < 0
+        || louds->num_keys > louds->num_nodes
+        || louds->label_width < 0 || louds->label_width > 8
+        || louds->data_width < 0 || louds->data_width > 32)
+    {
+        goto exit_louds_created;
+    }
+    louds->is_owned = !host_is_little_endian ();
+
+    pos = ALIGN_UP (LOUDS_HEADER_SIZE, LOUDS_ALIGN);
+    if (pos > size ||
+        NULL == (louds->alpha_map = alpha_map_new_mapped (mem + pos,
+                                                          size - pos, &len)))
+    {
+        goto exit_louds_created;
+    }
+    pos += len;
+
+    tree_bits = LOUDS_TREE_BITS (louds);
+    louds->tree_bits = (const uint64 *)
+        louds_map_array (mem, size, &pos, LOUDS_NUM_WORDS (tree_bits), 8);
+    if (!louds->tree_bits)
+        goto exit_arrays_mapped;
+    louds->tree_ranks = (const uint32 *)
+        louds_map_array (mem, size, &pos, LOUDS_NUM_BLOCKS (tree_bits) + 1, 4);
+    if (!louds->tree_ranks)
+        goto exit_arrays_mapped;
+    louds->tree_selects = (const uint32 *)
+        louds_map_array (mem, size, &pos, LOUDS_NUM_SELECTS (louds), 4);
+    if (!louds->tree_selects)
+        goto exit_arrays_mapped;
+    louds->label_bits = (const uint64 *)
+        louds_map_array (mem, size, &pos,
+                         LOUDS_NUM_WORDS (LOUDS_LABEL_BITS (louds)) + 1, 8);
+    if (!louds->label_bits)
+        goto exit_arrays_mapped;
+    louds->term_bits = (const uint64 *)
+        louds_map_array (mem, size, &pos, LOUDS_NUM_WORDS (louds->num_nodes),
+                         8);
+    if (!louds->term_bits)
+        goto exit_arrays_mapped;
+    louds->term_ranks = (const uint32 *)
+        louds_map_array (mem, size, &pos,
+                         LOUDS_NUM_BLOCKS (louds->num_nodes) + 1, 4);
+    if (!louds->term_ranks)
+        goto exit_arrays_mapped;
+    louds->data_bits = (const uint64 *)
+        louds_map_array (mem, size, &pos,
+                         LOUDS_NUM_WORDS (LOUDS_DATA_BITS (louds)) + 1, 8);
+    if (!louds->data_bits)
+        goto exit_arrays_mapped;
+
+    /* the directories must agree with the counts */
+    if (louds->tree_ranks[LOUDS_NUM_BLOCKS (tree_bits)]
+            != (uint32) louds->num_nodes
+        || louds->term_ranks[LOUDS_NUM_BLOCKS (louds->num_nodes)]
+            != (uint32) louds->num_keys)
+    {
+        goto exit_arrays_mapped;
+    }
+
+    louds->map_mem  = mem;
+    louds->map_size = size;
+    return louds;
+
+exit_arrays_mapped:
+    if (louds->is_owned)
+        louds_free_arrays (louds);
+    alpha_map_free (louds->alpha_map);
+exit_louds_created:
+    free (louds);
+exit_file_mapped:
+    file_unmap (mem, size);
+    return NULL;
+}
+
+/**
+ * @brief Free a succinct trie
+ *
+ * @param louds : the succinct trie
+ *
+ * Available since: 0.2.5
+ */
+void
+louds_free (Louds *louds)
+{
+    if (louds->is_owned)
+        louds_free_arrays (louds);
+    if (louds->map_mem)
+        file_unmap (louds->map_mem, louds->map_size);
+    if (louds->alpha_map)
+        alpha_map_free (louds->alpha_map);
+    free (louds);
+}
+
+static Bool
+louds_write_array (FILE *file, const void *arr, uint64 n, int elem_size)
+{
+    uint64  i;
+
+    if (!file_write_padding (file, LOUDS_ALIGN))
+        return FALSE;
+
+    if (host_is_little_endian ())
+        return fwrite (arr, elem_size, n, file) == n;
+
+    for (i = 0; i < n; i++) {
+        if (4 == elem_size) {
+            if (!file_write_int32_le (file, ((const int32 *) arr)[i]))
+                return FALSE;
+        } else {
+            if (!file_write_int64_le (file, ((const int64 *) arr)[i]))
+                return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * @brief Save a succinct trie to file
+ *
+ * @param louds : the succinct trie
+ * @param path  : the path to the file
+ *
+ * @return 0 on success, non-zero on failure
+ *
+ * Create a new file at the given @a path and write @a louds to it, to be
+ * opened with louds_new_mapped(). If @a path already exists, its contents
+ * will be replaced.
+ *
+ * Available since: 0.2.5
+ */
+int
+louds_save (const Louds *louds, const char *path)
+{
+    FILE   *file;
+    uint64  tree_bits;
+    int     res = -1;
+
+    file = fopen (path, "w+");
+    if (!file)
+        return -1;
+
+    if (!file_write_int32_le (file, LOUDS_SIGNATURE) ||
+        !file_write_int32_le (file, LOUDS_VERSION)   ||
+        !file_write_int32_le (file, louds->num_nodes) ||
+        !file_write_int32_le (file, louds->num_keys) ||
+        !file_write_int32_le (file, louds->label_width) ||
+        !file_write_int32_le (file, louds->data_min) ||
+        !file_write_int32_le (file, louds->data_width))
+    {
+        goto exit_file_openned;
+    }
+
+    if (!file_write_padding (file, LOUDS_ALIGN) ||
+        alpha_map_fwrite_mapped (louds->alpha_map, file) != 0)
+    {
+        goto exit_file_openned;
+    }
+
+    tree_bits = LOUDS_TREE_BITS (louds);
+    if (!louds_write_array (file, louds->tree_bits,
+                            LOUDS_NUM_WORDS (tree_bits), 8) ||
+        !louds_write_array (file, louds->tree_ranks,
+                            LOUDS_NUM_BLOCKS (tree_bits) + 1, 4) ||
+        !louds_write_array (file, louds->tree_selects,
+                            LOUDS_NUM_SELECTS (louds), 4) ||
+        !louds_write_array (file, louds->label_bits,
+                            LOUDS_NUM_WORDS (LOUDS_LABEL_BITS (louds)) + 1, 8) ||
+        !louds_write_array (file, louds->term_bits,
+                            LOUDS_NUM_WORDS (louds->num_nodes), 8) ||
+        !louds_write_array (file, louds->term_ranks,
+                            LOUDS_NUM_BLOCKS (louds->num_nodes) + 1, 4) ||
+        !louds_write_array (file, louds->data_bits,
+                            LOUDS_NUM_WORDS (LOUDS_DATA_BITS (louds)) + 1, 8))
+    {
+        goto exit_file_openned;
+    }
+    res = 0;
+
+exit_file_openned:
+    if (fclose (file) != 0)
+        res = -1;
+    return res;
+}
+
+/**
+ * @brief Get the number of keys
+ *
+ * @param louds : the succinct trie
+ *
+ * @return the number of keys in @a louds
+ *
+ * Available since: 0.2.5
+ */
+int
+louds_get_num_keys (const Louds *louds)
+{
+    return louds->num_keys;
+}
+
+/**
+ * @brief Get memory usage
+ *
+ * @param louds : the succinct trie
+ *
+ * @return the size of the succinct trie tables, in bytes
+ *
+ * For a mapped succinct trie, this is the size of the tables in the file,
+ * shared with other processes mapping it.
+ *
+ * Available since: 0.2.5
+ */
+size_t
+louds_get_mem_size (const Louds *louds)
+{
+    uint64  tree_bits = LOUDS_TREE_BITS (louds);
+
+    return sizeof (Louds)
+           + LOUDS_NUM_WORDS (tree_bits) * 8
+           + (LOUDS_NUM_BLOCKS (tree_bits) + 1) * sizeof (uint32)
+           + LOUDS_NUM_SELECTS (louds) * sizeof (uint32)
+           + (LOUDS_NUM_WORDS (LOUDS_LABEL_BITS (louds)) + 1) * 8
+           + LOUDS_NUM_WORDS (louds->num_nodes) * 8
+           + (LOUDS_NUM_BLOCKS (louds->num_nodes) + 1) * sizeof (uint32)
+           + (LOUDS_NUM_WORDS (LOUDS_DATA_BITS (louds)) + 1) * 8;
+}
+
+
+/*------------------------------*
+ *   GENERAL QUERY OPERATIONS   *
+ *------------------------------*/
+
+/* node reached by walking key from the root, or -1 */
+static int32
+louds_walk (const Louds *louds, const AlphaChar *key)
+{
+    TrieChar    tc;
+    int32       x;
+
+    for (x = 0; *key; key++) {
+        if (!louds_char_to_trie (louds, *key, &tc))
+            return -1;
+        x = louds_child (louds, x, tc);
+        if (x < 0)
+            return -1;
+    }
+
+    return x;
+}
+
+/**
+ * @brief Retrieve an entry from succinct trie
+ *
+ * @param louds  : the succinct trie
+ * @param key    : the key for the entry to retrieve
+ * @param o_data : the storage for storing the entry data on return
+ *
+ * @return boolean value indicating the existence of the entry.
+ *
+ * Retrieve an entry for the given @a key from @a louds, as trie_retrieve()
+ * does for a trie. On return, if @a key is found and @a o_data is not
+ * NULL, @a *o_data is set to the data associated to @a key.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+louds_retrieve (const Louds *louds, const AlphaChar *key, TrieData *o_data)
+{
+    int32   x;
+
+    x = louds_walk (louds, key);
+    if (x < 0 || !louds_is_terminal (louds, x))
+        return FALSE;
+
+    if (o_data)
+        *o_data = louds_get_data (louds, x);
+    return TRUE;
+}
+
+/* state of louds_enumerate_prefix(): the key walked so far, and for each
+ * node on the path, the next child to visit and the end of its children
+ */
+typedef struct {
+    const Louds    *louds;
+    AlphaChar      *key;
+    int32          *next;
+    int32          *end;
+    int             size;
+    TrieEnumFunc    enum_func;
+    void           *user_data;
+} LoudsEnum;
+
+/* make room for a path of depth + 1 nodes, plus the key terminator */
+static Bool
+louds_enum_grow (LoudsEnum *e, int depth)
+{
+    AlphaChar  *new_key;
+    int32      *new_next, *new_end;
+    int         new_size;
+
+    if (depth + 1 < e->size)
+        return TRUE;
+
+    new_size = e->size * 2;
+    new_key = (AlphaChar *) realloc (e->key, new_size * sizeof (AlphaChar));
+    if (!new_key)
+        return FALSE;
+    e->key = new_key;
+    new_next = (int32 *) realloc (e->next, new_size * sizeof (int32));
+    if (!new_next)
+        return FALSE;
+    e->next = new_next;
+    new_end = (int32 *) realloc (e->end, new_size * sizeof (int32));
+    if (!new_end)
+        return FALSE;
+    e->end = new_end;
+    e->size = new_size;
+    return TRUE;
+}
+
+/* report the keys under node x, whose key so far is len characters long;
+ * the path is kept in e rather than on the call stack, so that keys of
+ * any length can be enumerated
+ */
+static Bool
+louds_enumerate_node (LoudsEnum *e, int32 x, int len)
+{
+    int32   first, n;
+    int     depth;
+
+    depth = len;
+    for (;;) {
+        if (louds_is_terminal (e->louds, x)) {
+            e->key[depth] = 0;
+            if (!(*e->enum_func) (e->key, louds_get_data (e->louds, x),
+                                  e->user_data))
+            {
+                return FALSE;
+            }
+        }
+
+        first = louds_first_child (e->louds, x, &n);
+        if (n > 0) {
+            if (!louds_enum_grow (e, depth))
+                return FALSE;
+            e->next[depth] = first;
+            e->end[depth]  = first + n;
+        } else {
+            /* climb up to the nearest node with a next child */
+            for (;;) {
+                if (depth == len)
+                    return TRUE;
+                --depth;
+                if (e->next[depth] < e->end[depth])
+                    break;
+            }
+        }
+
+        x = e->next[depth]++;
+        e->key[depth] = alpha_map_trie_to_char (e->louds->alpha_map,
+                                                louds_get_label (e->louds, x));
+        ++depth;
+    }
+}
+
+/**
+ * @brief Enumerate entries with a prefix
+ *
+ * @param louds     : the succinct trie
+ * @param prefix    : the prefix of the keys to enumerate
+ * @param enum_func : the callback function to be called on each key
+ * @param user_data : user-supplied data to send as an argument to
+ *                    @a enum_func
+ *
+ * @return boolean value indicating whether all the keys are visited
+ *
+ * Enumerate the entries of @a louds whose keys begin with @a prefix, in
+ * lexicographic order, as trie_enumerate() does for the whole trie. An
+ * empty @a prefix enumerates all entries. The keys passed to @a enum_func
+ * are whole keys, prefix included. Returning FALSE from @a enum_func stops
+ * the enumeration and returns FALSE.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+louds_enumerate_prefix (const Louds     *louds,
+                        const AlphaChar *prefix,
+                        TrieEnumFunc     enum_func,
+                        void            *user_data)
+{
+    LoudsEnum   e;
+    int32       x;
+    int         len;
+    Bool        ret;
+
+    x = louds_walk (louds, prefix);
+    if (x < 0)
+        return TRUE;
+
+    len = alpha_char_strlen (prefix);
+    e.louds     = louds;
+    e.size      = 64;
+    while (e.size <= len)
+        e.size *= 2;
+    e.key       = (AlphaChar *) malloc (e.size * sizeof (AlphaChar));
+    e.next      = (int32 *) malloc (e.size * sizeof (int32));
+    e.end       = (int32 *) malloc (e.size * sizeof (int32));
+    e.enum_func = enum_func;
+    e.user_data = user_data;
+    if (!e.key || !e.next || !e.end) {
+        ret = FALSE;
+        goto exit_enum_created;
+    }
+    memcpy (e.key, prefix, len * sizeof (AlphaChar));
+
+    ret = louds_enumerate_node (&e, x, len);
+
+exit_enum_created:
+    free (e.end);
+    free (e.next);
+    free (e.key);
+    return ret;
+}
+
+
+/*-----------------------*
+ *   PREFIX MATCHING     *
+ *-----------------------*/
+
+/* walk the text from node *x by one character, if not at its end */
+static Bool
+louds_prefix_walk_next (const Louds      *louds,
+                        const AlphaChar  *text,
+                        int               len,
+                        int               i,
+                        int32            *x)
+{
+    TrieChar    tc;
+
+    if (i >= len || !text[i] || !louds_char_to_trie (louds, text[i], &tc))
+        return FALSE;
+
+    *x = louds_child (louds, *x, tc);
+    return *x >= 0;
+}
+
+/**
+ * @brief Find the longest key which is a prefix of a text
+ *
+ * @param louds       : the succinct trie
+ * @param text        : the text
+ * @param len         : the length of @a text
+ * @param o_match_len : the storage for the length of the key found
+ * @param o_data      : the storage for the data of the key found
+ *
+ * @return boolean value indicating whether a key was found
+ *
+ * Find the longest key in @a louds matching the beginning of @a text, which
+ * ends after @a len characters or at a 0 character, whichever comes first,
+ * as trie_longest_prefix() does for a trie.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+louds_longest_prefix (const Louds      *louds,
+                      const AlphaChar  *text,
+                      int               len,
+                      int              *o_match_len,
+                      TrieData         *o_data)
+{
+    int32   x, match;
+    int     i, match_len;
+
+    match = -1;
+    match_len = 0;
+    x = 0;
+    for (i = 0; ; i++) {
+        if (louds_is_terminal (louds, x)) {
+            match = x;
+            match_len = i;
+        }
+        if (!louds_prefix_walk_next (louds, text, len, i, &x))
+            break;
+    }
+
+    if (match < 0)
+        return FALSE;
+    if (o_match_len)
+        *o_match_len = match_len;
+    if (o_data)
+        *o_data = louds_get_data (louds, match);
+    return TRUE;
+}
+
+/**
+ * @brief Find all keys which are prefixes of a text
+ *
+ * @param louds       : the succinct trie
+ * @param text        : the text
+ * @param len         : the length of @a text
+ * @param matches     : the array for storing the matches
+ * @param max_matches : the size of @a matches
+ *
+ * @return the number of keys found
+ *
+ * Find all keys in @a louds matching the beginning of @a text, which ends
+ * after @a len characters or at a 0 character, whichever comes first, as
+ * trie_common_prefix_search() does for a trie. The matches are stored in
+ * @a matches, from the shortest key on, with their pos set to 0. At most
+ * @a max_matches are stored, but all keys are counted, so a return value
+ * greater than @a max_matches tells that @a matches was too short.
+ *
+ * Available since: 0.2.5
+ */
+int
+louds_common_prefix_search (const Louds      *louds,
+                            const AlphaChar  *text,
+                            int               len,
+                            TrieMatch         matches[],
+                            int               max_matches)
+{
+    int32   x;
+    int     i, n_matches;
+
+    n_matches = 0;
+    x = 0;
+    for (i = 0; ; i++) {
+        if (louds_is_terminal (louds, x)) {
+            if (n_matches < max_matches) {
+                matches[n_matches].pos  = 0;
+                matches[n_matches].len  = i;
+                matches[n_matches].data = louds_get_data (louds, x);
+            }
+            ++n_matches;
+        }
+        if (!louds_prefix_walk_next (louds, text, len, i, &x))
+            break;
+    }
+
+    return n_matches;
+}
+
+/*
+vi:ts=4:ai:expandtab
+*/
@@ -0,0 +1,110 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * libdatrie - Double-Array Trie Library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * louds.h - Succinct read-only trie in level-order unary degree sequence
+ * Created: 2026-10-18
+ */
+
+#ifndef __LOUDS_H
+#define __LOUDS_H
+
+#include <datrie/triedefs.h>
+#include <datrie/alpha-map.h>
+#include <datrie/trie.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file louds.h
+ * @brief Succinct read-only trie
+ *
+ * A Louds holds the keys of a trie in a succinct tree: the shape of the
+ * trie is a bit vector in which each node, in breadth-first order, is
+ * written as one 1 bit per child followed by a 0 bit, with the child
+ * labels alongside. Rank and select directories over the bits lead from
+ * a node to its children, so the trie shape takes less than 3 bits per
+ * node, to which the labels and the data of the keys add as few bits as
+ * their ranges need. It is much smaller than the trie, but cannot be
+ * modified, and lookups are slower.
+ */
+
+/**
+ * @brief Succinct trie data type
+ */
+typedef struct _Louds   Louds;
+
+/*-----------------------*
+ *   GENERAL FUNCTIONS   *
+ *-----------------------*/
+
+Louds * louds_new_from_trie (const Trie *trie);
+
+Louds * louds_new_mapped (const char *path);
+
+void    louds_free (Louds *louds);
+
+int     louds_save (const Louds *louds, const char *path);
+
+int     louds_get_num_keys (const Louds *louds);
+
+size_t  louds_get_mem_size (const Louds *louds);
+
+
+/*------------------------------*
+ *   GENERAL QUERY OPERATIONS   *
+ *------------------------------*/
+
+Bool    louds_retrieve (const Louds     *louds,
+                        const AlphaChar *key,
+                        TrieData        *o_data);
+
+Bool    louds_enumerate_prefix (const Louds     *louds,
+                                const AlphaChar *prefix,
+                                TrieEnumFunc     enum_func,
+                                void            *user_data);
+
+
+/*-----------------------*
+ *   PREFIX MATCHING     *
+ *-----------------------*/
+
+Bool    louds_longest_prefix (const Louds      *louds,
+                              const AlphaChar  *text,
+                              int               len,
+                              int              *o_match_len,
+                              TrieData         *o_data);
+
+int     louds_common_prefix_search (const Louds      *louds,
+                                    const AlphaChar  *text,
+                                    int               len,
+                                    TrieMatch         matches[],
+                                    int               max_matches);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __LOUDS_H */
+
+/*
+vi:ts=4:ai:expandtab
+*/
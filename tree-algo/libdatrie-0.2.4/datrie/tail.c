@@ -26,9 +26,9 @@
 
 #include <string.h>
 #include <stdlib.h>
-#include <stdint.h>
 #include <stdio.h>
 
+#include "trie-private.h"
 #include "tail.h"
 #include "fileutils.h"
 
@@ -36,12 +36,41 @@
  *    INTERNAL TYPES DECLARATIONS   *
  *----------------------------------*/
 
+typedef struct _TailReader TailReader;
+
+/* a suffix, to be sorted by its reversed string */
+typedef struct {
+    const TrieChar *str;
+    int32           len;
+    TrieIndex       block;
+} TailSuffixRef;
+
+struct _TailReader {
+    FILE           *file;
+    unsigned char  *buff;
+    size_t          pos;
+    size_t          len;
+};
+
+static Bool     tail_reader_init (TailReader *reader, FILE *file);
+static void     tail_reader_done (TailReader *reader);
+static Bool     tail_reader_fill (TailReader *reader, size_t need);
+static int32    tail_reader_read_suffix (TailReader *reader, Tail *t,
+                                         int32 len);
+
 /*-----------------------------------*
  *    PRIVATE METHODS DECLARATIONS   *
  *-----------------------------------*/
 
 static TrieIndex    tail_alloc_block (Tail *t);
 static void         tail_free_block (Tail *t, TrieIndex block);
+static TrieIndex    tail_get_next_free (const Tail *t, TrieIndex block);
+static Bool         tail_reserve_pool (Tail *t, int32 need);
+static int32        tail_add_to_pool (Tail *t, const TrieChar *str, int32 len);
+static int          tail_suffix_ref_cmp (const void *a, const void *b);
+static Bool         tail_retire (Tail *t, void *mem);
+static Bool         tail_fread_values (Tail *t, FILE *file);
+static Bool         tail_grow_values (Tail *t, TrieIndex new_alloc);
 
 /* ==================== BEGIN IMPLEMENTATION PART ====================  */
 
@@ -49,28 +78,104 @@ static void         tail_free_block (Tail *t, TrieIndex block);
  *   INTERNAL TYPES IMPLEMENTATIONS   *
  *------------------------------------*/
 
+/* size of buffer for encoding/decoding tail blocks; longer suffixes
+ * bypass it
+ */
+#define TAIL_IO_BUFF_SIZE       65536
+#define TAIL_BLOCK_HEADER_SIZE  10
+#define TAIL_WIDE_BLOCK_HEADER_SIZE 12
+
+static Bool
+tail_reader_init (TailReader *reader, FILE *file)
+{
+    reader->file = file;
+    reader->pos  = 0;
+    reader->len  = 0;
+    reader->buff = (unsigned char *) malloc (TAIL_IO_BUFF_SIZE);
+
+    return (NULL != reader->buff);
+}
+
+static void
+tail_reader_done (TailReader *reader)
+{
+    free (reader->buff);
+}
+
+/* make sure at least 'need' unconsumed bytes are in buffer */
+static Bool
+tail_reader_fill (TailReader *reader, size_t need)
+{
+    size_t  rest;
+
+    rest = reader->len - reader->pos;
+    if (rest >= need)
+        return TRUE;
+
+    memmove (reader->buff, reader->buff + reader->pos, rest);
+    reader->pos = 0;
+    reader->len = rest + fread (reader->buff + rest, 1,
+                                TAIL_IO_BUFF_SIZE - rest, reader->file);
+
+    return (reader->len >= need);
+}
+
 /*------------------------------*
  *    PRIVATE DATA DEFINITONS   *
  *------------------------------*/
 
+/* same layout as mapped tail blocks */
 typedef struct {
-    TrieIndex   next_free;
-    TrieData    data;
-    TrieChar   *suffix;
+    int32       next_free;
+    int32       data;
+    int32       suffix;     /* offset in suffix pool, -1 for none */
 } TailBlock;
 
 struct _Tail {
     TrieIndex   num_tails;
+    TrieIndex   alloc_tails;
     TailBlock  *tails;
     TrieIndex   first_free;
+
+    /* '\0'-terminated suffixes, packed */
+    TrieChar   *pool;
+    int32       pool_size;      /* bytes in use, including garbage */
+    int32       pool_alloc;
+    int32       pool_garbage;   /* bytes of freed or shrunk suffixes */
+    Bool        is_shared;      /* suffixes may overlap in pool */
+
+    /* fixed-size values, value_size bytes per block, NULL if none */
+    unsigned char  *values;
+    int32           value_size;
+
+    Bool        is_mapped;      /* pool references memory not owned by us */
+    Bool        owns_tails;
+
+    /* in concurrent mode, replaced blocks and pools are kept for lock-free
+     * readers until tail_free_retired() is called
+     */
+    Bool        is_concurrent;
+    void      **retired;
+    int         num_retired;
 };
 
 /*-----------------------------*
  *    METHODS IMPLEMENTAIONS   *
  *-----------------------------*/
 
-#define TAIL_SIGNATURE      0xDFFCDFFC
-#define TAIL_START_BLOCKNO  1
+#define TAIL_SIGNATURE              0xDFFCDFFC
+#define TAIL_WIDE_SIGNATURE         0xDFFBDFFB
+#define TAIL_VALUES_SIGNATURE       0xDFFADFFA
+#define TAIL_VALUED_SIGNATURE       0xDFF9DFF9
+#define TAIL_WIDE_VALUED_SIGNATURE  0xDFF8DFF8
+#define TAIL_START_BLOCKNO          1
+
+/* initial allocations, doubled whenever exhausted */
+#define TAIL_MIN_BLOCKS     16
+#define TAIL_MIN_POOL       256
+
+/* suffix offsets are int32, as in mapped tail blocks */
+#define TAIL_POOL_MAX       0x7fffffff
 
 /* Tail Header:
  * INT32: signature
@@ -82,6 +187,39 @@ struct _Tail {
  * INT32: data for the key
  * INT16: length
  * BYTES[length]: suffix string (no terminating '\0')
+ *
+ * Tails with suffixes of 0x8000 bytes or more are written with
+ * TAIL_WIDE_SIGNATURE instead, and INT32 lengths.
+ *
+ * Tails whose values have a size are written with TAIL_VALUED_SIGNATURE,
+ * or TAIL_WIDE_VALUED_SIGNATURE with INT32 lengths, so that readers not
+ * knowing of values reject them, and the blocks are followed by:
+ *
+ * Tail Values:
+ * INT32: TAIL_VALUES_SIGNATURE
+ * INT32: value size
+ * BYTES[number of tail blocks * value size]: values of the blocks
+ *
+ * Mapped Tail (all values are little-endian):
+ * INT32: signature
+ * INT32: pointer to first free slot
+ * INT32: number of tail blocks
+ * INT32: size of suffix pool
+ *
+ * Mapped Tail Blocks:
+ * INT32: pointer to next free block (-1 for allocated blocks)
+ * INT32: data for the key
+ * INT32: offset of suffix in suffix pool (-1 for no suffix)
+ *
+ * Suffix Pool:
+ * BYTES[size]: '\0'-terminated suffix strings
+ *
+ * Mapped Tail Values, as a separate section:
+ * INT32: TAIL_VALUES_SIGNATURE
+ * INT32: value size
+ * INT32: number of tail blocks
+ * INT32: 0
+ * BYTES[number of tail blocks * value size]: values of the blocks
  */
 
 /**
@@ -98,9 +236,26 @@ tail_new ()
     if (!t)
         return NULL;
 
-    t->first_free = 0;
-    t->num_tails  = 0;
-    t->tails      = NULL;
+    t->first_free   = 0;
+    t->num_tails    = 0;
+    t->alloc_tails  = 0;
+    t->tails        = NULL;
+
+    t->pool         = NULL;
+    t->pool_size    = 0;
+    t->pool_alloc   = 0;
+    t->pool_garbage = 0;
+    t->is_shared    = FALSE;
+
+    t->values       = NULL;
+    t->value_size   = 0;
+
+    t->is_mapped    = FALSE;
+    t->owns_tails   = TRUE;
+
+    t->is_concurrent = FALSE;
+    t->retired      = NULL;
+    t->num_retired  = 0;
 
     return t;
 }
@@ -123,59 +278,106 @@ tail_fread (FILE *file)
     Tail       *t;
     TrieIndex   i;
     uint32      sig;
+    int32       first_free, num_tails;
+    size_t      header_size;
+    Bool        is_wide;
+    TailReader  reader;
 
     /* check signature */
     save_pos = ftell (file);
-    if (!file_read_int32 (file, (int32 *) &sig) || TAIL_SIGNATURE != sig)
+    if (!file_read_int32 (file, (int32 *) &sig) ||
+        (TAIL_SIGNATURE != sig && TAIL_WIDE_SIGNATURE != sig &&
+         TAIL_VALUED_SIGNATURE != sig && TAIL_WIDE_VALUED_SIGNATURE != sig))
+    {
         goto exit_file_read;
+    }
+    is_wide = (TAIL_WIDE_SIGNATURE == sig ||
+               TAIL_WIDE_VALUED_SIGNATURE == sig);
+    header_size = is_wide ? TAIL_WIDE_BLOCK_HEADER_SIZE
+                          : TAIL_BLOCK_HEADER_SIZE;
 
-    if (NULL == (t = (Tail *) malloc (sizeof (Tail))))
+    if (NULL == (t = tail_new ()))
         goto exit_file_read;
 
-    if (!file_read_int32 (file, &t->first_free) ||
-        !file_read_int32 (file, &t->num_tails))
+    if (!file_read_int32 (file, &first_free) ||
+        !file_read_int32 (file, &num_tails))
     {
         goto exit_tail_created;
     }
-    if (t->num_tails > SIZE_MAX / sizeof (TailBlock))
+    t->first_free = first_free;
+    t->num_tails = num_tails;
+    if (t->num_tails < 0 || t->num_tails > TRIE_SIZE_MAX / sizeof (TailBlock))
         goto exit_tail_created;
+    t->alloc_tails = t->num_tails;
     t->tails = (TailBlock *) malloc (t->num_tails * sizeof (TailBlock));
-    if (!t->tails)
+    if (t->num_tails > 0 && !t->tails)
+        goto exit_tail_created;
+    if (!tail_reader_init (&reader, file))
         goto exit_tail_created;
     for (i = 0; i < t->num_tails; i++) {
-        int16   length;
+        int32   length;
 
-        if (!file_read_int32 (file, &t->tails[i].next_free) ||
-            !file_read_int32 (file, &t->tails[i].data) ||
-            !file_read_int16 (file, &length))
-        {
+        if (!tail_reader_fill (&reader, header_size))
             goto exit_in_loop;
-        }
+        t->tails[i].next_free = mem_read_int32 (reader.buff + reader.pos);
+        t->tails[i].data = mem_read_int32 (reader.buff + reader.pos + 4);
+        length = is_wide
+                 ? mem_read_int32 (reader.buff + reader.pos + 8)
+                 : mem_read_int16 (reader.buff + reader.pos + 8);
+        reader.pos += header_size;
 
-        t->tails[i].suffix = (TrieChar *) malloc (length + 1);
-        if (length > 0) {
-            if (!file_read_chars (file, (char *)t->tails[i].suffix, length)) {
-                free (t->tails[i].suffix);
-                goto exit_in_loop;
-            }
-        }
-        t->tails[i].suffix[length] = '\0';
+        if (length < 0)
+            goto exit_in_loop;
+        t->tails[i].suffix = tail_reader_read_suffix (&reader, t, length);
+        if (t->tails[i].suffix < 0)
+            goto exit_in_loop;
+    }
+
+    /* give back what has been read ahead */
+    fseek (file, -(long) (reader.len - reader.pos), SEEK_CUR);
+    tail_reader_done (&reader);
+
+    if ((TAIL_VALUED_SIGNATURE == sig || TAIL_WIDE_VALUED_SIGNATURE == sig)
+        && !tail_fread_values (t, file))
+    {
+        goto exit_tail_created;
     }
 
     return t;
 
 exit_in_loop:
-    while (i > 0) {
-        free (t->tails[--i].suffix);
-    }
-    free (t->tails);
+    tail_reader_done (&reader);
 exit_tail_created:
-    free (t);
+    tail_free (t);
 exit_file_read:
     fseek (file, save_pos, SEEK_SET);
     return NULL;
 }
 
+/* read the values following the blocks of a tail with values */
+static Bool
+tail_fread_values (Tail *t, FILE *file)
+{
+    uint32      sig;
+    int32       value_size;
+    size_t      size;
+
+    if (!file_read_int32 (file, (int32 *) &sig) ||
+        TAIL_VALUES_SIGNATURE != sig ||
+        !file_read_int32 (file, &value_size) || value_size <= 0 ||
+        (size_t) t->num_tails > TRIE_SIZE_MAX / value_size)
+    {
+        return FALSE;
+    }
+    size = (size_t) t->num_tails * value_size;
+    t->values = (unsigned char *) malloc (size);
+    if (size > 0 && !t->values)
+        return FALSE;
+    t->value_size = value_size;
+
+    return fread (t->values, 1, size, file) == size;
+}
+
 /**
  * @brief Free tail data
  *
@@ -188,13 +390,12 @@ exit_file_read:
 void
 tail_free (Tail *t)
 {
-    TrieIndex   i;
-
-    if (t->tails) {
-        for (i = 0; i < t->num_tails; i++)
-            if (t->tails[i].suffix)
-                free (t->tails[i].suffix);
+    tail_free_retired (t);
+    if (t->owns_tails)
         free (t->tails);
+    if (!t->is_mapped) {
+        free (t->pool);
+        free (t->values);
     }
     free (t);
 }
@@ -213,29 +414,243 @@ tail_free (Tail *t)
 int
 tail_fwrite (const Tail *t, FILE *file)
 {
-    TrieIndex   i;
+    TrieIndex       i;
+    unsigned char  *buff, *p;
+    size_t          header_size = TAIL_BLOCK_HEADER_SIZE;
+    uint32          sig;
+    int             res = -1;
 
-    if (!file_write_int32 (file, TAIL_SIGNATURE) ||
+    /* keep the compact INT16 lengths unless some suffix needs more */
+    for (i = 0; i < t->num_tails; i++) {
+        const TrieChar *suffix = tail_get_suffix (t, i + TAIL_START_BLOCKNO);
+
+        if (suffix && strlen ((const char *) suffix) > 0x7fff) {
+            header_size = TAIL_WIDE_BLOCK_HEADER_SIZE;
+            break;
+        }
+    }
+
+    if (TAIL_WIDE_BLOCK_HEADER_SIZE == header_size) {
+        sig = (t->value_size > 0) ? TAIL_WIDE_VALUED_SIGNATURE
+                                  : TAIL_WIDE_SIGNATURE;
+    } else {
+        sig = (t->value_size > 0) ? TAIL_VALUED_SIGNATURE : TAIL_SIGNATURE;
+    }
+    if (!file_write_int32 (file, sig) ||
         !file_write_int32 (file, t->first_free)  ||
         !file_write_int32 (file, t->num_tails))
     {
         return -1;
     }
+
+    buff = (unsigned char *) malloc (TAIL_IO_BUFF_SIZE);
+    if (!buff)
+        return -1;
+
+    /* encode blocks into buffer, and write it out whenever it's full */
+    p = buff;
     for (i = 0; i < t->num_tails; i++) {
-        int16   length;
+        const TrieChar *suffix;
+        int32           length;
+
+        suffix = tail_get_suffix (t, i + TAIL_START_BLOCKNO);
+        length = suffix ? strlen ((const char *)suffix) : 0;
+
+        if (p + header_size + length > buff + TAIL_IO_BUFF_SIZE) {
+            if (fwrite (buff, 1, p - buff, file) != (size_t) (p - buff))
+                goto exit_buff_created;
+            p = buff;
+        }
+
+        mem_write_int32 (p, tail_get_next_free (t, i));
+        mem_write_int32 (p + 4, tail_get_data (t, i + TAIL_START_BLOCKNO));
+        if (TAIL_WIDE_BLOCK_HEADER_SIZE == header_size)
+            mem_write_int32 (p + 8, length);
+        else
+            mem_write_int16 (p + 8, length);
+        p += header_size;
+        if (p + length > buff + TAIL_IO_BUFF_SIZE) {
+            /* too long for the buffer, write it out directly */
+            if (fwrite (buff, 1, p - buff, file) != (size_t) (p - buff)
+                || fwrite (suffix, 1, length, file) != (size_t) length)
+            {
+                goto exit_buff_created;
+            }
+            p = buff;
+        } else if (length > 0) {
+            memcpy (p, suffix, length);
+            p += length;
+        }
+    }
+    if (fwrite (buff, 1, p - buff, file) != (size_t) (p - buff))
+        goto exit_buff_created;
+
+    if (t->value_size > 0) {
+        size_t  size = (size_t) t->num_tails * t->value_size;
 
-        if (!file_write_int32 (file, t->tails[i].next_free) ||
-            !file_write_int32 (file, t->tails[i].data))
+        if (!file_write_int32 (file, TAIL_VALUES_SIGNATURE) ||
+            !file_write_int32 (file, t->value_size) ||
+            fwrite (t->values, 1, size, file) != size)
         {
-            return -1;
+            goto exit_buff_created;
         }
+    }
+
+    res = 0;
+
+exit_buff_created:
+    free (buff);
+    return res;
+}
+
+/**
+ * @brief Map tail data from memory
+ *
+ * @param mem   : the memory block, in the layout by tail_fwrite_mapped()
+ * @param size  : size of @a mem in bytes
+ * @param o_len : storage for the number of bytes occupied by the tail data
+ *
+ * @return a read-only tail object, NULL on failure
+ *
+ * Create a tail object over the blocks and suffixes stored in @a mem.
+ * Suffixes are always used in place. The blocks are also used in place on
+ * little-endian hosts, and decoded into an allocated array otherwise.
+ * The memory must outlive the returned object.
+ */
+Tail *
+tail_new_mapped (const void *mem, size_t size, size_t *o_len)
+{
+    const unsigned char *p = (const unsigned char *) mem;
+    Tail       *t;
+    TrieIndex   num_tails, i;
+    int32       pool_size;
+    size_t      blocks_len;
+
+    if (size < 16 || TAIL_SIGNATURE != (uint32) mem_read_int32_le (p))
+        return NULL;
 
-        length = t->tails[i].suffix ? strlen ((const char *)t->tails[i].suffix)
-                                    : 0;
-        if (!file_write_int16 (file, length))
+    num_tails = mem_read_int32_le (p + 8);
+    pool_size = mem_read_int32_le (p + 12);
+    if (num_tails < 0 || pool_size < 0)
+        return NULL;
+    if ((size - 16) / sizeof (TailBlock) < (size_t) num_tails)
+        return NULL;
+    blocks_len = num_tails * sizeof (TailBlock);
+    if (size - 16 - blocks_len < (size_t) pool_size)
+        return NULL;
+    /* every suffix offset inside the pool must hit a terminated string */
+    if (pool_size > 0 && p[16 + blocks_len + pool_size - 1] != '\0')
+        return NULL;
+
+    if (NULL == (t = tail_new ()))
+        return NULL;
+
+    t->first_free  = mem_read_int32_le (p + 4);
+    t->num_tails   = num_tails;
+    t->alloc_tails = num_tails;
+    if (host_is_little_endian ()) {
+        t->tails = (TailBlock *) (p + 16);
+        t->owns_tails = FALSE;
+    } else {
+        const unsigned char *q;
+
+        t->tails = (TailBlock *) malloc (blocks_len);
+        if (num_tails > 0 && !t->tails) {
+            free (t);
+            return NULL;
+        }
+        for (i = 0, q = p + 16; i < num_tails; i++, q += 12) {
+            t->tails[i].next_free = mem_read_int32_le (q);
+            t->tails[i].data      = mem_read_int32_le (q + 4);
+            t->tails[i].suffix    = mem_read_int32_le (q + 8);
+        }
+    }
+    t->pool       = (TrieChar *) (p + 16 + blocks_len);
+    t->pool_size  = pool_size;
+    t->pool_alloc = pool_size;
+    t->is_mapped  = TRUE;
+
+    *o_len = 16 + blocks_len + pool_size;
+    return t;
+}
+
+/**
+ * @brief Write tail data in mappable layout
+ *
+ * @param t     : the tail data
+ * @param file  : the file to write to
+ *
+ * @return 0 on success, non-zero on failure
+ *
+ * Write tail data to @a file in the little-endian block-and-pool layout,
+ * for mapping back with tail_new_mapped().
+ */
+int
+tail_fwrite_mapped (const Tail *t, FILE *file)
+{
+    TrieIndex   i;
+    int32       pool_size;
+    Bool        is_pool_as_is;
+
+    /* a pool without garbage is written as is, which also keeps shared
+     * suffixes shared; otherwise, suffixes are repacked in block order
+     */
+    is_pool_as_is = (0 == t->pool_garbage || t->is_shared);
+
+    if (is_pool_as_is) {
+        pool_size = t->pool_size;
+    } else {
+        pool_size = 0;
+        for (i = 0; i < t->num_tails; i++) {
+            const TrieChar *suffix = tail_get_suffix (t,
+                                                      i + TAIL_START_BLOCKNO);
+            if (suffix)
+                pool_size += strlen ((const char *)suffix) + 1;
+        }
+    }
+
+    if (!file_write_int32_le (file, TAIL_SIGNATURE) ||
+        !file_write_int32_le (file, t->first_free)  ||
+        !file_write_int32_le (file, t->num_tails)   ||
+        !file_write_int32_le (file, pool_size))
+    {
+        return -1;
+    }
+
+    pool_size = 0;
+    for (i = 0; i < t->num_tails; i++) {
+        const TrieChar *suffix = tail_get_suffix (t, i + TAIL_START_BLOCKNO);
+        int32           offset;
+
+        if (!suffix)
+            offset = -1;
+        else if (is_pool_as_is)
+            offset = t->tails[i].suffix;
+        else
+            offset = pool_size;
+
+        if (!file_write_int32_le (file, tail_get_next_free (t, i)) ||
+            !file_write_int32_le (file,
+                                  tail_get_data (t, i + TAIL_START_BLOCKNO)) ||
+            !file_write_int32_le (file, offset))
+        {
             return -1;
-        if (length > 0 &&
-            !file_write_chars (file, (char *)t->tails[i].suffix, length))
+        }
+        if (suffix && !is_pool_as_is)
+            pool_size += strlen ((const char *)suffix) + 1;
+    }
+
+    if (is_pool_as_is) {
+        return (t->pool_size == 0
+                || file_write_chars (file, (const char *) t->pool,
+                                     t->pool_size)) ? 0 : -1;
+    }
+
+    for (i = 0; i < t->num_tails; i++) {
+        const TrieChar *suffix = tail_get_suffix (t, i + TAIL_START_BLOCKNO);
+
+        if (suffix && !file_write_chars (file, (const char *)suffix,
+                                         strlen ((const char *)suffix) + 1))
         {
             return -1;
         }
@@ -244,6 +659,501 @@ tail_fwrite (const Tail *t, FILE *file)
     return 0;
 }
 
+/**
+ * @brief Map tail values from memory
+ *
+ * @param t     : the tail data, as mapped by tail_new_mapped()
+ * @param mem   : the memory block, in the layout by tail_fwrite_mapped_values()
+ * @param size  : size of @a mem in bytes
+ * @param o_len : storage for the number of bytes occupied by the values
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Use the values of the blocks of @a t stored in @a mem, in place. The
+ * memory must outlive @a t.
+ */
+Bool
+tail_map_values (Tail *t, const void *mem, size_t size, size_t *o_len)
+{
+    const unsigned char *p = (const unsigned char *) mem;
+    int32       value_size;
+
+    if (size < 16 || TAIL_VALUES_SIGNATURE != (uint32) mem_read_int32_le (p))
+        return FALSE;
+
+    value_size = mem_read_int32_le (p + 4);
+    if (value_size <= 0 || mem_read_int32_le (p + 8) != t->num_tails)
+        return FALSE;
+    if ((size - 16) / value_size < (size_t) t->num_tails)
+        return FALSE;
+
+    t->values = (unsigned char *) (p + 16);
+    t->value_size = value_size;
+
+    *o_len = 16 + (size_t) t->num_tails * value_size;
+    return TRUE;
+}
+
+/**
+ * @brief Write tail values in mappable layout
+ *
+ * @param t     : the tail data, whose values have a size
+ * @param file  : the file to write to
+ *
+ * @return 0 on success, non-zero on failure
+ *
+ * Write the values of the blocks of @a t to @a file, for mapping back with
+ * tail_map_values().
+ */
+int
+tail_fwrite_mapped_values (const Tail *t, FILE *file)
+{
+    size_t  size = (size_t) t->num_tails * t->value_size;
+
+    if (!file_write_int32_le (file, TAIL_VALUES_SIGNATURE) ||
+        !file_write_int32_le (file, t->value_size) ||
+        !file_write_int32_le (file, t->num_tails) ||
+        !file_write_int32_le (file, 0))
+    {
+        return -1;
+    }
+
+    return (fwrite (t->values, 1, size, file) == size) ? 0 : -1;
+}
+
+static TrieIndex
+tail_get_next_free (const Tail *t, TrieIndex block)
+{
+    return t->tails[block].next_free;
+}
+
+/* make room for 'need' more bytes at end of pool, either by squeezing
+ * garbage out of it, or by growing it
+ */
+static Bool
+tail_reserve_pool (Tail *t, int32 need)
+{
+    int32       new_alloc;
+    TrieChar   *new_pool;
+
+    if (need <= t->pool_alloc - t->pool_size)
+        return TRUE;
+
+    if (t->pool_garbage >= t->pool_size / 2) {
+        if (!tail_compact (t))
+            return FALSE;
+        if (need <= t->pool_alloc - t->pool_size)
+            return TRUE;
+    }
+
+    if (need > TAIL_POOL_MAX - t->pool_size)
+        return FALSE;
+    new_alloc = (t->pool_alloc > 0) ? t->pool_alloc : TAIL_MIN_POOL;
+    while (new_alloc - t->pool_size < need) {
+        new_alloc = (new_alloc <= TAIL_POOL_MAX / 2) ? new_alloc * 2
+                                                     : TAIL_POOL_MAX;
+    }
+    if (t->is_concurrent) {
+        /* readers may still be reading the old pool */
+        new_pool = (TrieChar *) malloc (new_alloc);
+        if (!new_pool || (t->pool && !tail_retire (t, t->pool))) {
+            free (new_pool);
+            return FALSE;
+        }
+        if (t->pool_size > 0)
+            memcpy (new_pool, t->pool, t->pool_size);
+        TRIE_STORE_RELAXED (&t->pool, new_pool);
+    } else {
+        new_pool = (TrieChar *) realloc (t->pool, new_alloc);
+        if (!new_pool)
+            return FALSE;
+        t->pool = new_pool;
+    }
+    t->pool_alloc = new_alloc;
+
+    return TRUE;
+}
+
+/* append 'len' bytes of 'str' and a terminator to pool,
+ * returning its offset, or -1 on failure
+ */
+static int32
+tail_add_to_pool (Tail *t, const TrieChar *str, int32 len)
+{
+    int32   offset;
+
+    if (!tail_reserve_pool (t, len + 1))
+        return -1;
+
+    offset = t->pool_size;
+    memcpy (t->pool + offset, str, len);
+    t->pool[offset + len] = '\0';
+    TRIE_STORE_RELEASE (&t->pool_size, offset + len + 1);
+
+    return offset;
+}
+
+/* add the next 'len' bytes to the suffix pool of 't',
+ * returning its offset, or -1 on failure
+ */
+static int32
+tail_reader_read_suffix (TailReader *reader, Tail *t, int32 len)
+{
+    int32   offset;
+    size_t  rest;
+
+    if (len <= TAIL_IO_BUFF_SIZE) {
+        if (!tail_reader_fill (reader, len))
+            return -1;
+        offset = tail_add_to_pool (t, reader->buff + reader->pos, len);
+        reader->pos += len;
+        return offset;
+    }
+
+    /* too long for the buffer, read the rest of it directly into pool */
+    if (!tail_reserve_pool (t, len + 1))
+        return -1;
+    offset = t->pool_size;
+    rest = reader->len - reader->pos;
+    memcpy (t->pool + offset, reader->buff + reader->pos, rest);
+    reader->pos = reader->len;
+    if (fread (t->pool + offset + rest, 1, len - rest, reader->file)
+        != len - rest)
+    {
+        return -1;
+    }
+    t->pool[offset + len] = '\0';
+    t->pool_size = offset + len + 1;
+
+    return offset;
+}
+
+/**
+ * @brief Squeeze unused space out of suffix pool
+ *
+ * @param t : the tail data
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Repack the suffixes of @a t in block order, dropping the space left by
+ * deleted and shortened suffixes. If the suffixes have been shared with
+ * tail_share_suffixes(), they are shared again. Pointers previously
+ * returned by tail_get_suffix() become invalid.
+ */
+Bool
+tail_compact (Tail *t)
+{
+    TrieChar   *new_pool;
+    TrieIndex   i;
+    int32       pos;
+
+    if (t->is_mapped)
+        return FALSE;
+    if (0 == t->pool_garbage)
+        return TRUE;
+    if (t->is_shared)
+        return tail_share_suffixes (t);
+
+    new_pool = (TrieChar *) malloc (t->pool_alloc);
+    if (!new_pool)
+        return FALSE;
+    if (t->is_concurrent && !tail_retire (t, t->pool)) {
+        free (new_pool);
+        return FALSE;
+    }
+
+    pos = 0;
+    for (i = 0; i < t->num_tails; i++) {
+        int32   len;
+
+        if (t->tails[i].suffix < 0)
+            continue;
+        len = strlen ((const char *) t->pool + t->tails[i].suffix) + 1;
+        memcpy (new_pool + pos, t->pool + t->tails[i].suffix, len);
+        t->tails[i].suffix = pos;
+        pos += len;
+    }
+
+    if (!t->is_concurrent)
+        free (t->pool);
+    TRIE_STORE_RELAXED (&t->pool, new_pool);
+    TRIE_STORE_RELEASE (&t->pool_size, pos);
+    t->pool_garbage = 0;
+
+    return TRUE;
+}
+
+static int
+tail_suffix_ref_cmp (const void *a, const void *b)
+{
+    const TailSuffixRef *x = (const TailSuffixRef *) a;
+    const TailSuffixRef *y = (const TailSuffixRef *) b;
+    const TrieChar      *p = x->str + x->len;
+    const TrieChar      *q = y->str + y->len;
+
+    while (p > x->str && q > y->str) {
+        --p; --q;
+        if (*p != *q)
+            return (*p > *q) - (*p < *q);
+    }
+    return (x->len > y->len) - (x->len < y->len);
+}
+
+/**
+ * @brief Share common suffix ends in suffix pool
+ *
+ * @param t : the tail data
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Repack the suffixes of @a t so that each distinct string is stored once,
+ * and a string that ends another one, such as "ing" in "ting", is stored
+ * as the end of it. Later changes to the suffixes copy rather than modify
+ * the shared bytes. Pointers previously returned by tail_get_suffix()
+ * become invalid.
+ */
+Bool
+tail_share_suffixes (Tail *t)
+{
+    TailSuffixRef  *refs;
+    TrieChar       *new_pool;
+    TrieIndex       i, n;
+    int32           pos;
+
+    if (t->is_mapped)
+        return FALSE;
+
+    refs = (TailSuffixRef *) malloc ((t->num_tails + 1)
+                                     * sizeof (TailSuffixRef));
+    if (!refs)
+        return FALSE;
+
+    n = 0;
+    for (i = 0; i < t->num_tails; i++) {
+        if (t->tails[i].suffix < 0)
+            continue;
+        refs[n].str = t->pool + t->tails[i].suffix;
+        refs[n].len = strlen ((const char *) refs[n].str);
+        refs[n].block = i;
+        ++n;
+    }
+    qsort (refs, n, sizeof (TailSuffixRef), tail_suffix_ref_cmp);
+
+    new_pool = (TrieChar *) malloc (t->pool_size > 0 ? t->pool_size : 1);
+    if (!new_pool || (t->is_concurrent && t->pool
+                      && !tail_retire (t, t->pool)))
+    {
+        free (new_pool);
+        free (refs);
+        return FALSE;
+    }
+
+    /* in reversed order, a string ending another one comes right before
+     * it, or before another string ending it; so, place them from the end
+     */
+    pos = 0;
+    for (i = n - 1; i >= 0; i--) {
+        const TailSuffixRef *next = (i + 1 < n) ? &refs[i + 1] : NULL;
+
+        if (next && refs[i].len <= next->len
+            && memcmp (refs[i].str, next->str + next->len - refs[i].len,
+                       refs[i].len) == 0)
+        {
+            t->tails[refs[i].block].suffix = t->tails[next->block].suffix
+                                             + next->len - refs[i].len;
+        } else {
+            memcpy (new_pool + pos, refs[i].str, refs[i].len + 1);
+            t->tails[refs[i].block].suffix = pos;
+            pos += refs[i].len + 1;
+        }
+    }
+    free (refs);
+
+    if (!t->is_concurrent)
+        free (t->pool);
+    TRIE_STORE_RELAXED (&t->pool, new_pool);
+    TRIE_STORE_RELEASE (&t->pool_size, pos);
+    t->pool_alloc = pos;
+    t->pool_garbage = 0;
+    t->is_shared = TRUE;
+
+    return TRUE;
+}
+
+/**
+ * @brief Get memory used by tail data
+ *
+ * @param t : the tail data
+ *
+ * @return the number of bytes taken by the blocks, their values and the
+ *         suffixes
+ */
+size_t
+tail_get_mem_size (const Tail *t)
+{
+    return t->num_tails * (sizeof (TailBlock) + t->value_size) + t->pool_size;
+}
+
+/**
+ * @brief Append the blocks of another tail
+ *
+ * @param t        : the tail data
+ * @param src      : the tail data to append
+ * @param o_offset : the number added to the indices of @a src blocks
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Copy all blocks of @a src, with their suffixes, data and values, after
+ * those of @a t, so that block @a i of @a src becomes block
+ * @a i + @a *o_offset of @a t. Free blocks of @a src stay free. The values
+ * of both tails must be of the same size.
+ */
+Bool
+tail_append (Tail *t, const Tail *src, TrieIndex *o_offset)
+{
+    TrieIndex   num_tails, i;
+    int32       pool_offset;
+
+    if (t->is_mapped || t->is_concurrent || t->value_size != src->value_size)
+        return FALSE;
+    if (src->num_tails > TRIE_INDEX_MAX - t->num_tails)
+        return FALSE;
+
+    num_tails = t->num_tails + src->num_tails;
+    if (num_tails > t->alloc_tails) {
+        TailBlock  *new_tails;
+
+        if (t->value_size > 0) {
+            unsigned char  *new_values;
+
+            new_values = (unsigned char *) realloc (t->values,
+                                                    (size_t) num_tails
+                                                    * t->value_size);
+            if (!new_values)
+                return FALSE;
+            t->values = new_values;
+        }
+        new_tails = (TailBlock *) realloc (t->tails,
+                                           num_tails * sizeof (TailBlock));
+        if (!new_tails)
+            return FALSE;
+        t->tails = new_tails;
+        t->alloc_tails = num_tails;
+    }
+    if (t->value_size > 0) {
+        memcpy (t->values + (size_t) t->num_tails * t->value_size,
+                src->values, (size_t) src->num_tails * src->value_size);
+    }
+
+    if (!tail_reserve_pool (t, src->pool_size))
+        return FALSE;
+    pool_offset = t->pool_size;
+    if (src->pool_size > 0)
+        memcpy (t->pool + pool_offset, src->pool, src->pool_size);
+    t->pool_size += src->pool_size;
+    t->pool_garbage += src->pool_garbage;
+    t->is_shared = t->is_shared || src->is_shared;
+
+    for (i = 0; i < src->num_tails; i++) {
+        TailBlock  *block = &t->tails[t->num_tails + i];
+
+        *block = src->tails[i];
+        if (block->suffix >= 0)
+            block->suffix += pool_offset;
+        if (-1 != block->next_free) {
+            block->next_free = t->first_free;
+            t->first_free = t->num_tails + i;
+        }
+    }
+
+    *o_offset = t->num_tails;
+    t->num_tails = num_tails;
+
+    return TRUE;
+}
+
+
+/**
+ * @brief Copy given blocks of tail data into a new tail
+ *
+ * @param t      : the tail data
+ * @param blocks : the indices of the blocks to copy, replaced on return
+ *                 by their indices in the new tail
+ * @param n      : the number of @a blocks
+ *
+ * @return a pointer to the new tail data, NULL on failure
+ *
+ * Create a tail with blocks @a blocks of @a t, with their suffixes, data
+ * and values, numbered in the given order with no free block between them.
+ * The suffixes are packed with no garbage, and shared again if those of
+ * @a t are shared. @a t may be a mapped tail.
+ */
+Tail *
+tail_new_compacted (const Tail *t, TrieIndex blocks[], TrieIndex n)
+{
+    Tail       *nt;
+    TrieIndex   i;
+    size_t      pool_need;
+
+    nt = tail_new ();
+    if (!nt)
+        return NULL;
+    if (0 == n)
+        return nt;
+
+    nt->tails = (TailBlock *) malloc (n * sizeof (TailBlock));
+    if (!nt->tails)
+        goto exit_tail_created;
+    nt->alloc_tails = n;
+    if (t->value_size > 0) {
+        nt->values = (unsigned char *) malloc ((size_t) n * t->value_size);
+        if (!nt->values)
+            goto exit_tail_created;
+        nt->value_size = t->value_size;
+    }
+
+    pool_need = 0;
+    for (i = 0; i < n; i++) {
+        const TrieChar *suffix = tail_get_suffix (t, blocks[i]);
+
+        if (suffix)
+            pool_need += strlen ((const char *) suffix) + 1;
+    }
+    if (pool_need > TAIL_POOL_MAX)
+        goto exit_tail_created;
+    nt->pool = (TrieChar *) malloc (pool_need > 0 ? pool_need : 1);
+    if (!nt->pool)
+        goto exit_tail_created;
+    nt->pool_alloc = (int32) pool_need;
+
+    for (i = 0; i < n; i++) {
+        const TrieChar *suffix = tail_get_suffix (t, blocks[i]);
+        TailBlock      *block = &nt->tails[i];
+
+        block->next_free = -1;
+        block->data = tail_get_data (t, blocks[i]);
+        block->suffix = suffix ? tail_add_to_pool (nt, suffix,
+                                                   strlen ((const char *)
+                                                           suffix))
+                               : -1;
+        if (nt->value_size > 0) {
+            memcpy (nt->values + (size_t) i * nt->value_size,
+                    tail_get_value (t, blocks[i]), nt->value_size);
+        }
+    }
+    nt->num_tails = n;
+    for (i = 0; i < n; i++)
+        blocks[i] = i + TAIL_START_BLOCKNO;
+
+    if (t->is_shared && !tail_share_suffixes (nt))
+        goto exit_tail_created;
+
+    return nt;
+
+exit_tail_created:
+    tail_free (nt);
+    return NULL;
+}
 
 /**
  * @brief Get suffix
@@ -251,16 +1161,53 @@ tail_fwrite (const Tail *t, FILE *file)
  * @param t     : the tail data
  * @param index : the index of the suffix
  *
- * @return an allocated string of the indexed suffix.
+ * @return the indexed suffix, NULL if none
  *
- * Get suffix from tail with given @a index. The returned string is allocated.
- * The caller should free it with free().
+ * Get suffix from tail with given @a index. The returned string points into
+ * the tail data, and is valid until the tail is next modified.
  */
 const TrieChar *
 tail_get_suffix (const Tail *t, TrieIndex index)
 {
+    int32   offset;
+
     index -= TAIL_START_BLOCKNO;
-    return (index < t->num_tails) ? t->tails[index].suffix : NULL;
+    if ((uint32) index >= (uint32) TRIE_LOAD_ACQUIRE (&t->num_tails))
+        return NULL;
+    offset = TRIE_LOAD_RELAXED (&t->tails)[index].suffix;
+    return (0 <= offset && offset < TRIE_LOAD_ACQUIRE (&t->pool_size))
+           ? TRIE_LOAD_RELAXED (&t->pool) + offset : NULL;
+}
+
+/**
+ * @brief Get suffix with its readable length
+ *
+ * @param t         : the tail data
+ * @param index     : the index of the suffix
+ * @param o_max_len : the storage for the number of readable bytes
+ *
+ * @return pointer to the indexed suffix, NULL on failure
+ *
+ * Same as tail_get_suffix(), but also return in @a o_max_len the number of
+ * bytes from the returned pointer to the end of the pool. A lock-free
+ * reader of a concurrent tail may find the suffix being rewritten, with
+ * its terminator missing, and must not read beyond that length.
+ */
+const TrieChar *
+tail_peek_suffix (const Tail *t, TrieIndex index, int32 *o_max_len)
+{
+    int32   offset, pool_size;
+
+    index -= TAIL_START_BLOCKNO;
+    if ((uint32) index >= (uint32) TRIE_LOAD_ACQUIRE (&t->num_tails))
+        return NULL;
+    offset = TRIE_LOAD_RELAXED (&t->tails)[index].suffix;
+    pool_size = TRIE_LOAD_ACQUIRE (&t->pool_size);
+    if (offset < 0 || offset >= pool_size)
+        return NULL;
+
+    *o_max_len = pool_size - offset;
+    return TRIE_LOAD_RELAXED (&t->pool) + offset;
 }
 
 /**
@@ -275,21 +1222,60 @@ tail_get_suffix (const Tail *t, TrieIndex index)
 Bool
 tail_set_suffix (Tail *t, TrieIndex index, const TrieChar *suffix)
 {
+    int32   old, old_len, len, new_off;
+
     index -= TAIL_START_BLOCKNO;
-    if (index < t->num_tails) {
-        /* suffix and t->tails[index].suffix may overlap;
-         * so, dup it before it's overwritten
-         */
-        TrieChar *tmp = NULL;
-        if (suffix)
-            tmp = (TrieChar *) strdup ((const char *)suffix);
-        if (t->tails[index].suffix)
-            free (t->tails[index].suffix);
-        t->tails[index].suffix = tmp;
+    if (index >= t->num_tails || t->is_mapped)
+        return FALSE;
+
+    old = t->tails[index].suffix;
+    old_len = (old >= 0) ? strlen ((const char *) t->pool + old) : -1;
 
+    if (!suffix) {
+        t->pool_garbage += old_len + 1;
+        t->tails[index].suffix = -1;
         return TRUE;
     }
-    return FALSE;
+
+    len = strlen ((const char *) suffix);
+    if (old >= 0 && suffix + len == t->pool + old + old_len
+        && t->pool + old <= suffix)
+    {
+        /* new suffix ends the old one, just point there */
+        t->tails[index].suffix = suffix - t->pool;
+        t->pool_garbage += old_len - len;
+        return TRUE;
+    }
+    if (len <= old_len && !t->is_shared) {
+        /* fits in place; suffix may overlap it */
+        memmove (t->pool + old, suffix, len + 1);
+        t->pool_garbage += old_len - len;
+        return TRUE;
+    }
+
+    /* suffix may point into pool, which can move while growing;
+     * so, dup it before appending
+     */
+    if (t->pool <= suffix && suffix < t->pool + t->pool_size) {
+        TrieChar   *tmp;
+        Bool        res;
+
+        tmp = (TrieChar *) strdup ((const char *) suffix);
+        if (!tmp)
+            return FALSE;
+        res = tail_set_suffix (t, index + TAIL_START_BLOCKNO, tmp);
+        free (tmp);
+        return res;
+    }
+
+    /* the old offset may change if the pool gets compacted */
+    new_off = tail_add_to_pool (t, suffix, len);
+    if (new_off < 0)
+        return FALSE;
+    t->tails[index].suffix = new_off;
+    t->pool_garbage += old_len + 1;
+
+    return TRUE;
 }
 
 /**
@@ -308,7 +1294,12 @@ tail_add_suffix (Tail *t, const TrieChar *suffix)
     TrieIndex   new_block;
 
     new_block = tail_alloc_block (t);
-    tail_set_suffix (t, new_block, suffix);
+    if (TRIE_INDEX_ERROR == new_block)
+        return TRIE_INDEX_ERROR;
+    if (!tail_set_suffix (t, new_block, suffix)) {
+        tail_free_block (t, new_block);
+        return TRIE_INDEX_ERROR;
+    }
 
     return new_block;
 }
@@ -322,44 +1313,99 @@ tail_alloc_block (Tail *t)
         block = t->first_free;
         t->first_free = t->tails[block].next_free;
     } else {
+        if (t->num_tails == t->alloc_tails) {
+            TrieIndex   new_alloc;
+            TailBlock  *new_tails;
+
+            new_alloc = (t->alloc_tails > 0) ? t->alloc_tails * 2
+                                             : TAIL_MIN_BLOCKS;
+            if (t->value_size > 0 && !tail_grow_values (t, new_alloc))
+                return TRIE_INDEX_ERROR;
+            if (t->is_concurrent) {
+                /* readers may still be reading the old blocks */
+                new_tails = (TailBlock *) malloc (new_alloc
+                                                  * sizeof (TailBlock));
+                if (!new_tails || (t->tails && !tail_retire (t, t->tails))) {
+                    free (new_tails);
+                    return TRIE_INDEX_ERROR;
+                }
+                if (t->num_tails > 0) {
+                    memcpy (new_tails, t->tails,
+                            t->num_tails * sizeof (TailBlock));
+                }
+                TRIE_STORE_RELAXED (&t->tails, new_tails);
+            } else {
+                new_tails = (TailBlock *) realloc (t->tails,
+                                                   new_alloc
+                                                   * sizeof (TailBlock));
+                if (!new_tails)
+                    return TRIE_INDEX_ERROR;
+                t->tails = new_tails;
+            }
+            t->alloc_tails = new_alloc;
+        }
         block = t->num_tails;
-        t->tails = (TailBlock *) realloc (t->tails,
-                                          ++t->num_tails * sizeof (TailBlock));
     }
     t->tails[block].next_free = -1;
     t->tails[block].data = TRIE_DATA_ERROR;
-    t->tails[block].suffix = NULL;
-    
+    t->tails[block].suffix = -1;
+    if (t->value_size > 0)
+        memset (t->values + (size_t) block * t->value_size, 0, t->value_size);
+
+    /* publish new block to readers only once initialized */
+    if (block == t->num_tails)
+        TRIE_STORE_RELEASE (&t->num_tails, block + 1);
+
     return block + TAIL_START_BLOCKNO;
 }
 
+/* make room for the values of new_alloc blocks */
+static Bool
+tail_grow_values (Tail *t, TrieIndex new_alloc)
+{
+    unsigned char  *new_values;
+
+    if ((size_t) new_alloc > TRIE_SIZE_MAX / t->value_size)
+        return FALSE;
+    if (t->is_concurrent) {
+        /* readers may still be reading the old values */
+        new_values = (unsigned char *) malloc ((size_t) new_alloc
+                                               * t->value_size);
+        if (!new_values || (t->values && !tail_retire (t, t->values))) {
+            free (new_values);
+            return FALSE;
+        }
+        memcpy (new_values, t->values, (size_t) t->num_tails * t->value_size);
+        TRIE_STORE_RELAXED (&t->values, new_values);
+    } else {
+        new_values = (unsigned char *) realloc (t->values, (size_t) new_alloc
+                                                           * t->value_size);
+        if (!new_values)
+            return FALSE;
+        t->values = new_values;
+    }
+
+    return TRUE;
+}
+
 static void
 tail_free_block (Tail *t, TrieIndex block)
 {
-    TrieIndex   i, j;
-
     block -= TAIL_START_BLOCKNO;
 
-    if (block >= t->num_tails)
+    if (block >= t->num_tails || t->is_mapped)
         return;
 
     t->tails[block].data = TRIE_DATA_ERROR;
-    if (NULL != t->tails[block].suffix) {
-        free (t->tails[block].suffix);
-        t->tails[block].suffix = NULL;
+    if (t->tails[block].suffix >= 0) {
+        t->pool_garbage
+            += strlen ((const char *) t->pool + t->tails[block].suffix) + 1;
+        t->tails[block].suffix = -1;
     }
 
-    /* find insertion point */
-    j = 0;
-    for (i = t->first_free; i != 0 && i < block; i = t->tails[i].next_free)
-        j = i;
-
-    /* insert free block between j and i */
-    t->tails[block].next_free = i;
-    if (0 != j)
-        t->tails[j].next_free = block;
-    else
-        t->first_free = block;
+    /* push to free list; the most recently freed block is reused first */
+    t->tails[block].next_free = t->first_free;
+    t->first_free = block;
 }
 
 /**
@@ -376,7 +1422,187 @@ TrieData
 tail_get_data (const Tail *t, TrieIndex index)
 {
     index -= TAIL_START_BLOCKNO;
-    return (index < t->num_tails) ? t->tails[index].data : TRIE_DATA_ERROR;
+    if ((uint32) index >= (uint32) TRIE_LOAD_ACQUIRE (&t->num_tails))
+        return TRIE_DATA_ERROR;
+    return TRIE_LOAD_RELAXED (&t->tails)[index].data;
+}
+
+/**
+ * @brief Set size of values
+ *
+ * @param t          : the tail data
+ * @param value_size : the size of the value of each block in bytes, or 0
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Give each block of @a t a fixed-size value besides its data. Existing
+ * values are kept, truncated or padded with zeros; values of new blocks
+ * are zeros. A size of 0 drops the values.
+ */
+Bool
+tail_set_value_size (Tail *t, int32 value_size)
+{
+    unsigned char  *new_values;
+    TrieIndex       i;
+
+    if (t->is_mapped || t->is_concurrent || value_size < 0)
+        return FALSE;
+    if (value_size == t->value_size)
+        return TRUE;
+
+    new_values = NULL;
+    if (value_size > 0) {
+        if ((size_t) t->alloc_tails > TRIE_SIZE_MAX / value_size)
+            return FALSE;
+        new_values = (unsigned char *) calloc (t->alloc_tails, value_size);
+        if (t->alloc_tails > 0 && !new_values)
+            return FALSE;
+        for (i = 0; i < t->num_tails && t->value_size > 0; i++) {
+            memcpy (new_values + (size_t) i * value_size,
+                    t->values + (size_t) i * t->value_size,
+                    MIN_VAL (value_size, t->value_size));
+        }
+    }
+
+    free (t->values);
+    t->values = new_values;
+    t->value_size = value_size;
+
+    return TRUE;
+}
+
+/**
+ * @brief Get size of values
+ *
+ * @param t : the tail data
+ *
+ * @return the size of the value of each block in bytes, 0 if none
+ */
+int32
+tail_get_value_size (const Tail *t)
+{
+    return t->value_size;
+}
+
+/**
+ * @brief Get value of a suffix entry
+ *
+ * @param t     : the tail data
+ * @param index : the index of the suffix
+ *
+ * @return pointer to the value of the suffix entry in the tail data,
+ *         NULL if none
+ */
+const void *
+tail_get_value (const Tail *t, TrieIndex index)
+{
+    index -= TAIL_START_BLOCKNO;
+    if (0 == t->value_size
+        || (uint32) index >= (uint32) TRIE_LOAD_ACQUIRE (&t->num_tails))
+    {
+        return NULL;
+    }
+    return TRIE_LOAD_RELAXED (&t->values) + (size_t) index * t->value_size;
+}
+
+/**
+ * @brief Set value of a suffix entry
+ *
+ * @param t     : the tail data
+ * @param index : the index of the suffix
+ * @param value : the value, of the size set by tail_set_value_size()
+ *
+ * @return boolean value indicating the success of the process
+ */
+Bool
+tail_set_value (Tail *t, TrieIndex index, const void *value)
+{
+    index -= TAIL_START_BLOCKNO;
+    if (0 == t->value_size || index >= t->num_tails || t->is_mapped)
+        return FALSE;
+    memcpy (t->values + (size_t) index * t->value_size, value, t->value_size);
+    return TRUE;
+}
+
+/**
+ * @brief Set tail concurrent mode
+ *
+ * @param t             : the tail data
+ * @param is_concurrent : whether readers may read @a t while it is modified
+ *
+ * In concurrent mode, block arrays and suffix pools replaced on growth or
+ * compaction are not freed but retired, as lock-free readers may still be
+ * reading them. The caller frees them with tail_free_retired() when no
+ * reader can hold them anymore.
+ */
+void
+tail_set_concurrent (Tail *t, Bool is_concurrent)
+{
+    t->is_concurrent = is_concurrent;
+}
+
+/**
+ * @brief Get number of retired memory blocks
+ *
+ * @param t : the tail data
+ *
+ * @return the number of blocks retired in concurrent mode and not yet freed
+ */
+int
+tail_get_num_retired (const Tail *t)
+{
+    return t->num_retired;
+}
+
+/**
+ * @brief Free retired memory blocks
+ *
+ * @param t : the tail data
+ *
+ * Free the memory blocks retired in concurrent mode so far.
+ */
+void
+tail_free_retired (Tail *t)
+{
+    int     i;
+
+    for (i = 0; i < t->num_retired; i++)
+        free (t->retired[i]);
+    free (t->retired);
+    t->retired = NULL;
+    t->num_retired = 0;
+}
+
+static Bool
+tail_retire (Tail *t, void *mem)
+{
+    void  **new_retired;
+
+    new_retired = (void **) realloc (t->retired,
+                                     (t->num_retired + 1) * sizeof (void *));
+    if (!new_retired)
+        return FALSE;
+    t->retired = new_retired;
+    t->retired[t->num_retired++] = mem;
+
+    return TRUE;
+}
+
+/**
+ * @brief Prefetch suffix entry
+ *
+ * @param t      : the tail data
+ * @param index  : the index of the suffix entry to be read soon
+ *
+ * Hint the CPU to bring the block of suffix entry @a index, holding its
+ * data and suffix offset, into cache. Out-of-range entries are ignored.
+ */
+void
+tail_prefetch (const Tail *t, TrieIndex index)
+{
+    index -= TAIL_START_BLOCKNO;
+    if (0 <= index && index < t->num_tails)
+        TRIE_PREFETCH (&t->tails[index]);
 }
 
 /**
@@ -394,7 +1620,7 @@ Bool
 tail_set_data (Tail *t, TrieIndex index, TrieData data)
 {
     index -= TAIL_START_BLOCKNO;
-    if (index < t->num_tails) {
+    if (index < t->num_tails && !t->is_mapped) {
         t->tails[index].data = data;
         return TRUE;
     }
@@ -434,13 +1660,13 @@ tail_delete (Tail *t, TrieIndex index)
 int
 tail_walk_str  (const Tail      *t,
                 TrieIndex        s,
-                short           *suffix_idx,
+                int32           *suffix_idx,
                 const TrieChar  *str,
                 int              len)
 {
     const TrieChar *suffix;
     int             i;
-    short           j;
+    int32           j;
 
     suffix = tail_get_suffix (t, s);
     if (!suffix)
@@ -478,7 +1704,7 @@ tail_walk_str  (const Tail      *t,
 Bool
 tail_walk_char (const Tail      *t,
                 TrieIndex        s,
-                short           *suffix_idx,
+                int32           *suffix_idx,
                 TrieChar         c)
 {
     const TrieChar *suffix;
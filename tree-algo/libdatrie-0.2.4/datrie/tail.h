@@ -47,28 +47,68 @@ void     tail_free (Tail *t);
 
 int      tail_fwrite (const Tail *t, FILE *file);
 
+Tail *   tail_new_mapped (const void *mem, size_t size, size_t *o_len);
+
+int      tail_fwrite_mapped (const Tail *t, FILE *file);
+
+Bool     tail_compact (Tail *t);
+
+Bool     tail_share_suffixes (Tail *t);
+
+size_t   tail_get_mem_size (const Tail *t);
+
+Bool     tail_append (Tail *t, const Tail *src, TrieIndex *o_offset);
+
+Tail *   tail_new_compacted (const Tail    *t,
+                             TrieIndex      blocks[],
+                             TrieIndex      n);
+
+Bool     tail_set_value_size (Tail *t, int32 value_size);
+
+int32    tail_get_value_size (const Tail *t);
+
+Bool     tail_map_values (Tail *t, const void *mem, size_t size, size_t *o_len);
+
+int      tail_fwrite_mapped_values (const Tail *t, FILE *file);
+
+void     tail_set_concurrent (Tail *t, Bool is_concurrent);
+
+int      tail_get_num_retired (const Tail *t);
+
+void     tail_free_retired (Tail *t);
+
 
 const TrieChar *    tail_get_suffix (const Tail *t, TrieIndex index);
 
+const TrieChar *    tail_peek_suffix (const Tail   *t,
+                                      TrieIndex     index,
+                                      int32        *o_max_len);
+
 Bool     tail_set_suffix (Tail *t, TrieIndex index, const TrieChar *suffix);
 
 TrieIndex tail_add_suffix (Tail *t, const TrieChar *suffix);
 
 TrieData tail_get_data (const Tail *t, TrieIndex index);
 
+void     tail_prefetch (const Tail *t, TrieIndex index);
+
 Bool     tail_set_data (Tail *t, TrieIndex index, TrieData data);
 
+const void * tail_get_value (const Tail *t, TrieIndex index);
+
+Bool     tail_set_value (Tail *t, TrieIndex index, const void *value);
+
 void     tail_delete (Tail *t, TrieIndex index);
 
 int      tail_walk_str  (const Tail      *t,
                          TrieIndex        s,
-                         short           *suffix_idx,
+                         int32           *suffix_idx,
                          const TrieChar  *str,
                          int              len);
 
 Bool     tail_walk_char (const Tail      *t,
                          TrieIndex        s,
-                         short           *suffix_idx,
+                         int32           *suffix_idx,
                          TrieChar         c);
 
 /**
@@ -87,7 +127,7 @@ Bool     tail_walk_char (const Tail      *t,
 /*
 Bool     tail_is_walkable_char (Tail            *t,
                                 TrieIndex        s,
-                                short            suffix_idx,
+                                int32            suffix_idx,
                                 const TrieChar   c);
 */
 #define  tail_is_walkable_char(t,s,suffix_idx,c) \
@@ -43,6 +43,66 @@
  */
 #define MAX_VAL(a,b)  ((a)>(b)?(a):(b))
 
+/**
+ * @brief Maximum value of size_t, for overflow checks of allocation sizes
+ */
+#define TRIE_SIZE_MAX  ((size_t) -1)
+
+/**
+ * @brief Prefetch macro, hinting that memory at @a addr is to be read soon
+ */
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 1))
+# define TRIE_PREFETCH(addr)  __builtin_prefetch ((addr), 0, 3)
+#else
+# define TRIE_PREFETCH(addr)  ((void) (addr))
+#endif
+
+/**
+ * @brief Atomic access macros, for lock-free readers in concurrent mode
+ *
+ * Sizes of arrays that lock-free readers index are stored with release
+ * semantics after the array pointers, and loaded with acquire semantics
+ * before them, so that a reader never pairs a size with a smaller array.
+ * Without compiler support, the concurrent mode is unavailable and the
+ * macros fall back to plain accesses.
+ */
+#if defined(__clang__) \
+    || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+# define TRIE_HAVE_ATOMICS          1
+# define TRIE_LOAD_ACQUIRE(p)       __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+# define TRIE_LOAD_RELAXED(p)       __atomic_load_n ((p), __ATOMIC_RELAXED)
+# define TRIE_STORE_RELEASE(p,v)    __atomic_store_n ((p), (v), __ATOMIC_RELEASE)
+# define TRIE_STORE_RELAXED(p,v)    __atomic_store_n ((p), (v), __ATOMIC_RELAXED)
+# define TRIE_FENCE_ACQUIRE()       __atomic_thread_fence (__ATOMIC_ACQUIRE)
+# define TRIE_FENCE_RELEASE()       __atomic_thread_fence (__ATOMIC_RELEASE)
+# define TRIE_FENCE()               __atomic_thread_fence (__ATOMIC_SEQ_CST)
+# define TRIE_CAS(p,old,new)        __atomic_compare_exchange_n ((p), (old), \
+                                        (new), 0, __ATOMIC_ACQ_REL, \
+                                        __ATOMIC_ACQUIRE)
+# define TRIE_ADD_FETCH(p,v)        __atomic_add_fetch ((p), (v), \
+                                        __ATOMIC_SEQ_CST)
+#else
+# define TRIE_HAVE_ATOMICS          0
+# define TRIE_LOAD_ACQUIRE(p)       (*(p))
+# define TRIE_LOAD_RELAXED(p)       (*(p))
+# define TRIE_STORE_RELEASE(p,v)    (*(p) = (v))
+# define TRIE_STORE_RELAXED(p,v)    (*(p) = (v))
+# define TRIE_FENCE_ACQUIRE()       ((void) 0)
+# define TRIE_FENCE_RELEASE()       ((void) 0)
+# define TRIE_FENCE()               ((void) 0)
+# define TRIE_CAS(p,old,new)        (*(p) == *(old) ? (*(p) = (new), 1) \
+                                                    : (*(old) = *(p), 0))
+# define TRIE_ADD_FETCH(p,v)        (*(p) += (v))
+#endif
+
+/* give up the processor while waiting for another thread */
+#if defined(__unix__) || defined(__APPLE__)
+# include <sched.h>
+# define TRIE_YIELD()               sched_yield ()
+#else
+# define TRIE_YIELD()               ((void) 0)
+#endif
+
 #endif  /* __TRIE_PRIVATE_H */
 
 /*
@@ -28,6 +28,7 @@
 #include <string.h>
 
 #include "trie.h"
+#include "trie-private.h"
 #include "fileutils.h"
 #include "alpha-map.h"
 #include "alpha-map-private.h"
@@ -43,16 +44,65 @@ struct _Trie {
     Tail       *tail;
 
     Bool        is_dirty;
+
+    void       *map_mem;    /**< mapped file block, for read-only trie */
+    size_t      map_size;   /**< size of the mapped block */
+
+    /* concurrent mode, see trie_set_concurrent() */
+    Bool        is_concurrent;
+    uint32      seq;        /**< write sequence number, odd while writing */
+    uint32      retire_seq; /**< seq of the latest write retiring memory */
+    int         num_retired;/**< retired blocks when the write began */
+    TrieReader *readers;    /**< registered readers */
+
+    Trie       *next_retired;   /**< next trie replaced in a TrieHandle */
+};
+
+/* marker for a reader not in a read */
+#define TRIE_READER_IDLE    1
+
+/* number of polls for another thread to progress before yielding */
+#define TRIE_WAIT_SPINS     64
+
+/**
+ * @brief TrieReader structure
+ */
+struct _TrieReader {
+    Trie       *trie;       /**< the trie read */
+    TrieReader *next;       /**< next registered reader of the trie */
+    uint32      epoch;      /**< trie seq when the current read began,
+                                 or TRIE_READER_IDLE */
+    int         in_use;     /**< whether the reader is taken by a thread */
+
+    /* keep epoch of each reader, written on every read, off the cache
+     * lines of other readers
+     */
+    char        pad[128];
+};
+
+/**
+ * @brief TrieHandleReader structure
+ */
+struct _TrieHandleReader {
+    TrieHandle       *handle;   /**< the handle read */
+    TrieHandleReader *next;     /**< next registered reader of the handle */
+    Trie             *trie;     /**< the trie acquired, or NULL */
+    int               in_use;   /**< whether the reader is taken by a thread */
+
+    /* keep the trie of each reader, written on every acquisition, off the
+     * cache lines of other readers
+     */
+    char              pad[128];
 };
 
 /**
- * @brief TrieState structure
+ * @brief TrieHandle structure
  */
-struct _TrieState {
-    const Trie *trie;       /**< the corresponding trie */
-    TrieIndex   index;      /**< index in double-array/tail structures */
-    short       suffix_idx; /**< suffix character offset, if in suffix */
-    short       is_suffix;  /**< whether it is currently in suffix part */
+struct _TrieHandle {
+    Trie             *trie;     /**< the published trie */
+    Trie             *retired;  /**< replaced tries, which readers may
+                                     still hold */
+    TrieHandleReader *readers;  /**< registered readers */
 };
 
 /*------------------------*
@@ -63,26 +113,115 @@ struct _TrieState {
 #define trie_da_get_tail_index(da,s)   (-da_get_base ((da), (s)))
 #define trie_da_set_tail_index(da,s,v) (da_set_base ((da), (s), -(v)))
 
+#define trie_is_mapped(trie)           (NULL != (trie)->map_mem)
+
+#define TRIE_MAPPED_SIGNATURE   0xDBFCDBFC
+#define TRIE_MAPPED_VERSION     1
+#define TRIE_MAPPED_ALIGN       64
+
+#define TRIE_MAPPED_FLAG_DA_LINKS   0x1
+#define TRIE_MAPPED_FLAG_FAILURE    0x2
+#define TRIE_MAPPED_FLAG_VALUES     0x4
+#define TRIE_MAPPED_FLAGS_KNOWN     (TRIE_MAPPED_FLAG_DA_LINKS \
+                                     | TRIE_MAPPED_FLAG_FAILURE \
+                                     | TRIE_MAPPED_FLAG_VALUES)
+
+#define ALIGN_UP(n,a)           (((n) + (a) - 1) / (a) * (a))
+
+/* Mapped Trie Header (all values are little-endian):
+ * - INT32: signature
+ * - INT32: format version
+ * - INT32: flags (TRIE_MAPPED_FLAG_*, other bits must be 0)
+ * - INT32: header size
+ *
+ * Sections, each starting at a TRIE_MAPPED_ALIGN boundary:
+ * - AlphaMap, as written by alpha_map_fwrite_mapped()
+ * - DArray, as written by da_fwrite_mapped()
+ * - Tail, as written by tail_fwrite_mapped()
+ * - DArray child index, as written by da_fwrite_mapped_links(),
+ *   if TRIE_MAPPED_FLAG_DA_LINKS is set
+ * - DArray failure links, as written by da_fwrite_mapped_failure(),
+ *   if TRIE_MAPPED_FLAG_FAILURE is set
+ * - Tail values, as written by tail_fwrite_mapped_values(),
+ *   if TRIE_MAPPED_FLAG_VALUES is set
+ */
+#define TRIE_MAPPED_HEADER_SIZE 16
+
+/* size of the stack buffer for keys converted to trie codes, which covers
+ * all but unusually long keys
+ */
+#define TRIE_KEY_BUFF_SIZE  256
+
 static TrieState * trie_state_new (const Trie *trie,
                                    TrieIndex   index,
-                                   short       suffix_idx,
+                                   int32       suffix_idx,
                                    short       is_suffix);
 
 static Bool
 trie_store_conditionally (Trie            *trie,
                           const AlphaChar *key,
+                          int              len,
                           TrieData         data,
+                          const void      *value,
                           Bool             is_overwrite);
 
+static void        trie_write_begin      (Trie            *trie);
+
+static void        trie_write_end        (Trie            *trie);
+
+static void        trie_handle_free_retired (TrieHandle *handle);
+
+static Bool        trie_do_store         (Trie            *trie,
+                                          const AlphaChar *key,
+                                          int              len,
+                                          TrieData         data,
+                                          const void      *value,
+                                          Bool             is_overwrite);
+
+static Bool        trie_do_store_str     (Trie            *trie,
+                                          const TrieChar  *key_str,
+                                          TrieData         data,
+                                          const void      *value,
+                                          Bool             is_overwrite);
+
+static TrieIndex   trie_find_key         (const Trie      *trie,
+                                          const AlphaChar *key,
+                                          int              len);
+
+static TrieIndex   trie_find_key_str     (const Trie      *trie,
+                                          const TrieChar  *key_str);
+
+static Bool        trie_do_delete        (Trie            *trie,
+                                          const AlphaChar *key);
+
+static TrieChar *  trie_key_to_trie_str  (const AlphaMap  *alpha_map,
+                                          const AlphaChar *key,
+                                          int              len,
+                                          TrieChar        *buff,
+                                          int              buff_size);
+
+static TrieChar *  trie_utf8_to_trie_str (const AlphaMap  *alpha_map,
+                                          const char      *key,
+                                          int              len,
+                                          TrieChar        *buff,
+                                          int              buff_size);
+
 static Bool        trie_branch_in_branch (Trie           *trie,
                                           TrieIndex       sep_node,
                                           const TrieChar *suffix,
-                                          TrieData        data);
+                                          TrieData        data,
+                                          const void     *value);
 
 static Bool        trie_branch_in_tail   (Trie           *trie,
                                           TrieIndex       sep_node,
                                           const TrieChar *suffix,
-                                          TrieData        data);
+                                          TrieData        data,
+                                          const void     *value);
+
+static void        trie_count_walks      (const Trie      *trie,
+                                          const AlphaChar *key,
+                                          TrieData         count,
+                                          int64           *weights);
 
 /*-----------------------*
  *   GENERAL FUNCTIONS   *
@@ -123,6 +262,14 @@ trie_new (const AlphaMap *alpha_map)
         goto exit_da_created;
  
     trie->is_dirty = TRUE;
+    trie->map_mem  = NULL;
+    trie->map_size = 0;
+
+    trie->is_concurrent = FALSE;
+    trie->seq = trie->retire_seq = 0;
+    trie->num_retired = 0;
+    trie->readers = NULL;
+    trie->next_retired = NULL;
     return trie;
 
 exit_da_created:
@@ -193,6 +340,14 @@ trie_fread (FILE *file)
         goto exit_da_created;
 
     trie->is_dirty = FALSE;
+    trie->map_mem  = NULL;
+    trie->map_size = 0;
+
+    trie->is_concurrent = FALSE;
+    trie->seq = trie->retire_seq = 0;
+    trie->num_retired = 0;
+    trie->readers = NULL;
+    trie->next_retired = NULL;
     return trie;
 
 exit_da_created:
@@ -214,10 +369,131 @@ exit_trie_created:
 void
 trie_free (Trie *trie)
 {
+    while (trie->readers) {
+        TrieReader *next = trie->readers->next;
+
+        free (trie->readers);
+        trie->readers = next;
+    }
     alpha_map_free (trie->alpha_map);
     da_free (trie->da);
     tail_free (trie->tail);
+    if (trie_is_mapped (trie))
+        file_unmap (trie->map_mem, trie->map_size);
+    free (trie);
+}
+
+/**
+ * @brief Create a read-only trie by mapping a file into memory
+ *
+ * @param path  : the path to the file, as written by trie_save_mapped()
+ *
+ * @return a pointer to the created trie, NULL on failure
+ *
+ * Create a trie whose double-array and tail data are used directly from
+ * the memory-mapped file at @a path, rather than decoded into allocated
+ * memory. Opening is thus independent of the trie size, and processes
+ * mapping the same file share the same physical pages.
+ *
+ * The trie is read-only: trie_store(), trie_store_if_absent() and
+ * trie_delete() on it always fail. It can still be written out with
+ * trie_save() or trie_fwrite().
+ *
+ * The created object must be freed with trie_free().
+ *
+ * Available since: 0.2.5
+ */
+Trie *
+trie_new_mapped (const char *path)
+{
+    Trie           *trie;
+    unsigned char  *mem;
+    size_t          size, pos, len;
+    int32           flags;
+
+    mem = (unsigned char *) file_map (path, &size);
+    if (!mem)
+        return NULL;
+
+    if (size < TRIE_MAPPED_HEADER_SIZE
+        || TRIE_MAPPED_SIGNATURE != (uint32) mem_read_int32_le (mem)
+        || TRIE_MAPPED_VERSION != mem_read_int32_le (mem + 4)
+        || 0 != ((flags = mem_read_int32_le (mem + 8))
+                 & ~TRIE_MAPPED_FLAGS_KNOWN))
+    {
+        goto exit_file_mapped;
+    }
+    pos = ALIGN_UP (TRIE_MAPPED_HEADER_SIZE, TRIE_MAPPED_ALIGN);
+
+    trie = (Trie *) malloc (sizeof (Trie));
+    if (!trie)
+        goto exit_file_mapped;
+
+    if (pos > size ||
+        NULL == (trie->alpha_map = alpha_map_new_mapped (mem + pos,
+                                                         size - pos, &len)))
+    {
+        goto exit_trie_created;
+    }
+    pos = ALIGN_UP (pos + len, TRIE_MAPPED_ALIGN);
+    if (pos > size ||
+        NULL == (trie->da = da_new_mapped (mem + pos, size - pos, &len)))
+    {
+        goto exit_alpha_map_created;
+    }
+    pos = ALIGN_UP (pos + len, TRIE_MAPPED_ALIGN);
+    if (pos > size ||
+        NULL == (trie->tail = tail_new_mapped (mem + pos, size - pos, &len)))
+    {
+        goto exit_da_created;
+    }
+    if (flags & TRIE_MAPPED_FLAG_DA_LINKS) {
+        pos = ALIGN_UP (pos + len, TRIE_MAPPED_ALIGN);
+        if (pos > size
+            || !da_map_links (trie->da, mem + pos, size - pos, &len))
+        {
+            goto exit_tail_created;
+        }
+    }
+    if (flags & TRIE_MAPPED_FLAG_FAILURE) {
+        pos = ALIGN_UP (pos + len, TRIE_MAPPED_ALIGN);
+        if (pos > size
+            || !da_map_failure (trie->da, mem + pos, size - pos, &len))
+        {
+            goto exit_tail_created;
+        }
+    }
+    if (flags & TRIE_MAPPED_FLAG_VALUES) {
+        pos = ALIGN_UP (pos + len, TRIE_MAPPED_ALIGN);
+        if (pos > size
+            || !tail_map_values (trie->tail, mem + pos, size - pos, &len))
+        {
+            goto exit_tail_created;
+        }
+    }
+
+    trie->is_dirty = FALSE;
+    trie->map_mem  = mem;
+    trie->map_size = size;
+
+    trie->is_concurrent = FALSE;
+    trie->seq = trie->retire_seq = 0;
+    trie->num_retired = 0;
+    trie->readers = NULL;
+    trie->next_retired = NULL;
+    return trie;
+
+exit_tail_created:
+    tail_free (trie->tail);
+exit_da_created:
+    da_free (trie->da);
+exit_alpha_map_created:
+    alpha_map_free (trie->alpha_map);
+exit_trie_created:
     free (trie);
+exit_file_mapped:
+    file_unmap (mem, size);
+    return NULL;
 }
 
 /**
@@ -279,6 +555,89 @@ trie_fwrite (Trie *trie, FILE *file)
     return 0;
 }
 
+/**
+ * @brief Save a trie to file in mappable layout
+ *
+ * @param trie  : the trie
+ *
+ * @param path  : the path to the file
+ *
+ * @return 0 on success, non-zero on failure
+ *
+ * Create a new file at the given @a path and write @a trie data to it in
+ * the aligned little-endian layout to be opened with trie_new_mapped().
+ * If @a path already exists, its contents will be replaced.
+ *
+ * Unlike trie_save(), this does not clear the dirty flag of @a trie, as the
+ * written file cannot be loaded back for updating.
+ *
+ * Available since: 0.2.5
+ */
+int
+trie_save_mapped (const Trie *trie, const char *path)
+{
+    FILE *file;
+    int32 flags;
+    int   res = -1;
+
+    file = fopen (path, "w+");
+    if (!file)
+        return -1;
+
+    flags = TRIE_MAPPED_FLAG_DA_LINKS;
+    if (da_has_failure (trie->da))
+        flags |= TRIE_MAPPED_FLAG_FAILURE;
+    if (tail_get_value_size (trie->tail) > 0)
+        flags |= TRIE_MAPPED_FLAG_VALUES;
+
+    if (!file_write_int32_le (file, TRIE_MAPPED_SIGNATURE) ||
+        !file_write_int32_le (file, TRIE_MAPPED_VERSION)   ||
+        !file_write_int32_le (file, flags) ||
+        !file_write_int32_le (file, TRIE_MAPPED_HEADER_SIZE))
+    {
+        goto exit_file_openned;
+    }
+
+    if (!file_write_padding (file, TRIE_MAPPED_ALIGN) ||
+        alpha_map_fwrite_mapped (trie->alpha_map, file) != 0)
+    {
+        goto exit_file_openned;
+    }
+    if (!file_write_padding (file, TRIE_MAPPED_ALIGN) ||
+        da_fwrite_mapped (trie->da, file) != 0)
+    {
+        goto exit_file_openned;
+    }
+    if (!file_write_padding (file, TRIE_MAPPED_ALIGN) ||
+        tail_fwrite_mapped (trie->tail, file) != 0)
+    {
+        goto exit_file_openned;
+    }
+    if (!file_write_padding (file, TRIE_MAPPED_ALIGN) ||
+        da_fwrite_mapped_links (trie->da, file) != 0)
+    {
+        goto exit_file_openned;
+    }
+    if ((flags & TRIE_MAPPED_FLAG_FAILURE) &&
+        (!file_write_padding (file, TRIE_MAPPED_ALIGN) ||
+         da_fwrite_mapped_failure (trie->da, file) != 0))
+    {
+        goto exit_file_openned;
+    }
+    if ((flags & TRIE_MAPPED_FLAG_VALUES) &&
+        (!file_write_padding (file, TRIE_MAPPED_ALIGN) ||
+         tail_fwrite_mapped_values (trie->tail, file) != 0))
+    {
+        goto exit_file_openned;
+    }
+    res = 0;
+
+exit_file_openned:
+    if (fclose (file) != 0)
+        res = -1;
+    return res;
+}
+
 /**
  * @brief Check pending changes
  *
@@ -295,340 +654,2525 @@ trie_is_dirty (const Trie *trie)
     return trie->is_dirty;
 }
 
-
-/*------------------------------*
- *   GENERAL QUERY OPERATIONS   *
- *------------------------------*/
-
 /**
- * @brief Retrieve an entry from trie
+ * @brief Check whether a trie is read-only
  *
- * @param trie   : the trie
- * @param key    : the key for the entry to retrieve
- * @param o_data : the storage for storing the entry data on return
+ * @param trie  : the trie object
  *
- * @return boolean value indicating the existence of the entry.
+ * @return TRUE if @a trie cannot be modified, FALSE otherwise
  *
- * Retrieve an entry for the given @a key from @a trie. On return,
- * if @a key is found and @a o_data is not NULL, @a *o_data is set
- * to the data associated to @a key.
+ * Check if the @a trie is read-only, as when it is opened with
+ * trie_new_mapped().
+ *
+ * Available since: 0.2.5
  */
 Bool
-trie_retrieve (const Trie *trie, const AlphaChar *key, TrieData *o_data)
+trie_is_readonly (const Trie *trie)
 {
-    TrieIndex        s;
-    short            suffix_idx;
-    const AlphaChar *p;
-
-    /* walk through branches */
-    s = da_get_root (trie->da);
-    for (p = key; !trie_da_is_separate (trie->da, s); p++) {
-        if (!da_walk (trie->da, &s,
-                      alpha_map_char_to_trie (trie->alpha_map, *p)))
-        {
-            return FALSE;
-        }
-        if (0 == *p)
-            break;
-    }
-
-    /* walk through tail */
-    s = trie_da_get_tail_index (trie->da, s);
-    suffix_idx = 0;
-    for ( ; ; p++) {
-        if (!tail_walk_char (trie->tail, s, &suffix_idx,
-                             alpha_map_char_to_trie (trie->alpha_map, *p)))
-        {
-            return FALSE;
-        }
-        if (0 == *p)
-            break;
-    }
-
-    /* found, set the val and return */
-    if (o_data)
-        *o_data = tail_get_data (trie->tail, s);
-    return TRUE;
+    return trie_is_mapped (trie);
 }
 
 /**
- * @brief Store a value for an entry to trie
+ * @brief Get memory used by a trie
  *
- * @param trie  : the trie
- * @param key   : the key for the entry to retrieve
- * @param data  : the data associated to the entry
+ * @param trie        : the trie object
+ * @param o_da_size   : storage for the size of the double-array, in bytes
+ * @param o_tail_size : storage for the size of the tail, in bytes
  *
- * @return boolean value indicating the success of the process
+ * Get the number of bytes occupied by the double-array and the tail of
+ * @a trie, excluding spare capacity reserved for growth. For a trie opened
+ * with trie_new_mapped(), these are the sizes of the mapped sections.
  *
- * Store a @a data for the given @a key in @a trie. If @a key does not 
- * exist in @a trie, it will be appended. If it does, its current data will
- * be overwritten.
+ * Available since: 0.2.5
  */
-Bool
-trie_store (Trie *trie, const AlphaChar *key, TrieData data)
+void
+trie_get_mem_usage (const Trie *trie, size_t *o_da_size, size_t *o_tail_size)
 {
-    return trie_store_conditionally (trie, key, data, TRUE);
+    if (o_da_size)
+        *o_da_size = da_get_mem_size (trie->da);
+    if (o_tail_size)
+        *o_tail_size = tail_get_mem_size (trie->tail);
 }
 
 /**
- * @brief Store a value for an entry to trie only if the key is not present
+ * @brief Set size of the values of trie entries
  *
- * @param trie  : the trie
- * @param key   : the key for the entry to retrieve
- * @param data  : the data associated to the entry
+ * @param trie       : the trie
+ * @param value_size : the size of the value of each entry in bytes, or 0
  *
  * @return boolean value indicating the success of the process
  *
- * Store a @a data for the given @a key in @a trie. If @a key does not 
- * exist in @a trie, it will be appended. If it does, the function will
- * return failure and the existing value will not be touched.
+ * Give each entry of @a trie a fixed-size value of @a value_size bytes,
+ * besides its TrieData, to be set with trie_store_value() and read with
+ * trie_retrieve_value(). Values are opaque bytes, saved with the trie as
+ * they are. Existing values are kept, truncated or padded with zeros; the
+ * values of entries stored with trie_store() are zeros. A size of 0 drops
+ * the values.
  *
- * This can be useful for multi-thread applications, as race condition
- * can be avoided.
+ * A trie with values is saved by trie_save() in a format that versions
+ * before 0.2.5 refuse to read. Without values, the format is unchanged.
  *
- * Available since: 0.2.4
+ * This fails on a read-only trie, or on a trie in concurrent mode.
+ *
+ * Available since: 0.2.5
  */
 Bool
-trie_store_if_absent (Trie *trie, const AlphaChar *key, TrieData data)
+trie_set_value_size (Trie *trie, int value_size)
 {
-    return trie_store_conditionally (trie, key, data, FALSE);
+    if (trie_is_mapped (trie) || trie->is_concurrent)
+        return FALSE;
+    if (!tail_set_value_size (trie->tail, value_size))
+        return FALSE;
+    trie->is_dirty = TRUE;
+    return TRUE;
 }
 
-static Bool
-trie_store_conditionally (Trie            *trie,
-                          const AlphaChar *key,
-                          TrieData         data,
-                          Bool             is_overwrite)
+/**
+ * @brief Get size of the values of trie entries
+ *
+ * @param trie : the trie
+ *
+ * @return the size of the value of each entry in bytes, 0 if none
+ *
+ * Available since: 0.2.5
+ */
+int
+trie_get_value_size (const Trie *trie)
 {
-    TrieIndex        s, t;
-    short            suffix_idx;
-    const AlphaChar *p, *sep;
+    return tail_get_value_size (trie->tail);
+}
 
-    /* walk through branches */
-    s = da_get_root (trie->da);
-    for (p = key; !trie_da_is_separate (trie->da, s); p++) {
-        if (!da_walk (trie->da, &s,
-                      alpha_map_char_to_trie (trie->alpha_map, *p)))
-        {
-            TrieChar *key_str;
-            Bool      res;
+/**
+ * @brief Share common key endings in trie tail
+ *
+ * @param trie  : the trie object
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Repack the suffixes kept in the tail of @a trie, so that identical ones
+ * are stored once, and one that ends another, such as "ing" in "ting", is
+ * stored as the end of it. Keys are not affected, and the trie can still
+ * be modified afterwards; changed suffixes are then copied rather than
+ * overwritten.
+ *
+ * The sharing is kept by trie_save_mapped(). The stream format stores each
+ * suffix separately, so a trie saved with trie_save() and loaded back is
+ * unshared.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_share_suffixes (Trie *trie)
+{
+    Bool    res;
 
-            key_str = alpha_map_char_to_trie_str (trie->alpha_map, p);
-            res = trie_branch_in_branch (trie, s, key_str, data);
-            free (key_str);
+    if (trie_is_mapped (trie))
+        return FALSE;
 
-            return res;
-        }
-        if (0 == *p)
-            break;
-    }
+    trie_write_begin (trie);
+    res = tail_share_suffixes (trie->tail);
+    trie_write_end (trie);
 
-    /* walk through tail */
-    sep = p;
-    t = trie_da_get_tail_index (trie->da, s);
-    suffix_idx = 0;
-    for ( ; ; p++) {
-        if (!tail_walk_char (trie->tail, t, &suffix_idx,
-                             alpha_map_char_to_trie (trie->alpha_map, *p)))
-        {
-            TrieChar *tail_str;
-            Bool      res;
+    return res;
+}
+
+/**
+ * @brief Renumber trie states for cache locality
+ *
+ * @param trie   : the trie object
+ * @param layout : the order in which to place the states
+ * @param keys   : keys looked up in a typical workload, or NULL
+ * @param counts : number of lookups of each of @a keys, or NULL for one
+ * @param n_keys : the number of @a keys
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Rebuild the double-array of @a trie with its states placed in @a layout
+ * order rather than in the order keys were added, so that lookups touch
+ * fewer cache lines and pages. TRIE_LAYOUT_DFS keeps the states of a path
+ * close together, which suits lookups of keys spread over the whole trie.
+ * If @a keys are given, the states they walk through are placed first,
+ * the most walked first, so that the hot part of the trie is packed at
+ * the beginning. Keys and data are not affected, and the trie can still
+ * be modified afterwards, the new keys being placed as usual.
+ *
+ * The layout is kept by trie_save() and trie_save_mapped(), so it can be
+ * done once, offline. States and iterators of @a trie must not be used
+ * across the call. A mapped or concurrent trie cannot be relaid out.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_relayout (Trie              *trie,
+               TrieLayout         layout,
+               const AlphaChar   *const keys[],
+               const TrieData     counts[],
+               int                n_keys)
+{
+    int64      *weights = NULL;
+    DArray     *new_da;
+    int         i;
 
-            tail_str = alpha_map_char_to_trie_str (trie->alpha_map, sep);
-            res = trie_branch_in_tail (trie, s, tail_str, data);
-            free (tail_str);
+    if (trie_is_mapped (trie) || trie->is_concurrent)
+        return FALSE;
 
-            return res;
-        }
-        if (0 == *p)
-            break;
+    if (keys && n_keys > 0) {
+        weights = (int64 *) calloc (da_get_num_cells (trie->da),
+                                    sizeof (int64));
+        if (!weights)
+            return FALSE;
+        for (i = 0; i < n_keys; i++)
+            trie_count_walks (trie, keys[i], counts ? counts[i] : 1, weights);
     }
 
-    /* duplicated key, overwrite val if flagged */
-    if (!is_overwrite) {
+    new_da = da_new_relayout (trie->da, weights, TRIE_LAYOUT_DFS == layout,
+                              NULL, NULL);
+    free (weights);
+    if (!new_da)
         return FALSE;
-    }
-    tail_set_data (trie->tail, t, data);
+
+    da_free (trie->da);
+    trie->da = new_da;
     trie->is_dirty = TRUE;
+
     return TRUE;
 }
 
-static Bool
-trie_branch_in_branch (Trie           *trie,
-                       TrieIndex       sep_node,
+/* add count to each state of the double-array walked through by key */
+static void
+trie_count_walks (const Trie       *trie,
+                  const AlphaChar  *key,
+                  TrieData          count,
+                  int64            *weights)
+{
+    TrieIndex   s;
+
+    s = da_get_root (trie->da);
+    weights[s] += count;
+    while (!trie_da_is_separate (trie->da, s)
+           && da_walk (trie->da, &s,
+                       alpha_map_char_to_trie (trie->alpha_map, *key)))
+    {
+        weights[s] += count;
+        if (0 == *key++)
+            break;
+    }
+}
+
+/* build compacted copies of the double-array and tail of trie */
+static Bool
+trie_compact_structures (const Trie *trie, DArray **o_da, Tail **o_tail)
+{
+    TrieIndex      *sep_nodes;
+    TrieIndex      *blocks;
+    TrieIndex       num_sep, i;
+    DArray         *da;
+    Tail           *tail;
+
+    /* breadth-first placement fills the cells most densely, and gives the
+     * separate nodes in the same pass */
+    da = da_new_relayout (trie->da, NULL, FALSE, &sep_nodes, &num_sep);
+    if (!da)
+        return FALSE;
+
+    /* a double-array with few free cells may come out of placement with
+     * more, keep its layout then */
+    if (da_get_num_cells (da) >= da_get_num_cells (trie->da)) {
+        da_free (da);
+        free (sep_nodes);
+        da = da_new_copy (trie->da, &sep_nodes, &num_sep);
+        if (!da)
+            return FALSE;
+    }
+
+    /* renumber tail blocks in the order of their separate nodes, leaving
+     * out free ones */
+    blocks = (TrieIndex *) malloc ((num_sep + 1) * sizeof (TrieIndex));
+    if (!blocks)
+        goto exit_da_created;
+    for (i = 0; i < num_sep; i++)
+        blocks[i] = trie_da_get_tail_index (da, sep_nodes[i]);
+    tail = tail_new_compacted (trie->tail, blocks, num_sep);
+    if (!tail) {
+        free (blocks);
+        goto exit_da_created;
+    }
+    for (i = 0; i < num_sep; i++)
+        trie_da_set_tail_index (da, sep_nodes[i], blocks[i]);
+    free (blocks);
+    free (sep_nodes);
+
+    *o_da = da;
+    *o_tail = tail;
+    return TRUE;
+
+exit_da_created:
+    free (sep_nodes);
+    da_free (da);
+    return FALSE;
+}
+
+/**
+ * @brief Compact trie structures
+ *
+ * @param trie  : the trie object
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Rebuild the double-array and the tail of @a trie without the free cells
+ * and free tail blocks left by deleted keys. The states are placed
+ * breadth-first, which fills nearly all cells, and the tail blocks are
+ * renumbered in the same order with their suffixes packed, so that the
+ * suffixes of sibling states are neighbours and lookups and enumeration
+ * touch less scattered memory. Keys, data and values are not
+ * affected, and the trie can still be modified afterwards.
+ *
+ * If placing the states would not take fewer cells, as for a trie that
+ * is already dense, the double-array is kept as it is, and only the tail
+ * is compacted. So compacting never makes the double-array larger.
+ *
+ * Failure links built with trie_build_failure_links() are dropped, and so
+ * is any layout done with trie_relayout() unless the double-array is kept.
+ * Suffixes shared with trie_share_suffixes() are shared again. Use
+ * trie_get_cell_usage() to see how many cells are free before and after.
+ *
+ * The structures are rebuilt aside and then swapped in, so the trie needs
+ * as much memory again during the call. States and iterators of @a trie
+ * must not be used across the call. A mapped or concurrent trie cannot be
+ * compacted in place; use trie_new_compacted() instead.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_compact (Trie *trie)
+{
+    DArray     *da;
+    Tail       *tail;
+
+    if (trie_is_mapped (trie) || trie->is_concurrent)
+        return FALSE;
+    if (!trie_compact_structures (trie, &da, &tail))
+        return FALSE;
+
+    da_free (trie->da);
+    tail_free (trie->tail);
+    trie->da = da;
+    trie->tail = tail;
+    trie->is_dirty = TRUE;
+
+    return TRUE;
+}
+
+/**
+ * @brief Create a compacted copy of a trie
+ *
+ * @param trie  : the trie object
+ *
+ * @return a pointer to the new trie, NULL on failure
+ *
+ * Same as trie_compact(), but build the compacted structures into a new
+ * trie, leaving @a trie unchanged. This works on a mapped trie, giving a
+ * modifiable copy of it. For a trie in concurrent mode, it is to be called
+ * by the writer thread, or while no key is being written, and the copy can
+ * then be put in service with trie_handle_publish() while readers keep
+ * using the old trie.
+ *
+ * Available since: 0.2.5
+ */
+Trie *
+trie_new_compacted (const Trie *trie)
+{
+    Trie       *new_trie;
+    DArray     *da;
+    Tail       *tail;
+
+    new_trie = trie_new (trie->alpha_map);
+    if (!new_trie)
+        return NULL;
+    if (!trie_compact_structures (trie, &da, &tail)) {
+        trie_free (new_trie);
+        return NULL;
+    }
+
+    da_free (new_trie->da);
+    tail_free (new_trie->tail);
+    new_trie->da = da;
+    new_trie->tail = tail;
+
+    return new_trie;
+}
+
+/**
+ * @brief Get cell usage of trie double-array
+ *
+ * @param trie        : the trie object
+ * @param o_num_cells : the storage for the number of cells, or NULL
+ * @param o_num_free  : the storage for the number of free cells, or NULL
+ *
+ * Get the number of cells of the double-array of @a trie, and how many of
+ * them are free, e.g. left by deleted keys. The load factor of the array
+ * is the share of cells in use, (cells - free) / cells. The free cells
+ * are counted through the whole array, which takes time proportional to
+ * its size.
+ *
+ * Available since: 0.2.5
+ */
+void
+trie_get_cell_usage (const Trie *trie,
+                     TrieIndex  *o_num_cells,
+                     TrieIndex  *o_num_free)
+{
+    if (o_num_cells)
+        *o_num_cells = da_get_num_cells (trie->da);
+    if (o_num_free)
+        *o_num_free = da_get_num_free (trie->da);
+}
+
+/**
+ * @brief Get alphabet map of a trie
+ *
+ * @param trie : the trie
+ *
+ * @return the alphabet map of @a trie, owned by it
+ *
+ * Get the alphabet map of @a trie, e.g. to create other tries with the
+ * same alphabet, as for trie_build_from_parts().
+ *
+ * Available since: 0.2.5
+ */
+const AlphaMap *
+trie_get_alpha_map (const Trie *trie)
+{
+    return trie->alpha_map;
+}
+
+
+/*------------------------------*
+ *   GENERAL QUERY OPERATIONS   *
+ *------------------------------*/
+
+/**
+ * @brief Retrieve an entry from trie
+ *
+ * @param trie   : the trie
+ * @param key    : the key for the entry to retrieve
+ * @param o_data : the storage for storing the entry data on return
+ *
+ * @return boolean value indicating the existence of the entry.
+ *
+ * Retrieve an entry for the given @a key from @a trie. On return,
+ * if @a key is found and @a o_data is not NULL, @a *o_data is set
+ * to the data associated to @a key.
+ */
+Bool
+trie_retrieve (const Trie *trie, const AlphaChar *key, TrieData *o_data)
+{
+    return trie_retrieve_n (trie, key, INT_MAX, o_data);
+}
+
+/**
+ * @brief Retrieve an entry from trie, with key length
+ *
+ * @param trie   : the trie
+ * @param key    : the key for the entry to retrieve
+ * @param len    : the number of characters in @a key
+ * @param o_data : the storage for storing the entry data on return
+ *
+ * @return boolean value indicating the existence of the entry.
+ *
+ * Same as trie_retrieve(), but the key is given by its first @a len
+ * characters, so it needs not be zero-terminated, and can be a part of
+ * a longer string. The key still ends at the first zero character, if any.
+ *
+ * No memory is allocated during the lookup.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_retrieve_n (const Trie        *trie,
+                 const AlphaChar   *key,
+                 int                len,
+                 TrieData          *o_data)
+{
+    TrieIndex   t;
+
+    t = trie_find_key (trie, key, len);
+    if (TRIE_INDEX_ERROR == t)
+        return FALSE;
+
+    /* found, set the val and return */
+    if (o_data)
+        *o_data = tail_get_data (trie->tail, t);
+    return TRUE;
+}
+
+/**
+ * @brief Retrieve an entry from trie, with UTF-8 key
+ *
+ * @param trie   : the trie
+ * @param key    : the key for the entry to retrieve, in UTF-8
+ * @param len    : the number of bytes of @a key, or -1 if NUL-terminated
+ * @param o_data : the storage for storing the entry data on return
+ *
+ * @return boolean value indicating the existence of the entry.
+ *
+ * Same as trie_retrieve(), but with the key given as UTF-8 bytes, up to
+ * @a len bytes or a NUL byte. The key is decoded and mapped to the trie
+ * alphabet in one pass, with no AlphaChar string in between, and runs of
+ * ASCII characters are checked several bytes at a time. A key that is not
+ * valid UTF-8, or has a character out of the alphabet, is not found.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_retrieve_utf8 (const Trie    *trie,
+                    const char    *key,
+                    int            len,
+                    TrieData      *o_data)
+{
+    TrieChar    buff[TRIE_KEY_BUFF_SIZE];
+    TrieChar   *key_str;
+    TrieIndex   t;
+
+    key_str = trie_utf8_to_trie_str (trie->alpha_map, key, len,
+                                     buff, TRIE_KEY_BUFF_SIZE);
+    if (!key_str)
+        return FALSE;
+    t = trie_find_key_str (trie, key_str);
+    if (key_str != buff)
+        free (key_str);
+    if (TRIE_INDEX_ERROR == t)
+        return FALSE;
+
+    if (o_data)
+        *o_data = tail_get_data (trie->tail, t);
+    return TRUE;
+}
+
+/**
+ * @brief Retrieve the value of an entry from trie
+ *
+ * @param trie    : the trie
+ * @param key     : the key for the entry to retrieve
+ * @param o_value : the storage for the entry value on return
+ *
+ * @return boolean value indicating the existence of the entry.
+ *
+ * Retrieve an entry for the given @a key from @a trie, as trie_retrieve()
+ * does. On return, if @a key is found and @a o_value is not NULL, the
+ * fixed-size value of the entry is copied to @a o_value, which must have
+ * room for trie_get_value_size() bytes.
+ *
+ * The value is kept next to the rest of the entry, so this saves a lookup
+ * in a separate table of values indexed by the entry data.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_retrieve_value (const Trie *trie, const AlphaChar *key, void *o_value)
+{
+    TrieIndex   t;
+    const void *value;
+
+    t = trie_find_key (trie, key, INT_MAX);
+    if (TRIE_INDEX_ERROR == t)
+        return FALSE;
+
+    if (o_value) {
+        value = tail_get_value (trie->tail, t);
+        if (!value)
+            return FALSE;
+        memcpy (o_value, value, tail_get_value_size (trie->tail));
+    }
+    return TRUE;
+}
+
+/* tail block of the first len characters of key, or TRIE_INDEX_ERROR */
+static TrieIndex
+trie_find_key (const Trie *trie, const AlphaChar *key, int len)
+{
+    TrieIndex       s;
+    const TrieChar *suffix;
+    int32           max_len, j;
+    AlphaChar       c;
+    int             i;
+
+    /* walk through branches */
+    s = da_get_root (trie->da);
+    for (i = 0; !trie_da_is_separate (trie->da, s); i++) {
+        c = (i < len) ? key[i] : 0;
+        if (!da_walk (trie->da, &s,
+                      alpha_map_char_to_trie (trie->alpha_map, c)))
+        {
+            return TRIE_INDEX_ERROR;
+        }
+        if (0 == c)
+            break;
+    }
+
+    /* walk through tail, within the pool in case of a concurrent write */
+    s = trie_da_get_tail_index (trie->da, s);
+    suffix = tail_peek_suffix (trie->tail, s, &max_len);
+    if (!suffix)
+        return TRIE_INDEX_ERROR;
+    for (j = 0; ; i++, j++) {
+        c = (i < len) ? key[i] : 0;
+        if (j >= max_len
+            || suffix[j] != alpha_map_char_to_trie (trie->alpha_map, c))
+        {
+            return TRIE_INDEX_ERROR;
+        }
+        if (0 == c)
+            break;
+    }
+
+    return s;
+}
+
+/* same as trie_find_key(), for a key already in trie codes */
+static TrieIndex
+trie_find_key_str (const Trie *trie, const TrieChar *key_str)
+{
+    TrieIndex       s;
+    const TrieChar *p, *suffix;
+    int32           max_len, j;
+
+    /* walk through branches */
+    s = da_get_root (trie->da);
+    for (p = key_str; !trie_da_is_separate (trie->da, s); p++) {
+        if (!da_walk (trie->da, &s, *p))
+            return TRIE_INDEX_ERROR;
+        if (0 == *p)
+            break;
+    }
+
+    /* walk through tail, within the pool in case of a concurrent write */
+    s = trie_da_get_tail_index (trie->da, s);
+    suffix = tail_peek_suffix (trie->tail, s, &max_len);
+    if (!suffix)
+        return TRIE_INDEX_ERROR;
+    for (j = 0; ; p++, j++) {
+        if (j >= max_len || suffix[j] != *p)
+            return TRIE_INDEX_ERROR;
+        if (0 == *p)
+            break;
+    }
+
+    return s;
+}
+
+/* number of lookups kept in flight by trie_retrieve_batch() */
+#define TRIE_BATCH_WIDTH    16
+
+typedef enum {
+    TRIE_BATCH_DA,          /* checking the pending double-array cell */
+    TRIE_BATCH_TAIL_BLOCK,  /* reading the tail block for the suffix */
+    TRIE_BATCH_TAIL_SUFFIX  /* comparing the suffix */
+} _TrieBatchStage;
+
+typedef struct {
+    int                 index;  /**< index of the key in batch, -1 if idle */
+    const AlphaChar    *p;      /**< key character being walked */
+    TrieIndex           s;      /**< current node, or tail block */
+    TrieIndex           next;   /**< pending cell, for stage TRIE_BATCH_DA */
+    _TrieBatchStage     stage;
+    const TrieChar     *suffix; /**< suffix, for TRIE_BATCH_TAIL_SUFFIX */
+} _TrieBatchSlot;
+
+/* Take the step out of the double-array node slot->s, whose cell has just
+ * been read and is in cache, and prefetch the cell for the following step.
+ */
+static void
+trie_batch_advance (const Trie *trie, _TrieBatchSlot *slot)
+{
+    TrieIndex   base;
+
+    base = da_get_base (trie->da, slot->s);
+    if (base < 0) {
+        slot->s = -base;
+        slot->stage = TRIE_BATCH_TAIL_BLOCK;
+        tail_prefetch (trie->tail, slot->s);
+        return;
+    }
+
+    slot->next = base + alpha_map_char_to_trie (trie->alpha_map, *slot->p);
+    slot->stage = TRIE_BATCH_DA;
+    da_prefetch (trie->da, slot->next);
+}
+
+/* Run one stage of the lookup in slot, whose memory has been prefetched
+ * in its previous stage. Returns FALSE when the lookup is finished, with
+ * its result stored in o_data.
+ */
+static Bool
+trie_batch_step (const Trie        *trie,
+                 _TrieBatchSlot    *slot,
+                 TrieData           o_data[],
+                 int               *n_found)
+{
+    const TrieChar *suffix;
+    TrieData        data;
+    int             i;
+
+    data = TRIE_DATA_ERROR;
+
+    switch (slot->stage) {
+    case TRIE_BATCH_DA:
+        if (da_get_check (trie->da, slot->next) != slot->s)
+            goto done;
+        slot->s = slot->next;
+        if (0 != *slot->p) {
+            ++slot->p;
+        } else if (!trie_da_is_separate (trie->da, slot->s)) {
+            goto done;
+        }
+        trie_batch_advance (trie, slot);
+        return TRUE;
+
+    case TRIE_BATCH_TAIL_BLOCK:
+        slot->suffix = tail_get_suffix (trie->tail, slot->s);
+        if (!slot->suffix)
+            goto done;
+        slot->stage = TRIE_BATCH_TAIL_SUFFIX;
+        TRIE_PREFETCH (slot->suffix);
+        return TRUE;
+
+    case TRIE_BATCH_TAIL_SUFFIX:
+        suffix = slot->suffix;
+        for (i = 0; ; i++) {
+            if (suffix[i] != alpha_map_char_to_trie (trie->alpha_map,
+                                                     slot->p[i]))
+            {
+                goto done;
+            }
+            if (0 == suffix[i])
+                break;
+        }
+        data = tail_get_data (trie->tail, slot->s);
+        ++*n_found;
+        break;
+    }
+
+done:
+    if (o_data)
+        o_data[slot->index] = data;
+    return FALSE;
+}
+
+static void
+trie_batch_start (const Trie       *trie,
+                  _TrieBatchSlot   *slot,
+                  const AlphaChar  *key,
+                  int               index)
+{
+    slot->index = index;
+    slot->p     = key;
+    slot->s     = da_get_root (trie->da);
+    trie_batch_advance (trie, slot);
+}
+
+/**
+ * @brief Retrieve a batch of entries from trie
+ *
+ * @param trie   : the trie
+ * @param keys   : the keys for the entries to retrieve
+ * @param n_keys : the number of keys
+ * @param o_data : the storage for the @a n_keys entry data on return,
+ *                 or NULL
+ *
+ * @return the number of keys found
+ *
+ * Retrieve the entries for @a keys[i] from @a trie, for i from 0 to
+ * @a n_keys - 1. On return, if @a o_data is not NULL, @a o_data[i] is set
+ * to the data associated to @a keys[i], or TRIE_DATA_ERROR if it is not
+ * found. Use trie_retrieve() to tell a missing key from one associated to
+ * TRIE_DATA_ERROR.
+ *
+ * The result is the same as calling trie_retrieve() for each key, but
+ * faster for large tries: the walks of several keys are interleaved, and
+ * the memory for the next step of each walk is prefetched while the other
+ * walks proceed, so that cache misses overlap rather than follow one
+ * another.
+ *
+ * Available since: 0.2.5
+ */
+int
+trie_retrieve_batch (const Trie        *trie,
+                     const AlphaChar   *const keys[],
+                     int                n_keys,
+                     TrieData           o_data[])
+{
+    _TrieBatchSlot  slots[TRIE_BATCH_WIDTH];
+    int             n_slots, n_active, n_found;
+    int             first, i;
+
+    n_found = 0;
+    for (first = 0; first < n_keys; first += n_slots) {
+        n_slots = MIN_VAL (TRIE_BATCH_WIDTH, n_keys - first);
+        for (i = 0; i < n_slots; i++)
+            trie_batch_start (trie, &slots[i], keys[first + i], first + i);
+
+        /* round-robin over the group until all its lookups are done */
+        for (n_active = n_slots; n_active > 0; ) {
+            for (i = 0; i < n_slots; i++) {
+                if (slots[i].index < 0
+                    || trie_batch_step (trie, &slots[i], o_data, &n_found))
+                {
+                    continue;
+                }
+                slots[i].index = -1;
+                --n_active;
+            }
+        }
+    }
+
+    return n_found;
+}
+
+/**
+ * @brief Store a value for an entry to trie
+ *
+ * @param trie  : the trie
+ * @param key   : the key for the entry to retrieve
+ * @param data  : the data associated to the entry
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Store a @a data for the given @a key in @a trie. If @a key does not 
+ * exist in @a trie, it will be appended. If it does, its current data will
+ * be overwritten.
+ */
+Bool
+trie_store (Trie *trie, const AlphaChar *key, TrieData data)
+{
+    return trie_store_conditionally (trie, key, INT_MAX, data, NULL, TRUE);
+}
+
+/**
+ * @brief Store a value for an entry to trie, with key length
+ *
+ * @param trie  : the trie
+ * @param key   : the key for the entry to store
+ * @param len   : the number of characters in @a key
+ * @param data  : the data associated to the entry
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Same as trie_store(), but the key is given by its first @a len
+ * characters, as with trie_retrieve_n().
+ *
+ * Storing allocates no memory, unless the trie storage has to grow, or the
+ * key is longer than 255 characters.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_store_n (Trie *trie, const AlphaChar *key, int len, TrieData data)
+{
+    return trie_store_conditionally (trie, key, len, data, NULL, TRUE);
+}
+
+/**
+ * @brief Store a value for an entry to trie only if the key is not present
+ *
+ * @param trie  : the trie
+ * @param key   : the key for the entry to retrieve
+ * @param data  : the data associated to the entry
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Store a @a data for the given @a key in @a trie. If @a key does not 
+ * exist in @a trie, it will be appended. If it does, the function will
+ * return failure and the existing value will not be touched.
+ *
+ * This can be useful for multi-thread applications, as race condition
+ * can be avoided.
+ *
+ * Available since: 0.2.4
+ */
+Bool
+trie_store_if_absent (Trie *trie, const AlphaChar *key, TrieData data)
+{
+    return trie_store_conditionally (trie, key, INT_MAX, data, NULL, FALSE);
+}
+
+/**
+ * @brief Store an entry with a value to trie
+ *
+ * @param trie  : the trie
+ * @param key   : the key for the entry
+ * @param data  : the data associated to the entry
+ * @param value : the value associated to the entry
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Same as trie_store(), also storing a copy of the trie_get_value_size()
+ * bytes at @a value as the fixed-size value of the entry. It fails if the
+ * values of @a trie have no size.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_store_value (Trie             *trie,
+                  const AlphaChar  *key,
+                  TrieData          data,
+                  const void       *value)
+{
+    if (0 == tail_get_value_size (trie->tail))
+        return FALSE;
+    return trie_store_conditionally (trie, key, INT_MAX, data, value, TRUE);
+}
+
+/**
+ * @brief Store a value for an entry to trie, with UTF-8 key
+ *
+ * @param trie  : the trie
+ * @param key   : the key for the entry to store, in UTF-8
+ * @param len   : the number of bytes of @a key, or -1 if NUL-terminated
+ * @param data  : the data associated to the entry
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Same as trie_store(), but with the key given as UTF-8 bytes, as with
+ * trie_retrieve_utf8(). It fails if @a key is not valid UTF-8, or has a
+ * character out of the alphabet of @a trie.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_store_utf8 (Trie *trie, const char *key, int len, TrieData data)
+{
+    TrieChar    buff[TRIE_KEY_BUFF_SIZE];
+    TrieChar   *key_str;
+    Bool        res;
+
+    if (trie_is_mapped (trie))
+        return FALSE;
+
+    key_str = trie_utf8_to_trie_str (trie->alpha_map, key, len,
+                                     buff, TRIE_KEY_BUFF_SIZE);
+    if (!key_str)
+        return FALSE;
+
+    trie_write_begin (trie);
+    res = trie_do_store_str (trie, key_str, data, NULL, TRUE);
+    trie_write_end (trie);
+
+    if (key_str != buff)
+        free (key_str);
+    return res;
+}
+
+static Bool
+trie_store_conditionally (Trie            *trie,
+                          const AlphaChar *key,
+                          int              len,
+                          TrieData         data,
+                          const void      *value,
+                          Bool             is_overwrite)
+{
+    Bool    res;
+
+    if (trie_is_mapped (trie))
+        return FALSE;
+
+    trie_write_begin (trie);
+    res = trie_do_store (trie, key, len, data, value, is_overwrite);
+    trie_write_end (trie);
+
+    return res;
+}
+
+static Bool
+trie_do_store (Trie            *trie,
+               const AlphaChar *key,
+               int              len,
+               TrieData         data,
+               const void      *value,
+               Bool             is_overwrite)
+{
+    TrieChar    buff[TRIE_KEY_BUFF_SIZE];
+    TrieChar   *key_str;
+    Bool        res;
+
+    key_str = trie_key_to_trie_str (trie->alpha_map, key, len,
+                                    buff, TRIE_KEY_BUFF_SIZE);
+    if (!key_str)
+        return FALSE;
+    res = trie_do_store_str (trie, key_str, data, value, is_overwrite);
+    if (key_str != buff)
+        free (key_str);
+
+    return res;
+}
+
+static Bool
+trie_do_store_str (Trie            *trie,
+                   const TrieChar  *key_str,
+                   TrieData         data,
+                   const void      *value,
+                   Bool             is_overwrite)
+{
+    TrieIndex       s, t;
+    int32           suffix_idx;
+    const TrieChar *p, *sep;
+
+    /* walk through branches */
+    s = da_get_root (trie->da);
+    for (p = key_str; !trie_da_is_separate (trie->da, s); p++) {
+        if (!da_walk (trie->da, &s, *p))
+            return trie_branch_in_branch (trie, s, p, data, value);
+        if (0 == *p)
+            break;
+    }
+
+    /* walk through tail */
+    sep = p;
+    t = trie_da_get_tail_index (trie->da, s);
+    suffix_idx = 0;
+    for ( ; ; p++) {
+        if (!tail_walk_char (trie->tail, t, &suffix_idx, *p))
+            return trie_branch_in_tail (trie, s, sep, data, value);
+        if (0 == *p)
+            break;
+    }
+
+    /* duplicated key, overwrite val if flagged */
+    if (!is_overwrite) {
+        return FALSE;
+    }
+    tail_set_data (trie->tail, t, data);
+    if (value)
+        tail_set_value (trie->tail, t, value);
+    trie->is_dirty = TRUE;
+    return TRUE;
+}
+
+/* Convert the first @a len characters of @a key, up to its terminator,
+ * into @a buff if it fits, or into a newly allocated string otherwise,
+ * which is to be freed by the caller. Returns NULL on allocation failure.
+ */
+static TrieChar *
+trie_key_to_trie_str  (const AlphaMap  *alpha_map,
+                       const AlphaChar *key,
+                       int              len,
+                       TrieChar        *buff,
+                       int              buff_size)
+{
+    TrieChar   *trie_str;
+    int         n, i;
+
+    for (n = 0; n < len && key[n]; n++)
+        ;
+
+    trie_str = buff;
+    if (n >= buff_size) {
+        trie_str = (TrieChar *) malloc (n + 1);
+        if (!trie_str)
+            return NULL;
+    }
+
+    for (i = 0; i < n; i++) {
+        trie_str[i] = alpha_map_char_to_trie (alpha_map, key[i]);
+    }
+    trie_str[n] = 0;
+
+    return trie_str;
+}
+
+/* Same as trie_key_to_trie_str(), for the first @a len bytes of UTF-8
+ * @a key, or all of it if @a len is negative. Also returns NULL if @a key
+ * is not valid UTF-8 or has a character out of the alphabet.
+ */
+static TrieChar *
+trie_utf8_to_trie_str (const AlphaMap  *alpha_map,
+                       const char      *key,
+                       int              len,
+                       TrieChar        *buff,
+                       int              buff_size)
+{
+    TrieChar   *trie_str;
+
+    if (len < 0)
+        len = strlen (key);
+
+    trie_str = buff;
+    if (len >= buff_size) {
+        trie_str = (TrieChar *) malloc ((size_t) len + 1);
+        if (!trie_str)
+            return NULL;
+    }
+
+    if (alpha_map_utf8_to_trie_str (alpha_map, key, len, trie_str) < 0) {
+        if (trie_str != buff)
+            free (trie_str);
+        return NULL;
+    }
+
+    return trie_str;
+}
+
+static Bool
+trie_branch_in_branch (Trie           *trie,
+                       TrieIndex       sep_node,
+                       const TrieChar *suffix,
+                       TrieData        data,
+                       const void     *value)
+{
+    TrieIndex new_da, new_tail;
+
+    new_da = da_insert_branch (trie->da, sep_node, *suffix);
+    if (TRIE_INDEX_ERROR == new_da)
+        return FALSE;
+
+    if ('\0' != *suffix)
+        ++suffix;
+
+    new_tail = tail_add_suffix (trie->tail, suffix);
+    tail_set_data (trie->tail, new_tail, data);
+    if (value)
+        tail_set_value (trie->tail, new_tail, value);
+    trie_da_set_tail_index (trie->da, new_da, new_tail);
+
+    trie->is_dirty = TRUE;
+    return TRUE;
+}
+
+static Bool
+trie_branch_in_tail   (Trie           *trie,
+                       TrieIndex       sep_node,
                        const TrieChar *suffix,
-                       TrieData        data)
+                       TrieData        data,
+                       const void     *value)
+{
+    TrieIndex       old_tail, old_da, s;
+    const TrieChar *old_suffix, *p;
+
+    /* adjust separate point in old path */
+    old_tail = trie_da_get_tail_index (trie->da, sep_node);
+    old_suffix = tail_get_suffix (trie->tail, old_tail);
+    if (!old_suffix)
+        return FALSE;
+
+    for (p = old_suffix, s = sep_node; *p == *suffix; p++, suffix++) {
+        TrieIndex t = da_insert_branch (trie->da, s, *p);
+        if (TRIE_INDEX_ERROR == t)
+            goto fail;
+        s = t;
+    }
+
+    old_da = da_insert_branch (trie->da, s, *p);
+    if (TRIE_INDEX_ERROR == old_da)
+        goto fail;
+
+    if ('\0' != *p)
+        ++p;
+    tail_set_suffix (trie->tail, old_tail, p);
+    trie_da_set_tail_index (trie->da, old_da, old_tail);
+
+    /* insert the new branch at the new separate point */
+    return trie_branch_in_branch (trie, s, suffix, data, value);
+
+fail:
+    /* failed, undo previous insertions and return error */
+    da_prune_upto (trie->da, sep_node, s);
+    trie_da_set_tail_index (trie->da, sep_node, old_tail);
+    return FALSE;
+}
+
+/* node pending in bulk build: keys [lo, hi) sharing first depth chars */
+typedef struct {
+    TrieIndex   node;
+    int         lo;
+    int         hi;
+} _TrieBuildNode;
+
+typedef struct {
+    _TrieBuildNode *nodes;
+    int             num_nodes;
+    int             size;
+} _TrieBuildLevel;
+
+static Bool
+trie_build_level_add (_TrieBuildLevel *level, TrieIndex node, int lo, int hi)
+{
+    if (level->num_nodes == level->size) {
+        _TrieBuildNode *new_nodes;
+        int             new_size;
+
+        new_size = level->size ? level->size * 2 : 256;
+        new_nodes = (_TrieBuildNode *) realloc (level->nodes,
+                                                new_size
+                                                * sizeof (_TrieBuildNode));
+        if (!new_nodes)
+            return FALSE;
+        level->nodes = new_nodes;
+        level->size  = new_size;
+    }
+    level->nodes[level->num_nodes].node = node;
+    level->nodes[level->num_nodes].lo   = lo;
+    level->nodes[level->num_nodes].hi   = hi;
+    level->num_nodes++;
+
+    return TRUE;
+}
+
+/* compare keys in trie character order, from given depth on */
+static int
+trie_key_cmp (const AlphaMap   *alpha_map,
+              const AlphaChar  *a,
+              const AlphaChar  *b,
+              int               depth)
+{
+    TrieChar    ca, cb;
+
+    for (a += depth, b += depth; ; a++, b++) {
+        ca = alpha_map_char_to_trie (alpha_map, *a);
+        cb = alpha_map_char_to_trie (alpha_map, *b);
+        if (ca != cb)
+            return (ca < cb) ? -1 : 1;
+        if (0 == ca)
+            return 0;
+    }
+}
+
+/**
+ * @brief Build trie contents from sorted keys
+ *
+ * @param trie   : the trie
+ * @param keys   : the keys, sorted in ascending order
+ * @param data   : the data associated to the keys, or NULL
+ * @param n_keys : the number of keys
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Replace the contents of @a trie with the entries @a keys[i] associated
+ * to @a data[i], for i from 0 to @a n_keys - 1. If @a data is NULL, all
+ * entries are associated to TRIE_DATA_ERROR.
+ *
+ * The keys must be sorted in the order of their characters as mapped by
+ * the trie alphabet map, which is the code point order for characters
+ * within the map. Duplicated keys are allowed, in which case the last one
+ * wins, as with successive trie_store() calls.
+ *
+ * As the children of every node are known in advance, the double-array is
+ * laid out breadth-first, one level at a time, with no relocation. This is
+ * much faster than storing the keys one by one, and gives a compact result.
+ *
+ * The entries keep the value size of @a trie, with zero values.
+ *
+ * On failure, including when the keys are not sorted, the trie is left
+ * unchanged. A trie in concurrent mode cannot be rebuilt this way, as its
+ * readers may be walking the structures to be replaced.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_build_from_sorted (Trie               *trie,
+                        const AlphaChar    *const keys[],
+                        const TrieData      data[],
+                        int                 n_keys)
+{
+    DArray         *da;
+    Tail           *tail;
+    _TrieBuildLevel cur, next, tmp;
+    TrieChar        labels[TRIE_CHAR_MAX + 1];
+    int             los[TRIE_CHAR_MAX + 2];
+    TrieChar       *suffix;
+    int             suffix_size;
+    TrieIndex       hint;
+    Bool            has_dups;
+    int             depth, i, j;
+
+    if (trie_is_mapped (trie) || trie->is_concurrent)
+        return FALSE;
+
+    /* check sorting */
+    has_dups = FALSE;
+    for (i = 1; i < n_keys; i++) {
+        int cmp = trie_key_cmp (trie->alpha_map, keys[i - 1], keys[i], 0);
+        if (cmp > 0)
+            return FALSE;
+        if (0 == cmp)
+            has_dups = TRUE;
+    }
+
+    da = da_new ();
+    if (!da)
+        return FALSE;
+    tail = tail_new ();
+    if (!tail)
+        goto exit_da_created;
+    if (!tail_set_value_size (tail, tail_get_value_size (trie->tail)))
+        goto exit_tail_created;
+
+    suffix_size = 64;
+    suffix = (TrieChar *) malloc (suffix_size);
+    if (!suffix)
+        goto exit_tail_created;
+
+    cur.nodes = next.nodes = NULL;
+    cur.num_nodes = next.num_nodes = 0;
+    cur.size = next.size = 0;
+    if (n_keys > 0 && !trie_build_level_add (&cur, da_get_root (da), 0, n_keys))
+        goto exit_levels_created;
+
+    hint = 0;
+    for (depth = 0; cur.num_nodes > 0; depth++) {
+        next.num_nodes = 0;
+        for (i = 0; i < cur.num_nodes; i++) {
+            TrieIndex   node = cur.nodes[i].node;
+            int         lo = cur.nodes[i].lo;
+            int         hi = cur.nodes[i].hi;
+            int         n_labels;
+            TrieIndex   base;
+
+            /* single key (possibly duplicated) goes to tail */
+            if (node != da_get_root (da)
+                && (hi - lo == 1
+                    || 0 == keys[lo][depth - 1]
+                    || (has_dups
+                        && 0 == trie_key_cmp (trie->alpha_map,
+                                              keys[lo], keys[hi - 1], depth))))
+            {
+                const AlphaChar *key = keys[hi - 1];
+                TrieIndex        t;
+                int              len;
+
+                /* terminator arc takes no suffix */
+                len = 0;
+                if (0 != key[depth - 1]) {
+                    while (key[depth + len])
+                        len++;
+                }
+                if (len + 1 > suffix_size) {
+                    TrieChar *new_suffix;
+
+                    new_suffix = (TrieChar *) realloc (suffix, len + 1);
+                    if (!new_suffix)
+                        goto exit_levels_created;
+                    suffix = new_suffix;
+                    suffix_size = len + 1;
+                }
+                for (j = 0; j < len; j++) {
+                    suffix[j] = alpha_map_char_to_trie (trie->alpha_map,
+                                                        key[depth + j]);
+                }
+                suffix[len] = '\0';
+
+                t = tail_add_suffix (tail, suffix);
+                tail_set_data (tail, t, data ? data[hi - 1] : TRIE_DATA_ERROR);
+                trie_da_set_tail_index (da, node, t);
+                continue;
+            }
+
+            /* group keys by their characters at this depth */
+            n_labels = 0;
+            for (j = lo; j < hi; j++) {
+                TrieChar c = alpha_map_char_to_trie (trie->alpha_map,
+                                                     keys[j][depth]);
+                if (0 == n_labels || c != labels[n_labels - 1]) {
+                    labels[n_labels] = c;
+                    los[n_labels++] = j;
+                }
+            }
+            los[n_labels] = hi;
+
+            base = da_insert_children (da, node, labels, n_labels, &hint);
+            if (TRIE_INDEX_ERROR == base)
+                goto exit_levels_created;
+
+            for (j = 0; j < n_labels; j++) {
+                if (!trie_build_level_add (&next, base + labels[j],
+                                           los[j], los[j + 1]))
+                {
+                    goto exit_levels_created;
+                }
+            }
+        }
+
+        tmp = cur;
+        cur = next;
+        next = tmp;
+    }
+
+    free (cur.nodes);
+    free (next.nodes);
+    free (suffix);
+
+    da_free (trie->da);
+    tail_free (trie->tail);
+    trie->da = da;
+    trie->tail = tail;
+    trie->is_dirty = TRUE;
+    return TRUE;
+
+exit_levels_created:
+    free (cur.nodes);
+    free (next.nodes);
+    free (suffix);
+exit_tail_created:
+    tail_free (tail);
+exit_da_created:
+    da_free (da);
+    return FALSE;
+}
+
+/**
+ * @brief Build trie contents from tries of distinct key beginnings
+ *
+ * @param trie    : the trie
+ * @param parts   : the tries to merge
+ * @param n_parts : the number of tries
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Replace the contents of @a trie with the entries of all @a parts, which
+ * are left unchanged. No two parts may have keys beginning with the same
+ * character, and all must use the alphabet map of @a trie and have values
+ * of the same size, which the trie takes.
+ *
+ * This is the last step of a parallel build: keys partitioned by their
+ * first character can be added to separate tries by separate threads, as
+ * with trie_build_from_sorted(), and the tries then merged here. The
+ * structures of the parts are copied as blocks, with their states and tail
+ * blocks renumbered by offsets, which takes much less time than building
+ * them.
+ *
+ * On failure, including when two parts have keys beginning with the same
+ * character, the trie is left unchanged. A trie in concurrent mode cannot
+ * be rebuilt this way, as its readers may be walking the structures to be
+ * replaced.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_build_from_parts (Trie *trie, const Trie *const parts[], int n_parts)
+{
+    const DArray  **das;
+    TrieIndex      *tail_offsets;
+    DArray         *da;
+    Tail           *tail;
+    int             i;
+
+    if (trie_is_mapped (trie) || trie->is_concurrent)
+        return FALSE;
+
+    das = (const DArray **) malloc (n_parts * sizeof (DArray *));
+    if (!das)
+        return FALSE;
+    tail_offsets = (TrieIndex *) malloc (n_parts * sizeof (TrieIndex));
+    if (!tail_offsets)
+        goto exit_das_created;
+
+    tail = tail_new ();
+    if (!tail)
+        goto exit_offsets_created;
+    if (n_parts > 0
+        && !tail_set_value_size (tail, tail_get_value_size (parts[0]->tail)))
+    {
+        goto exit_tail_created;
+    }
+    for (i = 0; i < n_parts; i++) {
+        das[i] = parts[i]->da;
+        if (!tail_append (tail, parts[i]->tail, &tail_offsets[i]))
+            goto exit_tail_created;
+    }
+
+    da = da_new_merged (das, tail_offsets, n_parts);
+    if (!da)
+        goto exit_tail_created;
+
+    free (tail_offsets);
+    free (das);
+
+    da_free (trie->da);
+    tail_free (trie->tail);
+    trie->da = da;
+    trie->tail = tail;
+    trie->is_dirty = TRUE;
+    return TRUE;
+
+exit_tail_created:
+    tail_free (tail);
+exit_offsets_created:
+    free (tail_offsets);
+exit_das_created:
+    free (das);
+    return FALSE;
+}
+
+/**
+ * @brief Delete an entry from trie
+ *
+ * @param trie  : the trie
+ * @param key   : the key for the entry to delete
+ *
+ * @return boolean value indicating whether the key exists and is removed
+ *
+ * Delete an entry for the given @a key from @a trie.
+ */
+Bool
+trie_delete (Trie *trie, const AlphaChar *key)
+{
+    Bool    res;
+
+    if (trie_is_mapped (trie))
+        return FALSE;
+
+    trie_write_begin (trie);
+    res = trie_do_delete (trie, key);
+    trie_write_end (trie);
+
+    return res;
+}
+
+static Bool
+trie_do_delete (Trie *trie, const AlphaChar *key)
+{
+    TrieIndex        s, t;
+    int32            suffix_idx;
+    const AlphaChar *p;
+
+    /* walk through branches */
+    s = da_get_root (trie->da);
+    for (p = key; !trie_da_is_separate (trie->da, s); p++) {
+        if (!da_walk (trie->da, &s,
+                      alpha_map_char_to_trie (trie->alpha_map, *p)))
+        {
+            return FALSE;
+        }
+        if (0 == *p)
+            break;
+    }
+
+    /* walk through tail */
+    t = trie_da_get_tail_index (trie->da, s);
+    suffix_idx = 0;
+    for ( ; ; p++) {
+        if (!tail_walk_char (trie->tail, t, &suffix_idx,
+                             alpha_map_char_to_trie (trie->alpha_map, *p)))
+        {
+            return FALSE;
+        }
+        if (0 == *p)
+            break;
+    }
+
+    tail_delete (trie->tail, t);
+    da_set_base (trie->da, s, TRIE_INDEX_ERROR);
+    da_prune (trie->da, s);
+
+    trie->is_dirty = TRUE;
+    return TRUE;
+}
+
+typedef struct {
+    const Trie     *trie;
+    TrieEnumFunc    enum_func;
+    void           *user_data;
+    AlphaChar      *key;        /**< key buffer, reused for all entries */
+    int             key_size;   /**< allocated size of key, in characters */
+} _TrieEnumData;
+
+static Bool
+trie_da_enum_func (const TrieChar *key, TrieIndex sep_node, void *user_data)
+{
+    _TrieEnumData  *enum_data;
+    TrieIndex       t;
+    const TrieChar *suffix;
+    AlphaChar      *p;
+    int             key_len;
+
+    enum_data = (_TrieEnumData *) user_data;
+
+    t = trie_da_get_tail_index (enum_data->trie->da, sep_node);
+    suffix = tail_get_suffix (enum_data->trie->tail, t);
+
+    key_len = strlen ((const char *)key) + strlen ((const char *)suffix) + 1;
+    if (key_len > enum_data->key_size) {
+        AlphaChar  *new_key;
+        int         new_size;
+
+        new_size = enum_data->key_size ? enum_data->key_size : 64;
+        while (new_size < key_len)
+            new_size *= 2;
+        new_key = (AlphaChar *) realloc (enum_data->key,
+                                         new_size * sizeof (AlphaChar));
+        if (!new_key)
+            return FALSE;
+        enum_data->key = new_key;
+        enum_data->key_size = new_size;
+    }
+
+    for (p = enum_data->key; *key; p++, key++) {
+        *p = alpha_map_trie_to_char (enum_data->trie->alpha_map, *key);
+    }
+    for ( ; *suffix; p++, suffix++) {
+        *p = alpha_map_trie_to_char (enum_data->trie->alpha_map, *suffix);
+    }
+    *p = 0;
+
+    return (*enum_data->enum_func) (enum_data->key,
+                                    tail_get_data (enum_data->trie->tail, t),
+                                    enum_data->user_data);
+}
+
+/**
+ * @brief Enumerate entries in trie
+ *
+ * @param trie       : the trie
+ * @param enum_func  : the callback function to be called on each key
+ * @param user_data  : user-supplied data to send as an argument to @a enum_func
+ *
+ * @return boolean value indicating whether all the keys are visited
+ *
+ * Enumerate all entries in trie. For each entry, the user-supplied 
+ * @a enum_func callback function is called, with the entry key and data.
+ * Returning FALSE from such callback will stop enumeration and return FALSE.
+ *
+ * The key passed to @a enum_func is only valid during the call, and must
+ * be copied if it is to be kept.
+ */
+Bool
+trie_enumerate (const Trie *trie, TrieEnumFunc enum_func, void *user_data)
+{
+    _TrieEnumData   enum_data;
+    Bool            ret;
+
+    enum_data.trie      = trie;
+    enum_data.enum_func = enum_func;
+    enum_data.user_data = user_data;
+    enum_data.key       = NULL;
+    enum_data.key_size  = 0;
+
+    ret = da_enumerate (trie->da, trie_da_enum_func, &enum_data);
+
+    free (enum_data.key);
+    return ret;
+}
+
+
+/*-----------------------*
+ *   PREFIX MATCHING     *
+ *-----------------------*/
+
+/* walk along a text, yielding the keys which are prefixes of it */
+typedef struct {
+    TrieIndex   s;          /**< current double-array state */
+    int         i;          /**< number of characters walked */
+    Bool        is_done;
+} _TriePrefixWalk;
+
+#define trie_prefix_walk_init(trie,w) \
+    ((w)->s = da_get_root ((trie)->da), (w)->i = 0, (w)->is_done = FALSE)
+
+/* next key, shortest first, which is a prefix of str of len characters */
+static Bool
+trie_prefix_walk_next (const Trie      *trie,
+                       const TrieChar  *str,
+                       int              len,
+                       _TriePrefixWalk *w,
+                       int             *o_len,
+                       TrieData        *o_data)
+{
+    const DArray   *da = trie->da;
+    const TrieChar *suffix;
+    TrieIndex       s, base, t, next;
+    int             i, j;
+    Bool            is_found, is_walkable;
+
+    while (!w->is_done) {
+        s = w->s;
+        i = w->i;
+        base = da_get_base (da, s);
+
+        /* a single key remains in the tail */
+        if (base < 0) {
+            w->is_done = TRUE;
+            t = -base;
+            suffix = tail_get_suffix (trie->tail, t);
+            if (!suffix)
+                return FALSE;
+            for (j = 0; suffix[j]; j++) {
+                if (i + j >= len || suffix[j] != str[i + j])
+                    return FALSE;
+            }
+            *o_len = i + j;
+            *o_data = tail_get_data (trie->tail, t);
+            return TRUE;
+        }
+
+        /* a key ends here if there is a terminator branch; load it along
+         * with the next branch, so that both cache misses overlap
+         */
+        t = base + TRIE_CHAR_TERM;
+        next = base + ((i < len) ? str[i] : TRIE_CHAR_TERM);
+        is_found = (da_get_check (da, t) == s);
+        is_walkable = (i < len && da_get_check (da, next) == s);
+        if (is_found) {
+            *o_len = i;
+            *o_data = tail_get_data (trie->tail,
+                                     trie_da_get_tail_index (da, t));
+        }
+
+        if (is_walkable) {
+            w->s = next;
+            w->i = i + 1;
+        } else {
+            w->is_done = TRUE;
+        }
+
+        if (is_found)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * @brief Find the longest key which is a prefix of a text
+ *
+ * @param trie        : the trie
+ * @param text        : the text
+ * @param len         : the length of @a text
+ * @param o_match_len : the storage for the length of the key found
+ * @param o_data      : the storage for the data of the key found
+ *
+ * @return boolean value indicating whether a key was found
+ *
+ * Find the longest key in @a trie matching the beginning of @a text, which
+ * ends after @a len characters or at a 0 character, whichever comes first.
+ * This is the usual step of dictionary-based tokenization.
+ *
+ * The text is translated to the trie alphabet in one pass before the walk,
+ * so @a len should not be much longer than the longest possible match. To
+ * find matches throughout a long text, use trie_scan().
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_longest_prefix (const Trie       *trie,
+                     const AlphaChar  *text,
+                     int               len,
+                     int              *o_match_len,
+                     TrieData         *o_data)
 {
-    TrieIndex new_da, new_tail;
-
-    new_da = da_insert_branch (trie->da, sep_node, *suffix);
-    if (TRIE_INDEX_ERROR == new_da)
+    TrieChar        buff[TRIE_KEY_BUFF_SIZE];
+    TrieChar       *str;
+    _TriePrefixWalk w;
+    TrieData        data;
+    int             n, match_len;
+    Bool            is_found;
+
+    str = trie_key_to_trie_str (trie->alpha_map, text, len,
+                                buff, TRIE_KEY_BUFF_SIZE);
+    if (!str)
         return FALSE;
+    n = strlen ((const char *) str);
+
+    is_found = FALSE;
+    trie_prefix_walk_init (trie, &w);
+    while (trie_prefix_walk_next (trie, str, n, &w, &match_len, &data)) {
+        is_found = TRUE;
+        if (o_match_len)
+            *o_match_len = match_len;
+        if (o_data)
+            *o_data = data;
+    }
 
-    if ('\0' != *suffix)
-        ++suffix;
+    if (str != buff)
+        free (str);
+    return is_found;
+}
 
-    new_tail = tail_add_suffix (trie->tail, suffix);
-    tail_set_data (trie->tail, new_tail, data);
-    trie_da_set_tail_index (trie->da, new_da, new_tail);
+/**
+ * @brief Find all keys which are prefixes of a text
+ *
+ * @param trie        : the trie
+ * @param text        : the text
+ * @param len         : the length of @a text
+ * @param matches     : the array for storing the matches
+ * @param max_matches : the size of @a matches
+ *
+ * @return the number of keys found, or -1 on failure
+ *
+ * Find all keys in @a trie matching the beginning of @a text, which ends
+ * after @a len characters or at a 0 character, whichever comes first. The
+ * matches are stored in @a matches, from the shortest key on, with their
+ * pos set to 0. At most @a max_matches are stored, but all keys are
+ * counted, so a return value greater than @a max_matches tells that
+ * @a matches was too short.
+ *
+ * As for trie_longest_prefix(), @a len should not be much longer than the
+ * longest possible match.
+ *
+ * Available since: 0.2.5
+ */
+int
+trie_common_prefix_search (const Trie       *trie,
+                           const AlphaChar  *text,
+                           int               len,
+                           TrieMatch         matches[],
+                           int               max_matches)
+{
+    TrieChar        buff[TRIE_KEY_BUFF_SIZE];
+    TrieChar       *str;
+    _TriePrefixWalk w;
+    TrieMatch       match;
+    int             n, n_matches;
+
+    str = trie_key_to_trie_str (trie->alpha_map, text, len,
+                                buff, TRIE_KEY_BUFF_SIZE);
+    if (!str)
+        return -1;
+    n = strlen ((const char *) str);
+
+    n_matches = 0;
+    match.pos = 0;
+    trie_prefix_walk_init (trie, &w);
+    while (trie_prefix_walk_next (trie, str, n, &w, &match.len, &match.data)) {
+        if (n_matches < max_matches)
+            matches[n_matches] = match;
+        ++n_matches;
+    }
 
-    trie->is_dirty = TRUE;
-    return TRUE;
+    if (str != buff)
+        free (str);
+    return n_matches;
+}
+
+/**
+ * @brief Find all occurrences of keys in a text
+ *
+ * @param trie       : the trie
+ * @param text       : the text
+ * @param len        : the length of @a text
+ * @param match_func : the callback function to be called on each match
+ * @param user_data  : user-supplied data to send as an argument to
+ *                     @a match_func
+ *
+ * @return boolean value indicating whether the whole text was scanned
+ *
+ * Find every key of @a trie occurring anywhere in @a text, which ends
+ * after @a len characters or at a 0 character, whichever comes first. For
+ * each match, @a match_func is called with the match, by ascending start
+ * position, then ascending length. Returning FALSE from it stops the scan
+ * and returns FALSE.
+ *
+ * The text is translated to the trie alphabet once, then walked from each
+ * position, which takes time proportional to the text length times the
+ * average depth reached in the trie.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_scan (const Trie       *trie,
+           const AlphaChar  *text,
+           int               len,
+           TrieMatchFunc     match_func,
+           void             *user_data)
+{
+    TrieChar        buff[TRIE_KEY_BUFF_SIZE];
+    TrieChar       *str;
+    _TriePrefixWalk w;
+    TrieMatch       match;
+    int             n;
+    Bool            ret;
+
+    str = trie_key_to_trie_str (trie->alpha_map, text, len,
+                                buff, TRIE_KEY_BUFF_SIZE);
+    if (!str)
+        return FALSE;
+    n = strlen ((const char *) str);
+
+    ret = TRUE;
+    for (match.pos = 0; match.pos < n && ret; match.pos++) {
+        trie_prefix_walk_init (trie, &w);
+        while (trie_prefix_walk_next (trie, str + match.pos, n - match.pos,
+                                      &w, &match.len, &match.data))
+        {
+            if (!(*match_func) (&match, user_data)) {
+                ret = FALSE;
+                break;
+            }
+        }
+    }
+
+    if (str != buff)
+        free (str);
+    return ret;
 }
 
+/*-----------------------------*
+ *   MULTI-PATTERN MATCHING    *
+ *-----------------------------*/
+
+/* move the suffix of a separate node into the double-array, so that the
+ * key ends with a terminator branch
+ */
 static Bool
-trie_branch_in_tail   (Trie           *trie,
-                       TrieIndex       sep_node,
-                       const TrieChar *suffix,
-                       TrieData        data)
+trie_expand_tail (Trie *trie, TrieIndex sep_node)
 {
-    TrieIndex       old_tail, old_da, s;
-    const TrieChar *old_suffix, *p;
+    TrieIndex       tail_idx, s, t;
+    const TrieChar *p;
+
+    /* already reached through a terminator branch */
+    if (da_get_base (trie->da, da_get_check (trie->da, sep_node))
+            + TRIE_CHAR_TERM == sep_node)
+    {
+        return TRUE;
+    }
 
-    /* adjust separate point in old path */
-    old_tail = trie_da_get_tail_index (trie->da, sep_node);
-    old_suffix = tail_get_suffix (trie->tail, old_tail);
-    if (!old_suffix)
+    tail_idx = trie_da_get_tail_index (trie->da, sep_node);
+    p = tail_get_suffix (trie->tail, tail_idx);
+    if (!p)
         return FALSE;
 
-    for (p = old_suffix, s = sep_node; *p == *suffix; p++, suffix++) {
-        TrieIndex t = da_insert_branch (trie->da, s, *p);
+    for (s = sep_node; ; p++) {
+        t = da_insert_branch (trie->da, s, *p);
         if (TRIE_INDEX_ERROR == t)
             goto fail;
         s = t;
+        if ('\0' == *p)
+            break;
     }
 
-    old_da = da_insert_branch (trie->da, s, *p);
-    if (TRIE_INDEX_ERROR == old_da)
-        goto fail;
-
-    if ('\0' != *p)
-        ++p;
-    tail_set_suffix (trie->tail, old_tail, p);
-    trie_da_set_tail_index (trie->da, old_da, old_tail);
-
-    /* insert the new branch at the new separate point */
-    return trie_branch_in_branch (trie, s, suffix, data);
+    tail_set_suffix (trie->tail, tail_idx, p);
+    trie_da_set_tail_index (trie->da, s, tail_idx);
+    return TRUE;
 
 fail:
     /* failed, undo previous insertions and return error */
     da_prune_upto (trie->da, sep_node, s);
-    trie_da_set_tail_index (trie->da, sep_node, old_tail);
+    trie_da_set_tail_index (trie->da, sep_node, tail_idx);
     return FALSE;
 }
 
 /**
- * @brief Delete an entry from trie
+ * @brief Build failure links for one-pass matching
+ *
+ * @param trie  : the trie
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Add Aho-Corasick failure links to @a trie, for trie_scan_linear() to
+ * find all keys in a text in a single pass. The suffixes of the keys are
+ * moved from the tail into the double-array first, as the links need a
+ * state for each character. This enlarges the double-array, see
+ * trie_get_mem_usage().
+ *
+ * The links are dropped when a key is added or deleted, and must then be
+ * built again. They are kept by trie_save_mapped(), but not by the stream
+ * format of trie_save(), so they must also be built again after
+ * trie_new_from_file() or trie_fread().
+ *
+ * A mapped or concurrent trie cannot be given links, nor a trie of more
+ * than 2^31 states.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_build_failure_links (Trie *trie)
+{
+    TrieIndex  *queue;
+    TrieIndex   head, tail, s, t;
+    TrieChar    c;
+    Bool        res = FALSE;
+
+    if (trie_is_mapped (trie) || trie->is_concurrent)
+        return FALSE;
+
+    /* move the suffixes into the double-array breadth-first; expanding a
+     * tail only adds states below its separate node and moves no existing
+     * one, so the walk can go on around the new states, and only existing
+     * states are queued */
+    queue = (TrieIndex *) malloc (da_get_num_cells (trie->da)
+                                  * sizeof (TrieIndex));
+    if (!queue)
+        return FALSE;
+    head = tail = 0;
+    queue[tail++] = da_get_root (trie->da);
+    while (head < tail) {
+        s = queue[head++];
+        for (t = da_get_first_child (trie->da, s, &c);
+             TRIE_INDEX_ERROR != t;
+             t = da_get_next_child (trie->da, s, &c))
+        {
+            if (!trie_da_is_separate (trie->da, t)) {
+                queue[tail++] = t;
+                continue;
+            }
+            if (!trie_expand_tail (trie, t))
+                goto exit_queue_created;
+            trie->is_dirty = TRUE;
+        }
+    }
+
+    res = da_build_failure (trie->da);
+
+exit_queue_created:
+    free (queue);
+    return res;
+}
+
+/**
+ * @brief Check for failure links
+ *
+ * @param trie  : the trie
+ *
+ * @return TRUE if @a trie has failure links for trie_scan_linear()
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_has_failure_links (const Trie *trie)
+{
+    return da_has_failure (trie->da);
+}
+
+/**
+ * @brief Find all occurrences of keys in a text in one pass
+ *
+ * @param trie       : the trie, with failure links
+ * @param text       : the text
+ * @param len        : the length of @a text
+ * @param match_func : the callback function to be called on each match
+ * @param user_data  : user-supplied data to send as an argument to
+ *                     @a match_func
+ *
+ * @return boolean value indicating whether the whole text was scanned
+ *
+ * Find every non-empty key of @a trie occurring anywhere in @a text, like
+ * trie_scan(), but following failure links instead of walking again from
+ * each position, so that it takes time proportional to the text length
+ * plus the number of matches. The matches are reported by ascending end
+ * position, then descending length. Returning FALSE from @a match_func
+ * stops the scan and returns FALSE.
+ *
+ * The failure links must have been built with trie_build_failure_links(),
+ * or mapped with trie_new_mapped(); FALSE is returned otherwise.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_scan_linear (const Trie       *trie,
+                  const AlphaChar  *text,
+                  int               len,
+                  TrieMatchFunc     match_func,
+                  void             *user_data)
+{
+    const DArray   *da = trie->da;
+    TrieChar        buff[TRIE_KEY_BUFF_SIZE];
+    TrieChar       *str;
+    TrieMatch       match;
+    TrieIndex       s, o;
+    int             i, n;
+    Bool            ret;
+
+    if (!da_has_failure (da))
+        return FALSE;
+
+    str = trie_key_to_trie_str (trie->alpha_map, text, len,
+                                buff, TRIE_KEY_BUFF_SIZE);
+    if (!str)
+        return FALSE;
+    n = strlen ((const char *) str);
+
+    ret = TRUE;
+    s = da_get_root (da);
+    for (i = 0; i < n && ret; i++) {
+        s = da_failure_walk (da, s, str[i]);
+        for (o = da_get_output (da, s); o; o = da_get_next_output (da, o)) {
+            match.len = da_get_depth (da, o);
+            match.pos = i + 1 - match.len;
+            match.data = tail_get_data (trie->tail,
+                             trie_da_get_tail_index (da,
+                                 da_get_base (da, o) + TRIE_CHAR_TERM));
+            if (!(*match_func) (&match, user_data)) {
+                ret = FALSE;
+                break;
+            }
+        }
+    }
+
+    if (str != buff)
+        free (str);
+    return ret;
+}
+
+/*-------------------------*
+ *   CONCURRENT READING    *
+ *-------------------------*/
+
+/**
+ * @brief Set trie to concurrent mode
+ *
+ * @param trie : the trie
+ *
+ * @return boolean value indicating the success of the process
+ *
+ * Allow @a trie to be read by any number of threads through TrieReader
+ * objects while one other thread modifies it, with no lock. It must be
+ * called before the threads start, and cannot be undone.
+ *
+ * Readers do not block the writer, nor each other. Each modification
+ * bumps a sequence number, and a read that overlaps a modification is
+ * retried, so readers never see a half-done change. Memory released by
+ * modifications, such as the arrays replaced when the trie grows, is
+ * kept until all readers which may have seen it have finished their
+ * reads.
+ *
+ * The functions modifying the trie, such as trie_store() and
+ * trie_delete(), are still to be called from one thread at a time.
+ * trie_build_from_sorted() fails on a trie in concurrent mode. The other
+ * query functions, such as trie_retrieve() or stepwise walking, are only
+ * safe for the writer thread.
+ *
+ * Fails if atomic operations are not supported by the compiler.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_set_concurrent (Trie *trie)
+{
+    if (!TRIE_HAVE_ATOMICS)
+        return FALSE;
+
+    if (!trie_is_mapped (trie)) {
+        da_set_concurrent (trie->da, TRUE);
+        tail_set_concurrent (trie->tail, TRUE);
+    }
+    trie->is_concurrent = TRUE;
+
+    return TRUE;
+}
+
+/**
+ * @brief Create a lock-free reader of trie
+ *
+ * @param trie : the trie, in concurrent mode
+ *
+ * @return the reader, or NULL on failure
+ *
+ * Get a reader for @a trie, to be used by one thread at a time. Readers
+ * can be taken from any thread, and must be released with
+ * trie_reader_free() before the trie is freed.
+ *
+ * Fails if @a trie is not in concurrent mode, as set by
+ * trie_set_concurrent().
+ *
+ * Available since: 0.2.5
+ */
+TrieReader *
+trie_reader_new (Trie *trie)
+{
+    TrieReader *reader, *head;
+
+    if (!trie->is_concurrent)
+        return NULL;
+
+    /* reuse a released reader, if any */
+    for (reader = TRIE_LOAD_ACQUIRE (&trie->readers);
+         reader;
+         reader = reader->next)
+    {
+        int     unused = 0;
+
+        if (TRIE_CAS (&reader->in_use, &unused, 1))
+            return reader;
+    }
+
+    reader = (TrieReader *) malloc (sizeof (TrieReader));
+    if (!reader)
+        return NULL;
+    reader->trie   = trie;
+    reader->epoch  = TRIE_READER_IDLE;
+    reader->in_use = 1;
+
+    head = TRIE_LOAD_RELAXED (&trie->readers);
+    do {
+        reader->next = head;
+    } while (!TRIE_CAS (&trie->readers, &head, reader));
+
+    return reader;
+}
+
+/**
+ * @brief Release a trie reader
+ *
+ * @param reader : the reader
+ *
+ * Release @a reader, which can then be reused by trie_reader_new(). Its
+ * memory is freed with the trie.
+ *
+ * Available since: 0.2.5
+ */
+void
+trie_reader_free (TrieReader *reader)
+{
+    TRIE_STORE_RELEASE (&reader->epoch, TRIE_READER_IDLE);
+    TRIE_STORE_RELEASE (&reader->in_use, 0);
+}
+
+/**
+ * @brief Retrieve an entry through a lock-free reader
+ *
+ * @param reader : the reader
+ * @param key    : the key for the entry to retrieve
+ * @param o_data : the storage for storing the entry data on return
+ *
+ * @return boolean value indicating the existence of the entry.
+ *
+ * Same as trie_retrieve() on the trie of @a reader, but safe while another
+ * thread modifies the trie. The result is that of the trie either before
+ * or after any modification, never in between.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_reader_retrieve (TrieReader       *reader,
+                      const AlphaChar  *key,
+                      TrieData         *o_data)
+{
+    const Trie *trie = reader->trie;
+    TrieData    data;
+    uint32      seq;
+    Bool        ret;
+    int         spins = 0;
+
+    for (;;) {
+        seq = TRIE_LOAD_ACQUIRE (&trie->seq);
+        if (seq & 1) {
+            /* the writer may have been preempted in the middle */
+            if (++spins == TRIE_WAIT_SPINS) {
+                TRIE_YIELD ();
+                spins = 0;
+            }
+            continue;
+        }
+
+        /* announce the read before loading any pointer from the trie,
+         * so that the writer keeps what we may load
+         */
+        TRIE_STORE_RELAXED (&reader->epoch, seq);
+        TRIE_FENCE ();
+
+        ret = trie_retrieve_n (trie, key, INT_MAX, &data);
+
+        TRIE_FENCE_ACQUIRE ();
+        if (TRIE_LOAD_RELAXED (&trie->seq) == seq)
+            break;
+    }
+    TRIE_STORE_RELEASE (&reader->epoch, TRIE_READER_IDLE);
+
+    if (ret && o_data)
+        *o_data = data;
+    return ret;
+}
+
+static void
+trie_write_begin (Trie *trie)
+{
+    if (!trie->is_concurrent)
+        return;
+
+    trie->num_retired = da_get_num_retired (trie->da)
+                        + tail_get_num_retired (trie->tail);
+    TRIE_STORE_RELAXED (&trie->seq, trie->seq + 1);
+    TRIE_FENCE_RELEASE ();
+}
+
+static void
+trie_write_end (Trie *trie)
+{
+    const TrieReader *reader;
+    uint32            seq;
+    int               num_retired;
+
+    if (!trie->is_concurrent)
+        return;
+
+    seq = trie->seq;
+    TRIE_STORE_RELEASE (&trie->seq, seq + 1);
+
+    num_retired = da_get_num_retired (trie->da)
+                  + tail_get_num_retired (trie->tail);
+    if (0 == num_retired)
+        return;
+    if (num_retired > trie->num_retired)
+        trie->retire_seq = seq;
+
+    /* free retired memory once every reader began after its retirement */
+    TRIE_FENCE ();
+    for (reader = TRIE_LOAD_ACQUIRE (&trie->readers);
+         reader;
+         reader = reader->next)
+    {
+        uint32  epoch = TRIE_LOAD_ACQUIRE (&reader->epoch);
+
+        if (TRIE_READER_IDLE != epoch
+            && (int32) (epoch - trie->retire_seq) < 0)
+        {
+            return;
+        }
+    }
+    da_free_retired (trie->da);
+    tail_free_retired (trie->tail);
+}
+
+
+/*-------------------*
+ *   TRIE HANDLES    *
+ *-------------------*/
+
+/**
+ * @brief Create a handle publishing a trie to readers
+ *
+ * @param trie : the trie to publish
+ *
+ * @return the handle, or NULL on failure
+ *
+ * Create a handle through which threads get the latest version of a trie,
+ * while new versions are published with trie_handle_publish(). The handle
+ * takes over @a trie, which is freed once it has been replaced and no
+ * reader holds it any longer. A published trie must no longer be
+ * modified, as readers may be using it at any time.
+ *
+ * Fails if atomic operations are not supported by the compiler.
+ *
+ * The created handle must be freed with trie_handle_free().
+ *
+ * Available since: 0.2.5
+ */
+TrieHandle *
+trie_handle_new (Trie *trie)
+{
+    TrieHandle *handle;
+
+    if (!TRIE_HAVE_ATOMICS)
+        return NULL;
+
+    handle = (TrieHandle *) malloc (sizeof (TrieHandle));
+    if (!handle)
+        return NULL;
+
+    handle->trie    = trie;
+    handle->retired = NULL;
+    handle->readers = NULL;
+
+    return handle;
+}
+
+/**
+ * @brief Free a trie handle
+ *
+ * @param handle : the handle
+ *
+ * Free @a handle, with the tries published through it and its readers.
+ * No reader may hold a trie from @a handle, nor acquire one, during or
+ * after this call.
+ *
+ * Available since: 0.2.5
+ */
+void
+trie_handle_free (TrieHandle *handle)
+{
+    while (handle->retired) {
+        Trie   *next = handle->retired->next_retired;
+
+        trie_free (handle->retired);
+        handle->retired = next;
+    }
+    while (handle->readers) {
+        TrieHandleReader *next = handle->readers->next;
+
+        free (handle->readers);
+        handle->readers = next;
+    }
+    trie_free (handle->trie);
+    free (handle);
+}
+
+/* free the replaced tries which no reader holds */
+static void
+trie_handle_free_retired (TrieHandle *handle)
+{
+    const TrieHandleReader *reader;
+    Trie                  **p, *trie;
+
+    p = &handle->retired;
+    while (NULL != (trie = *p)) {
+        for (reader = TRIE_LOAD_ACQUIRE (&handle->readers);
+             reader;
+             reader = reader->next)
+        {
+            if (TRIE_LOAD_ACQUIRE (&reader->trie) == trie)
+                break;
+        }
+        if (reader) {
+            p = &trie->next_retired;
+        } else {
+            *p = trie->next_retired;
+            trie_free (trie);
+        }
+    }
+}
+
+/**
+ * @brief Publish a new trie through a handle
+ *
+ * @param handle : the handle
+ * @param trie   : the new trie
+ *
+ * Replace the trie published by @a handle with @a trie, which the handle
+ * takes over. Readers acquiring afterwards get @a trie, while those
+ * holding the old trie keep using it until they release it. The call does
+ * not wait for readers: the old trie is freed here if no reader holds it,
+ * or else by a later publication or by trie_handle_free().
+ *
+ * Publications through a handle are to be made by one thread at a time.
+ *
+ * Loading the new version with trie_new_mapped() keeps the switch cheap:
+ * the old and new versions share no memory, and opening does not read the
+ * whole file.
+ *
+ * Available since: 0.2.5
+ */
+void
+trie_handle_publish (TrieHandle *handle, Trie *trie)
+{
+    Trie   *old;
+
+    old = handle->trie;
+    TRIE_STORE_RELEASE (&handle->trie, trie);
+
+    /* a reader either sees the new trie when checking its acquisition, or
+     * has announced the old one before we look at its slot
+     */
+    TRIE_FENCE ();
+    old->next_retired = handle->retired;
+    handle->retired = old;
+    trie_handle_free_retired (handle);
+}
+
+/**
+ * @brief Create a reader of a trie handle
  *
- * @param trie  : the trie
- * @param key   : the key for the entry to delete
+ * @param handle : the handle
  *
- * @return boolean value indicating whether the key exists and is removed
+ * @return the reader, or NULL on failure
  *
- * Delete an entry for the given @a key from @a trie.
+ * Get a reader for @a handle, to be used by one thread at a time to
+ * acquire the published trie. Readers can be taken from any thread, and
+ * must be released with trie_handle_reader_free() before the handle is
+ * freed.
+ *
+ * Available since: 0.2.5
  */
-Bool
-trie_delete (Trie *trie, const AlphaChar *key)
+TrieHandleReader *
+trie_handle_reader_new (TrieHandle *handle)
 {
-    TrieIndex        s, t;
-    short            suffix_idx;
-    const AlphaChar *p;
+    TrieHandleReader *reader, *head;
 
-    /* walk through branches */
-    s = da_get_root (trie->da);
-    for (p = key; !trie_da_is_separate (trie->da, s); p++) {
-        if (!da_walk (trie->da, &s,
-                      alpha_map_char_to_trie (trie->alpha_map, *p)))
-        {
-            return FALSE;
-        }
-        if (0 == *p)
-            break;
-    }
+    /* reuse a released reader, if any */
+    for (reader = TRIE_LOAD_ACQUIRE (&handle->readers);
+         reader;
+         reader = reader->next)
+    {
+        int     unused = 0;
 
-    /* walk through tail */
-    t = trie_da_get_tail_index (trie->da, s);
-    suffix_idx = 0;
-    for ( ; ; p++) {
-        if (!tail_walk_char (trie->tail, t, &suffix_idx,
-                             alpha_map_char_to_trie (trie->alpha_map, *p)))
-        {
-            return FALSE;
-        }
-        if (0 == *p)
-            break;
+        if (TRIE_CAS (&reader->in_use, &unused, 1))
+            return reader;
     }
 
-    tail_delete (trie->tail, t);
-    da_set_base (trie->da, s, TRIE_INDEX_ERROR);
-    da_prune (trie->da, s);
+    reader = (TrieHandleReader *) malloc (sizeof (TrieHandleReader));
+    if (!reader)
+        return NULL;
+    reader->handle = handle;
+    reader->trie   = NULL;
+    reader->in_use = 1;
 
-    trie->is_dirty = TRUE;
-    return TRUE;
-}
+    head = TRIE_LOAD_RELAXED (&handle->readers);
+    do {
+        reader->next = head;
+    } while (!TRIE_CAS (&handle->readers, &head, reader));
 
-typedef struct {
-    const Trie     *trie;
-    TrieEnumFunc    enum_func;
-    void           *user_data;
-} _TrieEnumData;
+    return reader;
+}
 
-static Bool
-trie_da_enum_func (const TrieChar *key, TrieIndex sep_node, void *user_data)
+/**
+ * @brief Release a trie handle reader
+ *
+ * @param reader : the reader
+ *
+ * Release @a reader, along with the trie it holds, if any. The reader can
+ * then be reused by trie_handle_reader_new(). Its memory is freed with the
+ * handle.
+ *
+ * Available since: 0.2.5
+ */
+void
+trie_handle_reader_free (TrieHandleReader *reader)
 {
-    _TrieEnumData  *enum_data;
-    TrieIndex       t;
-    const TrieChar *suffix;
-    AlphaChar      *full_key, *p;
-    Bool            ret;
-
-    enum_data = (_TrieEnumData *) user_data;
+    TRIE_STORE_RELEASE (&reader->trie, NULL);
+    TRIE_STORE_RELEASE (&reader->in_use, 0);
+}
 
-    t = trie_da_get_tail_index (enum_data->trie->da, sep_node);
-    suffix = tail_get_suffix (enum_data->trie->tail, t);
+/**
+ * @brief Acquire the trie published through a handle
+ *
+ * @param reader : the reader of the handle
+ *
+ * @return the trie currently published
+ *
+ * Get the latest trie published through the handle of @a reader. The
+ * trie stays valid, and unchanged, until released with
+ * trie_handle_release(), even if newer versions get published meanwhile.
+ * It can be queried with any function taking a const Trie, by any number
+ * of threads. A reader holds one trie at a time, so acquiring again
+ * releases the trie acquired before.
+ *
+ * This takes no lock, and writes nothing shared with other readers. It
+ * only retries when a new trie is published meanwhile.
+ *
+ * Available since: 0.2.5
+ */
+const Trie *
+trie_handle_acquire (TrieHandleReader *reader)
+{
+    TrieHandle *handle = reader->handle;
+    Trie       *trie, *latest;
 
-    full_key = (AlphaChar *) malloc ((strlen ((const char *)key)
-                                      + strlen ((const char *)suffix) + 1)
-                                     * sizeof (AlphaChar));
-    for (p = full_key; *key; p++, key++) {
-        *p = alpha_map_trie_to_char (enum_data->trie->alpha_map, *key);
-    }
-    for ( ; *suffix; p++, suffix++) {
-        *p = alpha_map_trie_to_char (enum_data->trie->alpha_map, *suffix);
-    }
-    *p = 0;
+    latest = TRIE_LOAD_ACQUIRE (&handle->trie);
+    do {
+        trie = latest;
 
-    ret = (*enum_data->enum_func) (full_key,
-                                   tail_get_data (enum_data->trie->tail, t),
-                                   enum_data->user_data);
+        /* announce the trie before checking that it is still published,
+         * so that the publisher keeps it
+         */
+        TRIE_STORE_RELAXED (&reader->trie, trie);
+        TRIE_FENCE ();
+        latest = TRIE_LOAD_ACQUIRE (&handle->trie);
+    } while (latest != trie);
 
-    free (full_key);
-    return ret;
+    return trie;
 }
 
 /**
- * @brief Enumerate entries in trie
+ * @brief Release the trie acquired by a handle reader
  *
- * @param trie       : the trie
- * @param enum_func  : the callback function to be called on each key
- * @param user_data  : user-supplied data to send as an argument to @a enum_func
+ * @param reader : the reader, which holds a trie from trie_handle_acquire()
  *
- * @return boolean value indicating whether all the keys are visited
+ * Stop using the trie acquired by @a reader. If the trie is no longer
+ * published, it is freed by a later publication, or with the handle.
  *
- * Enumerate all entries in trie. For each entry, the user-supplied 
- * @a enum_func callback function is called, with the entry key and data.
- * Returning FALSE from such callback will stop enumeration and return FALSE.
+ * Available since: 0.2.5
  */
-Bool
-trie_enumerate (const Trie *trie, TrieEnumFunc enum_func, void *user_data)
+void
+trie_handle_release (TrieHandleReader *reader)
 {
-    _TrieEnumData   enum_data;
-
-    enum_data.trie      = trie;
-    enum_data.enum_func = enum_func;
-    enum_data.user_data = user_data;
-
-    return da_enumerate (trie->da, trie_da_enum_func, &enum_data);
+    TRIE_STORE_RELEASE (&reader->trie, NULL);
 }
 
 
@@ -653,6 +3197,28 @@ trie_root (const Trie *trie)
     return trie_state_new (trie, da_get_root (trie->da), 0, FALSE);
 }
 
+/**
+ * @brief Initialize a trie state at root
+ *
+ * @param s    : the state to initialize
+ * @param trie : the trie
+ *
+ * Set @a s to the root state of @a trie, like trie_root() does for a newly
+ * allocated state. This allows walking with a state declared on the stack,
+ * with no heap allocation. Such a state must not be passed to
+ * trie_state_free().
+ *
+ * Available since: 0.2.5
+ */
+void
+trie_state_init (TrieState *s, const Trie *trie)
+{
+    s->trie       = trie;
+    s->index      = da_get_root (trie->da);
+    s->suffix_idx = 0;
+    s->is_suffix  = FALSE;
+}
+
 /*----------------*
  *   TRIE STATE   *
  *----------------*/
@@ -660,7 +3226,7 @@ trie_root (const Trie *trie)
 static TrieState *
 trie_state_new (const Trie *trie,
                 TrieIndex   index,
-                short       suffix_idx,
+                int32       suffix_idx,
                 short       is_suffix)
 {
     TrieState *s;
@@ -826,6 +3392,521 @@ trie_state_get_data (const TrieState *s)
                         : TRIE_DATA_ERROR;
 }
 
+/**
+ * @brief Get value from leaf state
+ *
+ * @param s       : a leaf state
+ * @param o_value : the storage for the value on return
+ *
+ * @return boolean value indicating whether the value is got
+ *
+ * Copy the fixed-size value of the entry of a leaf state to @a o_value,
+ * which must have room for trie_get_value_size() bytes. This fails on
+ * a non-leaf state, or if the values of the trie have no size.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_state_get_value (const TrieState *s, void *o_value)
+{
+    const void *value;
+
+    if (!s->is_suffix)
+        return FALSE;
+    value = tail_get_value (s->trie->tail, s->index);
+    if (!value)
+        return FALSE;
+    memcpy (o_value, value, tail_get_value_size (s->trie->tail));
+    return TRUE;
+}
+
+
+/*---------------------*
+ *   ENTRY ITERATION   *
+ *---------------------*/
+
+/* iterator status */
+#define TRIE_ITER_START     0
+#define TRIE_ITER_ENTRY     1
+#define TRIE_ITER_END       2
+
+/**
+ * @brief TrieIterator structure
+ */
+struct _TrieIterator {
+    TrieState   root;       /**< the state iteration started from */
+    short       status;     /**< one of the TRIE_ITER_* values */
+
+    /* path of double-array states from root to the current entry, the
+     * explicit stack of the walk; key holds one character per state below
+     * root, followed by the tail suffix of the current entry
+     */
+    TrieIndex  *path;
+    TrieChar   *labels;     /**< label leading to each state below root */
+    int         depth;      /**< number of states on path below root */
+    int         path_size;
+    AlphaChar  *key;
+    int         key_size;
+
+    TrieIndex   tail_idx;   /**< tail block of the current entry */
+};
+
+static Bool
+trie_iterator_push (TrieIterator *iter, TrieIndex s, TrieChar c)
+{
+    if (iter->depth + 1 >= iter->path_size) {
+        TrieIndex  *new_path;
+        int         new_size = iter->path_size * 2;
+
+        TrieChar   *new_labels;
+
+        new_path = (TrieIndex *) realloc (iter->path,
+                                          new_size * sizeof (TrieIndex));
+        if (!new_path)
+            return FALSE;
+        iter->path = new_path;
+        new_labels = (TrieChar *) realloc (iter->labels, new_size);
+        if (!new_labels)
+            return FALSE;
+        iter->labels = new_labels;
+        iter->path_size = new_size;
+    }
+    if (iter->depth >= iter->key_size) {
+        AlphaChar  *new_key;
+        int         new_size = iter->key_size * 2;
+
+        new_key = (AlphaChar *) realloc (iter->key,
+                                         new_size * sizeof (AlphaChar));
+        if (!new_key)
+            return FALSE;
+        iter->key = new_key;
+        iter->key_size = new_size;
+    }
+
+    iter->key[iter->depth] = alpha_map_trie_to_char (iter->root.trie->alpha_map,
+                                                     c);
+    iter->labels[iter->depth] = c;
+    iter->path[++iter->depth] = s;
+    return TRUE;
+}
+
+/* complete key with the suffix of tail block tail_idx from suffix_idx on */
+static Bool
+trie_iterator_set_entry (TrieIterator *iter,
+                         TrieIndex     tail_idx,
+                         int           suffix_idx)
+{
+    const Trie     *trie = iter->root.trie;
+    const TrieChar *suffix;
+    AlphaChar      *p;
+    int             key_len, len;
+
+    suffix = tail_get_suffix (trie->tail, tail_idx);
+    if (!suffix)
+        return FALSE;
+    suffix += suffix_idx;
+
+    /* a terminator ending the path is not part of the key */
+    key_len = iter->depth;
+    if (key_len > 0 && TRIE_CHAR_TERM == iter->labels[key_len - 1])
+        --key_len;
+
+    len = key_len + strlen ((const char *) suffix) + 1;
+    if (len > iter->key_size) {
+        AlphaChar  *new_key;
+        int         new_size = iter->key_size;
+
+        while (new_size < len)
+            new_size *= 2;
+        new_key = (AlphaChar *) realloc (iter->key,
+                                         new_size * sizeof (AlphaChar));
+        if (!new_key)
+            return FALSE;
+        iter->key = new_key;
+        iter->key_size = new_size;
+    }
+
+    for (p = iter->key + key_len; *suffix; p++, suffix++)
+        *p = alpha_map_trie_to_char (trie->alpha_map, *suffix);
+    *p = 0;
+
+    iter->tail_idx = tail_idx;
+    iter->status = TRIE_ITER_ENTRY;
+    return TRUE;
+}
+
+/**
+ * @brief Create an iterator over the entries under a state
+ *
+ * @param s : the state to iterate from
+ *
+ * @return the created iterator, or NULL on failure
+ *
+ * Create an iterator over all the entries reachable from state @a s, such
+ * as those with the prefix walked from the root to @a s. The entries are
+ * visited by trie_iterator_next() in lexicographic order of their keys,
+ * so an iteration can be stopped after the first results needed.
+ *
+ * The iterator keeps its own copy of @a s, which can thus be freed or
+ * walked further. The trie must not be modified during the iteration.
+ *
+ * The created object must be freed with trie_iterator_free().
+ *
+ * Available since: 0.2.5
+ */
+TrieIterator *
+trie_iterator_new (const TrieState *s)
+{
+    TrieIterator   *iter;
+
+    iter = (TrieIterator *) malloc (sizeof (TrieIterator));
+    if (!iter)
+        return NULL;
+
+    iter->root = *s;
+    iter->status = TRIE_ITER_START;
+    iter->depth = 0;
+    iter->tail_idx = 0;
+
+    iter->path_size = 32;
+    iter->path = (TrieIndex *) malloc (iter->path_size * sizeof (TrieIndex));
+    if (!iter->path)
+        goto exit_iter_created;
+    iter->labels = (TrieChar *) malloc (iter->path_size);
+    if (!iter->labels)
+        goto exit_path_created;
+    iter->key_size = 64;
+    iter->key = (AlphaChar *) malloc (iter->key_size * sizeof (AlphaChar));
+    if (!iter->key)
+        goto exit_labels_created;
+
+    return iter;
+
+exit_labels_created:
+    free (iter->labels);
+exit_path_created:
+    free (iter->path);
+exit_iter_created:
+    free (iter);
+    return NULL;
+}
+
+/**
+ * @brief Free an iterator
+ *
+ * @param iter : the iterator to free
+ *
+ * Destruct the iterator @a iter and free its allocated memory.
+ *
+ * Available since: 0.2.5
+ */
+void
+trie_iterator_free (TrieIterator *iter)
+{
+    free (iter->key);
+    free (iter->labels);
+    free (iter->path);
+    free (iter);
+}
+
+/**
+ * @brief Move an iterator to the next entry
+ *
+ * @param iter : the iterator
+ *
+ * @return TRUE if moved to an entry, FALSE when there are no more entries
+ *
+ * Move @a iter to its first entry on the first call, then to the next
+ * entry on each call. The walk keeps its path on an explicit stack and
+ * reuses one key buffer, so it does not allocate after the first few
+ * entries.
+ *
+ * Available since: 0.2.5
+ */
+Bool
+trie_iterator_next (TrieIterator *iter)
+{
+    const DArray   *da = iter->root.trie->da;
+    TrieIndex       s, parent;
+    TrieChar        c;
+    Bool            is_descending;
+
+    switch (iter->status) {
+    case TRIE_ITER_START:
+        /* a state in a tail has just one entry below */
+        if (iter->root.is_suffix) {
+            iter->depth = 0;
+            if (trie_iterator_set_entry (iter, iter->root.index,
+                                         iter->root.suffix_idx))
+            {
+                return TRUE;
+            }
+            iter->status = TRIE_ITER_END;
+            return FALSE;
+        }
+        iter->depth = 0;
+        iter->path[0] = s = iter->root.index;
+        is_descending = TRUE;
+        break;
+    case TRIE_ITER_ENTRY:
+        s = iter->path[iter->depth];
+        is_descending = FALSE;
+        break;
+    default:
+        return FALSE;
+    }
+
+    for (;;) {
+        if (is_descending) {
+            if (trie_da_is_separate (da, s)) {
+                if (trie_iterator_set_entry (iter,
+                                             trie_da_get_tail_index (da, s),
+                                             0))
+                {
+                    return TRUE;
+                }
+                break;
+            }
+            s = da_get_first_child (da, s, &c);
+            if (TRIE_INDEX_ERROR != s) {
+                if (!trie_iterator_push (iter, s, c))
+                    break;
+                continue;
+            }
+        }
+
+        /* climb up to the nearest state with a next child */
+        if (iter->root.is_suffix || 0 == iter->depth)
+            break;
+        --iter->depth;
+        parent = iter->path[iter->depth];
+        c = iter->labels[iter->depth];
+        s = da_get_next_child (da, parent, &c);
+        if (TRIE_INDEX_ERROR != s) {
+            if (!trie_iterator_push (iter, s, c))
+                break;
+            is_descending = TRUE;
+        }
+    }
+
+    iter->status = TRIE_ITER_END;
+    return FALSE;
+}
+
+/**
+ * @brief Get the key of the current entry of an iterator
+ *
+ * @param iter : the iterator
+ *
+ * @return the key of the current entry, or NULL if there is none
+ *
+ * Get the key of the entry @a iter is at, without the part walked before
+ * the iteration started, i.e. relative to the state it was created from.
+ * The key is held in a buffer of @a iter, only valid until the next call
+ * to trie_iterator_next(), and must be copied if it is to be kept.
+ *
+ * Available since: 0.2.5
+ */
+const AlphaChar *
+trie_iterator_get_key (const TrieIterator *iter)
+{
+    return (TRIE_ITER_ENTRY == iter->status) ? iter->key : NULL;
+}
+
+/**
+ * @brief Get the data of the current entry of an iterator
+ *
+ * @param iter : the iterator
+ *
+ * @return the data of the current entry, or TRIE_DATA_ERROR if there is
+ *         none
+ *
+ * Available since: 0.2.5
+ */
+TrieData
+trie_iterator_get_data (const TrieIterator *iter)
+{
+    return (TRIE_ITER_ENTRY == iter->status)
+           ? tail_get_data (iter->root.trie->tail, iter->tail_idx)
+           : TRIE_DATA_ERROR;
+}
+
+/* state of trie_enumerate_into(): the keys are stored one after another
+ * in key_buff, and the path being walked is spelled right after the last
+ * stored key, at key_buff + buff_used, where the next key will start
+ */
+typedef struct {
+    const Trie         *trie;
+    AlphaChar          *key_buff;
+    int                 buff_size;
+    int                 buff_used;
+    const AlphaChar   **keys;
+    TrieData           *data;
+    int                 max_entries;
+    int                 n_entries;
+} _TrieEnumInto;
+
+/* store the entry of tail block tail_idx from suffix_idx on, its key being
+ * the first key_len characters of the path followed by the suffix;
+ * FALSE if no more entries are to be stored
+ */
+static Bool
+trie_enum_into_add (_TrieEnumInto  *e,
+                    int             key_len,
+                    TrieIndex       tail_idx,
+                    int             suffix_idx)
+{
+    const TrieChar *suffix;
+    AlphaChar      *key, *p;
+    int             len;
+
+    suffix = tail_get_suffix (e->trie->tail, tail_idx);
+    if (!suffix)
+        return FALSE;
+    suffix += suffix_idx;
+
+    len = key_len + strlen ((const char *) suffix) + 1;
+    if (len > e->buff_size - e->buff_used)
+        return FALSE;
+
+    key = e->key_buff + e->buff_used;
+    for (p = key + key_len; *suffix; p++, suffix++)
+        *p = alpha_map_trie_to_char (e->trie->alpha_map, *suffix);
+    *p = 0;
+
+    e->keys[e->n_entries] = key;
+    if (e->data)
+        e->data[e->n_entries] = tail_get_data (e->trie->tail, tail_idx);
+    e->buff_used += len;
+    if (++e->n_entries == e->max_entries)
+        return FALSE;
+
+    /* move the path along, past the stored key; the part that does not
+     * fit is not needed, as no key spelled with it would fit either */
+    if (key_len > e->buff_size - e->buff_used)
+        key_len = e->buff_size - e->buff_used;
+    memcpy (e->key_buff + e->buff_used, key, key_len * sizeof (AlphaChar));
+    return TRUE;
+}
+
+/* walk the states below s depth-first, storing the entries found; with
+ * no stack to keep the path on, the walk climbs back up through the check
+ * of each state, which is its parent
+ */
+static void
+trie_enum_into_walk (_TrieEnumInto *e, TrieIndex s)
+{
+    const DArray   *da = e->trie->da;
+    TrieIndex       t, parent;
+    TrieChar        c;
+    int             depth;
+
+    depth = 0;
+    t = s;
+    for (;;) {
+        /* descend along the first children down to a separate node */
+        while (!trie_da_is_separate (da, t)) {
+            parent = t;
+            t = da_get_first_child (da, parent, &c);
+            if (TRIE_INDEX_ERROR == t) {
+                t = parent;
+                break;
+            }
+            /* a terminator ending the path is not part of the key */
+            if (TRIE_CHAR_TERM != c) {
+                if (depth + 1 >= e->buff_size - e->buff_used)
+                    return;
+                e->key_buff[e->buff_used + depth++]
+                    = alpha_map_trie_to_char (e->trie->alpha_map, c);
+            }
+        }
+        if (trie_da_is_separate (da, t)
+            && !trie_enum_into_add (e, depth, trie_da_get_tail_index (da, t),
+                                    0))
+        {
+            return;
+        }
+
+        /* climb up to the nearest state with a next child */
+        for (;;) {
+            if (t == s)
+                return;
+            parent = da_get_check (da, t);
+            c = (TrieChar) (t - da_get_base (da, parent));
+            if (TRIE_CHAR_TERM != c)
+                --depth;
+            t = da_get_next_child (da, parent, &c);
+            if (TRIE_INDEX_ERROR != t)
+                break;
+            t = parent;
+        }
+        if (TRIE_CHAR_TERM != c) {
+            if (depth + 1 >= e->buff_size - e->buff_used)
+                return;
+            e->key_buff[e->buff_used + depth++]
+                = alpha_map_trie_to_char (e->trie->alpha_map, c);
+        }
+    }
+}
+
+/**
+ * @brief Enumerate the entries under a state into caller buffers
+ *
+ * @param s           : the state to enumerate from
+ * @param key_buff    : the buffer to store the keys in
+ * @param buff_size   : the size of @a key_buff, in characters
+ * @param keys        : the array to get the key of each entry in
+ * @param data        : the array to get the data of each entry in,
+ *                      or NULL if not needed
+ * @param max_entries : the maximum number of entries to get
+ *
+ * @return the number of entries got
+ *
+ * Get the entries reachable from state @a s in lexicographic order of
+ * their keys, like a trie iterator created from @a s would, but with no
+ * memory allocation. The keys, relative to @a s, are stored one after
+ * another in @a key_buff, each terminated by 0, and the i-th entry gets
+ * a pointer to its key in @a keys[i] and its data in @a data[i].
+ *
+ * The enumeration stops after @a max_entries entries, or at the first key
+ * that does not fit in the rest of @a key_buff. So, if fewer entries than
+ * asked for are returned, either @a s has no more, or the buffer was too
+ * small for the next one. For completion lists and similar, where only
+ * the first few entries are wanted, the buffers can live on the stack.
+ *
+ * Available since: 0.2.5
+ */
+int
+trie_enumerate_into (const TrieState   *s,
+                     AlphaChar         *key_buff,
+                     int                buff_size,
+                     const AlphaChar   *keys[],
+                     TrieData           data[],
+                     int                max_entries)
+{
+    _TrieEnumInto   e;
+
+    if (max_entries <= 0 || buff_size <= 0)
+        return 0;
+
+    e.trie        = s->trie;
+    e.key_buff    = key_buff;
+    e.buff_size   = buff_size;
+    e.buff_used   = 0;
+    e.keys        = keys;
+    e.data        = data;
+    e.max_entries = max_entries;
+    e.n_entries   = 0;
+
+    /* a state in a tail has just one entry below */
+    if (s->is_suffix)
+        trie_enum_into_add (&e, 0, s->index, s->suffix_idx);
+    else
+        trie_enum_into_walk (&e, s->index);
+
+    return e.n_entries;
+}
+
 /*
 vi:ts=4:ai:expandtab
 */
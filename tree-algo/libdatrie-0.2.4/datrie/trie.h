@@ -56,11 +56,73 @@ typedef Bool (*TrieEnumFunc) (const AlphaChar  *key,
                               TrieData          key_data,
                               void             *user_data);
 
+/**
+ * @brief Match of a trie key in a text
+ */
+typedef struct {
+    int         pos;    /**< position of the match in the text */
+    int         len;    /**< length of the matched key */
+    TrieData    data;   /**< data of the matched key */
+} TrieMatch;
+
+/**
+ * @brief Trie match function
+ *
+ * @param match     : the match found
+ * @param user_data : user-supplied data
+ *
+ * @return TRUE to continue matching, FALSE to stop
+ */
+typedef Bool (*TrieMatchFunc) (const TrieMatch  *match,
+                               void             *user_data);
+
+/**
+ * @brief State placement order, see trie_relayout()
+ */
+typedef enum {
+    TRIE_LAYOUT_BFS,    /**< breadth-first, level by level */
+    TRIE_LAYOUT_DFS     /**< depth-first, each path together */
+} TrieLayout;
+
 /**
  * @brief Trie walking state
  */
 typedef struct _TrieState TrieState;
 
+/**
+ * @brief TrieState structure
+ *
+ * The fields are private. The structure is only exposed so that a state
+ * can be declared on the stack and set up with trie_state_init(), with no
+ * heap allocation.
+ */
+struct _TrieState {
+    const Trie *trie;       /**< the corresponding trie */
+    TrieIndex   index;      /**< index in double-array/tail structures */
+    int32       suffix_idx; /**< suffix character offset, if in suffix */
+    short       is_suffix;  /**< whether it is currently in suffix part */
+};
+
+/**
+ * @brief Lock-free trie reader
+ */
+typedef struct _TrieReader TrieReader;
+
+/**
+ * @brief Handle publishing successive versions of a trie
+ */
+typedef struct _TrieHandle TrieHandle;
+
+/**
+ * @brief Reader of the trie published through a TrieHandle
+ */
+typedef struct _TrieHandleReader TrieHandleReader;
+
+/**
+ * @brief Iterator over trie entries
+ */
+typedef struct _TrieIterator TrieIterator;
+
 /*-----------------------*
  *   GENERAL FUNCTIONS   *
  *-----------------------*/
@@ -71,14 +133,46 @@ Trie *  trie_new_from_file (const char *path);
 
 Trie *  trie_fread (FILE *file);
 
+Trie *  trie_new_mapped (const char *path);
+
 void    trie_free (Trie *trie);
 
 int     trie_save (Trie *trie, const char *path);
 
 int     trie_fwrite (Trie *trie, FILE *file);
 
+int     trie_save_mapped (const Trie *trie, const char *path);
+
 Bool    trie_is_dirty (const Trie *trie);
 
+Bool    trie_is_readonly (const Trie *trie);
+
+const AlphaMap * trie_get_alpha_map (const Trie *trie);
+
+void    trie_get_mem_usage (const Trie *trie,
+                            size_t     *o_da_size,
+                            size_t     *o_tail_size);
+
+Bool    trie_share_suffixes (Trie *trie);
+
+Bool    trie_set_value_size (Trie *trie, int value_size);
+
+int     trie_get_value_size (const Trie *trie);
+
+Bool    trie_relayout (Trie              *trie,
+                       TrieLayout         layout,
+                       const AlphaChar   *const keys[],
+                       const TrieData     counts[],
+                       int                n_keys);
+
+Bool    trie_compact (Trie *trie);
+
+Trie *  trie_new_compacted (const Trie *trie);
+
+void    trie_get_cell_usage (const Trie *trie,
+                             TrieIndex  *o_num_cells,
+                             TrieIndex  *o_num_free);
+
 
 /*------------------------------*
  *   GENERAL QUERY OPERATIONS   *
@@ -88,10 +182,53 @@ Bool    trie_retrieve (const Trie      *trie,
                        const AlphaChar *key,
                        TrieData        *o_data);
 
+Bool    trie_retrieve_n (const Trie      *trie,
+                         const AlphaChar *key,
+                         int              len,
+                         TrieData        *o_data);
+
+Bool    trie_retrieve_utf8 (const Trie      *trie,
+                            const char      *key,
+                            int              len,
+                            TrieData        *o_data);
+
+Bool    trie_retrieve_value (const Trie      *trie,
+                             const AlphaChar *key,
+                             void            *o_value);
+
+int     trie_retrieve_batch (const Trie        *trie,
+                             const AlphaChar   *const keys[],
+                             int                n_keys,
+                             TrieData           o_data[]);
+
 Bool    trie_store (Trie *trie, const AlphaChar *key, TrieData data);
 
+Bool    trie_store_n (Trie            *trie,
+                      const AlphaChar *key,
+                      int              len,
+                      TrieData         data);
+
 Bool    trie_store_if_absent (Trie *trie, const AlphaChar *key, TrieData data);
 
+Bool    trie_store_utf8 (Trie            *trie,
+                         const char      *key,
+                         int              len,
+                         TrieData         data);
+
+Bool    trie_store_value (Trie             *trie,
+                          const AlphaChar  *key,
+                          TrieData          data,
+                          const void       *value);
+
+Bool    trie_build_from_sorted (Trie               *trie,
+                                const AlphaChar    *const keys[],
+                                const TrieData      data[],
+                                int                 n_keys);
+
+Bool    trie_build_from_parts (Trie               *trie,
+                               const Trie         *const parts[],
+                               int                 n_parts);
+
 Bool    trie_delete (Trie *trie, const AlphaChar *key);
 
 Bool    trie_enumerate (const Trie     *trie,
@@ -99,12 +236,87 @@ Bool    trie_enumerate (const Trie     *trie,
                         void           *user_data);
 
 
+/*-----------------------*
+ *   PREFIX MATCHING     *
+ *-----------------------*/
+
+Bool    trie_longest_prefix (const Trie       *trie,
+                             const AlphaChar  *text,
+                             int               len,
+                             int              *o_match_len,
+                             TrieData         *o_data);
+
+int     trie_common_prefix_search (const Trie       *trie,
+                                   const AlphaChar  *text,
+                                   int               len,
+                                   TrieMatch         matches[],
+                                   int               max_matches);
+
+Bool    trie_scan (const Trie       *trie,
+                   const AlphaChar  *text,
+                   int               len,
+                   TrieMatchFunc     match_func,
+                   void             *user_data);
+
+
+
+/*-----------------------------*
+ *   MULTI-PATTERN MATCHING    *
+ *-----------------------------*/
+
+Bool    trie_build_failure_links (Trie *trie);
+
+Bool    trie_has_failure_links (const Trie *trie);
+
+Bool    trie_scan_linear (const Trie       *trie,
+                          const AlphaChar  *text,
+                          int               len,
+                          TrieMatchFunc     match_func,
+                          void             *user_data);
+
+
+/*-------------------------*
+ *   CONCURRENT READING    *
+ *-------------------------*/
+
+Bool         trie_set_concurrent (Trie *trie);
+
+TrieReader * trie_reader_new (Trie *trie);
+
+void         trie_reader_free (TrieReader *reader);
+
+Bool         trie_reader_retrieve (TrieReader       *reader,
+                                   const AlphaChar  *key,
+                                   TrieData         *o_data);
+
+
+/*-------------------*
+ *   TRIE HANDLES    *
+ *-------------------*/
+
+TrieHandle * trie_handle_new (Trie *trie);
+
+void         trie_handle_free (TrieHandle *handle);
+
+void         trie_handle_publish (TrieHandle *handle, Trie *trie);
+
+TrieHandleReader * trie_handle_reader_new (TrieHandle *handle);
+
+void         trie_handle_reader_free (TrieHandleReader *reader);
+
+const Trie * trie_handle_acquire (TrieHandleReader *reader);
+
+void         trie_handle_release (TrieHandleReader *reader);
+
+
 /*-------------------------------*
  *   STEPWISE QUERY OPERATIONS   *
  *-------------------------------*/
 
 TrieState * trie_root (const Trie *trie);
 
+void        trie_state_init (TrieState *s, const Trie *trie);
+
 
 /*----------------*
  *   TRIE STATE   *
@@ -151,6 +363,30 @@ Bool      trie_state_is_single (const TrieState *s);
 
 TrieData trie_state_get_data (const TrieState *s);
 
+Bool     trie_state_get_value (const TrieState *s, void *o_value);
+
+
+/*---------------------*
+ *   ENTRY ITERATION   *
+ *---------------------*/
+
+TrieIterator *   trie_iterator_new (const TrieState *s);
+
+void             trie_iterator_free (TrieIterator *iter);
+
+Bool             trie_iterator_next (TrieIterator *iter);
+
+const AlphaChar * trie_iterator_get_key (const TrieIterator *iter);
+
+TrieData         trie_iterator_get_data (const TrieIterator *iter);
+
+int              trie_enumerate_into (const TrieState   *s,
+                                      AlphaChar         *key_buff,
+                                      int                buff_size,
+                                      const AlphaChar   *keys[],
+                                      TrieData           data[],
+                                      int                max_entries);
+
 #ifdef __cplusplus
 }
 #endif
@@ -56,8 +56,11 @@ typedef unsigned char  TrieChar;
 
 /**
  * @brief Type of Trie index
+ *
+ * Indices are 64-bit, so that a trie can grow beyond 2^31 states. Small
+ * tries still store them in 32-bit cells, see darray.c.
  */
-typedef int32          TrieIndex;
+typedef int64          TrieIndex;
 /**
  * @brief Trie error index
  */
@@ -65,7 +68,7 @@ typedef int32          TrieIndex;
 /**
  * @brief Maximum trie index value
  */
-#define TRIE_INDEX_MAX    0x7fffffff
+#define TRIE_INDEX_MAX    ((TrieIndex) 0x7fffffffffffffffLL)
 
 /**
  * @brief Type of value associated to trie entries
@@ -101,6 +101,34 @@ typedef enum { FALSE = 0, TRUE = 1 } Bool;
 #   endif /* INT32_TYPEDEF */
 # endif /* LONG_MAX */
 
+# if ULONG_MAX == 0xffffffffffffffff
+#   ifndef UINT64_TYPEDEF
+#     define UINT64_TYPEDEF
+      typedef unsigned long  uint64;
+#   endif /* UINT64_TYPEDEF */
+# endif /* ULONG_MAX */
+
+# if LONG_MAX == 0x7fffffffffffffff
+#   ifndef INT64_TYPEDEF
+#     define INT64_TYPEDEF
+      typedef long           int64;
+#   endif /* INT64_TYPEDEF */
+# endif /* LONG_MAX */
+
+# if defined(ULLONG_MAX) && ULLONG_MAX == 0xffffffffffffffff
+#   ifndef UINT64_TYPEDEF
+#     define UINT64_TYPEDEF
+      typedef unsigned long long uint64;
+#   endif /* UINT64_TYPEDEF */
+# endif /* ULLONG_MAX */
+
+# if defined(LLONG_MAX) && LLONG_MAX == 0x7fffffffffffffff
+#   ifndef INT64_TYPEDEF
+#     define INT64_TYPEDEF
+      typedef long long      int64;
+#   endif /* INT64_TYPEDEF */
+# endif /* LLONG_MAX */
+
 # ifndef UINT8_TYPEDEF
 #   error "uint8 type is undefined!"
 # endif
@@ -119,6 +147,12 @@ typedef enum { FALSE = 0, TRUE = 1 } Bool;
 # ifndef INT32_TYPEDEF
 #   error "int32 type is undefined!"
 # endif
+# ifndef UINT64_TYPEDEF
+#   error "uint64 type is undefined!"
+# endif
+# ifndef INT64_TYPEDEF
+#   error "int64 type is undefined!"
+# endif
 
 typedef uint8  byte;
 typedef uint16 word;
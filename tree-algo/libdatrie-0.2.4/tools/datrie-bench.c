@@ -0,0 +1,2621 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * datrie-bench.c - Benchmarks for libdatrie
+ * Created: 2026-10-18
+ */
+
+#include <config.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __linux__
+# include <sys/syscall.h>
+# include <linux/perf_event.h>
+#endif
+
+#include <datrie/trie.h>
+#include <datrie/dawg.h>
+#include <datrie/louds.h>
+
+#define N_ELEMENTS(a)   (sizeof(a)/sizeof((a)[0]))
+
+#define DEFAULT_N_KEYS  500000
+#define DEFAULT_REPEAT  3
+#define DEFAULT_TMP     "datrie-bench.tmp"
+#define DEFAULT_THREADS 4
+
+#define PREFIX_RESULTS  10
+#define PREFIX_BUFF     1024
+#define SCAN_WORDS      100000
+#define SCAN_TOKEN_MAX  64
+#define COLD_LOOKUPS    1000
+#define UPDATE_CHURN    2
+
+typedef enum {
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON
+} Format;
+
+typedef struct {
+    const char *word_list;
+    const char *tmp_path;
+    int         n_keys;
+    int         repeat;
+    unsigned    seed;
+    int         n_threads;
+    double      zipf_s;
+    Format      format;
+
+    AlphaChar **keys;
+    AlphaMap   *alpha_map;
+} BenchEnv;
+
+typedef struct {
+    const char *name;
+    void      (*run) (BenchEnv *env);
+    const char *desc;
+} Bench;
+
+static void     bench_insert    (BenchEnv *env);
+static void     bench_save_load (BenchEnv *env);
+static void     check_mapped_nolinks (BenchEnv *env);
+static void     bench_enumerate (BenchEnv *env);
+static void     bench_retrieve  (BenchEnv *env);
+static void     bench_alloc     (BenchEnv *env);
+static void     bench_batch     (BenchEnv *env);
+static void     bench_concurrent (BenchEnv *env);
+static void     bench_swap      (BenchEnv *env);
+static void     bench_scan      (BenchEnv *env);
+static void     bench_dawg      (BenchEnv *env);
+static void     bench_relayout  (BenchEnv *env);
+static void     bench_values    (BenchEnv *env);
+static void     bench_latency   (BenchEnv *env);
+static void     bench_update    (BenchEnv *env);
+static void     bench_utf8      (BenchEnv *env);
+static void     bench_louds     (BenchEnv *env);
+
+static const Bench benches[] = {
+    { "insert", bench_insert,
+      "store keys one by one, in random and in sorted order" },
+    { "save-load", bench_save_load,
+      "save and load the trie in stream and mapped formats, and check a\n"
+      "              mapped file without child index over a full alphabet" },
+    { "enumerate", bench_enumerate,
+      "walk all keys of the trie, in memory, mapped and with an iterator,\n"
+      "              and the first keys under prefixes" },
+    { "retrieve", bench_retrieve,
+      "look up all keys, in memory and mapped" },
+    { "alloc", bench_alloc,
+      "count heap allocations per key of lookups, walks and stores" },
+    { "batch", bench_batch,
+      "look up shuffled keys one by one and in batches, on a bulk-built trie" },
+    { "concurrent", bench_concurrent,
+      "look up keys from threads while deleting and re-adding keys, with a\n"
+      "              read-write lock and with lock-free readers" },
+    { "swap", bench_swap,
+      "look up keys from threads while reloading the trie file, under a\n"
+      "              read-write lock and through a trie handle" },
+    { "scan", bench_scan,
+      "find keys in a text of concatenated keys, state by state, with\n"
+      "              trie_scan(), with failure links and by longest match" },
+    { "dawg", bench_dawg,
+      "build the minimal automaton of the keys, check that it is smaller\n"
+      "              than the trie and compare lookups with the mapped trie" },
+    { "relayout", bench_relayout,
+      "look up skewed queries on the mapped trie, with states as inserted\n"
+      "              and relaid out, counting cache misses and pages touched" },
+    { "values", bench_values,
+      "look up 16-byte payloads on the mapped trie, kept as entry values\n"
+      "              and in a separate table indexed by entry data" },
+    { "latency", bench_latency,
+      "time each lookup of the query workload, with trie_retrieve() and\n"
+      "              state by state, and report percentiles" },
+    { "update", bench_update,
+      "delete keys, store them back and overwrite them, then compact the\n"
+      "              trie left by deleting some of them, and check that\n"
+      "              compacting a dense trie does not grow it" },
+    { "utf8", bench_utf8,
+      "store and look up keys given in UTF-8, decoded to AlphaChar first\n"
+      "              and with the UTF-8 functions" },
+    { "louds", bench_louds,
+      "build the succinct trie of the keys, compare its file size, lookups\n"
+      "              and prefix matches with the mapped trie" },
+};
+
+/* payload of the values benchmark */
+typedef struct {
+    int64   id;
+    int64   check;
+} Payload;
+
+typedef enum {
+    COUNTER_CACHE_MISSES,
+    COUNTER_PAGE_FAULTS
+} Counter;
+
+static int      prepare_keys    (BenchEnv *env);
+static int      read_word_list  (BenchEnv *env);
+static void     utf8_decode     (const char *line, AlphaChar *key);
+static char *   alpha_to_utf8   (const AlphaChar *key);
+static void     make_keys       (BenchEnv *env);
+static void     make_alpha_map  (BenchEnv *env);
+static void     free_keys       (BenchEnv *env);
+
+static Trie *   build_trie      (BenchEnv *env);
+static int      alpha_key_cmp   (const void *a, const void *b);
+static Bool     count_key       (const AlphaChar *key, TrieData data,
+                                 void *user_data);
+static int      iterate_keys    (const TrieState *s, int max_keys);
+static int *    make_order      (BenchEnv *env);
+static AlphaChar ** make_queries (BenchEnv *env);
+static double   time_retrieve   (BenchEnv *env, const Trie *trie);
+static void     init_writer_lock (pthread_rwlock_t *lock);
+static void     report_alloc    (BenchEnv *env, const char *op,
+                                 double elapsed, long allocs);
+
+static int      counter_open    (Counter counter);
+static long     counter_read    (int fd);
+static double   now_sec         ();
+static void     reset_peak_rss  ();
+static long     peak_rss        ();
+static void     report_begin    (BenchEnv *env);
+static void     report          (const char *bench, const char *op,
+                                 double value, const char *unit);
+static void     report_end      (BenchEnv *env);
+static void     report_percentiles (const char *bench, const char *op,
+                                    double samples[], int n_samples);
+static void     check_failed    (const char *fmt, ...);
+
+/* number of failed result checks, which make the run exit with failure */
+static int      n_failures = 0;
+
+static void     usage           (const char *prog_name, int exit_status);
+
+int
+main (int argc, char *argv[])
+{
+    BenchEnv    env;
+    int         i, j;
+
+    env.word_list = NULL;
+    env.tmp_path  = DEFAULT_TMP;
+    env.n_keys    = DEFAULT_N_KEYS;
+    env.repeat    = DEFAULT_REPEAT;
+    env.seed      = 1;
+    env.n_threads = DEFAULT_THREADS;
+    env.zipf_s    = 0.0;
+    env.format    = FORMAT_TEXT;
+    env.keys      = NULL;
+    env.alpha_map = NULL;
+
+    for (i = 1; i < argc && *argv[i] == '-'; i++) {
+        if (strcmp (argv[i], "-h") == 0 || strcmp (argv[i], "--help") == 0) {
+            usage (argv[0], EXIT_SUCCESS);
+        } else if (i + 1 >= argc) {
+            fprintf (stderr, "Option %s requires an argument\n", argv[i]);
+            exit (EXIT_FAILURE);
+        } else if (strcmp (argv[i], "-n") == 0) {
+            env.n_keys = atoi (argv[++i]);
+        } else if (strcmp (argv[i], "-r") == 0) {
+            env.repeat = atoi (argv[++i]);
+        } else if (strcmp (argv[i], "-s") == 0) {
+            env.seed = atoi (argv[++i]);
+        } else if (strcmp (argv[i], "-w") == 0) {
+            env.word_list = argv[++i];
+        } else if (strcmp (argv[i], "-t") == 0) {
+            env.tmp_path = argv[++i];
+        } else if (strcmp (argv[i], "-j") == 0) {
+            env.n_threads = atoi (argv[++i]);
+        } else if (strcmp (argv[i], "-z") == 0) {
+            env.zipf_s = atof (argv[++i]);
+        } else if (strcmp (argv[i], "-f") == 0) {
+            ++i;
+            if (strcmp (argv[i], "text") == 0) {
+                env.format = FORMAT_TEXT;
+            } else if (strcmp (argv[i], "csv") == 0) {
+                env.format = FORMAT_CSV;
+            } else if (strcmp (argv[i], "json") == 0) {
+                env.format = FORMAT_JSON;
+            } else {
+                fprintf (stderr, "Unknown output format: %s\n", argv[i]);
+                exit (EXIT_FAILURE);
+            }
+        } else {
+            fprintf (stderr, "Unknown option: %s\n", argv[i]);
+            exit (EXIT_FAILURE);
+        }
+    }
+    if (i == argc)
+        usage (argv[0], EXIT_FAILURE);
+    if (env.n_keys <= 0 || env.repeat <= 0 || env.n_threads <= 0) {
+        fprintf (stderr,
+                 "Number of keys, repeat count and threads must be positive\n");
+        exit (EXIT_FAILURE);
+    }
+    if (env.zipf_s < 0.0) {
+        fprintf (stderr, "Zipf exponent must not be negative\n");
+        exit (EXIT_FAILURE);
+    }
+
+    if (prepare_keys (&env) != 0)
+        exit (EXIT_FAILURE);
+
+    for (j = i; j < argc; j++) {
+        int k;
+
+        for (k = 0; k < N_ELEMENTS (benches); k++) {
+            if (strcmp (argv[j], benches[k].name) == 0)
+                break;
+        }
+        if (k == N_ELEMENTS (benches)) {
+            fprintf (stderr, "Unknown benchmark: %s\n", argv[j]);
+            free_keys (&env);
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    report_begin (&env);
+    for ( ; i < argc; i++) {
+        for (j = 0; strcmp (argv[i], benches[j].name) != 0; j++)
+            ;
+        reset_peak_rss ();
+        benches[j].run (&env);
+        report (benches[j].name, "peak-rss", peak_rss (), "KiB");
+    }
+    report_end (&env);
+
+    free_keys (&env);
+    return n_failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*-----------------*
+ *    TEST KEYS    *
+ *-----------------*/
+
+/*-------------------------*
+ *    ALLOCATION COUNTING  *
+ *-------------------------*/
+
+#ifdef __GLIBC__
+/* Count heap allocations of the whole process, the library included, by
+ * overriding the allocator entry points and forwarding them to glibc.
+ */
+#define HAVE_ALLOC_COUNT 1
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static long n_allocs = 0;
+
+void *
+malloc (size_t size)
+{
+    ++n_allocs;
+    return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+    ++n_allocs;
+    return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+    ++n_allocs;
+    return __libc_realloc (ptr, size);
+}
+#else
+#define HAVE_ALLOC_COUNT 0
+
+static long n_allocs = 0;
+#endif
+
+static int
+prepare_keys (BenchEnv *env)
+{
+    if (env->word_list) {
+        if (read_word_list (env) != 0)
+            return -1;
+    } else {
+        make_keys (env);
+    }
+
+    make_alpha_map (env);
+    return 0;
+}
+
+/* decode one UTF-8 line into AlphaChar string, stopping at tab or EOL;
+ * invalid bytes are taken as Latin-1
+ */
+static AlphaChar *
+utf8_to_alpha (const char *line)
+{
+    AlphaChar  *key;
+
+    key = (AlphaChar *) malloc ((strlen (line) + 1) * sizeof (AlphaChar));
+    utf8_decode (line, key);
+
+    return key;
+}
+
+/* decode UTF-8 line into key, which has room for as many chars as bytes */
+static void
+utf8_decode (const char *line, AlphaChar *key)
+{
+    const unsigned char *p = (const unsigned char *) line;
+    int         n;
+
+    for (n = 0; *p && *p != '\t' && *p != '\n' && *p != '\r'; n++) {
+        if (*p >= 0xc0 && *p < 0xe0 && (p[1] & 0xc0) == 0x80) {
+            key[n] = ((p[0] & 0x1f) << 6) | (p[1] & 0x3f);
+            p += 2;
+        } else if (*p >= 0xe0 && *p < 0xf0 && (p[1] & 0xc0) == 0x80
+                   && (p[2] & 0xc0) == 0x80)
+        {
+            key[n] = ((p[0] & 0x0f) << 12) | ((p[1] & 0x3f) << 6)
+                     | (p[2] & 0x3f);
+            p += 3;
+        } else if (*p >= 0xf0 && (p[1] & 0xc0) == 0x80
+                   && (p[2] & 0xc0) == 0x80 && (p[3] & 0xc0) == 0x80)
+        {
+            key[n] = ((p[0] & 0x07) << 18) | ((p[1] & 0x3f) << 12)
+                     | ((p[2] & 0x3f) << 6) | (p[3] & 0x3f);
+            p += 4;
+        } else {
+            key[n] = *p++;
+        }
+    }
+    key[n] = 0;
+}
+
+/* encode key into UTF-8, in a newly allocated string */
+static char *
+alpha_to_utf8 (const AlphaChar *key)
+{
+    char   *str, *q;
+    int     n;
+
+    for (n = 0; key[n]; n++)
+        ;
+    str = q = (char *) malloc (4 * n + 1);
+    for ( ; *key; key++) {
+        AlphaChar   c = *key;
+
+        if (c < 0x80) {
+            *q++ = c;
+        } else if (c < 0x800) {
+            *q++ = 0xc0 | (c >> 6);
+            *q++ = 0x80 | (c & 0x3f);
+        } else if (c < 0x10000) {
+            *q++ = 0xe0 | (c >> 12);
+            *q++ = 0x80 | ((c >> 6) & 0x3f);
+            *q++ = 0x80 | (c & 0x3f);
+        } else {
+            *q++ = 0xf0 | (c >> 18);
+            *q++ = 0x80 | ((c >> 12) & 0x3f);
+            *q++ = 0x80 | ((c >> 6) & 0x3f);
+            *q++ = 0x80 | (c & 0x3f);
+        }
+    }
+    *q = 0;
+
+    return str;
+}
+
+static int
+read_word_list (BenchEnv *env)
+{
+    FILE   *input;
+    char    line[1024];
+    int     n, size;
+
+    input = fopen (env->word_list, "r");
+    if (!input) {
+        fprintf (stderr, "Cannot open word list \"%s\"\n", env->word_list);
+        return -1;
+    }
+
+    n = size = 0;
+    while (n < env->n_keys && fgets (line, sizeof line, input)) {
+        if ('\n' == line[0] || '\0' == line[0])
+            continue;
+        if (n == size) {
+            size = size ? size * 2 : 1024;
+            env->keys = (AlphaChar **) realloc (env->keys,
+                                                size * sizeof (AlphaChar *));
+        }
+        env->keys[n++] = utf8_to_alpha (line);
+    }
+    fclose (input);
+
+    if (0 == n) {
+        fprintf (stderr, "No words in \"%s\"\n", env->word_list);
+        return -1;
+    }
+    env->n_keys = n;
+
+    return 0;
+}
+
+/* Synthetic keys: lowercase words with a skewed letter distribution,
+ * so that they share prefixes as natural words do.
+ */
+static void
+make_keys (BenchEnv *env)
+{
+    static const char letters[] = "etaoinshrdlcumwfgypbvkjxqz";
+    int     i, j, len;
+
+    srand (env->seed);
+    env->keys = (AlphaChar **) malloc (env->n_keys * sizeof (AlphaChar *));
+    for (i = 0; i < env->n_keys; i++) {
+        len = 3 + rand () % 14;
+        env->keys[i] = (AlphaChar *) malloc ((len + 1) * sizeof (AlphaChar));
+        for (j = 0; j < len; j++) {
+            /* product of two uniforms favors the first letters */
+            int r = (rand () % 26) * (rand () % 26) / 25;
+            env->keys[i][j] = letters[r];
+        }
+        env->keys[i][len] = 0;
+    }
+}
+
+#define MAX_ALPHA_CHAR  0x10ffff
+
+/* alphabet map covering exactly the characters used in keys */
+static void
+make_alpha_map (BenchEnv *env)
+{
+    unsigned char  *used;
+    AlphaChar       c, begin;
+    const AlphaChar *p;
+    int             i;
+
+    used = (unsigned char *) calloc (MAX_ALPHA_CHAR + 2, 1);
+    for (i = 0; i < env->n_keys; i++) {
+        for (p = env->keys[i]; *p; p++) {
+            if (*p <= MAX_ALPHA_CHAR)
+                used[*p] = 1;
+        }
+    }
+
+    env->alpha_map = alpha_map_new ();
+    for (c = 1; c <= MAX_ALPHA_CHAR; c++) {
+        if (!used[c])
+            continue;
+        for (begin = c; used[c + 1]; c++)
+            ;
+        alpha_map_add_range (env->alpha_map, begin, c);
+    }
+
+    free (used);
+}
+
+static void
+free_keys (BenchEnv *env)
+{
+    int i;
+
+    if (env->keys) {
+        for (i = 0; i < env->n_keys; i++)
+            free (env->keys[i]);
+        free (env->keys);
+    }
+    if (env->alpha_map)
+        alpha_map_free (env->alpha_map);
+}
+
+static Trie *
+build_trie (BenchEnv *env)
+{
+    Trie   *trie;
+    int     i;
+
+    trie = trie_new (env->alpha_map);
+    for (i = 0; i < env->n_keys; i++)
+        trie_store (trie, env->keys[i], i);
+
+    return trie;
+}
+
+static int
+alpha_key_cmp (const void *a, const void *b)
+{
+    const AlphaChar *p = *(const AlphaChar *const *) a;
+    const AlphaChar *q = *(const AlphaChar *const *) b;
+
+    while (*p && *p == *q) {
+        p++;
+        q++;
+    }
+    return (*p > *q) - (*p < *q);
+}
+
+static Bool
+count_key (const AlphaChar *key, TrieData data, void *user_data)
+{
+    ++*(int *) user_data;
+    return TRUE;
+}
+
+/* count up to max_keys entries under s, or all if max_keys < 0 */
+static int
+iterate_keys (const TrieState *s, int max_keys)
+{
+    TrieIterator   *iter;
+    int             n;
+
+    iter = trie_iterator_new (s);
+    if (!iter)
+        return 0;
+    for (n = 0; n != max_keys && trie_iterator_next (iter); n++)
+        ;
+    trie_iterator_free (iter);
+
+    return n;
+}
+
+/* indices of all keys in random order */
+static int *
+make_order (BenchEnv *env)
+{
+    int    *order;
+    int     i, j, tmp;
+
+    order = (int *) malloc (env->n_keys * sizeof (int));
+    for (i = 0; i < env->n_keys; i++)
+        order[i] = i;
+    for (i = env->n_keys - 1; i > 0; i--) {
+        j = rand () % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    return order;
+}
+
+/* Query workload of as many queries as keys: each key once, in random
+ * order, or, with a Zipf exponent, keys drawn from a random ranking of
+ * them, the key of rank r being drawn in proportion to 1 / r^s.
+ */
+static AlphaChar **
+make_queries (BenchEnv *env)
+{
+    AlphaChar **queries;
+    double     *cdf;
+    double      sum, u;
+    int        *order;
+    int         i, lo, hi, mid;
+
+    srand (env->seed);
+    order = make_order (env);
+    queries = (AlphaChar **) malloc (env->n_keys * sizeof (AlphaChar *));
+
+    if (0.0 == env->zipf_s) {
+        for (i = 0; i < env->n_keys; i++)
+            queries[i] = env->keys[order[i]];
+        free (order);
+        return queries;
+    }
+
+    cdf = (double *) malloc (env->n_keys * sizeof (double));
+    sum = 0.0;
+    for (i = 0; i < env->n_keys; i++) {
+        sum += pow (i + 1, -env->zipf_s);
+        cdf[i] = sum;
+    }
+    for (i = 0; i < env->n_keys; i++) {
+        u = rand () / (RAND_MAX + 1.0) * sum;
+        lo = 0;
+        hi = env->n_keys - 1;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (cdf[mid] > u)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        queries[i] = env->keys[order[lo]];
+    }
+    free (cdf);
+    free (order);
+
+    return queries;
+}
+
+/*------------------*
+ *    BENCHMARKS    *
+ *------------------*/
+
+static void
+bench_insert (BenchEnv *env)
+{
+    Trie       *trie;
+    AlphaChar **sorted;
+    TrieData   *data;
+    double      t, elapsed;
+    int         i;
+
+    /* keys as given */
+    t = now_sec ();
+    trie = build_trie (env);
+    elapsed = now_sec () - t;
+    trie_free (trie);
+
+    report ("insert", "random", elapsed * 1000, "ms");
+    report ("insert", "random-rate", env->n_keys / elapsed, "keys/s");
+
+    /* keys in sorted order */
+    sorted = (AlphaChar **) malloc (env->n_keys * sizeof (AlphaChar *));
+    memcpy (sorted, env->keys, env->n_keys * sizeof (AlphaChar *));
+    qsort (sorted, env->n_keys, sizeof (AlphaChar *), alpha_key_cmp);
+
+    t = now_sec ();
+    trie = trie_new (env->alpha_map);
+    for (i = 0; i < env->n_keys; i++)
+        trie_store (trie, sorted[i], i);
+    elapsed = now_sec () - t;
+    trie_free (trie);
+
+    report ("insert", "sorted", elapsed * 1000, "ms");
+    report ("insert", "sorted-rate", env->n_keys / elapsed, "keys/s");
+
+    /* sorted keys built level by level */
+    data = (TrieData *) malloc (env->n_keys * sizeof (TrieData));
+    for (i = 0; i < env->n_keys; i++)
+        data[i] = i;
+    t = now_sec ();
+    trie = trie_new (env->alpha_map);
+    if (!trie_build_from_sorted (trie, (const AlphaChar *const *) sorted,
+                                 data, env->n_keys))
+    {
+        fprintf (stderr, "insert: Cannot build trie from sorted keys\n");
+    }
+    elapsed = now_sec () - t;
+    trie_free (trie);
+    free (data);
+    free (sorted);
+
+    report ("insert", "bulk", elapsed * 1000, "ms");
+    report ("insert", "bulk-rate", env->n_keys / elapsed, "keys/s");
+}
+
+static void
+bench_save_load (BenchEnv *env)
+{
+    Trie   *trie, *loaded;
+    double  t, save, load, save_mapped, load_mapped;
+    int     i;
+
+    trie = build_trie (env);
+
+    save = load = save_mapped = load_mapped = 0.0;
+    for (i = 0; i < env->repeat; i++) {
+        t = now_sec ();
+        if (trie_save (trie, env->tmp_path) != 0) {
+            fprintf (stderr, "save-load: Cannot save to %s\n", env->tmp_path);
+            goto exit_trie_created;
+        }
+        save += now_sec () - t;
+
+        t = now_sec ();
+        loaded = trie_new_from_file (env->tmp_path);
+        load += now_sec () - t;
+        if (!loaded) {
+            fprintf (stderr, "save-load: Cannot load %s\n", env->tmp_path);
+            goto exit_trie_created;
+        }
+        trie_free (loaded);
+
+        t = now_sec ();
+        if (trie_save_mapped (trie, env->tmp_path) != 0) {
+            fprintf (stderr, "save-load: Cannot save to %s\n", env->tmp_path);
+            goto exit_trie_created;
+        }
+        save_mapped += now_sec () - t;
+
+        t = now_sec ();
+        loaded = trie_new_mapped (env->tmp_path);
+        load_mapped += now_sec () - t;
+        if (!loaded) {
+            fprintf (stderr, "save-load: Cannot map %s\n", env->tmp_path);
+            goto exit_trie_created;
+        }
+        trie_free (loaded);
+    }
+
+    report ("save-load", "save", save * 1000 / env->repeat, "ms");
+    report ("save-load", "load", load * 1000 / env->repeat, "ms");
+    report ("save-load", "save-mapped",
+            save_mapped * 1000 / env->repeat, "ms");
+    report ("save-load", "load-mapped",
+            load_mapped * 1000 / env->repeat, "ms");
+
+    check_mapped_nolinks (env);
+
+exit_trie_created:
+    remove (env->tmp_path);
+    trie_free (trie);
+}
+
+/* alphabet using every trie label, from 1 to TRIE_CHAR_MAX */
+#define FULL_ALPHA_BEGIN    0x100
+#define FULL_ALPHA_SIZE     TRIE_CHAR_MAX
+
+/* Files mapped before the double-array had a child index are walked by
+ * scanning the labels of each state. Make such a file by clearing the
+ * index flag, bit 0 of the little-endian flags at offset 8 of the header,
+ * of a trie whose states have children of every label, and check that
+ * all keys are found in it.
+ */
+static void
+check_mapped_nolinks (BenchEnv *env)
+{
+    AlphaMap   *alpha_map;
+    Trie       *trie, *mapped;
+    TrieState  *root;
+    FILE       *file;
+    AlphaChar   key[3];
+    TrieData    data;
+    int         i, j, n_mem, n_map, n_iter, n_bad;
+
+    alpha_map = alpha_map_new ();
+    alpha_map_add_range (alpha_map, FULL_ALPHA_BEGIN,
+                         FULL_ALPHA_BEGIN + FULL_ALPHA_SIZE - 1);
+    trie = trie_new (alpha_map);
+    alpha_map_free (alpha_map);
+
+    /* every one- and two-letter key with a first or last letter */
+    for (i = 0; i < FULL_ALPHA_SIZE; i++) {
+        key[0] = FULL_ALPHA_BEGIN + i;
+        key[1] = 0;
+        trie_store (trie, key, i);
+        key[1] = FULL_ALPHA_BEGIN + (i % 2 ? 0 : FULL_ALPHA_SIZE - 1);
+        key[2] = 0;
+        trie_store (trie, key, FULL_ALPHA_SIZE + i);
+    }
+
+    if (trie_save_mapped (trie, env->tmp_path) != 0) {
+        fprintf (stderr, "save-load: Cannot save to %s\n", env->tmp_path);
+        goto exit_trie_created;
+    }
+    file = fopen (env->tmp_path, "r+b");
+    if (!file || fseek (file, 8, SEEK_SET) != 0 || (j = fgetc (file)) == EOF
+        || fseek (file, 8, SEEK_SET) != 0 || fputc (j & ~1, file) == EOF)
+    {
+        fprintf (stderr, "save-load: Cannot modify %s\n", env->tmp_path);
+        if (file)
+            fclose (file);
+        goto exit_trie_created;
+    }
+    fclose (file);
+    mapped = trie_new_mapped (env->tmp_path);
+    if (!mapped) {
+        fprintf (stderr, "save-load: Cannot map %s\n", env->tmp_path);
+        goto exit_trie_created;
+    }
+
+    n_mem = n_map = 0;
+    trie_enumerate (trie, count_key, &n_mem);
+    trie_enumerate (mapped, count_key, &n_map);
+    root = trie_root (mapped);
+    n_iter = iterate_keys (root, -1);
+    trie_state_free (root);
+    if (n_map != n_mem || n_iter != n_mem) {
+        check_failed ("save-load: %d keys in memory, %d mapped without "
+                      "child index, %d iterated\n", n_mem, n_map, n_iter);
+    }
+
+    n_bad = 0;
+    for (i = 0; i < FULL_ALPHA_SIZE; i++) {
+        key[0] = FULL_ALPHA_BEGIN + i;
+        key[1] = 0;
+        if (!trie_retrieve (mapped, key, &data) || data != i)
+            n_bad++;
+        key[1] = FULL_ALPHA_BEGIN + (i % 2 ? 0 : FULL_ALPHA_SIZE - 1);
+        key[2] = 0;
+        if (!trie_retrieve (mapped, key, &data)
+            || data != FULL_ALPHA_SIZE + i)
+        {
+            n_bad++;
+        }
+    }
+    if (n_bad > 0) {
+        check_failed ("save-load: %d lookups failed without child index\n",
+                      n_bad);
+    }
+
+    trie_free (mapped);
+exit_trie_created:
+    trie_free (trie);
+}
+
+static void
+bench_enumerate (BenchEnv *env)
+{
+    Trie       *trie, *mapped;
+    TrieState   s;
+    AlphaChar   key_buff[PREFIX_BUFF];
+    const AlphaChar *keys[PREFIX_RESULTS];
+    TrieData    data[PREFIX_RESULTS];
+    double      t, mem, map, iter, prefix, prefix_into;
+    int         i, j, k, n_mem, n_map, n_iter, n_into;
+
+    trie = build_trie (env);
+    if (trie_save_mapped (trie, env->tmp_path) != 0) {
+        fprintf (stderr, "enumerate: Cannot save to %s\n", env->tmp_path);
+        goto exit_trie_created;
+    }
+    mapped = trie_new_mapped (env->tmp_path);
+    if (!mapped) {
+        fprintf (stderr, "enumerate: Cannot map %s\n", env->tmp_path);
+        goto exit_trie_created;
+    }
+
+    mem = map = iter = 0.0;
+    n_iter = 0;
+    for (i = 0; i < env->repeat; i++) {
+        n_mem = 0;
+        t = now_sec ();
+        trie_enumerate (trie, count_key, &n_mem);
+        mem += now_sec () - t;
+
+        n_map = 0;
+        t = now_sec ();
+        trie_enumerate (mapped, count_key, &n_map);
+        map += now_sec () - t;
+
+        t = now_sec ();
+        trie_state_init (&s, trie);
+        n_iter = iterate_keys (&s, -1);
+        iter += now_sec () - t;
+    }
+    if (n_mem != n_map || n_mem != n_iter)
+        check_failed ("enumerate: %d keys in memory, %d mapped, "
+                      "%d iterated\n", n_mem, n_map, n_iter);
+
+    /* autocompletion: first results under the first half of each key */
+    n_iter = 0;
+    t = now_sec ();
+    for (i = 0; i < env->repeat; i++) {
+        for (j = 0; j < env->n_keys; j++) {
+            const AlphaChar *key = env->keys[j];
+            int              len = 0;
+
+            while (key[len])
+                ++len;
+            trie_state_init (&s, trie);
+            for (k = 0; k < (len + 1) / 2; k++)
+                trie_state_walk (&s, key[k]);
+            n_iter += iterate_keys (&s, PREFIX_RESULTS);
+        }
+    }
+    prefix = now_sec () - t;
+
+    /* the same, into buffers on the stack */
+    n_into = 0;
+    t = now_sec ();
+    for (i = 0; i < env->repeat; i++) {
+        for (j = 0; j < env->n_keys; j++) {
+            const AlphaChar *key = env->keys[j];
+            int              len = 0;
+
+            while (key[len])
+                ++len;
+            trie_state_init (&s, trie);
+            for (k = 0; k < (len + 1) / 2; k++)
+                trie_state_walk (&s, key[k]);
+            n_into += trie_enumerate_into (&s, key_buff, PREFIX_BUFF,
+                                           keys, data, PREFIX_RESULTS);
+        }
+    }
+    prefix_into = now_sec () - t;
+    if (n_into != n_iter)
+        check_failed ("enumerate: %d prefix results iterated, %d into "
+                      "buffers\n", n_iter, n_into);
+
+    report ("enumerate", "memory", mem * 1000 / env->repeat, "ms");
+    report ("enumerate", "memory-rate", n_mem * env->repeat / mem, "keys/s");
+    report ("enumerate", "mapped", map * 1000 / env->repeat, "ms");
+    report ("enumerate", "iterator", iter * 1000 / env->repeat, "ms");
+    report ("enumerate", "prefix-first-10",
+            prefix * 1e9 / ((double) env->repeat * env->n_keys), "ns/query");
+    report ("enumerate", "prefix-10-into",
+            prefix_into * 1e9 / ((double) env->repeat * env->n_keys),
+            "ns/query");
+
+    trie_free (mapped);
+exit_trie_created:
+    remove (env->tmp_path);
+    trie_free (trie);
+}
+
+static double
+time_retrieve (BenchEnv *env, const Trie *trie)
+{
+    TrieData    data;
+    double      t;
+    int         i, j, n_found;
+
+    n_found = 0;
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            if (trie_retrieve (trie, env->keys[i], &data))
+                ++n_found;
+        }
+    }
+    t = now_sec () - t;
+    if (n_found != env->repeat * env->n_keys)
+        check_failed ("retrieve: %d keys not found\n",
+                      env->repeat * env->n_keys - n_found);
+
+    return t;
+}
+
+static void
+bench_retrieve (BenchEnv *env)
+{
+    Trie   *trie, *mapped;
+    double  mem, map;
+
+    trie = build_trie (env);
+    if (trie_save_mapped (trie, env->tmp_path) != 0) {
+        fprintf (stderr, "retrieve: Cannot save to %s\n", env->tmp_path);
+        goto exit_trie_created;
+    }
+    mapped = trie_new_mapped (env->tmp_path);
+    if (!mapped) {
+        fprintf (stderr, "retrieve: Cannot map %s\n", env->tmp_path);
+        goto exit_trie_created;
+    }
+
+    mem = time_retrieve (env, trie);
+    map = time_retrieve (env, mapped);
+
+    report ("retrieve", "memory",
+            mem * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+    report ("retrieve", "mapped",
+            map * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+
+    trie_free (mapped);
+exit_trie_created:
+    remove (env->tmp_path);
+    trie_free (trie);
+}
+
+static void
+bench_alloc (BenchEnv *env)
+{
+    Trie       *trie;
+    TrieState  *state, stack_state;
+    TrieData    data;
+    int        *lens;
+    double      t;
+    long        allocs;
+    int         i, j, n_keys, n_bad;
+
+    lens = (int *) malloc (env->n_keys * sizeof (int));
+    for (i = 0; i < env->n_keys; i++)
+        lens[i] = alpha_char_strlen (env->keys[i]);
+
+    /* insertion, which only allocates to grow the trie storage */
+    allocs = n_allocs;
+    t = now_sec ();
+    trie = trie_new (env->alpha_map);
+    for (i = 0; i < env->n_keys; i++)
+        trie_store_n (trie, env->keys[i], lens[i], i);
+    t = now_sec () - t;
+    report_alloc (env, "store-new", t, n_allocs - allocs);
+
+    n_bad = 0;
+    allocs = n_allocs;
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            if (!trie_store_n (trie, env->keys[i], lens[i], i))
+                ++n_bad;
+        }
+    }
+    t = now_sec () - t;
+    report_alloc (env, "store-update", t / env->repeat,
+                  (n_allocs - allocs) / env->repeat);
+
+    allocs = n_allocs;
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            if (!trie_retrieve_n (trie, env->keys[i], lens[i], &data))
+                ++n_bad;
+        }
+    }
+    t = now_sec () - t;
+    report_alloc (env, "retrieve-n", t / env->repeat,
+                  (n_allocs - allocs) / env->repeat);
+
+    /* stepwise walks, with allocated and stack states; trie_root()
+     * mallocs its state, one allocation per key, which
+     * trie_state_init() avoids
+     */
+    allocs = n_allocs;
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            const AlphaChar *p;
+
+            state = trie_root (trie);
+            for (p = env->keys[i]; *p && trie_state_walk (state, *p); p++)
+                ;
+            if (*p || !trie_state_is_terminal (state))
+                ++n_bad;
+            trie_state_free (state);
+        }
+    }
+    t = now_sec () - t;
+    report_alloc (env, "walk-root", t / env->repeat,
+                  (n_allocs - allocs) / env->repeat);
+
+    allocs = n_allocs;
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            const AlphaChar *p;
+
+            trie_state_init (&stack_state, trie);
+            for (p = env->keys[i]; *p && trie_state_walk (&stack_state, *p); p++)
+                ;
+            if (*p || !trie_state_is_terminal (&stack_state))
+                ++n_bad;
+        }
+    }
+    t = now_sec () - t;
+    report_alloc (env, "walk-init", t / env->repeat,
+                  (n_allocs - allocs) / env->repeat);
+
+    allocs = n_allocs;
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        n_keys = 0;
+        trie_enumerate (trie, count_key, &n_keys);
+    }
+    t = now_sec () - t;
+    report_alloc (env, "enumerate", t / env->repeat,
+                  (n_allocs - allocs) / env->repeat);
+
+    /* clones of a walked state, as taken at each position by tokenizers;
+     * each clone is one allocation
+     */
+    allocs = n_allocs;
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            trie_state_init (&stack_state, trie);
+            trie_state_walk (&stack_state, env->keys[i][0]);
+            state = trie_state_clone (&stack_state);
+            if (!state)
+                ++n_bad;
+            trie_state_free (state);
+        }
+    }
+    t = now_sec () - t;
+    report_alloc (env, "clone-free", t / env->repeat,
+                  (n_allocs - allocs) / env->repeat);
+
+    if (n_bad > 0)
+        check_failed ("alloc: %d failed operations\n", n_bad);
+
+    trie_free (trie);
+    free (lens);
+}
+
+static void
+bench_batch (BenchEnv *env)
+{
+    static const int batch_sizes[] = { 16, 64, 256, 1024 };
+
+    Trie       *trie;
+    AlphaChar **keys;
+    TrieData   *expected, *data;
+    size_t      da_size, tail_size;
+    char        op[32];
+    double      t;
+    int         b, i, j, k, n, n_bad;
+
+    keys = (AlphaChar **) malloc (env->n_keys * sizeof (AlphaChar *));
+    memcpy (keys, env->keys, env->n_keys * sizeof (AlphaChar *));
+    qsort (keys, env->n_keys, sizeof (AlphaChar *), alpha_key_cmp);
+    expected = (TrieData *) malloc (env->n_keys * sizeof (TrieData));
+    data = (TrieData *) malloc (env->n_keys * sizeof (TrieData));
+
+    /* bulk build, as storing keys one by one is too slow for big tries;
+     * data of each key is its index in sorted order
+     */
+    for (i = 0; i < env->n_keys; i++)
+        data[i] = i;
+    trie = trie_new (env->alpha_map);
+    if (!trie_build_from_sorted (trie, (const AlphaChar *const *) keys,
+                                 data, env->n_keys))
+    {
+        fprintf (stderr, "batch: Cannot build trie\n");
+        goto exit_trie_created;
+    }
+    trie_get_mem_usage (trie, &da_size, &tail_size);
+    report ("batch", "trie-size", (da_size + tail_size) / 1048576.0, "MiB");
+
+    /* query in random order */
+    srand (env->seed);
+    for (i = env->n_keys - 1; i > 0; i--) {
+        AlphaChar *tmp;
+
+        j = rand () % (i + 1);
+        tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            if (!trie_retrieve (trie, keys[i], &expected[i]))
+                expected[i] = TRIE_DATA_ERROR;
+        }
+    }
+    t = now_sec () - t;
+    report ("batch", "loop",
+            t * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+
+    for (b = 0; b < N_ELEMENTS (batch_sizes); b++) {
+        t = now_sec ();
+        for (j = 0; j < env->repeat; j++) {
+            for (i = 0; i < env->n_keys; i += n) {
+                n = env->n_keys - i;
+                if (n > batch_sizes[b])
+                    n = batch_sizes[b];
+                trie_retrieve_batch (trie,
+                                     (const AlphaChar *const *) keys + i,
+                                     n, data + i);
+            }
+        }
+        t = now_sec () - t;
+
+        n_bad = 0;
+        for (k = 0; k < env->n_keys; k++) {
+            if (data[k] != expected[k])
+                ++n_bad;
+        }
+        if (n_bad > 0)
+            check_failed ("batch: %d mismatches in batches of %d\n",
+                          n_bad, batch_sizes[b]);
+
+        sprintf (op, "batch-%d", batch_sizes[b]);
+        report ("batch", op,
+                t * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+    }
+
+exit_trie_created:
+    trie_free (trie);
+    free (data);
+    free (expected);
+    free (keys);
+}
+
+#define CONC_SECONDS    1.0
+#define CONC_CHECK_TIME 64
+
+typedef struct {
+    Trie             *trie;
+    TrieReader       *reader;
+    pthread_rwlock_t *lock;
+    AlphaChar *const *keys;
+    const TrieData   *expected;
+    int               n_keys;
+    unsigned          seed;
+    volatile int     *stop;
+
+    long              n_reads;
+    long              n_misses;
+    long              n_torn;
+} ConcReader;
+
+static void *
+conc_read (void *arg)
+{
+    ConcReader *r = (ConcReader *) arg;
+    TrieData    data;
+    Bool        found;
+    int         i;
+
+    while (!*r->stop) {
+        i = rand_r (&r->seed) % r->n_keys;
+        if (r->reader) {
+            found = trie_reader_retrieve (r->reader, r->keys[i], &data);
+        } else {
+            pthread_rwlock_rdlock (r->lock);
+            found = trie_retrieve (r->trie, r->keys[i], &data);
+            pthread_rwlock_unlock (r->lock);
+        }
+        /* a key being rewritten may be missing, but never carries
+         * other data
+         */
+        if (!found)
+            ++r->n_misses;
+        else if (data != r->expected[i])
+            ++r->n_torn;
+        ++r->n_reads;
+    }
+
+    return NULL;
+}
+
+static void
+run_concurrent (BenchEnv *env, Trie *trie, pthread_rwlock_t *lock,
+                AlphaChar **keys, const TrieData *expected, const char *op)
+{
+    ConcReader     *readers;
+    pthread_t      *threads;
+    volatile int    stop;
+    long            n_reads, n_misses, n_torn, n_writes;
+    char            op_buff[32];
+    double          t, elapsed;
+    int             i, j, n_threads;
+
+    readers = (ConcReader *) malloc (env->n_threads * sizeof (ConcReader));
+    threads = (pthread_t *) malloc (env->n_threads * sizeof (pthread_t));
+
+    stop = 0;
+    for (n_threads = 0; n_threads < env->n_threads; n_threads++) {
+        ConcReader *r = &readers[n_threads];
+
+        r->trie     = trie;
+        r->reader   = lock ? NULL : trie_reader_new (trie);
+        r->lock     = lock;
+        r->keys     = keys;
+        r->expected = expected;
+        r->n_keys   = env->n_keys;
+        r->seed     = env->seed + n_threads;
+        r->stop     = &stop;
+        r->n_reads = r->n_misses = r->n_torn = 0;
+        if (pthread_create (&threads[n_threads], NULL, conc_read, r) != 0) {
+            fprintf (stderr, "concurrent: Cannot create thread\n");
+            break;
+        }
+    }
+
+    /* the writer: delete and re-add keys, with their original data,
+     * for a fixed time, so that readers and writer share the same period
+     */
+    n_writes = 0;
+    t = now_sec ();
+    do {
+        for (j = 0; j < CONC_CHECK_TIME; j++) {
+            i = n_writes++ % env->n_keys;
+            if (lock)
+                pthread_rwlock_wrlock (lock);
+            trie_delete (trie, keys[i]);
+            if (lock) {
+                pthread_rwlock_unlock (lock);
+                pthread_rwlock_wrlock (lock);
+            }
+            trie_store (trie, keys[i], expected[i]);
+            if (lock)
+                pthread_rwlock_unlock (lock);
+        }
+        elapsed = now_sec () - t;
+    } while (elapsed < CONC_SECONDS * env->repeat);
+    stop = 1;
+
+    n_reads = n_misses = n_torn = 0;
+    for (i = 0; i < n_threads; i++) {
+        pthread_join (threads[i], NULL);
+        if (readers[i].reader)
+            trie_reader_free (readers[i].reader);
+        n_reads  += readers[i].n_reads;
+        n_misses += readers[i].n_misses;
+        n_torn   += readers[i].n_torn;
+    }
+
+    sprintf (op_buff, "%s-reads", op);
+    report ("concurrent", op_buff, n_reads / elapsed / 1e6, "M/s");
+    sprintf (op_buff, "%s-writes", op);
+    report ("concurrent", op_buff, 2.0 * n_writes / elapsed / 1e6, "M/s");
+    sprintf (op_buff, "%s-misses", op);
+    report ("concurrent", op_buff,
+            n_reads ? (double) n_misses / n_reads : 0.0, "ratio");
+    if (n_torn > 0)
+        check_failed ("concurrent: %ld reads got wrong data with %s\n",
+                      n_torn, op);
+
+    free (threads);
+    free (readers);
+}
+
+static void
+bench_concurrent (BenchEnv *env)
+{
+    Trie               *trie;
+    AlphaChar         **keys;
+    TrieData           *expected;
+    pthread_rwlock_t    lock;
+    int                 i;
+
+    keys = (AlphaChar **) malloc (env->n_keys * sizeof (AlphaChar *));
+    memcpy (keys, env->keys, env->n_keys * sizeof (AlphaChar *));
+    qsort (keys, env->n_keys, sizeof (AlphaChar *), alpha_key_cmp);
+    expected = (TrieData *) malloc (env->n_keys * sizeof (TrieData));
+
+    for (i = 0; i < env->n_keys; i++)
+        expected[i] = i;
+    trie = trie_new (env->alpha_map);
+    if (!trie_build_from_sorted (trie, (const AlphaChar *const *) keys,
+                                 expected, env->n_keys))
+    {
+        fprintf (stderr, "concurrent: Cannot build trie\n");
+        goto exit_trie_created;
+    }
+    /* duplicated keys keep the data of the last one */
+    for (i = 0; i < env->n_keys; i++)
+        trie_retrieve (trie, keys[i], &expected[i]);
+
+    init_writer_lock (&lock);
+    run_concurrent (env, trie, &lock, keys, expected, "rwlock");
+    pthread_rwlock_destroy (&lock);
+
+    if (!trie_set_concurrent (trie)) {
+        fprintf (stderr, "concurrent: Lock-free readers not supported\n");
+        goto exit_trie_created;
+    }
+    run_concurrent (env, trie, NULL, keys, expected, "lock-free");
+
+exit_trie_created:
+    trie_free (trie);
+    free (expected);
+    free (keys);
+}
+
+#define SWAP_INTERVAL   0.1
+
+typedef struct {
+    TrieHandle       *handle;
+    pthread_rwlock_t *lock;
+    Trie *volatile   *trie;
+    AlphaChar *const *keys;
+    int               n_keys;
+    unsigned          seed;
+    volatile int     *stop;
+
+    long              n_reads;
+    long              n_misses;
+    double            max_latency;
+} SwapReader;
+
+static void *
+swap_read (void *arg)
+{
+    SwapReader       *r = (SwapReader *) arg;
+    TrieHandleReader *reader;
+    const Trie       *trie;
+    Bool              found;
+    double            t;
+    int               i;
+
+    reader = r->handle ? trie_handle_reader_new (r->handle) : NULL;
+    if (r->handle && !reader) {
+        fprintf (stderr, "swap: Cannot create handle reader\n");
+        return NULL;
+    }
+    while (!*r->stop) {
+        i = rand_r (&r->seed) % r->n_keys;
+        t = now_sec ();
+        if (reader) {
+            trie = trie_handle_acquire (reader);
+            found = trie_retrieve (trie, r->keys[i], NULL);
+            trie_handle_release (reader);
+        } else {
+            pthread_rwlock_rdlock (r->lock);
+            found = trie_retrieve (*r->trie, r->keys[i], NULL);
+            pthread_rwlock_unlock (r->lock);
+        }
+        t = now_sec () - t;
+        if (t > r->max_latency)
+            r->max_latency = t;
+        if (!found)
+            ++r->n_misses;
+        ++r->n_reads;
+    }
+    if (reader)
+        trie_handle_reader_free (reader);
+
+    return NULL;
+}
+
+static void
+run_swap (BenchEnv *env, TrieHandle *handle, AlphaChar **keys,
+          const char *op)
+{
+    SwapReader         *readers;
+    pthread_t          *threads;
+    pthread_rwlock_t    lock;
+    Trie *volatile      trie;
+    Trie               *loaded;
+    volatile int        stop;
+    struct timespec     pause;
+    char                op_buff[32];
+    long                n_reads, n_misses;
+    double              t, elapsed, reload, max_latency;
+    int                 i, n_reloads, n_threads;
+
+    init_writer_lock (&lock);
+    trie = handle ? NULL : trie_new_from_file (env->tmp_path);
+    if (!handle && !trie) {
+        fprintf (stderr, "swap: Cannot load %s\n", env->tmp_path);
+        pthread_rwlock_destroy (&lock);
+        return;
+    }
+
+    readers = (SwapReader *) malloc (env->n_threads * sizeof (SwapReader));
+    threads = (pthread_t *) malloc (env->n_threads * sizeof (pthread_t));
+
+    stop = 0;
+    for (n_threads = 0; n_threads < env->n_threads; n_threads++) {
+        SwapReader *r = &readers[n_threads];
+
+        r->handle   = handle;
+        r->lock     = &lock;
+        r->trie     = &trie;
+        r->keys     = keys;
+        r->n_keys   = env->n_keys;
+        r->seed     = env->seed + n_threads;
+        r->stop     = &stop;
+        r->n_reads  = r->n_misses = 0;
+        r->max_latency = 0.0;
+        if (pthread_create (&threads[n_threads], NULL, swap_read, r) != 0) {
+            fprintf (stderr, "swap: Cannot create thread\n");
+            break;
+        }
+    }
+
+    /* the loader: reload the trie file periodically */
+    pause.tv_sec  = 0;
+    pause.tv_nsec = SWAP_INTERVAL * 1e9;
+    n_reloads = 0;
+    reload = 0.0;
+    t = now_sec ();
+    do {
+        nanosleep (&pause, NULL);
+        elapsed = now_sec ();
+        if (handle) {
+            loaded = trie_new_mapped (env->tmp_path);
+            if (loaded)
+                trie_handle_publish (handle, loaded);
+        } else {
+            pthread_rwlock_wrlock (&lock);
+            loaded = trie_new_from_file (env->tmp_path);
+            if (loaded) {
+                trie_free (trie);
+                trie = loaded;
+            }
+            pthread_rwlock_unlock (&lock);
+        }
+        reload += now_sec () - elapsed;
+        if (!loaded) {
+            fprintf (stderr, "swap: Cannot load %s\n", env->tmp_path);
+            break;
+        }
+        ++n_reloads;
+        elapsed = now_sec () - t;
+    } while (elapsed < CONC_SECONDS * env->repeat);
+    stop = 1;
+
+    n_reads = n_misses = 0;
+    max_latency = 0.0;
+    for (i = 0; i < n_threads; i++) {
+        pthread_join (threads[i], NULL);
+        n_reads  += readers[i].n_reads;
+        n_misses += readers[i].n_misses;
+        if (readers[i].max_latency > max_latency)
+            max_latency = readers[i].max_latency;
+    }
+    if (n_misses > 0)
+        check_failed ("swap: %ld keys not found with %s\n", n_misses, op);
+
+    sprintf (op_buff, "%s-reads", op);
+    report ("swap", op_buff, n_reads / elapsed / 1e6, "M/s");
+    sprintf (op_buff, "%s-max-read", op);
+    report ("swap", op_buff, max_latency * 1000, "ms");
+    sprintf (op_buff, "%s-reload", op);
+    report ("swap", op_buff,
+            n_reloads ? reload * 1000 / n_reloads : 0.0, "ms");
+
+    free (threads);
+    free (readers);
+    if (trie)
+        trie_free (trie);
+    pthread_rwlock_destroy (&lock);
+}
+
+static void
+bench_swap (BenchEnv *env)
+{
+    Trie       *trie;
+    TrieHandle *handle;
+
+    trie = build_trie (env);
+
+    if (trie_save (trie, env->tmp_path) != 0) {
+        fprintf (stderr, "swap: Cannot save to %s\n", env->tmp_path);
+        goto exit_trie_created;
+    }
+    run_swap (env, NULL, env->keys, "reload-lock");
+
+    if (trie_save_mapped (trie, env->tmp_path) != 0) {
+        fprintf (stderr, "swap: Cannot save to %s\n", env->tmp_path);
+        goto exit_trie_created;
+    }
+    handle = trie_handle_new (trie);
+    if (!handle) {
+        fprintf (stderr, "swap: Trie handles not supported\n");
+        goto exit_trie_created;
+    }
+    run_swap (env, handle, env->keys, "handle");
+    trie_handle_free (handle);
+    remove (env->tmp_path);
+    return;
+
+exit_trie_created:
+    remove (env->tmp_path);
+    trie_free (trie);
+}
+
+static Bool
+count_match (const TrieMatch *match, void *user_data)
+{
+    ++*(long *) user_data;
+    return TRUE;
+}
+
+static void
+bench_scan (BenchEnv *env)
+{
+    Trie       *trie;
+    TrieState  *s, *t;
+    AlphaChar  *text;
+    TrieData    data;
+    double      elapsed;
+    long        n_matches, n_stepwise;
+    size_t      da_size, tail_size, linked_da_size;
+    int         i, j, k, n_words, len, match_len;
+
+    trie = build_trie (env);
+
+    /* text of words with no separator, as in languages written that way */
+    n_words = (env->n_keys < SCAN_WORDS) ? env->n_keys : SCAN_WORDS;
+    for (len = 0, i = 0; i < n_words; i++)
+        for (j = 0; env->keys[i][j]; j++)
+            ++len;
+    text = (AlphaChar *) malloc ((len + 1) * sizeof (AlphaChar));
+    for (k = 0, i = 0; i < n_words; i++)
+        for (j = 0; env->keys[i][j]; j++)
+            text[k++] = env->keys[i][j];
+    text[len] = 0;
+
+    /* walking state by state from each position, as a tokenizer would
+     * without trie_scan()
+     */
+    n_stepwise = 0;
+    elapsed = now_sec ();
+    for (i = 0; i < env->repeat; i++) {
+        n_stepwise = 0;
+        for (j = 0; j < len; j++) {
+            s = trie_root (trie);
+            for (k = j; ; k++) {
+                if (trie_state_is_terminal (s)) {
+                    t = trie_state_clone (s);
+                    trie_state_walk (t, TRIE_CHAR_TERM);
+                    data = trie_state_get_data (t);
+                    trie_state_free (t);
+                    ++n_stepwise;
+                }
+                if (k == len || !trie_state_walk (s, text[k]))
+                    break;
+            }
+            trie_state_free (s);
+        }
+    }
+    elapsed = now_sec () - elapsed;
+    report ("scan", "stepwise",
+            elapsed * 1e9 / ((double) env->repeat * len), "ns/char");
+
+    n_matches = 0;
+    elapsed = now_sec ();
+    for (i = 0; i < env->repeat; i++) {
+        n_matches = 0;
+        trie_scan (trie, text, len, count_match, &n_matches);
+    }
+    elapsed = now_sec () - elapsed;
+    report ("scan", "scan",
+            elapsed * 1e9 / ((double) env->repeat * len), "ns/char");
+    if (n_matches != n_stepwise)
+        check_failed ("scan: %ld matches stepwise, %ld scanned\n",
+                      n_stepwise, n_matches);
+
+    /* one pass through Aho-Corasick failure links */
+    trie_get_mem_usage (trie, &da_size, &tail_size);
+    elapsed = now_sec ();
+    if (!trie_build_failure_links (trie)) {
+        fprintf (stderr, "scan: Cannot build failure links\n");
+    } else {
+        elapsed = now_sec () - elapsed;
+        report ("scan", "build-links", elapsed * 1e3, "ms");
+        trie_get_mem_usage (trie, &linked_da_size, NULL);
+        report ("scan", "links-da-growth",
+                100.0 * linked_da_size / da_size - 100.0, "%");
+
+        elapsed = now_sec ();
+        for (i = 0; i < env->repeat; i++) {
+            n_stepwise = 0;
+            trie_scan_linear (trie, text, len, count_match, &n_stepwise);
+        }
+        elapsed = now_sec () - elapsed;
+        report ("scan", "linear",
+                elapsed * 1e9 / ((double) env->repeat * len), "ns/char");
+        if (n_matches != n_stepwise)
+            check_failed ("scan: %ld matches scanned, %ld linear\n",
+                          n_matches, n_stepwise);
+    }
+
+    /* greedy longest-match tokenization, skipping unknown characters */
+    elapsed = now_sec ();
+    for (i = 0; i < env->repeat; i++) {
+        for (j = 0; j < len; j += (match_len > 0) ? match_len : 1) {
+            match_len = 0;
+            trie_longest_prefix (trie, text + j, SCAN_TOKEN_MAX,
+                                 &match_len, &data);
+        }
+    }
+    elapsed = now_sec () - elapsed;
+    report ("scan", "longest-tokens",
+            elapsed * 1e9 / ((double) env->repeat * len), "ns/char");
+
+    free (text);
+    trie_free (trie);
+}
+
+static void
+bench_dawg (BenchEnv *env)
+{
+    Trie       *trie, *mapped;
+    Dawg       *dawg;
+    TrieData    data, dawg_data;
+    char       *dawg_path;
+    size_t      da_size, tail_size;
+    double      t;
+    int         i, j, n_bad;
+
+    trie = build_trie (env);
+    trie_share_suffixes (trie);
+    trie_get_mem_usage (trie, &da_size, &tail_size);
+    report ("dawg", "trie-size", (da_size + tail_size) / 1048576.0, "MiB");
+
+    t = now_sec ();
+    dawg = dawg_new_from_trie (trie);
+    t = now_sec () - t;
+    if (!dawg) {
+        fprintf (stderr, "dawg: Cannot build automaton\n");
+        trie_free (trie);
+        return;
+    }
+    report ("dawg", "build", t * 1e3, "ms");
+    report ("dawg", "dawg-size", dawg_get_mem_size (dawg) / 1048576.0, "MiB");
+    if (dawg_get_mem_size (dawg) >= da_size + tail_size) {
+        check_failed ("dawg: automaton of %lu bytes is not smaller than "
+                      "the trie of %lu\n",
+                      (unsigned long) dawg_get_mem_size (dawg),
+                      (unsigned long) (da_size + tail_size));
+    }
+
+    /* both mapped, from separate files */
+    dawg_path = (char *) malloc (strlen (env->tmp_path) + 6);
+    sprintf (dawg_path, "%s.dawg", env->tmp_path);
+    mapped = NULL;
+    if (dawg_save (dawg, dawg_path) != 0
+        || trie_save_mapped (trie, env->tmp_path) != 0)
+    {
+        fprintf (stderr, "dawg: Cannot save to %s\n", env->tmp_path);
+        goto exit_dawg_created;
+    }
+    dawg_free (dawg);
+    dawg = dawg_new_mapped (dawg_path);
+    mapped = trie_new_mapped (env->tmp_path);
+    if (!dawg || !mapped) {
+        fprintf (stderr, "dawg: Cannot map %s\n", env->tmp_path);
+        goto exit_dawg_created;
+    }
+
+    t = time_retrieve (env, mapped);
+    report ("dawg", "trie-retrieve",
+            t * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+
+    n_bad = 0;
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            if (!dawg_retrieve (dawg, env->keys[i], &dawg_data))
+                ++n_bad;
+        }
+    }
+    t = now_sec () - t;
+    report ("dawg", "dawg-retrieve",
+            t * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+
+    for (i = 0; i < env->n_keys; i++) {
+        if (!dawg_retrieve (dawg, env->keys[i], &dawg_data)
+            || !trie_retrieve (mapped, env->keys[i], &data)
+            || data != dawg_data)
+        {
+            ++n_bad;
+        }
+    }
+    if (n_bad > 0)
+        check_failed ("dawg: %d lookups mismatched\n", n_bad);
+
+exit_dawg_created:
+    if (dawg)
+        dawg_free (dawg);
+    if (mapped)
+        trie_free (mapped);
+    remove (dawg_path);
+    remove (env->tmp_path);
+    free (dawg_path);
+    trie_free (trie);
+}
+
+/* time queries on the trie, mapped afresh, and count the events */
+static void
+measure_layout (BenchEnv *env, const Trie *trie, const char *layout,
+                AlphaChar **queries)
+{
+    Trie   *mapped;
+    char    op[32];
+    double  t;
+    long    misses, faults;
+    int     fd, i, j, n_found;
+
+    if (trie_save_mapped (trie, env->tmp_path) != 0
+        || NULL == (mapped = trie_new_mapped (env->tmp_path)))
+    {
+        fprintf (stderr, "relayout: Cannot map %s\n", env->tmp_path);
+        return;
+    }
+
+    /* pages touched by the first lookups, before the trie is all paged in */
+    fd = counter_open (COUNTER_PAGE_FAULTS);
+    faults = counter_read (fd);
+    for (i = 0; i < env->n_keys && i < COLD_LOOKUPS; i++)
+        trie_retrieve (mapped, queries[i], NULL);
+    faults = counter_read (fd) - faults;
+    if (fd >= 0) {
+        close (fd);
+        sprintf (op, "%s-pages", layout);
+        report ("relayout", op, (double) faults / i, "pages/key");
+    }
+
+    fd = counter_open (COUNTER_CACHE_MISSES);
+    misses = counter_read (fd);
+    n_found = 0;
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            if (trie_retrieve (mapped, queries[i], NULL))
+                ++n_found;
+        }
+    }
+    t = now_sec () - t;
+    misses = counter_read (fd) - misses;
+    if (n_found != env->repeat * env->n_keys)
+        check_failed ("relayout: %d keys not found\n",
+                      env->repeat * env->n_keys - n_found);
+
+    sprintf (op, "%s-retrieve", layout);
+    report ("relayout", op,
+            t * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+    if (fd >= 0) {
+        close (fd);
+        sprintf (op, "%s-misses", layout);
+        report ("relayout", op,
+                (double) misses / ((double) env->repeat * env->n_keys),
+                "misses/key");
+    }
+
+    trie_free (mapped);
+    remove (env->tmp_path);
+}
+
+static void
+bench_relayout (BenchEnv *env)
+{
+    static const struct {
+        const char *name;
+        TrieLayout  layout;
+        Bool        is_guided;
+    } layouts[] = {
+        { "bfs", TRIE_LAYOUT_BFS, FALSE },
+        { "dfs", TRIE_LAYOUT_DFS, FALSE },
+        { "guided", TRIE_LAYOUT_DFS, TRUE },
+    };
+    Trie       *trie;
+    AlphaChar **queries;
+    int        *order;
+    char        op[32];
+    double      t, u;
+    int         i, j, tmp;
+
+    /* queries skewed towards keys at random positions, as in a log */
+    srand (env->seed);
+    order = (int *) malloc (env->n_keys * sizeof (int));
+    for (i = 0; i < env->n_keys; i++)
+        order[i] = i;
+    for (i = env->n_keys - 1; i > 0; i--) {
+        j = rand () % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    queries = (AlphaChar **) malloc (env->n_keys * sizeof (AlphaChar *));
+    for (i = 0; i < env->n_keys; i++) {
+        u = rand () / (RAND_MAX + 1.0);
+        queries[i] = env->keys[order[(int) (u * u * u * env->n_keys)]];
+    }
+    free (order);
+
+    trie = build_trie (env);
+    measure_layout (env, trie, "inserted", queries);
+
+    for (i = 0; i < N_ELEMENTS (layouts); i++) {
+        t = now_sec ();
+        if (!trie_relayout (trie, layouts[i].layout,
+                            layouts[i].is_guided
+                                ? (const AlphaChar *const *) queries : NULL,
+                            NULL, layouts[i].is_guided ? env->n_keys : 0))
+        {
+            fprintf (stderr, "relayout: Cannot relayout trie\n");
+            break;
+        }
+        t = now_sec () - t;
+        sprintf (op, "%s-build", layouts[i].name);
+        report ("relayout", op, t * 1e3, "ms");
+        measure_layout (env, trie, layouts[i].name, queries);
+    }
+
+    free (queries);
+    trie_free (trie);
+}
+
+static void
+bench_values (BenchEnv *env)
+{
+    Trie       *trie, *mapped;
+    Payload    *table, payload;
+    TrieData    data;
+    int64       sum;
+    double      t;
+    int        *places;
+    int         i, j, n_bad;
+
+    /* the table is shuffled, as when payloads are kept in another store */
+    srand (env->seed);
+    table = (Payload *) malloc (env->n_keys * sizeof (Payload));
+    trie = trie_new (env->alpha_map);
+    trie_set_value_size (trie, sizeof (Payload));
+    for (i = 0; i < env->n_keys; i++) {
+        payload.id = i;
+        payload.check = ~(int64) i;
+        data = rand () % (i + 1);
+        table[i] = table[data];
+        table[data] = payload;
+        trie_store_value (trie, env->keys[i], data, &payload);
+    }
+    /* the entries of moved payloads point to their new places, the last
+     * of duplicated keys winning as with the values
+     */
+    places = (int *) malloc (env->n_keys * sizeof (int));
+    for (i = 0; i < env->n_keys; i++)
+        places[table[i].id] = i;
+    for (i = 0; i < env->n_keys; i++)
+        trie_store (trie, env->keys[i], places[i]);
+    free (places);
+
+    mapped = NULL;
+    if (trie_save_mapped (trie, env->tmp_path) != 0
+        || NULL == (mapped = trie_new_mapped (env->tmp_path)))
+    {
+        fprintf (stderr, "values: Cannot map %s\n", env->tmp_path);
+        goto exit_table_created;
+    }
+
+    n_bad = 0;
+    sum = 0;
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            if (!trie_retrieve (mapped, env->keys[i], &data))
+                ++n_bad;
+            else
+                sum += table[data].check;
+        }
+    }
+    t = now_sec () - t;
+    report ("values", "table",
+            t * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            if (!trie_retrieve_value (mapped, env->keys[i], &payload))
+                ++n_bad;
+            else
+                sum -= payload.check;
+        }
+    }
+    t = now_sec () - t;
+    report ("values", "inline",
+            t * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+
+    if (n_bad > 0 || sum != 0)
+        check_failed ("values: %d lookups failed or mismatched\n", n_bad);
+
+    trie_free (mapped);
+exit_table_created:
+    remove (env->tmp_path);
+    free (table);
+    trie_free (trie);
+}
+
+static void
+bench_latency (BenchEnv *env)
+{
+    Trie       *trie;
+    AlphaChar **queries;
+    double     *samples;
+    TrieState   s;
+    TrieData    data;
+    const AlphaChar *p;
+    double      t;
+    int         i, j, n, n_bad;
+
+    queries = make_queries (env);
+    samples = (double *) malloc ((size_t) env->repeat * env->n_keys
+                                 * sizeof (double));
+    trie = build_trie (env);
+
+    /* one untimed pass, so that the percentiles are of a warm trie */
+    for (i = 0; i < env->n_keys; i++)
+        trie_retrieve (trie, queries[i], &data);
+
+    n = n_bad = 0;
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            t = now_sec ();
+            if (!trie_retrieve (trie, queries[i], &data))
+                ++n_bad;
+            samples[n++] = (now_sec () - t) * 1e9;
+        }
+    }
+    report_percentiles ("latency", "retrieve", samples, n);
+
+    n = 0;
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            t = now_sec ();
+            trie_state_init (&s, trie);
+            for (p = queries[i]; *p && trie_state_walk (&s, *p); p++)
+                ;
+            if (*p || !trie_state_is_terminal (&s))
+                ++n_bad;
+            samples[n++] = (now_sec () - t) * 1e9;
+        }
+    }
+    report_percentiles ("latency", "walk", samples, n);
+
+    if (n_bad > 0)
+        check_failed ("latency: %d queries not found\n", n_bad);
+
+    trie_free (trie);
+    free (samples);
+    free (queries);
+}
+
+/* compacting a trie with few free cells must keep it at least as small */
+static void
+check_compact_no_grow (Trie *trie, const char *what)
+{
+    TrieIndex   cells, cells_compacted;
+
+    trie_get_cell_usage (trie, &cells, NULL);
+    if (!trie_compact (trie)) {
+        fprintf (stderr, "update: Cannot compact trie\n");
+        return;
+    }
+    trie_get_cell_usage (trie, &cells_compacted, NULL);
+    if (cells_compacted > cells) {
+        check_failed ("update: %s trie of %ld cells compacted into %ld\n",
+                      what, (long) cells, (long) cells_compacted);
+    }
+}
+
+static void
+bench_update (BenchEnv *env)
+{
+    Trie       *trie;
+    AlphaMap   *alpha_map;
+    AlphaChar **keys;
+    AlphaChar   first, last;
+    TrieData   *data;
+    int        *order;
+    TrieIndex   cells, n_free;
+    double      t, elapsed;
+    int         i;
+
+    srand (env->seed);
+    order = make_order (env);
+    trie = build_trie (env);
+
+    /* a freshly stored trie is dense already */
+    check_compact_no_grow (trie, "stored");
+
+    /* delete all keys, then store them back into the freed cells */
+    t = now_sec ();
+    for (i = 0; i < env->n_keys; i++)
+        trie_delete (trie, env->keys[order[i]]);
+    elapsed = now_sec () - t;
+    report ("update", "delete-rate", env->n_keys / elapsed, "keys/s");
+
+    t = now_sec ();
+    for (i = 0; i < env->n_keys; i++)
+        trie_store (trie, env->keys[order[i]], i);
+    elapsed = now_sec () - t;
+    report ("update", "store-rate", env->n_keys / elapsed, "keys/s");
+
+    t = now_sec ();
+    for (i = 0; i < env->n_keys; i++)
+        trie_store (trie, env->keys[i], i);
+    elapsed = now_sec () - t;
+    report ("update", "overwrite-rate", env->n_keys / elapsed, "keys/s");
+
+    /* churn: delete a share of the keys, and compact what is left */
+    for (i = 0; i < env->n_keys; i += UPDATE_CHURN)
+        trie_delete (trie, env->keys[order[i]]);
+    trie_get_cell_usage (trie, &cells, &n_free);
+    report ("update", "load-churned", 100.0 * (cells - n_free) / cells, "%");
+
+    t = now_sec ();
+    if (!trie_compact (trie))
+        fprintf (stderr, "update: Cannot compact trie\n");
+    elapsed = now_sec () - t;
+    trie_get_cell_usage (trie, &cells, &n_free);
+    report ("update", "compact", elapsed * 1000, "ms");
+    report ("update", "load-compacted", 100.0 * (cells - n_free) / cells,
+            "%");
+
+    /* compacting again finds nothing to drop */
+    check_compact_no_grow (trie, "compacted");
+    trie_free (trie);
+
+    /* bulk build packs states in key order, with hardly a free cell;
+     * take the letters as one range, as alphabet map files often do
+     */
+    keys = (AlphaChar **) malloc (env->n_keys * sizeof (AlphaChar *));
+    data = (TrieData *) malloc (env->n_keys * sizeof (TrieData));
+    memcpy (keys, env->keys, env->n_keys * sizeof (AlphaChar *));
+    qsort (keys, env->n_keys, sizeof (AlphaChar *), alpha_key_cmp);
+    first = MAX_ALPHA_CHAR;
+    last = 0;
+    for (i = 0; i < env->n_keys; i++) {
+        const AlphaChar *p;
+
+        for (p = keys[i]; *p; p++) {
+            if (*p < first)
+                first = *p;
+            if (*p > last)
+                last = *p;
+        }
+        data[i] = i;
+    }
+    if (first <= last && last - first < TRIE_CHAR_MAX) {
+        alpha_map = alpha_map_new ();
+        alpha_map_add_range (alpha_map, first, last);
+    } else {
+        alpha_map = alpha_map_clone (env->alpha_map);
+    }
+    trie = trie_new (alpha_map);
+    alpha_map_free (alpha_map);
+    if (trie_build_from_sorted (trie, (const AlphaChar *const *) keys,
+                                data, env->n_keys))
+    {
+        check_compact_no_grow (trie, "bulk-built");
+    } else {
+        fprintf (stderr, "update: Cannot build trie\n");
+    }
+
+    trie_free (trie);
+    free (data);
+    free (keys);
+    free (order);
+}
+
+static void
+bench_utf8 (BenchEnv *env)
+{
+    Trie       *trie;
+    char      **utf8_keys;
+    AlphaChar  *key;
+    TrieData    data;
+    double      t, widen, direct;
+    size_t      max_len;
+    int         i, j, n_found;
+
+    utf8_keys = (char **) malloc (env->n_keys * sizeof (char *));
+    max_len = 0;
+    for (i = 0; i < env->n_keys; i++) {
+        utf8_keys[i] = alpha_to_utf8 (env->keys[i]);
+        if (strlen (utf8_keys[i]) > max_len)
+            max_len = strlen (utf8_keys[i]);
+    }
+    key = (AlphaChar *) malloc ((max_len + 1) * sizeof (AlphaChar));
+
+    t = now_sec ();
+    trie = trie_new (env->alpha_map);
+    for (i = 0; i < env->n_keys; i++) {
+        utf8_decode (utf8_keys[i], key);
+        trie_store (trie, key, i);
+    }
+    widen = now_sec () - t;
+    trie_free (trie);
+
+    t = now_sec ();
+    trie = trie_new (env->alpha_map);
+    for (i = 0; i < env->n_keys; i++)
+        trie_store_utf8 (trie, utf8_keys[i], -1, i);
+    direct = now_sec () - t;
+
+    report ("utf8", "store-widen", widen * 1e9 / env->n_keys, "ns/key");
+    report ("utf8", "store-direct", direct * 1e9 / env->n_keys, "ns/key");
+
+    n_found = 0;
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            utf8_decode (utf8_keys[i], key);
+            if (trie_retrieve (trie, key, &data))
+                ++n_found;
+        }
+    }
+    widen = now_sec () - t;
+
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            if (trie_retrieve_utf8 (trie, utf8_keys[i], -1, &data))
+                ++n_found;
+        }
+    }
+    direct = now_sec () - t;
+    if (n_found != 2 * env->repeat * env->n_keys)
+        check_failed ("utf8: %d keys not found\n",
+                      2 * env->repeat * env->n_keys - n_found);
+
+    report ("utf8", "retrieve-widen",
+            widen * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+    report ("utf8", "retrieve-direct",
+            direct * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+
+    trie_free (trie);
+    free (key);
+    for (i = 0; i < env->n_keys; i++)
+        free (utf8_keys[i]);
+    free (utf8_keys);
+}
+
+/*---------------*
+ *    HELPERS    *
+ *---------------*/
+
+/* Open a counter of events of the calling thread, or return -1 if not
+ * supported. Hardware counters are often not available in virtual
+ * machines.
+ */
+static int
+counter_open (Counter counter)
+{
+#ifdef __linux__
+    struct perf_event_attr  attr;
+
+    memset (&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    if (COUNTER_CACHE_MISSES == counter) {
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    } else {
+        attr.type = PERF_TYPE_SOFTWARE;
+        attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+    }
+
+    return syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static long
+counter_read (int fd)
+{
+    long long   count;
+
+    if (fd < 0 || read (fd, &count, sizeof count) != sizeof count)
+        return 0;
+
+    return (long) count;
+}
+
+static double
+now_sec ()
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    struct timeval  tv;
+
+    gettimeofday (&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+#endif
+}
+
+/* Peak resident set size of the process, in KiB. On Linux, the peak is
+ * reset before each benchmark, so that it is of that benchmark only, on
+ * top of the keys; elsewhere, it is the peak since the process started.
+ */
+static void
+reset_peak_rss ()
+{
+    FILE   *clear_refs;
+
+    clear_refs = fopen ("/proc/self/clear_refs", "w");
+    if (clear_refs) {
+        fputs ("5", clear_refs);
+        fclose (clear_refs);
+    }
+}
+
+static long
+peak_rss ()
+{
+    struct rusage   usage;
+    FILE           *status;
+    char            line[256];
+    long            kib;
+
+    status = fopen ("/proc/self/status", "r");
+    if (status) {
+        while (fgets (line, sizeof line, status)) {
+            if (sscanf (line, "VmHWM: %ld kB", &kib) == 1) {
+                fclose (status);
+                return kib;
+            }
+        }
+        fclose (status);
+    }
+
+    if (getrusage (RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+/* output format, and number of results so far, for report () */
+static Format   report_format = FORMAT_TEXT;
+static int      n_reports = 0;
+
+static void
+report_begin (BenchEnv *env)
+{
+    report_format = env->format;
+    n_reports = 0;
+
+    switch (report_format) {
+    case FORMAT_CSV:
+        printf ("bench,op,value,unit\n");
+        break;
+    case FORMAT_JSON:
+        printf ("{\n");
+        printf ("  \"version\": \"%s\",\n", VERSION);
+        printf ("  \"keys\": %d,\n", env->n_keys);
+        printf ("  \"repeat\": %d,\n", env->repeat);
+        printf ("  \"seed\": %u,\n", env->seed);
+        printf ("  \"zipf\": %g,\n", env->zipf_s);
+        printf ("  \"results\": [");
+        break;
+    default:
+        break;
+    }
+}
+
+static void
+report (const char *bench, const char *op, double value, const char *unit)
+{
+    switch (report_format) {
+    case FORMAT_CSV:
+        printf ("%s,%s,%.3f,%s\n", bench, op, value, unit);
+        break;
+    case FORMAT_JSON:
+        printf ("%s\n    {\"bench\": \"%s\", \"op\": \"%s\", "
+                "\"value\": %.3f, \"unit\": \"%s\"}",
+                n_reports > 0 ? "," : "", bench, op, value, unit);
+        break;
+    default:
+        printf ("%-12s %-16s %12.3f %s\n", bench, op, value, unit);
+        break;
+    }
+    ++n_reports;
+    fflush (stdout);
+}
+
+static void
+report_end (BenchEnv *env)
+{
+    if (FORMAT_JSON == report_format)
+        printf ("\n  ]\n}\n");
+}
+
+/* report a result that a benchmark found to be wrong */
+static void
+check_failed (const char *fmt, ...)
+{
+    va_list args;
+
+    va_start (args, fmt);
+    vfprintf (stderr, fmt, args);
+    va_end (args);
+    ++n_failures;
+}
+
+static int
+double_cmp (const void *a, const void *b)
+{
+    double  x = *(const double *) a;
+    double  y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* report mean, median, tail percentiles and maximum of samples in ns */
+static void
+report_percentiles (const char *bench, const char *op,
+                    double samples[], int n_samples)
+{
+    static const struct {
+        const char *suffix;
+        double      rank;
+    } ranks[] = {
+        { "p50", 0.50 },
+        { "p90", 0.90 },
+        { "p99", 0.99 },
+        { "p99.9", 0.999 },
+        { "max", 1.0 },
+    };
+    char    name[64];
+    double  sum;
+    int     i;
+
+    if (0 == n_samples)
+        return;
+
+    sum = 0.0;
+    for (i = 0; i < n_samples; i++)
+        sum += samples[i];
+    sprintf (name, "%s-mean", op);
+    report (bench, name, sum / n_samples, "ns");
+
+    qsort (samples, n_samples, sizeof (double), double_cmp);
+    for (i = 0; i < N_ELEMENTS (ranks); i++) {
+        sprintf (name, "%s-%s", op, ranks[i].suffix);
+        report (bench, name,
+                samples[(int) (ranks[i].rank * (n_samples - 1))], "ns");
+    }
+}
+
+static void
+init_writer_lock (pthread_rwlock_t *lock)
+{
+    pthread_rwlockattr_t attr;
+
+    /* glibc favours readers by default, which starves the writer */
+    pthread_rwlockattr_init (&attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np (&attr,
+                                   PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init (lock, &attr);
+    pthread_rwlockattr_destroy (&attr);
+}
+
+static void
+report_alloc (BenchEnv *env, const char *op, double elapsed, long allocs)
+{
+    report ("alloc", op, elapsed * 1e9 / env->n_keys, "ns/key");
+    if (HAVE_ALLOC_COUNT)
+        report ("alloc", op, (double) allocs / env->n_keys, "allocs/key");
+}
+
+static void
+usage (const char *prog_name, int exit_status)
+{
+    int i;
+
+    printf ("%s - libdatrie benchmarks\n", prog_name);
+    printf ("Usage: %s [OPTION]... BENCH...\n", prog_name);
+    printf (
+        "Options:\n"
+        "  -n N        number of keys [default=%d]\n"
+        "  -w FILE     read keys from FILE, one UTF-8 word per line,\n"
+        "              instead of generating them\n"
+        "  -r N        repeat each measurement N times [default=%d]\n"
+        "  -s SEED     random seed for generated keys [default=1]\n"
+        "  -t PATH     temporary file for save/load [default=%s]\n"
+        "  -j N        number of reader threads [default=%d]\n"
+        "  -z S        draw the queries of the latency benchmark by Zipf's\n"
+        "              law of exponent S, rather than each key once\n"
+        "  -f FORMAT   output format, text, csv or json [default=text]\n"
+        "  -h, --help  display this help and exit\n"
+        "\n"
+        "Benchmarks:\n",
+        DEFAULT_N_KEYS, DEFAULT_REPEAT, DEFAULT_TMP, DEFAULT_THREADS
+    );
+    for (i = 0; i < N_ELEMENTS (benches); i++)
+        printf ("  %-11s %s\n", benches[i].name, benches[i].desc);
+    printf ("\nThe results of each benchmark are checked, and the exit status"
+            " is nonzero\nif any is wrong.\n");
+
+    exit (exit_status);
+}
+
+static double
+file_size_mib (const char *path)
+{
+    struct stat st;
+
+    return (stat (path, &st) == 0) ? st.st_size / 1048576.0 : 0.0;
+}
+
+static void
+bench_louds (BenchEnv *env)
+{
+    Trie       *trie, *mapped;
+    Louds      *louds;
+    TrieData    data, louds_data;
+    char       *louds_path;
+    size_t      da_size, tail_size;
+    double      t;
+    int         i, j, n_bad, len, louds_len;
+
+    /* the trie as it would be shipped */
+    trie = build_trie (env);
+    trie_compact (trie);
+    trie_share_suffixes (trie);
+    trie_get_mem_usage (trie, &da_size, &tail_size);
+    report ("louds", "trie-size", (da_size + tail_size) / 1048576.0, "MiB");
+
+    t = now_sec ();
+    louds = louds_new_from_trie (trie);
+    t = now_sec () - t;
+    if (!louds) {
+        fprintf (stderr, "louds: Cannot build succinct trie\n");
+        trie_free (trie);
+        return;
+    }
+    report ("louds", "build", t * 1e3, "ms");
+    report ("louds", "louds-size", louds_get_mem_size (louds) / 1048576.0,
+            "MiB");
+
+    /* both mapped, from separate files */
+    louds_path = (char *) malloc (strlen (env->tmp_path) + 7);
+    sprintf (louds_path, "%s.louds", env->tmp_path);
+    mapped = NULL;
+    if (louds_save (louds, louds_path) != 0
+        || trie_save_mapped (trie, env->tmp_path) != 0)
+    {
+        fprintf (stderr, "louds: Cannot save to %s\n", env->tmp_path);
+        goto exit_louds_created;
+    }
+    report ("louds", "trie-file", file_size_mib (env->tmp_path), "MiB");
+    report ("louds", "louds-file", file_size_mib (louds_path), "MiB");
+    louds_free (louds);
+    louds = louds_new_mapped (louds_path);
+    mapped = trie_new_mapped (env->tmp_path);
+    if (!louds || !mapped) {
+        fprintf (stderr, "louds: Cannot map %s\n", env->tmp_path);
+        goto exit_louds_created;
+    }
+
+    t = time_retrieve (env, mapped);
+    report ("louds", "trie-retrieve",
+            t * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+
+    n_bad = 0;
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++) {
+            if (!louds_retrieve (louds, env->keys[i], &louds_data))
+                ++n_bad;
+        }
+    }
+    t = now_sec () - t;
+    report ("louds", "louds-retrieve",
+            t * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+
+    /* longest match at the start of each key */
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++)
+            trie_longest_prefix (mapped, env->keys[i], SCAN_TOKEN_MAX,
+                                 &len, &data);
+    }
+    t = now_sec () - t;
+    report ("louds", "trie-longest-prefix",
+            t * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+
+    t = now_sec ();
+    for (j = 0; j < env->repeat; j++) {
+        for (i = 0; i < env->n_keys; i++)
+            louds_longest_prefix (louds, env->keys[i], SCAN_TOKEN_MAX,
+                                  &louds_len, &louds_data);
+    }
+    t = now_sec () - t;
+    report ("louds", "louds-longest-prefix",
+            t * 1e9 / ((double) env->repeat * env->n_keys), "ns/key");
+
+    for (i = 0; i < env->n_keys; i++) {
+        if (!louds_retrieve (louds, env->keys[i], &louds_data)
+            || !trie_retrieve (mapped, env->keys[i], &data)
+            || data != louds_data)
+        {
+            ++n_bad;
+        }
+    }
+    if (n_bad > 0)
+        check_failed ("louds: %d lookups mismatched\n", n_bad);
+
+exit_louds_created:
+    if (louds)
+        louds_free (louds);
+    if (mapped)
+        trie_free (mapped);
+    remove (louds_path);
+    remove (env->tmp_path);
+    free (louds_path);
+    trie_free (trie);
+}
+
+/*
+vi:ts=4:ai:expandtab
+*/
@@ -18,26 +18,50 @@
 # define locale_charset()  nl_langinfo(CODESET)
 #endif
 #include <iconv.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <assert.h>
 
 #include <config.h>
 #include <datrie/trie.h>
+#include <datrie/dawg.h>
+#include <datrie/louds.h>
 
 /* iconv encoding name for AlphaChar string */
 #define ALPHA_ENC   "UCS-4LE"
 
 #define N_ELEMENTS(a)   (sizeof(a)/sizeof((a)[0]))
 
+/* partitions of a sorted key list, built into tries by worker threads */
+typedef struct {
+    const AlphaChar *const *keys;
+    const TrieData         *data;
+    const int              *part_los;   /* first key of each part, and end */
+    Trie                  **parts;
+    int                     n_parts;
+    int                     next_part;
+    Bool                    is_failed;
+    pthread_mutex_t         lock;
+} BuildJob;
+
 typedef struct {
     const char *path;
     const char *trie_name;
     iconv_t     to_alpha_conv;
     iconv_t     from_alpha_conv;
+    Bool        is_utf8;        /* input keys are UTF-8, needing no iconv */
     Trie       *trie;
 } ProgEnv;
 
 static void init_conv           (ProgEnv *env);
+static Bool is_utf8_codeset     (const char *codeset);
+static Bool store_key           (ProgEnv           *env,
+                                 const char        *key,
+                                 TrieData           data);
+static Bool retrieve_key        (ProgEnv           *env,
+                                 const char        *key,
+                                 TrieData          *o_data);
 static size_t conv_to_alpha     (ProgEnv           *env,
                                  const char        *in,
                                  AlphaChar         *out,
@@ -56,14 +80,27 @@ static int  decode_command      (int argc, char *argv[], ProgEnv *env);
 
 static int  command_add         (int argc, char *argv[], ProgEnv *env);
 static int  command_add_list    (int argc, char *argv[], ProgEnv *env);
+static int  command_build_sorted (int argc, char *argv[], ProgEnv *env);
+static int  command_build_parallel (int argc, char *argv[], ProgEnv *env);
 static int  command_delete      (int argc, char *argv[], ProgEnv *env);
 static int  command_delete_list (int argc, char *argv[], ProgEnv *env);
 static int  command_query       (int argc, char *argv[], ProgEnv *env);
 static int  command_list        (int argc, char *argv[], ProgEnv *env);
+static int  command_save_mapped (int argc, char *argv[], ProgEnv *env);
+static int  command_compact     (int argc, char *argv[], ProgEnv *env);
+static int  command_relayout    (int argc, char *argv[], ProgEnv *env);
+static int  command_save_dawg   (int argc, char *argv[], ProgEnv *env);
+static int  command_save_louds  (int argc, char *argv[], ProgEnv *env);
 
 static void usage               (const char *prog_name, int exit_status);
 
 static char *string_trim        (char *s);
+static int  read_key_list       (ProgEnv       *env,
+                                 FILE          *input,
+                                 TrieData       default_data,
+                                 AlphaChar   ***o_keys,
+                                 TrieData     **o_data);
+static void free_key_list       (AlphaChar **keys, TrieData *data, int n_keys);
 
 int
 main (int argc, char *argv[])
@@ -107,6 +144,40 @@ init_conv (ProgEnv *env)
 
     env->to_alpha_conv = iconv_open (ALPHA_ENC, locale_codeset);
     env->from_alpha_conv = iconv_open (locale_codeset, ALPHA_ENC);
+    env->is_utf8 = is_utf8_codeset (locale_codeset);
+}
+
+static Bool
+is_utf8_codeset (const char *codeset)
+{
+    return strcasecmp (codeset, "UTF-8") == 0
+           || strcasecmp (codeset, "UTF8") == 0;
+}
+
+/* store key given in the input encoding, with no iconv if it is UTF-8 */
+static Bool
+store_key (ProgEnv *env, const char *key, TrieData data)
+{
+    AlphaChar   key_alpha[256];
+
+    if (env->is_utf8)
+        return trie_store_utf8 (env->trie, key, -1, data);
+
+    conv_to_alpha (env, key, key_alpha, N_ELEMENTS (key_alpha));
+    return trie_store (env->trie, key_alpha, data);
+}
+
+/* retrieve key given in the input encoding, with no iconv if it is UTF-8 */
+static Bool
+retrieve_key (ProgEnv *env, const char *key, TrieData *o_data)
+{
+    AlphaChar   key_alpha[256];
+
+    if (env->is_utf8)
+        return trie_retrieve_utf8 (env->trie, key, -1, o_data);
+
+    conv_to_alpha (env, key, key_alpha, N_ELEMENTS (key_alpha));
+    return trie_retrieve (env->trie, key_alpha, o_data);
 }
 
 static size_t
@@ -284,13 +355,22 @@ decode_command (int argc, char *argv[], ProgEnv *env)
 {
     int opt_idx;
 
-    for (opt_idx = 0; opt_idx < argc; opt_idx++) {
+    opt_idx = 0;
+    while (opt_idx < argc) {
         if (strcmp (argv[opt_idx], "add") == 0) {
             ++opt_idx;
             opt_idx += command_add (argc - opt_idx, argv + opt_idx, env);
         } else if (strcmp (argv[opt_idx], "add-list") == 0) {
             ++opt_idx;
             opt_idx += command_add_list (argc - opt_idx, argv + opt_idx, env);
+        } else if (strcmp (argv[opt_idx], "build-sorted") == 0) {
+            ++opt_idx;
+            opt_idx += command_build_sorted (argc - opt_idx, argv + opt_idx,
+                                             env);
+        } else if (strcmp (argv[opt_idx], "build-parallel") == 0) {
+            ++opt_idx;
+            opt_idx += command_build_parallel (argc - opt_idx, argv + opt_idx,
+                                               env);
         } else if (strcmp (argv[opt_idx], "delete") == 0) {
             ++opt_idx;
             opt_idx += command_delete (argc - opt_idx, argv + opt_idx, env);
@@ -303,6 +383,23 @@ decode_command (int argc, char *argv[], ProgEnv *env)
         } else if (strcmp (argv[opt_idx], "list") == 0) {
             ++opt_idx;
             opt_idx += command_list (argc - opt_idx, argv + opt_idx, env);
+        } else if (strcmp (argv[opt_idx], "save-mapped") == 0) {
+            ++opt_idx;
+            opt_idx += command_save_mapped (argc - opt_idx, argv + opt_idx,
+                                            env);
+        } else if (strcmp (argv[opt_idx], "compact") == 0) {
+            ++opt_idx;
+            opt_idx += command_compact (argc - opt_idx, argv + opt_idx, env);
+        } else if (strcmp (argv[opt_idx], "relayout") == 0) {
+            ++opt_idx;
+            opt_idx += command_relayout (argc - opt_idx, argv + opt_idx, env);
+        } else if (strcmp (argv[opt_idx], "save-dawg") == 0) {
+            ++opt_idx;
+            opt_idx += command_save_dawg (argc - opt_idx, argv + opt_idx, env);
+        } else if (strcmp (argv[opt_idx], "save-louds") == 0) {
+            ++opt_idx;
+            opt_idx += command_save_louds (argc - opt_idx, argv + opt_idx,
+                                           env);
         } else {
             fprintf (stderr, "Unknown command: %s\n", argv[opt_idx]);
             return EXIT_FAILURE;
@@ -320,14 +417,12 @@ command_add (int argc, char *argv[], ProgEnv *env)
     opt_idx = 0;
     while (opt_idx < argc) {
         const char     *key;
-        AlphaChar       key_alpha[256];
         TrieData        data;
 
         key = argv[opt_idx++];
         data = (opt_idx < argc) ? atoi (argv[opt_idx++]) : TRIE_DATA_ERROR;
 
-        conv_to_alpha (env, key, key_alpha, N_ELEMENTS (key_alpha));
-        if (!trie_store (env->trie, key_alpha, data)) {
+        if (!store_key (env, key, data)) {
             fprintf (stderr, "Failed to add entry '%s' with data %d\n",
                      key, data);
         }
@@ -342,12 +437,14 @@ command_add_list (int argc, char *argv[], ProgEnv *env)
     const char *enc_name, *input_name;
     int         opt_idx;
     iconv_t     saved_conv;
+    Bool        saved_is_utf8;
     FILE       *input;
     char        line[256];
 
     enc_name = 0;
     opt_idx = 0;
     saved_conv = env->to_alpha_conv;
+    saved_is_utf8 = env->is_utf8;
     if (strcmp (argv[0], "-e") == 0 ||
         strcmp (argv[0], "--encoding") == 0)
     {
@@ -374,6 +471,7 @@ command_add_list (int argc, char *argv[], ProgEnv *env)
         }
 
         env->to_alpha_conv = conv;
+        env->is_utf8 = is_utf8_codeset (enc_name);
     }
 
     input = fopen (input_name, "r");
@@ -385,7 +483,6 @@ command_add_list (int argc, char *argv[], ProgEnv *env)
 
     while (fgets (line, sizeof line, input)) {
         char       *key, *data;
-        AlphaChar   key_alpha[256];
         TrieData    data_val;
 
         key = string_trim (line);
@@ -403,8 +500,7 @@ command_add_list (int argc, char *argv[], ProgEnv *env)
             data_val = ('\0' != *data) ? atoi (data) : TRIE_DATA_ERROR;
 
             /* store the key */
-            conv_to_alpha (env, key, key_alpha, N_ELEMENTS (key_alpha));
-            if (!trie_store (env->trie, key_alpha, data_val))
+            if (!store_key (env, key, data_val))
                 fprintf (stderr, "Failed to add key '%s' with data %d.\n",
                          key, data_val);
         }
@@ -412,6 +508,292 @@ command_add_list (int argc, char *argv[], ProgEnv *env)
 
     fclose (input);
 
+exit_iconv_openned:
+    if (enc_name) {
+        iconv_close (env->to_alpha_conv);
+        env->to_alpha_conv = saved_conv;
+        env->is_utf8 = saved_is_utf8;
+    }
+
+    return opt_idx;
+}
+
+static int
+command_build_sorted (int argc, char *argv[], ProgEnv *env)
+{
+    const char *enc_name, *input_name;
+    int         opt_idx;
+    iconv_t     saved_conv;
+    FILE       *input;
+    AlphaChar **keys;
+    TrieData   *data;
+    int         n_keys;
+
+    enc_name = 0;
+    opt_idx = 0;
+    saved_conv = env->to_alpha_conv;
+    if (argc > 0 && (strcmp (argv[0], "-e") == 0 ||
+                     strcmp (argv[0], "--encoding") == 0))
+    {
+        if (++opt_idx >= argc) {
+            fprintf (stderr,
+                     "build-sorted option \"%s\" requires encoding name",
+                     argv[0]);
+            return opt_idx;
+        }
+        enc_name = argv[opt_idx++];
+    }
+    if (opt_idx >= argc) {
+        fprintf (stderr, "build-sorted requires input word list file name\n");
+        return opt_idx;
+    }
+    input_name = argv[opt_idx++];
+
+    if (enc_name) {
+        iconv_t conv = iconv_open (ALPHA_ENC, enc_name);
+        if ((iconv_t) -1 == conv) {
+            fprintf (stderr,
+                    "Conversion from \"%s\" to \"%s\" is not supported.\n",
+                    enc_name, ALPHA_ENC);
+            return opt_idx;
+        }
+
+        env->to_alpha_conv = conv;
+    }
+
+    input = fopen (input_name, "r");
+    if (!input) {
+        fprintf (stderr, "build-sorted: Cannot open input file \"%s\"\n",
+                 input_name);
+        goto exit_iconv_openned;
+    }
+
+    n_keys = read_key_list (env, input, TRIE_DATA_ERROR, &keys, &data);
+    fclose (input);
+    if (n_keys < 0) {
+        fprintf (stderr, "build-sorted: Cannot read \"%s\"\n", input_name);
+        goto exit_iconv_openned;
+    }
+
+    if (!trie_build_from_sorted (env->trie, (const AlphaChar **) keys,
+                                 data, n_keys))
+    {
+        fprintf (stderr,
+                 "build-sorted: Failed to build trie from \"%s\"; "
+                 "are the words sorted?\n", input_name);
+    }
+
+    free_key_list (keys, data, n_keys);
+
+exit_iconv_openned:
+    if (enc_name) {
+        iconv_close (env->to_alpha_conv);
+        env->to_alpha_conv = saved_conv;
+    }
+
+    return opt_idx;
+}
+
+static void *
+build_part_thread (void *arg)
+{
+    BuildJob   *job = (BuildJob *) arg;
+    int         i, lo, hi;
+
+    for (;;) {
+        pthread_mutex_lock (&job->lock);
+        i = job->next_part++;
+        pthread_mutex_unlock (&job->lock);
+        if (i >= job->n_parts)
+            break;
+
+        lo = job->part_los[i];
+        hi = job->part_los[i + 1];
+        if (!trie_build_from_sorted (job->parts[i], job->keys + lo,
+                                     job->data + lo, hi - lo))
+        {
+            pthread_mutex_lock (&job->lock);
+            job->is_failed = TRUE;
+            pthread_mutex_unlock (&job->lock);
+        }
+    }
+
+    return NULL;
+}
+
+static int
+command_build_parallel (int argc, char *argv[], ProgEnv *env)
+{
+    const char *enc_name, *input_name;
+    int         opt_idx;
+    iconv_t     saved_conv;
+    FILE       *input;
+    AlphaChar **keys;
+    TrieData   *data;
+    int         n_keys, n_threads, i;
+    int        *part_los;
+    BuildJob    job;
+    pthread_t  *threads;
+    const AlphaMap *alpha_map;
+
+    enc_name = 0;
+    n_threads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+    opt_idx = 0;
+    saved_conv = env->to_alpha_conv;
+    while (opt_idx < argc && '-' == *argv[opt_idx]) {
+        if (strcmp (argv[opt_idx], "-j") == 0 ||
+            strcmp (argv[opt_idx], "--jobs") == 0)
+        {
+            if (++opt_idx >= argc) {
+                fprintf (stderr,
+                         "build-parallel option \"%s\" requires number of "
+                         "threads\n", argv[opt_idx - 1]);
+                return opt_idx;
+            }
+            n_threads = atoi (argv[opt_idx]);
+        } else if (strcmp (argv[opt_idx], "-e") == 0 ||
+                   strcmp (argv[opt_idx], "--encoding") == 0)
+        {
+            if (++opt_idx >= argc) {
+                fprintf (stderr,
+                         "build-parallel option \"%s\" requires encoding "
+                         "name\n", argv[opt_idx - 1]);
+                return opt_idx;
+            }
+            enc_name = argv[opt_idx];
+        } else {
+            fprintf (stderr, "build-parallel: Unknown option \"%s\"\n",
+                     argv[opt_idx]);
+            return opt_idx + 1;
+        }
+        ++opt_idx;
+    }
+    if (n_threads < 1)
+        n_threads = 1;
+    if (opt_idx >= argc) {
+        fprintf (stderr, "build-parallel requires input word list file name\n");
+        return opt_idx;
+    }
+    input_name = argv[opt_idx++];
+
+    if (enc_name) {
+        iconv_t conv = iconv_open (ALPHA_ENC, enc_name);
+        if ((iconv_t) -1 == conv) {
+            fprintf (stderr,
+                    "Conversion from \"%s\" to \"%s\" is not supported.\n",
+                    enc_name, ALPHA_ENC);
+            return opt_idx;
+        }
+
+        env->to_alpha_conv = conv;
+    }
+
+    input = fopen (input_name, "r");
+    if (!input) {
+        fprintf (stderr, "build-parallel: Cannot open input file \"%s\"\n",
+                 input_name);
+        goto exit_iconv_openned;
+    }
+
+    n_keys = read_key_list (env, input, TRIE_DATA_ERROR, &keys, &data);
+    fclose (input);
+    if (n_keys < 0) {
+        fprintf (stderr, "build-parallel: Cannot read \"%s\"\n", input_name);
+        goto exit_iconv_openned;
+    }
+
+    /* no keys leave no parts to build, just an empty trie */
+    if (0 == n_keys) {
+        if (!trie_build_from_sorted (env->trie, (const AlphaChar **) keys,
+                                     data, 0))
+        {
+            fprintf (stderr,
+                     "build-parallel: Failed to build trie from \"%s\"\n",
+                     input_name);
+        }
+        goto exit_keys_read;
+    }
+
+    /* partition the sorted keys by their first character */
+    part_los = (int *) malloc ((n_keys + 1) * sizeof (int));
+    if (!part_los) {
+        fprintf (stderr, "build-parallel: Cannot allocate memory\n");
+        goto exit_keys_read;
+    }
+    job.n_parts = 0;
+    for (i = 0; i < n_keys; i++) {
+        if (i > 0 && keys[i][0] < keys[i - 1][0]) {
+            fprintf (stderr,
+                     "build-parallel: Failed to build trie from \"%s\"; "
+                     "are the words sorted?\n", input_name);
+            goto exit_part_los_created;
+        }
+        if (0 == i || keys[i][0] != keys[i - 1][0])
+            part_los[job.n_parts++] = i;
+    }
+    part_los[job.n_parts] = n_keys;
+
+    job.keys = (const AlphaChar *const *) keys;
+    job.data = data;
+    job.part_los = part_los;
+    job.next_part = 0;
+    job.is_failed = FALSE;
+    job.parts = (Trie **) calloc (job.n_parts, sizeof (Trie *));
+    if (!job.parts) {
+        fprintf (stderr, "build-parallel: Cannot allocate memory\n");
+        goto exit_part_los_created;
+    }
+    alpha_map = trie_get_alpha_map (env->trie);
+    for (i = 0; i < job.n_parts; i++) {
+        job.parts[i] = trie_new (alpha_map);
+        if (!job.parts[i]) {
+            fprintf (stderr, "build-parallel: Cannot allocate memory\n");
+            goto exit_parts_created;
+        }
+    }
+
+    if (n_threads > job.n_parts)
+        n_threads = job.n_parts;
+    threads = (pthread_t *) malloc (n_threads * sizeof (pthread_t));
+    if (!threads) {
+        fprintf (stderr, "build-parallel: Cannot allocate memory\n");
+        goto exit_parts_created;
+    }
+    pthread_mutex_init (&job.lock, NULL);
+    for (i = 0; i < n_threads; i++) {
+        if (pthread_create (&threads[i], NULL, build_part_thread, &job) != 0)
+            break;
+    }
+    /* threads not started leave their parts to those started */
+    if (0 == i)
+        build_part_thread (&job);
+    while (i > 0)
+        pthread_join (threads[--i], NULL);
+    pthread_mutex_destroy (&job.lock);
+    free (threads);
+
+    if (job.is_failed) {
+        fprintf (stderr,
+                 "build-parallel: Failed to build trie from \"%s\"; "
+                 "are the words sorted?\n", input_name);
+    } else if (!trie_build_from_parts (env->trie, (const Trie *const *) job.parts,
+                                       job.n_parts))
+    {
+        fprintf (stderr,
+                 "build-parallel: Failed to merge trie from \"%s\"; "
+                 "are the words sorted?\n", input_name);
+    }
+
+exit_parts_created:
+    for (i = 0; i < job.n_parts; i++) {
+        if (job.parts[i])
+            trie_free (job.parts[i]);
+    }
+    free (job.parts);
+exit_part_los_created:
+    free (part_los);
+exit_keys_read:
+    free_key_list (keys, data, n_keys);
 exit_iconv_openned:
     if (enc_name) {
         iconv_close (env->to_alpha_conv);
@@ -513,7 +895,6 @@ exit_iconv_openned:
 static int
 command_query (int argc, char *argv[], ProgEnv *env)
 {
-    AlphaChar   key_alpha[256];
     TrieData    data;
 
     if (argc == 0) {
@@ -521,8 +902,7 @@ command_query (int argc, char *argv[], ProgEnv *env)
         return 0;
     }
 
-    conv_to_alpha (env, argv[0], key_alpha, N_ELEMENTS (key_alpha));
-    if (trie_retrieve (env->trie, key_alpha, &data)) {
+    if (retrieve_key (env, argv[0], &data)) {
         printf ("%d\n", data);
     } else {
         fprintf (stderr, "query: Key '%s' not found.\n", argv[0]);
@@ -549,6 +929,224 @@ command_list (int argc, char *argv[], ProgEnv *env)
     return 0;
 }
 
+static int
+command_save_mapped (int argc, char *argv[], ProgEnv *env)
+{
+    if (argc == 0) {
+        fprintf (stderr, "save-mapped: No output file specified.\n");
+        return 0;
+    }
+
+    if (trie_save_mapped (env->trie, argv[0]) != 0) {
+        fprintf (stderr, "save-mapped: Cannot save trie to %s\n", argv[0]);
+    }
+
+    return 1;
+}
+
+static int
+command_compact (int argc, char *argv[], ProgEnv *env)
+{
+    size_t      da_before, tail_before, da_after, tail_after;
+    TrieIndex   cells_before, free_before, cells_after, free_after;
+
+    trie_get_mem_usage (env->trie, &da_before, &tail_before);
+    trie_get_cell_usage (env->trie, &cells_before, &free_before);
+    if (!trie_compact (env->trie) || !trie_share_suffixes (env->trie)) {
+        fprintf (stderr, "compact: Cannot compact trie\n");
+        return 0;
+    }
+    trie_get_mem_usage (env->trie, &da_after, &tail_after);
+    trie_get_cell_usage (env->trie, &cells_after, &free_after);
+
+    printf ("cells: %ld -> %ld (load factor %.1f%% -> %.1f%%)\n",
+            (long) cells_before, (long) cells_after,
+            100.0 * (cells_before - free_before) / cells_before,
+            100.0 * (cells_after - free_after) / cells_after);
+    printf ("double-array: %lu -> %lu bytes\n",
+            (unsigned long) da_before, (unsigned long) da_after);
+    printf ("tail: %lu -> %lu bytes\n",
+            (unsigned long) tail_before, (unsigned long) tail_after);
+
+    return 0;
+}
+
+static int
+command_relayout (int argc, char *argv[], ProgEnv *env)
+{
+    const char *enc_name, *log_name;
+    TrieLayout  layout;
+    int         opt_idx;
+    iconv_t     saved_conv;
+    FILE       *input;
+    AlphaChar **keys;
+    TrieData   *counts;
+    int         n_keys;
+    size_t      da_before, tail_size, da_after;
+
+    enc_name = log_name = 0;
+    layout = TRIE_LAYOUT_DFS;
+    opt_idx = 0;
+    saved_conv = env->to_alpha_conv;
+    while (opt_idx < argc && '-' == *argv[opt_idx]) {
+        if (strcmp (argv[opt_idx], "-o") == 0 ||
+            strcmp (argv[opt_idx], "--order") == 0)
+        {
+            if (++opt_idx >= argc) {
+                fprintf (stderr, "relayout option \"%s\" requires order\n",
+                         argv[opt_idx - 1]);
+                return opt_idx;
+            }
+            if (strcmp (argv[opt_idx], "bfs") == 0) {
+                layout = TRIE_LAYOUT_BFS;
+            } else if (strcmp (argv[opt_idx], "dfs") == 0) {
+                layout = TRIE_LAYOUT_DFS;
+            } else {
+                fprintf (stderr, "relayout: Unknown order \"%s\"\n",
+                         argv[opt_idx]);
+                return opt_idx + 1;
+            }
+        } else if (strcmp (argv[opt_idx], "-l") == 0 ||
+                   strcmp (argv[opt_idx], "--log") == 0)
+        {
+            if (++opt_idx >= argc) {
+                fprintf (stderr,
+                         "relayout option \"%s\" requires query log name\n",
+                         argv[opt_idx - 1]);
+                return opt_idx;
+            }
+            log_name = argv[opt_idx];
+        } else if (strcmp (argv[opt_idx], "-e") == 0 ||
+                   strcmp (argv[opt_idx], "--encoding") == 0)
+        {
+            if (++opt_idx >= argc) {
+                fprintf (stderr,
+                         "relayout option \"%s\" requires encoding name\n",
+                         argv[opt_idx - 1]);
+                return opt_idx;
+            }
+            enc_name = argv[opt_idx];
+        } else {
+            fprintf (stderr, "relayout: Unknown option \"%s\"\n",
+                     argv[opt_idx]);
+            return opt_idx + 1;
+        }
+        ++opt_idx;
+    }
+
+    if (enc_name) {
+        iconv_t conv = iconv_open (ALPHA_ENC, enc_name);
+        if ((iconv_t) -1 == conv) {
+            fprintf (stderr,
+                    "Conversion from \"%s\" to \"%s\" is not supported.\n",
+                    enc_name, ALPHA_ENC);
+            return opt_idx;
+        }
+
+        env->to_alpha_conv = conv;
+    }
+
+    /* read the query log: one key per line, optionally with its count */
+    keys = NULL;
+    counts = NULL;
+    n_keys = 0;
+    if (log_name) {
+        input = fopen (log_name, "r");
+        if (!input) {
+            fprintf (stderr, "relayout: Cannot open query log \"%s\"\n",
+                     log_name);
+            goto exit_iconv_openned;
+        }
+        n_keys = read_key_list (env, input, 1, &keys, &counts);
+        fclose (input);
+        if (n_keys < 0) {
+            fprintf (stderr, "relayout: Cannot read query log \"%s\"\n",
+                     log_name);
+            goto exit_iconv_openned;
+        }
+    }
+
+    trie_get_mem_usage (env->trie, &da_before, &tail_size);
+    if (!trie_relayout (env->trie, layout, (const AlphaChar *const *) keys,
+                        counts, n_keys))
+    {
+        fprintf (stderr, "relayout: Cannot relayout trie\n");
+    } else {
+        trie_get_mem_usage (env->trie, &da_after, &tail_size);
+        printf ("double-array: %lu -> %lu bytes\n",
+                (unsigned long) da_before, (unsigned long) da_after);
+    }
+
+    free_key_list (keys, counts, n_keys);
+
+exit_iconv_openned:
+    if (enc_name) {
+        iconv_close (env->to_alpha_conv);
+        env->to_alpha_conv = saved_conv;
+    }
+
+    return opt_idx;
+}
+
+static int
+command_save_dawg (int argc, char *argv[], ProgEnv *env)
+{
+    Dawg   *dawg;
+    size_t  da_size, tail_size;
+
+    if (argc == 0) {
+        fprintf (stderr, "save-dawg: No output file specified.\n");
+        return 0;
+    }
+
+    dawg = dawg_new_from_trie (env->trie);
+    if (!dawg) {
+        fprintf (stderr, "save-dawg: Cannot build automaton\n");
+        return 1;
+    }
+    if (dawg_save (dawg, argv[0]) != 0) {
+        fprintf (stderr, "save-dawg: Cannot save automaton to %s\n", argv[0]);
+    } else {
+        trie_get_mem_usage (env->trie, &da_size, &tail_size);
+        printf ("trie: %lu bytes\n", (unsigned long) (da_size + tail_size));
+        printf ("automaton: %lu bytes\n",
+                (unsigned long) dawg_get_mem_size (dawg));
+    }
+    dawg_free (dawg);
+
+    return 1;
+}
+
+static int
+command_save_louds (int argc, char *argv[], ProgEnv *env)
+{
+    Louds  *louds;
+    size_t  da_size, tail_size;
+
+    if (argc == 0) {
+        fprintf (stderr, "save-louds: No output file specified.\n");
+        return 0;
+    }
+
+    louds = louds_new_from_trie (env->trie);
+    if (!louds) {
+        fprintf (stderr, "save-louds: Cannot build succinct trie\n");
+        return 1;
+    }
+    if (louds_save (louds, argv[0]) != 0) {
+        fprintf (stderr, "save-louds: Cannot save succinct trie to %s\n",
+                 argv[0]);
+    } else {
+        trie_get_mem_usage (env->trie, &da_size, &tail_size);
+        printf ("trie: %lu bytes\n", (unsigned long) (da_size + tail_size));
+        printf ("succinct trie: %lu bytes\n",
+                (unsigned long) louds_get_mem_size (louds));
+    }
+    louds_free (louds);
+
+    return 1;
+}
+
 
 static void
 usage (const char *prog_name, int exit_status)
@@ -568,6 +1166,17 @@ usage (const char *prog_name, int exit_status)
         "      Add words and data listed in LISTFILE to trie\n"
         "      Options:\n"
         "          -e, --encoding ENC    specify character encoding of LISTFILE\n"
+        "  build-sorted [OPTION] LISTFILE\n"
+        "      Replace trie contents with words and data listed in LISTFILE,\n"
+        "      which must be sorted\n"
+        "      Options:\n"
+        "          -e, --encoding ENC    specify character encoding of LISTFILE\n"
+        "  build-parallel [OPTION]... LISTFILE\n"
+        "      Like build-sorted, building the parts of trie for words of each\n"
+        "      first character in parallel\n"
+        "      Options:\n"
+        "          -j, --jobs N          use N threads [default=number of CPUs]\n"
+        "          -e, --encoding ENC    specify character encoding of LISTFILE\n"
         "  delete WORD ...\n"
         "      Delete WORD from trie\n"
         "  delete-list [OPTION] LISTFILE\n"
@@ -578,6 +1187,27 @@ usage (const char *prog_name, int exit_status)
         "      Query WORD data from trie\n"
         "  list\n"
         "      List all words in trie\n"
+        "  save-mapped FILE\n"
+        "      Save trie to FILE in read-only memory-mappable format\n"
+        "  compact\n"
+        "      Drop the space left by deleted words, share common word endings\n"
+        "      in memory, and report cell and memory usage; the sharing is\n"
+        "      kept by a following save-mapped\n"
+        "  relayout [OPTION]...\n"
+        "      Renumber trie states so that a lookup touches fewer cache lines\n"
+        "      and pages, and report memory usage\n"
+        "      Options:\n"
+        "          -o, --order ORDER     state order, bfs or dfs [default=dfs]\n"
+        "          -l, --log LOGFILE     keep the states walked by the queries\n"
+        "                                listed in LOGFILE, with optional\n"
+        "                                counts, together\n"
+        "          -e, --encoding ENC    specify character encoding of LOGFILE\n"
+        "  save-dawg FILE\n"
+        "      Save the minimal automaton of trie words to FILE, read-only,\n"
+        "      and report memory usage\n"
+        "  save-louds FILE\n"
+        "      Save the trie words to FILE as a succinct trie, read-only, and\n"
+        "      report memory usage\n"
     );
 
     exit (exit_status);
@@ -601,6 +1231,89 @@ string_trim (char *s)
     return s;
 }
 
+/* read keys, one per line, each optionally followed by a tab or a comma
+ * and its data, into arrays to be freed with free_key_list();
+ * returns the number of keys, or -1 on failure
+ */
+static int
+read_key_list (ProgEnv     *env,
+               FILE        *input,
+               TrieData     default_data,
+               AlphaChar ***o_keys,
+               TrieData   **o_data)
+{
+    char        line[256];
+    AlphaChar **keys, **new_keys;
+    TrieData   *data, *new_data;
+    int         n_keys, keys_size;
+
+    keys = NULL;
+    data = NULL;
+    n_keys = keys_size = 0;
+    while (fgets (line, sizeof line, input)) {
+        char       *key, *data_str;
+        AlphaChar   key_alpha[256];
+        size_t      key_len;
+
+        key = string_trim (line);
+        if ('\0' == *key)
+            continue;
+
+        /* find key boundary */
+        for (data_str = key; *data_str && !strchr ("\t,", *data_str);
+             ++data_str)
+            ;
+        /* mark key ending and find data begin */
+        if ('\0' != *data_str) {
+            *data_str++ = '\0';
+            while (isspace (*data_str))
+                ++data_str;
+        }
+
+        if (n_keys == keys_size) {
+            keys_size = keys_size ? keys_size * 2 : 1024;
+            new_keys = (AlphaChar **) realloc (keys, keys_size
+                                                     * sizeof (AlphaChar *));
+            if (!new_keys)
+                goto exit_keys_read;
+            keys = new_keys;
+            new_data = (TrieData *) realloc (data,
+                                             keys_size * sizeof (TrieData));
+            if (!new_data)
+                goto exit_keys_read;
+            data = new_data;
+        }
+
+        key_len = conv_to_alpha (env, key, key_alpha, N_ELEMENTS (key_alpha));
+        keys[n_keys] = (AlphaChar *) malloc ((key_len + 1)
+                                             * sizeof (AlphaChar));
+        if (!keys[n_keys])
+            goto exit_keys_read;
+        memcpy (keys[n_keys], key_alpha, (key_len + 1) * sizeof (AlphaChar));
+        data[n_keys] = ('\0' != *data_str) ? atoi (data_str) : default_data;
+        ++n_keys;
+    }
+
+    *o_keys = keys;
+    *o_data = data;
+    return n_keys;
+
+exit_keys_read:
+    free_key_list (keys, data, n_keys);
+    return -1;
+}
+
+static void
+free_key_list (AlphaChar **keys, TrieData *data, int n_keys)
+{
+    int i;
+
+    for (i = 0; i < n_keys; i++)
+        free (keys[i]);
+    free (keys);
+    free (data);
+}
+
 /*
 vi:ts=4:ai:expandtab
 */